@@ -0,0 +1,228 @@
+/*****************************************************************************
+ *
+ * @file 	bee_alarm.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	alarm rules engine: level limits with hysteresis, N-of-M debounce,
+ *          rate-of-change and dew point rules, state kept in RTC memory
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <math.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "bee_alarm.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define RULE_HUMI_LOW       0       /* Level rules, their limits follow alarm_set_thresholds() */
+#define RULE_HUMI_HIGH      1
+#define RULE_TEMP_LOW       2
+#define RULE_TEMP_HIGH      3
+
+#define MAGNUS_B            17.62f
+#define MAGNUS_C            243.12f /* Degrees Celsius */
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+typedef struct
+{
+    uint8_t u8history;              /* Last readings, newest in bit 0, 1 where it pushed towards a change */
+    bool    bActive;
+} rule_state_t;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static RTC_DATA_ATTR alarm_thresholds_t thresholds =
+{
+    .fTemp_high = ALARM_TEMP_HIGH,
+    .fTemp_low = ALARM_TEMP_LOW,
+    .fHumi_high = ALARM_HUMI_HIGH,
+    .fHumi_low = ALARM_HUMI_LOW,
+    .fTemp_hyst = ALARM_TEMP_HYST,
+    .fHumi_hyst = ALARM_HUMI_HYST,
+};
+
+/* Bit i of the warning value is rules[i], level rules first so the low nibble keeps its old meaning */
+static RTC_DATA_ATTR alarm_rule_t rules[ALARM_RULES_MAX] =
+{
+    [RULE_HUMI_LOW]  = {ALARM_METRIC_HUMI, ALARM_BELOW, 2, 3, ALARM_HUMI_LOW, ALARM_HUMI_LOW + ALARM_HUMI_HYST},
+    [RULE_HUMI_HIGH] = {ALARM_METRIC_HUMI, ALARM_ABOVE, 2, 3, ALARM_HUMI_HIGH, ALARM_HUMI_HIGH - ALARM_HUMI_HYST},
+    [RULE_TEMP_LOW]  = {ALARM_METRIC_TEMP, ALARM_BELOW, 2, 3, ALARM_TEMP_LOW, ALARM_TEMP_LOW + ALARM_TEMP_HYST},
+    [RULE_TEMP_HIGH] = {ALARM_METRIC_TEMP, ALARM_ABOVE, 2, 3, ALARM_TEMP_HIGH, ALARM_TEMP_HIGH - ALARM_TEMP_HYST},
+    {ALARM_METRIC_TEMP_RATE, ALARM_OUTSIDE, 1, 1, ALARM_TEMP_RATE, ALARM_TEMP_RATE / 2},
+    {ALARM_METRIC_HUMI_RATE, ALARM_OUTSIDE, 1, 1, ALARM_HUMI_RATE, ALARM_HUMI_RATE / 2},
+#if ALARM_DEW_POINT
+    {ALARM_METRIC_DEW_SPREAD, ALARM_BELOW, 2, 3, ALARM_DEW_SPREAD, ALARM_DEW_SPREAD + 1.0f},
+#endif
+};
+
+static RTC_DATA_ATTR rule_state_t state[ALARM_RULES_MAX];
+static RTC_DATA_ATTR float fLast_temp;      /* Reading the rates were last measured from */
+static RTC_DATA_ATTR float fLast_humi;
+static RTC_DATA_ATTR uint32_t u32last_s = 0;
+
+static const char *TAG = "ALARM";
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static bool is_rate(uint8_t u8metric)
+{
+    return (u8metric == ALARM_METRIC_TEMP_RATE) || (u8metric == ALARM_METRIC_HUMI_RATE);
+}
+
+/* Whether the value pushes the rule towards the other state, the clear level gives the hysteresis */
+static bool rule_hit(const alarm_rule_t *rule, bool bActive, float fValue)
+{
+    float fLevel = bActive ? rule->fClear : rule->fSet;
+    switch (rule->u8dir)
+    {
+        case ALARM_ABOVE:
+            return bActive ? (fValue < fLevel) : (fValue > fLevel);
+        case ALARM_BELOW:
+            return bActive ? (fValue > fLevel) : (fValue < fLevel);
+        default:
+            return bActive ? (fabsf(fValue) < fLevel) : (fabsf(fValue) > fLevel);
+    }
+}
+
+/* Push one reading into the window, true if the rule changed state */
+static bool rule_step(const alarm_rule_t *rule, rule_state_t *st, float fValue)
+{
+    uint8_t u8mask = (uint8_t)((1u << rule->u8m) - 1);
+    st->u8history = (uint8_t)((st->u8history << 1) | rule_hit(rule, st->bActive, fValue)) & u8mask;
+    if (__builtin_popcount(st->u8history) < rule->u8n)
+    {
+        return false;
+    }
+    st->bActive = !st->bActive;
+    st->u8history = 0;
+    return true;
+}
+
+static void rules_from_thresholds(void)
+{
+    rules[RULE_TEMP_HIGH].fSet = thresholds.fTemp_high;
+    rules[RULE_TEMP_HIGH].fClear = thresholds.fTemp_high - thresholds.fTemp_hyst;
+    rules[RULE_TEMP_LOW].fSet = thresholds.fTemp_low;
+    rules[RULE_TEMP_LOW].fClear = thresholds.fTemp_low + thresholds.fTemp_hyst;
+    rules[RULE_HUMI_HIGH].fSet = thresholds.fHumi_high;
+    rules[RULE_HUMI_HIGH].fClear = thresholds.fHumi_high - thresholds.fHumi_hyst;
+    rules[RULE_HUMI_LOW].fSet = thresholds.fHumi_low;
+    rules[RULE_HUMI_LOW].fClear = thresholds.fHumi_low + thresholds.fHumi_hyst;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+float alarm_dew_point(float fTemp, float fHumi)
+{
+    float fGamma = logf(fHumi / 100.0f) + MAGNUS_B * fTemp / (MAGNUS_C + fTemp);
+    return MAGNUS_C * fGamma / (MAGNUS_B - fGamma);
+}
+
+uint8_t alarm_evaluate(float fTemp, float fHumi, uint32_t u32now)
+{
+    float fValues[] = {
+        [ALARM_METRIC_TEMP] = fTemp,
+        [ALARM_METRIC_HUMI] = fHumi,
+        [ALARM_METRIC_TEMP_RATE] = 0,
+        [ALARM_METRIC_HUMI_RATE] = 0,
+        [ALARM_METRIC_DEW_SPREAD] = (fHumi > 0) ? (fTemp - alarm_dew_point(fTemp, fHumi)) : fTemp,
+    };
+
+    /* Rates need a previous reading far enough back, an RTC clock set backwards starts over */
+    bool bRate = false;
+    if ((u32last_s != 0) && (u32now >= u32last_s + ALARM_RATE_MIN_S))
+    {
+        float fMinutes = (float)(u32now - u32last_s) / 60.0f;
+        fValues[ALARM_METRIC_TEMP_RATE] = (fTemp - fLast_temp) / fMinutes;
+        fValues[ALARM_METRIC_HUMI_RATE] = (fHumi - fLast_humi) / fMinutes;
+        bRate = true;
+    }
+    if (bRate || (u32last_s == 0) || (u32now < u32last_s))
+    {
+        fLast_temp = fTemp;
+        fLast_humi = fHumi;
+        u32last_s = u32now;
+    }
+
+    bool bChanged = false;
+    for (uint8_t i = 0; i < ALARM_RULES_MAX; i++)
+    {
+        const alarm_rule_t *rule = &rules[i];
+        if ((rule->u8n == 0) || (is_rate(rule->u8metric) && !bRate))
+        {
+            continue;
+        }
+        if (rule_step(rule, &state[i], fValues[rule->u8metric]))
+        {
+            ESP_LOGI(TAG, "Rule %u %s at %.2f", i, state[i].bActive ? "set" : "cleared", fValues[rule->u8metric]);
+            bChanged = true;
+        }
+    }
+    return bChanged ? alarm_active() : ALARM_NO_CHANGE;
+}
+
+bool alarm_pending(void)
+{
+    for (uint8_t i = 0; i < ALARM_RULES_MAX; i++)
+    {
+        /* A confirming reading comes too soon after the last one to move a rate rule */
+        if ((rules[i].u8n != 0) && !is_rate(rules[i].u8metric) && (state[i].u8history != 0))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t alarm_active(void)
+{
+    uint8_t u8bits = 0;
+    for (uint8_t i = 0; i < ALARM_RULES_MAX; i++)
+    {
+        u8bits |= (uint8_t)(state[i].bActive << i);
+    }
+    return u8bits;
+}
+
+void alarm_get_thresholds(alarm_thresholds_t *out)
+{
+    *out = thresholds;
+}
+
+esp_err_t alarm_set_thresholds(const alarm_thresholds_t *in)
+{
+    /* A NaN limit fails every comparison below and would silently disable its rule */
+    if (!isfinite(in->fTemp_high) || !isfinite(in->fTemp_low) || !isfinite(in->fHumi_high) ||
+        !isfinite(in->fHumi_low) || !isfinite(in->fTemp_hyst) || !isfinite(in->fHumi_hyst) ||
+        (in->fTemp_low >= in->fTemp_high) || (in->fHumi_low >= in->fHumi_high) ||
+        (in->fTemp_hyst < 0) || (in->fHumi_hyst < 0))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    thresholds = *in;
+    rules_from_thresholds();
+    ESP_LOGI(TAG, "Thresholds: temperature %.1f..%.1f (hysteresis %.1f), humidity %.1f..%.1f (hysteresis %.1f)",
+             thresholds.fTemp_low, thresholds.fTemp_high, thresholds.fTemp_hyst,
+             thresholds.fHumi_low, thresholds.fHumi_high, thresholds.fHumi_hyst);
+    return ESP_OK;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
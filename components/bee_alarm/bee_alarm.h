@@ -0,0 +1,131 @@
+/*****************************************************************************
+ *
+ * @file 	bee_alarm.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	alarm rules engine: level limits with hysteresis, N-of-M debounce,
+ *          rate-of-change and dew point rules, state kept in RTC memory
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef BEE_ALARM_H
+#define BEE_ALARM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define ALARM_RULES_MAX         7       /* One bit each in the warning value, 0xFF is ALARM_NO_CHANGE */
+#define ALARM_NO_CHANGE         0xFF
+#define ALARM_WINDOW_MAX        8       /* M of N-of-M, the history is one byte */
+#define ALARM_CONFIRM_READS     3       /* Extra readings a wake may take to confirm a pending rule */
+#define ALARM_RATE_MIN_S        10      /* Shortest interval a rate is measured over */
+#define ALARM_DEW_POINT         1       /* Condensation rule on the temperature to dew point spread */
+
+/* Default limits, Bee.thresholds changes them at run time */
+#define ALARM_TEMP_HIGH         30.0f   /* Degrees Celsius */
+#define ALARM_TEMP_LOW          25.0f
+#define ALARM_TEMP_HYST         0.5f    /* A set alarm clears this far back inside the limit */
+#define ALARM_HUMI_HIGH         80.0f   /* %RH */
+#define ALARM_HUMI_LOW          60.0f
+#define ALARM_HUMI_HYST         2.0f
+#define ALARM_TEMP_RATE         2.0f    /* Degrees Celsius per minute, either way */
+#define ALARM_HUMI_RATE         10.0f   /* %RH per minute, either way */
+#define ALARM_DEW_SPREAD        2.0f    /* Degrees Celsius above the dew point */
+
+typedef enum
+{
+    ALARM_METRIC_TEMP = 0,
+    ALARM_METRIC_HUMI,
+    ALARM_METRIC_TEMP_RATE,             /* Per minute, signed */
+    ALARM_METRIC_HUMI_RATE,
+    ALARM_METRIC_DEW_SPREAD,            /* Temperature minus dew point */
+} alarm_metric_t;
+
+typedef enum
+{
+    ALARM_ABOVE = 0,                    /* Set above fSet, clear below fClear */
+    ALARM_BELOW,                        /* Set below fSet, clear above fClear */
+    ALARM_OUTSIDE,                      /* |value| above fSet, clear below fClear, for rates */
+} alarm_dir_t;
+
+typedef struct
+{
+    uint8_t u8metric;                   /* alarm_metric_t */
+    uint8_t u8dir;                      /* alarm_dir_t */
+    uint8_t u8n;                        /* Hits needed within the last u8m readings, 0 disables the rule */
+    uint8_t u8m;                        /* At most ALARM_WINDOW_MAX */
+    float   fSet;
+    float   fClear;
+} alarm_rule_t;
+
+typedef struct
+{
+    float fTemp_high;
+    float fTemp_low;
+    float fHumi_high;
+    float fHumi_low;
+    float fTemp_hyst;
+    float fHumi_hyst;
+} alarm_thresholds_t;
+
+/**
+ * @brief Evaluate every rule against a reading.
+ *
+ * Each rule costs a few comparisons and a popcount of its history byte, whatever the window.
+ * Rate rules only take a reading at least ALARM_RATE_MIN_S after the one they last used.
+ *
+ * @param fTemp   Degrees Celsius.
+ * @param fHumi   %RH.
+ * @param u32now  RTC clock in seconds, keeps counting in deep sleep.
+ * @return Bit i set while rule i is active, ALARM_NO_CHANGE if no rule changed state.
+ *  With the default table the low nibble keeps its former meaning:
+ *    - Bit 3: High temperature, bit 2: Low temperature.
+ *    - Bit 1: High humidity, bit 0: Low humidity.
+ *    - Bit 4: Temperature rate, bit 5: Humidity rate, bit 6: Condensation risk.
+ */
+uint8_t alarm_evaluate(float fTemp, float fHumi, uint32_t u32now);
+
+/**
+ * @brief Whether a rule has hits in its window but not enough to change state yet.
+ *
+ * The caller takes up to ALARM_CONFIRM_READS more readings in the same wake while this holds,
+ * so debouncing does not wait for the next wake.
+ */
+bool alarm_pending(void);
+
+/**
+ * @brief Bitmap of the active rules.
+ */
+uint8_t alarm_active(void);
+
+/**
+ * @brief Get the level limits and their hysteresis.
+ */
+void alarm_get_thresholds(alarm_thresholds_t *thresholds);
+
+/**
+ * @brief Replace the level limits, the clear levels follow from the hysteresis.
+ *
+ * Kept in RTC memory across deep sleep. Active alarms stay set until they meet the new clear level.
+ *
+ * @return ESP_ERR_INVALID_ARG if a value is not finite, a low limit is not below its high limit or a hysteresis
+ *         is negative.
+ */
+esp_err_t alarm_set_thresholds(const alarm_thresholds_t *thresholds);
+
+/**
+ * @brief Dew point by the Magnus formula.
+ *
+ * @param fTemp Degrees Celsius.
+ * @param fHumi %RH, above 0.
+ * @return Degrees Celsius.
+ */
+float alarm_dew_point(float fTemp, float fHumi);
+
+#endif /* BEE_ALARM_H */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
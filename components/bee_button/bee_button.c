@@ -18,6 +18,7 @@
 #include "bee_ota.h"
 #include "bee_nvs.h"
 #include "bee_mqtt.h"
+#include "bee_cmd.h"
 #include "bee_ledc.h"
 
 /****************************************************************************/
@@ -107,7 +108,7 @@ void button_task(void* arg)
             wifi_func_init();     
             mqtt_func_init();       
         }
-        xTaskCreate(rx_mqtt_ota_task, "rx_mqtt_ota_task", 8192, NULL, 9, NULL);
+        xTaskCreate(cmd_task, "cmd_task", 8192, NULL, 9, NULL);
         vTaskDelete(NULL); 
     }
     else
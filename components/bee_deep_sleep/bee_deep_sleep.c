@@ -12,6 +12,7 @@
 /****************************************************************************/
 
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <sys/time.h>
 #include "soc/soc_caps.h"
@@ -19,6 +20,7 @@
 #include "freertos/task.h"
 #include "esp_sleep.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/rtc_io.h"
 #include "driver/gpio.h"
 #include "esp_wifi.h"
@@ -29,9 +31,15 @@
 #include "bee_nvs.h"
 #include "bee_deep_sleep.h"
 #include "bee_mqtt.h"
+#include "bee_config.h"
+#include "bee_manifest.h"
 #include "bee_sht3x.h"
+#include "bee_alarm.h"
+#include "bee_history.h"
 #include "bee_i2c.h"
 #include "bee_wifi.h"
+#include "bee_tls.h"
+#include "bee_ota.h"
 
 /****************************************************************************/
 /***        Global Variables                                              ***/
@@ -45,9 +53,16 @@ bool bInit;
 // storage variables to rtc memory, so variables dont reset after wake up from deep sleep
 static RTC_DATA_ATTR struct timeval sleep_enter_time; 
 static RTC_DATA_ATTR uint8_t u8cnt_sleep = 0;
+static RTC_DATA_ATTR uint16_t u16interval_s = SECOND_30S;
+static RTC_DATA_ATTR uint8_t u8publish_every = DEEP_SLEEP_PUBLISH_EVERY;
+static RTC_DATA_ATTR payload_sample_t samples[MQTT_BATCH_MAX]; // Readings waiting for the next upload, oldest first
+static RTC_DATA_ATTR uint8_t u8samples = 0;
+static RTC_DATA_ATTR uint8_t u8unsynced = 0; // The oldest samples, timed by the clock since boot until SNTP sets it
 
-static float fTemp;
-static float fHumi;
+static payload_reading_t reading;
+static bool bWake_unsynced = false;         // The clock was not set when this wake started
+static uint32_t u32wake_clock = 0;          // time(NULL) then
+static int64_t i64wake_us = 0;
 
 // Define tags for log messages
 static const char *TAG_SHT3x = "SHT3x";
@@ -65,28 +80,86 @@ static void init_resource_pub_mqtt()
 {
     if (!bInit)
     {
-        nvs_flash_func_init();
+        nvs_flash_func_init(); // For the PHY calibration data, credentials come from the RTC copy of the blob
         wifi_func_init();
         mqtt_func_init();
         bInit = true;
     }
 }
 
-static void check_and_pub_warning()
+static void log_sample(const payload_sample_t *sample)
 {
-    uint8_t u8Warning_value = check_warning(fTemp, fHumi);
-    if (u8Warning_value != NO_WARNING)
+    history_rec_t rec =
     {
-        init_resource_pub_mqtt();
-        pub_warning(u8Warning_value, fTemp, fHumi);
-        vTaskDelay (30 / portTICK_PERIOD_MS);
-        mqtt_disconnect();
-        esp_wifi_disconnect();
-        vTaskDelay (10 / portTICK_PERIOD_MS);
+        .u32timestamp = sample->u32timestamp,
+        .u16temp_ticks = sample->u16temp_ticks,
+        .u16humi_ticks = sample->u16humi_ticks,
+    };
+    history_append(&rec); // Staged in RTC memory, a flash write every HISTORY_STAGE readings
+}
+
+static void push_sample(void)
+{
+    if (u8samples == MQTT_BATCH_MAX)
+    {
+        memmove(&samples[0], &samples[1], (MQTT_BATCH_MAX - 1) * sizeof(samples[0])); // Drop the oldest
+        u8samples--;
+        u8unsynced -= (u8unsynced > 0);
+    }
+    samples[u8samples].u16temp_ticks = reading.u16temp_ticks;
+    samples[u8samples].u16humi_ticks = reading.u16humi_ticks;
+    if (reading.u32timestamp != 0)
+    {
+        samples[u8samples].u32timestamp = reading.u32timestamp;
+        log_sample(&samples[u8samples]);
+    }
+    else
+    {
+        // Held until rebase_samples(), a set clock only gets unset with the RTC memory by a power loss
+        samples[u8samples].u32timestamp = (uint32_t)time(NULL); // RTC clock, keeps counting in deep sleep
+        u8unsynced++;
     }
+    u8samples++;
 }
 
-static bool read_data(void)
+/* Once SNTP has set the clock: the held samples move to Unix time, then go to the history and the uploads */
+static void rebase_samples(void)
+{
+    uint32_t u32now = wifi_get_unix_time();
+    if ((u8unsynced == 0) || (u32now == 0))
+    {
+        return;
+    }
+    if (bWake_unsynced)
+    {
+        uint32_t u32clock_now = u32wake_clock + (uint32_t)((esp_timer_get_time() - i64wake_us) / 1000000);
+        for (uint8_t i = 0; i < u8unsynced; i++)
+        {
+            samples[i].u32timestamp += u32now - u32clock_now;
+            log_sample(&samples[i]);
+        }
+        ESP_LOGI(TAG_PM, "Clock set, %u samples rebased", u8unsynced);
+    }
+    else
+    {
+        // Set in a wake that ended before this ran, the clock they were taken by is gone
+        ESP_LOGW(TAG_PM, "Clock set earlier, %u samples without a time dropped", u8unsynced);
+        memmove(&samples[0], &samples[u8unsynced], (u8samples - u8unsynced) * sizeof(samples[0]));
+        u8samples -= u8unsynced;
+    }
+    u8unsynced = 0;
+}
+
+static void pub_samples(void)
+{
+    uint8_t u8done = 0;
+    rebase_samples();
+    pub_batch(&samples[u8unsynced], u8samples - u8unsynced, &u8done); // One message for the whole interval
+    memmove(&samples[u8unsynced], &samples[u8unsynced + u8done], (u8samples - u8unsynced - u8done) * sizeof(samples[0]));
+    u8samples -= u8done;
+}
+
+static bool read_sensor(void)
 {
     sht3x_sensors_values_t sensors_values =
     {
@@ -101,16 +174,58 @@ static bool read_data(void)
         return false;
     }
 
-    fTemp = sensors_values.temperature;
-    fHumi = sensors_values.humidity;
+    reading.fTemp = sensors_values.temperature;
+    reading.fHumi = sensors_values.humidity;
+    reading.u16temp_ticks = sensors_values.temperature_ticks;
+    reading.u16humi_ticks = sensors_values.humidity_ticks;
+    reading.u32timestamp = wifi_get_unix_time();
+    return true;
+}
 
-    ESP_LOGI(TAG_SHT3x, "Temperature %2.1f °C - Humidity %2.1f%%", fTemp, fHumi);
+static bool read_data(void)
+{
+    if (!read_sensor())
+    {
+        return false;
+    }
+    ESP_LOGI(TAG_SHT3x, "Temperature %2.1f °C - Humidity %2.1f%%", reading.fTemp, reading.fHumi);
+    push_sample();
     return true;
 }
 
+static uint8_t check_alarms(void)
+{
+    uint8_t u8Warning_value = alarm_evaluate(reading.fTemp, reading.fHumi, (uint32_t)time(NULL));
+    for (uint8_t i = 0; (i < ALARM_CONFIRM_READS) && (u8Warning_value == ALARM_NO_CHANGE) && alarm_pending(); i++)
+    {
+        // Debounce within this wake: a few more readings cost milliseconds, waiting for the next wake costs an interval
+        if (!read_sensor())
+        {
+            break;
+        }
+        u8Warning_value = alarm_evaluate(reading.fTemp, reading.fHumi, (uint32_t)time(NULL));
+    }
+    return u8Warning_value;
+}
+
+static void check_and_pub_warning()
+{
+    uint8_t u8Warning_value = check_alarms();
+    if (u8Warning_value != ALARM_NO_CHANGE)
+    {
+        init_resource_pub_mqtt();
+        pub_warning(u8Warning_value, &reading); // Returns once acknowledged or past its deadline
+        mqtt_disconnect();
+        wifi_radio_off();
+    }
+}
+
 static void check_cause_wake_up(void)
 {
     start_time = xTaskGetTickCount();
+    bWake_unsynced = (wifi_get_unix_time() == 0);
+    u32wake_clock = (uint32_t)time(NULL);
+    i64wake_us = esp_timer_get_time();
     // Get current time and calculate sleep time
     struct timeval now;
     gettimeofday(&now, NULL);
@@ -121,20 +236,34 @@ static void check_cause_wake_up(void)
         case ESP_SLEEP_WAKEUP_TIMER:
         {
             ESP_LOGI(TAG_PM, "Wake up from timer. Time spent in deep sleep: %dms\n", sleep_time_ms);
+            wifi_release_bt_mem(); // Timer wakes never provision
 
-            if (u8cnt_sleep == 10)
+            if (u8cnt_sleep >= u8publish_every)
             {
                 u8cnt_sleep = 0;
                 
-                if (read_data())
+                uint8_t u8Warning_value = read_data() ? check_alarms() : ALARM_NO_CHANGE;
+                if ((u8samples > 0) || (u8Warning_value != ALARM_NO_CHANGE))
                 {
                     init_resource_pub_mqtt();
-                    pub_data(fTemp, fHumi);
-                    vTaskDelay (20 / portTICK_PERIOD_MS);
+                    pub_samples(); // Returns once acknowledged, queued in the outbox or past its deadline
+                    if (u8Warning_value != ALARM_NO_CHANGE)
+                    {
+                        pub_warning(u8Warning_value, &reading); // Same session as the batch
+                    }
+                    if (u8unsynced > 0)
+                    {
+                        pub_samples(); // SNTP normally sets the clock while the first publish is in flight
+                    }
+                    manifest_check(); // A release announced on the retained manifest topics
+                    if (ota_pending())
+                    {
+                        ota_resume(OTA_WAKE_BUDGET_MS); // A slice of an interrupted update, restarts once it is in
+                    }
                     mqtt_disconnect();
-                    esp_wifi_disconnect();
-                    vTaskDelay (10 / portTICK_PERIOD_MS);                
+                    wifi_radio_off();
                 }
+                history_maintain(); // Erase ahead on the wake that already pays for the radio
             }
             else
             {   
@@ -169,9 +298,42 @@ static void check_cause_wake_up(void)
 /***        Exported Functions                                            ***/
 /****************************************************************************/
 
-void deep_sleep_register_rtc_timer_wakeup(uint8_t wakeup_time_sec)
+void deep_sleep_register_rtc_timer_wakeup(uint16_t wakeup_time_sec)
+{
+    ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup(wakeup_time_sec * 1000000ULL));
+}
+
+esp_err_t deep_sleep_set_interval(uint16_t u16seconds)
 {
-    ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup(wakeup_time_sec * 1000000));
+    if ((u16seconds < DEEP_SLEEP_INTERVAL_MIN) || (u16seconds > DEEP_SLEEP_INTERVAL_MAX))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    u16interval_s = u16seconds;
+    deep_sleep_register_rtc_timer_wakeup(u16interval_s);
+    ESP_LOGI(TAG_PM, "Measurement interval %us", u16interval_s);
+    return ESP_OK;
+}
+
+uint16_t deep_sleep_get_interval(void)
+{
+    return u16interval_s;
+}
+
+esp_err_t deep_sleep_set_publish_every(uint8_t u8wakes)
+{
+    if (u8wakes > DEEP_SLEEP_PUBLISH_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    u8publish_every = u8wakes;
+    ESP_LOGI(TAG_PM, "Upload every %u wakes", u8publish_every + 1);
+    return ESP_OK;
+}
+
+uint8_t deep_sleep_get_publish_every(void)
+{
+    return u8publish_every;
 }
 
 void deep_sleep_register_gpio_wakeup(uint8_t gpio_wakeup)
@@ -192,7 +354,10 @@ void deep_sleep_register_gpio_wakeup(uint8_t gpio_wakeup)
 void deep_sleep_task(void *args)
 {    
     ESP_LOGI(TAG_PM, "Entering normal mode\n");
+    config_init(); // Reads NVS after a cold boot only
+    history_init(); // Scans the partition after a cold boot only
     check_cause_wake_up();
+    rebase_samples(); // A clock set on an alarm or button wake
     gettimeofday(&sleep_enter_time, NULL); // Get deep sleep enter time
     ESP_LOGI(TAG_PM, "Entering deep sleep again\n");
 
@@ -200,6 +365,18 @@ void deep_sleep_task(void *args)
     duration = end_time - start_time;
     double seconds = (double)duration / configTICK_RATE_HZ;
     ESP_LOGI(TAG_PM,"\nDuration: %.2f seconds\n", seconds);
+    if (bInit)
+    {
+        wifi_connect_stats_t wifi_stats;
+        mqtt_profile_t mqtt_profile;
+        tls_profile_t tls_profile;
+        wifi_get_connect_stats(&wifi_stats);
+        mqtt_get_profile(&mqtt_profile);
+        tls_get_profile(&tls_profile);
+        ESP_LOGI(TAG_PM, "Wake profile: wifi %lums, mqtt connect %lums (tls %lums %s), connack->publish %lums",
+                 wifi_stats.u32last_ms, mqtt_profile.u32connect_ms, tls_profile.u32handshake_ms,
+                 tls_profile.bResumed ? "resumed" : "full", mqtt_profile.u32connack_to_pub_ms);
+    }
     esp_deep_sleep_start(); // Enter deep sleep
 }
 /****************************************************************************/
@@ -16,6 +16,11 @@
 #define SECOND_20S 20
 #define SECOND_30S 30
 
+#define DEEP_SLEEP_INTERVAL_MIN 10      /* Seconds, limits of deep_sleep_set_interval() */
+#define DEEP_SLEEP_INTERVAL_MAX 3600
+#define DEEP_SLEEP_PUBLISH_EVERY 10     /* Wakes that only buffer their reading between two uploads */
+#define DEEP_SLEEP_PUBLISH_MAX  60      /* Below MQTT_BATCH_MAX, so an upload never drops a sample */
+
 #define RESET_PIN 7
 
 
@@ -36,7 +41,37 @@ void deep_sleep_task(void *args);
  * 
  * @param wakeup_time_sec time deep sleep
  */
-void deep_sleep_register_rtc_timer_wakeup(uint8_t wakeup_time_sec);
+void deep_sleep_register_rtc_timer_wakeup(uint16_t wakeup_time_sec);
+
+/**
+ * @brief Change the measurement interval.
+ *
+ * The interval is kept in RTC memory and the timer wake-up is registered again right away.
+ *
+ * @param u16seconds New interval, DEEP_SLEEP_INTERVAL_MIN to DEEP_SLEEP_INTERVAL_MAX.
+ * @return ESP_ERR_INVALID_ARG if out of range.
+ */
+esp_err_t deep_sleep_set_interval(uint16_t u16seconds);
+
+/**
+ * @brief Get the measurement interval in seconds, SECOND_30S until changed.
+ */
+uint16_t deep_sleep_get_interval(void);
+
+/**
+ * @brief Change how many timer wakes only buffer their reading before the next upload.
+ *
+ * Kept in RTC memory, takes effect on the next wake.
+ *
+ * @param u8wakes 0 (upload every wake) to DEEP_SLEEP_PUBLISH_MAX.
+ * @return ESP_ERR_INVALID_ARG if out of range.
+ */
+esp_err_t deep_sleep_set_publish_every(uint8_t u8wakes);
+
+/**
+ * @brief Get the wakes between uploads, DEEP_SLEEP_PUBLISH_EVERY until changed.
+ */
+uint8_t deep_sleep_get_publish_every(void);
 
 /**
  * @brief Register external GPIO wake-up source for deep sleep.
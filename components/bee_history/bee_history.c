@@ -0,0 +1,429 @@
+/*****************************************************************************
+ *
+ * @file 	bee_history.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	time-series history of every reading, a circular log of fixed
+ *          size records in the "history" data partition
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_partition.h"
+
+#include "bee_history.h"
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+typedef struct
+{
+    uint32_t u32magic;          /* HISTORY_STATE_MAGIC, anything else means cold boot */
+    uint32_t u32size;           /* Partition size the pages belong to */
+    uint32_t u32pages;
+    uint32_t u32head;           /* Page receiving the records */
+    uint32_t u32seq;            /* Sequence number of the head page */
+    uint16_t u16head_rec;       /* Records written in the head page */
+    bool     bSpare;            /* The page after the head is erased */
+    bool     bStep;             /* The next page starts after the clock went backwards */
+    uint8_t  u8staged;
+    uint32_t u32last;           /* Timestamp of the last record appended */
+    uint64_t u64steps;          /* Pages with HISTORY_FLAG_STEP, a bit per page */
+    history_rec_t stage[HISTORY_STAGE];
+    uint32_t u32first[HISTORY_PAGES_MAX];   /* First timestamp of each page, HISTORY_BLANK if it has none */
+} history_state_t;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static RTC_DATA_ATTR history_state_t state;
+static RTC_DATA_ATTR bool bMissing_logged = false;      /* The missing partition was reported */
+static const esp_partition_t *partition = NULL;
+
+static const char *TAG = "HISTORY";
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static uint32_t next_page(uint32_t u32page)
+{
+    return (u32page + 1 == state.u32pages) ? 0 : u32page + 1;
+}
+
+static uint32_t rec_offset(uint32_t u32page, uint32_t u32rec)
+{
+    return u32page * HISTORY_SECTOR_SIZE + sizeof(history_page_t) + u32rec * sizeof(history_rec_t);
+}
+
+static uint32_t rec_time(uint32_t u32page, uint32_t u32rec)
+{
+    history_rec_t rec;
+    if (esp_partition_read(partition, rec_offset(u32page, u32rec), &rec, sizeof(rec)) != ESP_OK)
+    {
+        return HISTORY_BLANK;
+    }
+    return rec.u32timestamp;
+}
+
+static esp_err_t erase_page(uint32_t u32page)
+{
+    state.u32first[u32page] = HISTORY_BLANK;
+    state.u64steps &= ~(1ULL << u32page);
+    return esp_partition_erase_range(partition, u32page * HISTORY_SECTOR_SIZE, HISTORY_SECTOR_SIZE);
+}
+
+/* Rebuild the head and the index from the page headers after a power loss */
+static esp_err_t scan(void)
+{
+    history_page_t page;
+    bool bFound = false;
+    bool bLast = false;
+    uint32_t u32max_seq = 0;
+    uint32_t u32last_seq = 0;
+    uint32_t u32newest = 0;
+    uint32_t u32last = 0;
+    uint32_t u32used = 0;
+
+    state.u64steps = 0;
+    for (uint32_t i = 0; i < state.u32pages; i++)
+    {
+        state.u32first[i] = HISTORY_BLANK;
+        if ((esp_partition_read(partition, i * HISTORY_SECTOR_SIZE, &page, sizeof(page)) != ESP_OK) ||
+            (page.u16magic != HISTORY_PAGE_MAGIC))
+        {
+            continue;
+        }
+        state.u32first[i] = rec_time(i, 0);
+        state.u64steps |= (page.u16flags & HISTORY_FLAG_STEP) ? 0 : (1ULL << i);
+        u32used += (state.u32first[i] != HISTORY_BLANK);
+        if (!bFound || (page.u32seq >= u32max_seq))
+        {
+            u32max_seq = page.u32seq;
+            u32newest = i;
+            bFound = true;
+        }
+        if ((state.u32first[i] != HISTORY_BLANK) && (!bLast || (page.u32seq >= u32last_seq)))
+        {
+            u32last_seq = page.u32seq;
+            u32last = i;
+            bLast = true;
+        }
+    }
+
+    /* The last record of the newest page holding any, a step back from it must start a page */
+    state.u32last = 0;
+    if (bLast)
+    {
+        uint32_t u32lo = 1;
+        uint32_t u32hi = HISTORY_RECS_PER_PAGE;
+        while (u32lo < u32hi)
+        {
+            uint32_t u32mid = (u32lo + u32hi) / 2;
+            if (rec_time(u32last, u32mid) != HISTORY_BLANK)
+            {
+                u32lo = u32mid + 1;
+            }
+            else
+            {
+                u32hi = u32mid;
+            }
+        }
+        state.u32last = rec_time(u32last, u32lo - 1);
+    }
+
+    /* The end of the newest page may hold a torn write, and carrying on from there keeps the wear even */
+    state.u32head = bFound ? next_page(u32newest) : 0;
+    state.u32seq = bFound ? u32max_seq + 1 : 0;
+    state.u16head_rec = 0;
+    state.bSpare = false;
+    state.bStep = false;
+    state.u8staged = 0;
+    ESP_LOGI(TAG, "Recovered %lu pages", u32used);
+    return erase_page(state.u32head);
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+esp_err_t history_init(void)
+{
+    if (partition != NULL)
+    {
+        return ESP_OK;
+    }
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, HISTORY_PARTITION_SUBTYPE, HISTORY_PARTITION_LABEL);
+    if (partition == NULL)
+    {
+        if (!bMissing_logged) // The table cannot change before a serial flash, once per cold boot is enough
+        {
+            ESP_LOGW(TAG, "No \"%s\" partition in the partition table, readings are not logged", HISTORY_PARTITION_LABEL);
+            bMissing_logged = true;
+        }
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint32_t u32size = partition->size & ~(HISTORY_SECTOR_SIZE - 1);
+    uint32_t u32pages = u32size / HISTORY_SECTOR_SIZE;
+    if (u32pages < 2)
+    {
+        partition = NULL;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if ((state.u32magic != HISTORY_STATE_MAGIC) || (state.u32size != u32size))
+    {
+        state.u32size = u32size;
+        state.u32pages = (u32pages < HISTORY_PAGES_MAX) ? u32pages : HISTORY_PAGES_MAX;
+        esp_err_t err = scan();
+        if (err != ESP_OK)
+        {
+            partition = NULL;
+            return err;
+        }
+        state.u32magic = HISTORY_STATE_MAGIC;
+    }
+    return ESP_OK;
+}
+
+esp_err_t history_append(const history_rec_t *rec)
+{
+    if (partition == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (rec->u32timestamp < state.u32last)
+    {
+        /* The clock went backwards: keep each page in order, the seek index relies on it */
+        ESP_LOGW(TAG, "Clock went back %lu s, starting a page", state.u32last - rec->u32timestamp);
+        history_flush();
+        if (state.u16head_rec > 0)
+        {
+            state.u16head_rec = HISTORY_RECS_PER_PAGE;
+        }
+        state.bStep = true;
+    }
+    state.u32last = rec->u32timestamp;
+    if (state.u8staged == HISTORY_STAGE) /* The last flush failed, keep the newest */
+    {
+        memmove(&state.stage[0], &state.stage[1], (HISTORY_STAGE - 1) * sizeof(state.stage[0]));
+        state.u8staged--;
+    }
+    state.stage[state.u8staged++] = *rec;
+    return (state.u8staged == HISTORY_STAGE) ? history_flush() : ESP_OK;
+}
+
+esp_err_t history_flush(void)
+{
+    if (partition == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    while (state.u8staged > 0)
+    {
+        if (state.u16head_rec == HISTORY_RECS_PER_PAGE)
+        {
+            uint32_t u32next = next_page(state.u32head);
+            if (!state.bSpare)
+            {
+                ESP_LOGW(TAG, "No page erased ahead, erasing on append");
+                esp_err_t err = erase_page(u32next);
+                if (err != ESP_OK)
+                {
+                    return err;
+                }
+            }
+            state.bSpare = false;
+            state.u32head = u32next;
+            state.u16head_rec = 0;
+            state.u32seq++;
+        }
+
+        bool bFirst = (state.u16head_rec == 0);
+        esp_err_t err = ESP_OK;
+        if (bFirst)
+        {
+            history_page_t page = {.u16magic = HISTORY_PAGE_MAGIC,
+                                   .u16flags = state.bStep ? (uint16_t)~HISTORY_FLAG_STEP : 0xFFFF,
+                                   .u32seq = state.u32seq};
+            err = esp_partition_write(partition, state.u32head * HISTORY_SECTOR_SIZE, &page, sizeof(page));
+        }
+
+        /* As many records as the page takes in one write */
+        uint16_t u16n = state.u8staged;
+        if (u16n > HISTORY_RECS_PER_PAGE - state.u16head_rec)
+        {
+            u16n = HISTORY_RECS_PER_PAGE - state.u16head_rec;
+        }
+        if (err == ESP_OK)
+        {
+            err = esp_partition_write(partition, rec_offset(state.u32head, state.u16head_rec), state.stage,
+                                      u16n * sizeof(history_rec_t));
+        }
+        if (err != ESP_OK)
+        {
+            state.u16head_rec = HISTORY_RECS_PER_PAGE; /* Leave whatever was written behind */
+            return err;
+        }
+
+        if (bFirst)
+        {
+            state.u32first[state.u32head] = state.stage[0].u32timestamp;
+            state.u64steps |= state.bStep ? (1ULL << state.u32head) : 0;
+            state.bStep = false;
+        }
+        state.u16head_rec += u16n;
+        state.u8staged -= u16n;
+        memmove(&state.stage[0], &state.stage[u16n], state.u8staged * sizeof(state.stage[0]));
+    }
+    return ESP_OK;
+}
+
+void history_maintain(void)
+{
+    if ((partition == NULL) || state.bSpare)
+    {
+        return;
+    }
+    state.bSpare = (erase_page(next_page(state.u32head)) == ESP_OK);
+}
+
+esp_err_t history_seek(history_cursor_t *cursor, uint32_t u32from, uint32_t u32to)
+{
+    cursor->u32pages_left = 0;
+    cursor->u16rec = 0;
+    cursor->u32from = u32from;
+    cursor->u32to = u32to;
+    cursor->bScan = false;
+
+    esp_err_t err = history_flush();
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    /* Oldest page first: the last one starting at or before u32from holds the first record wanted */
+    uint32_t u32oldest = 0;
+    uint32_t u32start = 0;
+    uint32_t u32page = state.u32head;
+    for (uint32_t k = 1; k <= state.u32pages; k++)
+    {
+        u32page = next_page(u32page);
+        if (state.u32first[u32page] == HISTORY_BLANK)
+        {
+            continue;
+        }
+        if (u32oldest == 0)
+        {
+            u32oldest = k;
+        }
+        if (state.u32first[u32page] <= u32from)
+        {
+            u32start = k;
+        }
+    }
+    if (u32oldest == 0)
+    {
+        return ESP_OK;
+    }
+
+    /* A step before the oldest page is harmless, anything later breaks the order across pages */
+    uint32_t u32first_page = (state.u32head + u32oldest) % state.u32pages;
+    if ((state.u64steps & ~(1ULL << u32first_page)) != 0)
+    {
+        cursor->u32page = u32first_page;
+        cursor->u32pages_left = state.u32pages + 1 - u32oldest;
+        cursor->bScan = true;
+        return ESP_OK;
+    }
+
+    cursor->u32page = (state.u32head + ((u32start != 0) ? u32start : u32oldest)) % state.u32pages;
+    cursor->u32pages_left = state.u32pages + 1 - ((u32start != 0) ? u32start : u32oldest);
+    if (u32start != 0)
+    {
+        /* Blank records sort last, like the largest timestamp */
+        uint32_t u32lo = 0;
+        uint32_t u32hi = (cursor->u32page == state.u32head) ? state.u16head_rec : HISTORY_RECS_PER_PAGE;
+        while (u32lo < u32hi)
+        {
+            uint32_t u32mid = (u32lo + u32hi) / 2;
+            uint32_t u32ts = rec_time(cursor->u32page, u32mid);
+            if ((u32ts != HISTORY_BLANK) && (u32ts < u32from))
+            {
+                u32lo = u32mid + 1;
+            }
+            else
+            {
+                u32hi = u32mid;
+            }
+        }
+        cursor->u16rec = (uint16_t)u32lo;
+    }
+    return ESP_OK;
+}
+
+size_t history_read(history_cursor_t *cursor, history_rec_t *recs, size_t max)
+{
+    size_t n = 0;
+
+    while ((n < max) && (cursor->u32pages_left > 0))
+    {
+        uint32_t u32limit = (cursor->u32page == state.u32head) ? state.u16head_rec : HISTORY_RECS_PER_PAGE;
+        if (cursor->u16rec >= u32limit)
+        {
+            cursor->u32page = next_page(cursor->u32page);
+            cursor->u16rec = 0;
+            cursor->u32pages_left--;
+            continue;
+        }
+
+        size_t chunk = u32limit - cursor->u16rec;
+        if (chunk > max - n)
+        {
+            chunk = max - n;
+        }
+        if (esp_partition_read(partition, rec_offset(cursor->u32page, cursor->u16rec), &recs[n],
+                               chunk * sizeof(history_rec_t)) != ESP_OK)
+        {
+            cursor->u16rec = HISTORY_RECS_PER_PAGE;
+            continue;
+        }
+
+        /* Keep the ones in range, in place */
+        size_t kept = n;
+        for (size_t i = 0; i < chunk; i++)
+        {
+            history_rec_t rec = recs[n + i];
+            if (rec.u32timestamp == HISTORY_BLANK)
+            {
+                cursor->u16rec = HISTORY_RECS_PER_PAGE; /* End of a page cut short by a power loss */
+                break;
+            }
+            if ((rec.u32timestamp > cursor->u32to) && !cursor->bScan)
+            {
+                cursor->u32pages_left = 0;
+                break;
+            }
+            cursor->u16rec++;
+            if ((rec.u32timestamp >= cursor->u32from) && (rec.u32timestamp <= cursor->u32to))
+            {
+                recs[kept++] = rec;
+            }
+        }
+        n = kept;
+    }
+    return n;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,128 @@
+/*****************************************************************************
+ *
+ * @file 	bee_history.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	time-series history of every reading, a circular log of fixed
+ *          size records in the "history" data partition
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef BEE_HISTORY_H
+#define BEE_HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define HISTORY_PARTITION_LABEL     "history"
+#define HISTORY_PARTITION_SUBTYPE   0x41        /* Custom data subtype, see partitions.csv */
+#define HISTORY_SECTOR_SIZE         4096
+#define HISTORY_PAGES_MAX           64          /* Pages indexed in RTC memory, the rest of a bigger partition is unused */
+#define HISTORY_PAGE_MAGIC          0x4853
+#define HISTORY_STATE_MAGIC         0x4857A7E6
+#define HISTORY_STAGE               16          /* Records gathered in RTC memory before one flash write */
+#define HISTORY_BLANK               0xFFFFFFFF  /* Timestamp of an erased record */
+#define HISTORY_FLAG_STEP           0x0001      /* Cleared in u16flags: the clock went backwards before this page */
+
+/*
+ * Log layout: every sector is a page, a history_page_t header followed by HISTORY_RECS_PER_PAGE records
+ * in append order. Pages are used in turn around the partition, so each one is erased once per trip.
+ * The page after the head is erased ahead of time by history_maintain(), appending only programs.
+ * Timestamps grow within a page: a record older than the one before closes the head page and starts
+ * the next one with HISTORY_FLAG_STEP cleared.
+ */
+typedef struct
+{
+    uint16_t u16magic;          /* HISTORY_PAGE_MAGIC */
+    uint16_t u16flags;          /* HISTORY_FLAG_*, active low so an erased header has none */
+    uint32_t u32seq;            /* Page order, survives power loss */
+} history_page_t;
+
+typedef struct
+{
+    uint32_t u32timestamp;      /* Seconds, HISTORY_BLANK ends the page */
+    uint16_t u16temp_ticks;     /* Raw SHT3x words */
+    uint16_t u16humi_ticks;
+} history_rec_t;
+
+#define HISTORY_RECS_PER_PAGE   ((HISTORY_SECTOR_SIZE - sizeof(history_page_t)) / sizeof(history_rec_t))
+
+typedef struct
+{
+    uint32_t u32page;           /* Page being read */
+    uint32_t u32pages_left;     /* Pages left, this one included */
+    uint16_t u16rec;            /* Next record in the page */
+    uint32_t u32from;
+    uint32_t u32to;
+    bool     bScan;             /* The clock went backwards, every page is read and nothing ends the range early */
+} history_cursor_t;
+
+/**
+ * @brief Open the history partition.
+ *
+ * The head, the staged records and the index of the first timestamp of every page are kept in RTC memory
+ * across deep sleep. After a power loss they are rebuilt from the page headers, the log continues in the
+ * page after the newest one and the staged records are lost.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if the partition table has no history.
+ */
+esp_err_t history_init(void);
+
+/**
+ * @brief Append a record.
+ *
+ * Records are staged in RTC memory and written HISTORY_STAGE at a time. Nothing is erased here unless
+ * history_maintain() fell a whole page behind. A timestamp older than the last one appended writes the
+ * staged records and starts a new page, the rest of the head page stays unused.
+ *
+ * @return ESP_OK or the flash error of the write it triggered.
+ */
+esp_err_t history_append(const history_rec_t *rec);
+
+/**
+ * @brief Write the staged records now.
+ */
+esp_err_t history_flush(void);
+
+/**
+ * @brief Erase the page after the head if it is not blank yet, evicting the oldest records.
+ *
+ * Call it where an erase costs nothing extra, e.g. after an upload. Does nothing most of the time.
+ */
+void history_maintain(void);
+
+/**
+ * @brief Position a cursor on the first record of a time range.
+ *
+ * Flushes the staged records, then finds the page from the RTC index and the record by a binary search
+ * in that page. While a page written after the clock went backwards is in the log, the cursor reads every
+ * page from the oldest instead.
+ *
+ * @param cursor  Cursor for history_read().
+ * @param u32from First timestamp wanted.
+ * @param u32to   Last timestamp wanted.
+ * @return ESP_OK, even if the range is empty, ESP_ERR_INVALID_STATE without a partition.
+ */
+esp_err_t history_seek(history_cursor_t *cursor, uint32_t u32from, uint32_t u32to);
+
+/**
+ * @brief Read the next records of the range in the order they were appended.
+ *
+ * That is oldest first unless the clock went backwards inside the range.
+ * No record may be appended while a cursor is in use.
+ *
+ * @param cursor Cursor from history_seek().
+ * @param recs   Receives the records.
+ * @param max    Size of recs.
+ * @return Number of records read, 0 past the end of the range.
+ */
+size_t history_read(history_cursor_t *cursor, history_rec_t *recs, size_t max);
+
+#endif /* BEE_HISTORY_H */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
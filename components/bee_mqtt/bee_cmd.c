@@ -0,0 +1,660 @@
+/*****************************************************************************
+ *
+ * @file 	bee_cmd.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	command router for messages received on the command topic,
+ *          fixed message pool and in-place JSON tokenizer, no heap use
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_system.h"
+#include "esp_log.h"
+
+#include "bee_cmd.h"
+#include "bee_mqtt.h"
+#include "bee_ota.h"
+#include "bee_sht3x.h"
+#include "bee_alarm.h"
+#include "bee_history.h"
+#include "bee_deep_sleep.h"
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+typedef struct
+{
+    char   cData[CMD_MSG_MAX + 1];
+    size_t len;
+} cmd_msg_t;
+
+typedef struct
+{
+    const char *cName;                                  /* cmd_name of the request */
+    esp_err_t (*fnHandle)(const cmd_args_t *args);      /* Validate and apply */
+    void (*fnAfter_ack)(const cmd_args_t *args);        /* Runs once the result is published, may not return */
+} cmd_handler_t;
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+
+static esp_err_t handle_ota(const cmd_args_t *args);
+static void start_ota_after_ack(const cmd_args_t *args);
+static esp_err_t handle_interval(const cmd_args_t *args);
+static esp_err_t handle_thresholds(const cmd_args_t *args);
+static esp_err_t handle_heater(const cmd_args_t *args);
+static esp_err_t handle_calibration(const cmd_args_t *args);
+static esp_err_t handle_history(const cmd_args_t *args);
+static esp_err_t handle_reboot(const cmd_args_t *args);
+static void reboot_after_ack(const cmd_args_t *args);
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static const cmd_handler_t handlers[] =
+{
+    {"Bee.ota",         handle_ota,         start_ota_after_ack},
+    {"Bee.interval",    handle_interval,    NULL},
+    {"Bee.thresholds",  handle_thresholds,  NULL},
+    {"Bee.heater",      handle_heater,      NULL},
+    {"Bee.calibration", handle_calibration, NULL},
+    {"Bee.history",     handle_history,     NULL},
+    {"Bee.reboot",      handle_reboot,      reboot_after_ack},
+};
+
+static cmd_msg_t pool[CMD_POOL_SIZE];
+static QueueHandle_t free_queue = NULL;     /* Empty slots */
+static QueueHandle_t ready_queue = NULL;    /* Complete messages for cmd_task */
+static cmd_msg_t *assembling = NULL;        /* Slot receiving the fragments, MQTT task only */
+
+static const char *TAG = "CMD";
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static bool is_space(char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+}
+
+static char *skip_space(char *p, const char *end)
+{
+    while ((p < end) && is_space(*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+/* Position of the delimiter after a value, NULL if the value was bad or the text ends */
+static char *after_value(char *p, const char *end)
+{
+    p = (p != NULL) ? skip_space(p, end) : NULL;
+    return ((p != NULL) && (p < end)) ? p : NULL;
+}
+
+static int hex_digit(char c)
+{
+    if ((c >= '0') && (c <= '9'))
+    {
+        return c - '0';
+    }
+    c |= 0x20;
+    return ((c >= 'a') && (c <= 'f')) ? c - 'a' + 10 : -1;
+}
+
+/* Unescape the string starting after its opening quote, returns the position after the closing quote */
+static char *scan_string(char *p, const char *end)
+{
+    char *out = p; // Never passes p, escapes only shrink
+
+    while ((p < end) && (*p != '"'))
+    {
+        char c = *p++;
+        if ((unsigned char)c < 0x20)
+        {
+            return NULL;
+        }
+        if (c != '\\')
+        {
+            *out++ = c;
+            continue;
+        }
+        if (p >= end)
+        {
+            return NULL;
+        }
+        switch (c = *p++)
+        {
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case '"':
+            case '\\':
+            case '/': *out++ = c; break;
+            case 'u':
+            {
+                uint32_t u32cp = 0;
+                for (uint8_t i = 0; i < 4; i++)
+                {
+                    int digit = (p < end) ? hex_digit(*p++) : -1;
+                    if (digit < 0)
+                    {
+                        return NULL;
+                    }
+                    u32cp = (u32cp << 4) | digit;
+                }
+                /* UTF-8, at most 3 bytes for the 6 of the escape (surrogates are kept as they are) */
+                if (u32cp < 0x80)
+                {
+                    *out++ = (char)u32cp;
+                }
+                else if (u32cp < 0x800)
+                {
+                    *out++ = (char)(0xC0 | (u32cp >> 6));
+                    *out++ = (char)(0x80 | (u32cp & 0x3F));
+                }
+                else
+                {
+                    *out++ = (char)(0xE0 | (u32cp >> 12));
+                    *out++ = (char)(0x80 | ((u32cp >> 6) & 0x3F));
+                    *out++ = (char)(0x80 | (u32cp & 0x3F));
+                }
+                break;
+            }
+            default:
+                return NULL;
+        }
+    }
+    if (p >= end)
+    {
+        return NULL;
+    }
+    *out = '\0';
+    return p + 1;
+}
+
+/* Skip a nested object or array, p points at its opening bracket */
+static char *skip_nested(char *p, const char *end)
+{
+    uint8_t u8depth = 0;
+    bool bIn_string = false;
+
+    for (; p < end; p++)
+    {
+        if (bIn_string)
+        {
+            if (*p == '\\')
+            {
+                p++;
+            }
+            else if (*p == '"')
+            {
+                bIn_string = false;
+            }
+        }
+        else if (*p == '"')
+        {
+            bIn_string = true;
+        }
+        else if ((*p == '{') || (*p == '['))
+        {
+            u8depth++;
+        }
+        else if (((*p == '}') || (*p == ']')) && (--u8depth == 0))
+        {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+static const char *skip_digits(const char *p)
+{
+    while (isdigit((unsigned char)*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+/* JSON number grammar, strtof alone would also take nan, inf, hex, a leading '+' or '.' */
+static bool is_json_number(const char *p)
+{
+    p += (*p == '-');
+    if (*p == '0')
+    {
+        p++;
+    }
+    else if (isdigit((unsigned char)*p))
+    {
+        p = skip_digits(p);
+    }
+    else
+    {
+        return false;
+    }
+    if (*p == '.')
+    {
+        if (!isdigit((unsigned char)*++p))
+        {
+            return false;
+        }
+        p = skip_digits(p);
+    }
+    if ((*p == 'e') || (*p == 'E'))
+    {
+        p++;
+        p += (*p == '+') || (*p == '-');
+        if (!isdigit((unsigned char)*p))
+        {
+            return false;
+        }
+        p = skip_digits(p);
+    }
+    return *p == '\0';
+}
+
+static bool literal_type(const char *cText, uint8_t *pu8type)
+{
+    if ((strcmp(cText, "true") == 0) || (strcmp(cText, "false") == 0))
+    {
+        *pu8type = CMD_VAL_BOOL;
+        return true;
+    }
+    if (strcmp(cText, "null") == 0)
+    {
+        *pu8type = CMD_VAL_NULL;
+        return true;
+    }
+    *pu8type = CMD_VAL_NUMBER;
+    return is_json_number(cText) && isfinite(strtof(cText, NULL)); // 1e39 overflows to inf
+}
+
+static const cmd_field_t *find_field(const cmd_args_t *args, const char *cKey)
+{
+    for (uint8_t i = 0; i < args->u8count; i++)
+    {
+        if (strcmp(args->field[i].cKey, cKey) == 0)
+        {
+            return &args->field[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t handle_ota(const cmd_args_t *args)
+{
+    const char *cObject_type = cmd_get_str(args, "object_type");
+    const char *cUrl = cmd_get_str(args, "url");
+    if ((cObject_type == NULL) || (strcmp(cObject_type, "Bee.ota_info") != 0) || (cUrl == NULL) || (cUrl[0] == '\0'))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+static void start_ota_after_ack(const cmd_args_t *args)
+{
+    start_ota((char *)cmd_get_str(args, "url")); // Restarts the chip
+}
+
+static esp_err_t handle_interval(const cmd_args_t *args)
+{
+    int32_t i32seconds;
+    if (!cmd_get_int(args, "interval", &i32seconds) || (i32seconds < 0) || (i32seconds > UINT16_MAX))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return deep_sleep_set_interval((uint16_t)i32seconds);
+}
+
+static esp_err_t handle_thresholds(const cmd_args_t *args)
+{
+    alarm_thresholds_t thresholds;
+    alarm_get_thresholds(&thresholds);
+
+    /* Any subset may be given, the others stay */
+    bool bAny = cmd_get_float(args, "temp_high", &thresholds.fTemp_high);
+    bAny |= cmd_get_float(args, "temp_low", &thresholds.fTemp_low);
+    bAny |= cmd_get_float(args, "humi_high", &thresholds.fHumi_high);
+    bAny |= cmd_get_float(args, "humi_low", &thresholds.fHumi_low);
+    bAny |= cmd_get_float(args, "temp_hyst", &thresholds.fTemp_hyst);
+    bAny |= cmd_get_float(args, "humi_hyst", &thresholds.fHumi_hyst);
+    return bAny ? alarm_set_thresholds(&thresholds) : ESP_ERR_INVALID_ARG;
+}
+
+static esp_err_t handle_heater(const cmd_args_t *args)
+{
+    bool bEnable;
+    if (!cmd_get_bool(args, "enable", &bEnable))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return bEnable ? sht3x_enable_heater() : sht3x_disable_heater();
+}
+
+static esp_err_t handle_calibration(const cmd_args_t *args)
+{
+    float fTemp_offset = 0;
+    float fHumi_offset = 0;
+    bool bAny = cmd_get_float(args, "temp_offset", &fTemp_offset);
+    bAny |= cmd_get_float(args, "humi_offset", &fHumi_offset);
+    return bAny ? sht3x_set_calibration(fTemp_offset, fHumi_offset) : ESP_ERR_INVALID_ARG;
+}
+
+/* Stream the samples of [from, to] in batches, the caller asks again from the last timestamp for more */
+static esp_err_t handle_history(const cmd_args_t *args)
+{
+    static history_rec_t recs[MQTT_BATCH_MAX];
+    static payload_sample_t samples[MQTT_BATCH_MAX];
+    int32_t i32from;
+    int32_t i32to = INT32_MAX;
+    if (!cmd_get_int(args, "from", &i32from) || (i32from < 0) ||
+        (cmd_get_int(args, "to", &i32to) && (i32to < i32from)))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    history_cursor_t cursor;
+    esp_err_t err = history_seek(&cursor, (uint32_t)i32from, (uint32_t)i32to);
+    uint32_t u32sent = 0;
+    while ((err == ESP_OK) && (u32sent < CMD_HISTORY_MAX))
+    {
+        size_t max = (CMD_HISTORY_MAX - u32sent < MQTT_BATCH_MAX) ? CMD_HISTORY_MAX - u32sent : MQTT_BATCH_MAX;
+        size_t n = history_read(&cursor, recs, max);
+        if (n == 0)
+        {
+            break;
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            samples[i].u32timestamp = recs[i].u32timestamp;
+            samples[i].u16temp_ticks = recs[i].u16temp_ticks;
+            samples[i].u16humi_ticks = recs[i].u16humi_ticks;
+        }
+        if (pub_history(samples, (uint8_t)n) != MQTT_PUB_OK)
+        {
+            err = ESP_ERR_TIMEOUT;
+        }
+        u32sent += n;
+    }
+    ESP_LOGI(TAG, "History %ld..%ld: %lu samples", i32from, i32to, u32sent);
+    return err;
+}
+
+static esp_err_t handle_reboot(const cmd_args_t *args)
+{
+    return ESP_OK;
+}
+
+static void reboot_after_ack(const cmd_args_t *args)
+{
+    mqtt_disconnect();
+    esp_restart();
+}
+
+static void cmd_dispatch(cmd_msg_t *msg)
+{
+    cmd_args_t args;
+    if (!cmd_tokenize(msg->cData, msg->len, &args))
+    {
+        ESP_LOGW(TAG, "Malformed command dropped");
+        return;
+    }
+
+    const char *cToken = cmd_get_str(&args, "thing_token");
+    if ((cToken == NULL) || (strcmp(cToken, mqtt_get_thing_token()) != 0))
+    {
+        ESP_LOGW(TAG, "Command for another device dropped");
+        return;
+    }
+
+    const char *cName = cmd_get_str(&args, "cmd_name");
+    const cmd_handler_t *handler = NULL;
+    for (uint8_t i = 0; (cName != NULL) && (i < sizeof(handlers) / sizeof(handlers[0])); i++)
+    {
+        if (strcmp(handlers[i].cName, cName) == 0)
+        {
+            handler = &handlers[i];
+            break;
+        }
+    }
+
+    int32_t i32trans_code = -1; // -1: the request has none, the reply takes the next local one
+    cmd_get_int(&args, "trans_code", &i32trans_code);
+
+    esp_err_t err = (handler != NULL) ? handler->fnHandle(&args) : ESP_ERR_NOT_SUPPORTED;
+    ESP_LOGI(TAG, "%s: %s", (cName != NULL) ? cName : "(no cmd_name)", esp_err_to_name(err));
+    pub_cmd_result((cName != NULL) ? cName : "", i32trans_code, err);
+
+    if ((err == ESP_OK) && (handler->fnAfter_ack != NULL))
+    {
+        handler->fnAfter_ack(&args);
+    }
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+bool cmd_tokenize(char *pcJson, size_t len, cmd_args_t *args)
+{
+    const char *end = pcJson + len;
+    char *p = skip_space(pcJson, end);
+
+    args->u8count = 0;
+    if ((p >= end) || (*p != '{'))
+    {
+        return false;
+    }
+    p = skip_space(p + 1, end);
+    if ((p < end) && (*p == '}'))
+    {
+        return true;
+    }
+
+    while ((p < end) && (*p == '"'))
+    {
+        cmd_field_t field = {.cKey = p + 1};
+        p = scan_string(p + 1, end);
+        p = (p != NULL) ? skip_space(p, end) : NULL;
+        if ((p == NULL) || (p >= end) || (*p != ':'))
+        {
+            return false;
+        }
+        p = skip_space(p + 1, end);
+        if (p >= end)
+        {
+            return false;
+        }
+
+        char c;
+        if (*p == '"')
+        {
+            field.cValue = p + 1;
+            field.u8type = CMD_VAL_STRING;
+            p = after_value(scan_string(p + 1, end), end);
+            c = (p != NULL) ? *p : '\0';
+        }
+        else if ((*p == '{') || (*p == '['))
+        {
+            field.cValue = p;
+            field.u8type = CMD_VAL_RAW;
+            p = after_value(skip_nested(p, end), end);
+            c = (p != NULL) ? *p : '\0';
+        }
+        else
+        {
+            /* Scalar: terminate it on its delimiter, then carry on from that delimiter */
+            field.cValue = p;
+            while ((p < end) && !is_space(*p) && (*p != ',') && (*p != '}'))
+            {
+                p++;
+            }
+            if ((p >= end) || (p == field.cValue))
+            {
+                return false;
+            }
+            c = *p;
+            *p = '\0';
+            if (!literal_type(field.cValue, &field.u8type))
+            {
+                return false;
+            }
+            if (is_space(c))
+            {
+                p = after_value(p + 1, end);
+                c = (p != NULL) ? *p : '\0';
+            }
+        }
+
+        if (args->u8count == CMD_FIELDS_MAX)
+        {
+            return false;
+        }
+        args->field[args->u8count++] = field;
+        if (c == '}')
+        {
+            return true;
+        }
+        if (c != ',')
+        {
+            return false;
+        }
+        p = skip_space(p + 1, end);
+    }
+    return false;
+}
+
+const char *cmd_get_str(const cmd_args_t *args, const char *cKey)
+{
+    const cmd_field_t *field = find_field(args, cKey);
+    return ((field != NULL) && (field->u8type == CMD_VAL_STRING)) ? field->cValue : NULL;
+}
+
+bool cmd_get_int(const cmd_args_t *args, const char *cKey, int32_t *pi32value)
+{
+    const cmd_field_t *field = find_field(args, cKey);
+    char *end;
+    if ((field == NULL) || ((field->u8type != CMD_VAL_NUMBER) && (field->u8type != CMD_VAL_STRING)))
+    {
+        return false;
+    }
+    long value = strtol(field->cValue, &end, 10);
+    if ((end == field->cValue) || (*end != '\0'))
+    {
+        return false;
+    }
+    *pi32value = (int32_t)value;
+    return true;
+}
+
+bool cmd_get_float(const cmd_args_t *args, const char *cKey, float *pfValue)
+{
+    const cmd_field_t *field = find_field(args, cKey);
+    if ((field == NULL) || (field->u8type != CMD_VAL_NUMBER))
+    {
+        return false;
+    }
+    float fValue = strtof(field->cValue, NULL);
+    if (!isfinite(fValue))
+    {
+        return false;
+    }
+    *pfValue = fValue;
+    return true;
+}
+
+bool cmd_get_bool(const cmd_args_t *args, const char *cKey, bool *pbValue)
+{
+    const cmd_field_t *field = find_field(args, cKey);
+    if ((field == NULL) || (field->u8type != CMD_VAL_BOOL))
+    {
+        return false;
+    }
+    *pbValue = (field->cValue[0] == 't');
+    return true;
+}
+
+void cmd_init(void)
+{
+    free_queue = xQueueCreate(CMD_POOL_SIZE, sizeof(cmd_msg_t *));
+    ready_queue = xQueueCreate(CMD_POOL_SIZE, sizeof(cmd_msg_t *));
+    for (uint8_t i = 0; i < CMD_POOL_SIZE; i++)
+    {
+        cmd_msg_t *msg = &pool[i];
+        xQueueSend(free_queue, &msg, 0);
+    }
+}
+
+void cmd_receive(const char *pcData, int len, int offset, int total)
+{
+    if (offset == 0)
+    {
+        if (assembling != NULL)
+        {
+            xQueueSend(free_queue, &assembling, 0); // The previous message never completed
+            assembling = NULL;
+        }
+        if ((total > CMD_MSG_MAX) || (xQueueReceive(free_queue, &assembling, 0) != pdTRUE))
+        {
+            ESP_LOGW(TAG, "Command of %d bytes dropped (%s)", total, (total > CMD_MSG_MAX) ? "too long" : "pool empty");
+            return;
+        }
+    }
+    if ((assembling == NULL) || (len < 0) || (offset + len > total))
+    {
+        return;
+    }
+
+    memcpy(&assembling->cData[offset], pcData, len);
+    if (offset + len == total)
+    {
+        assembling->len = total;
+        assembling->cData[total] = '\0';
+        xQueueSend(ready_queue, &assembling, 0); // Cannot be full, it holds as many entries as the pool
+        assembling = NULL;
+    }
+}
+
+/****************************************************************************/
+/***        Task                                                          ***/
+/****************************************************************************/
+
+void cmd_task(void *pvParameters)
+{
+    cmd_msg_t *msg;
+
+    pub_ota_status("Check_ota");
+    for (;;)
+    {
+        if (xQueueReceive(ready_queue, &msg, pdMS_TO_TICKS(CMD_LISTEN_MS)) != pdTRUE)
+        {
+            ESP_LOGI(TAG, "No command for %d ms, restarting", CMD_LISTEN_MS);
+            esp_restart();
+        }
+        cmd_dispatch(msg);
+        xQueueSend(free_queue, &msg, 0);
+    }
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,121 @@
+/*****************************************************************************
+ *
+ * @file 	bee_cmd.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	command router for messages received on the command topic,
+ *          fixed message pool and in-place JSON tokenizer, no heap use
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef BEE_CMD_H
+#define BEE_CMD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define CMD_POOL_SIZE       2       /* Messages between the MQTT task and cmd_task */
+#define CMD_MSG_MAX         512     /* Longer commands are dropped */
+#define CMD_FIELDS_MAX      16      /* Top level members of a command */
+#define CMD_LISTEN_MS       15000   /* cmd_task restarts the chip after this long without a command */
+#define CMD_HISTORY_MAX     2048    /* Samples one Bee.history request returns at most */
+
+typedef enum
+{
+    CMD_VAL_STRING = 0,     /* Unescaped in place, NUL terminated */
+    CMD_VAL_NUMBER,         /* NUL terminated text */
+    CMD_VAL_BOOL,           /* "true" or "false" */
+    CMD_VAL_NULL,
+    CMD_VAL_RAW,            /* Nested object or array, points at the bracket and is NOT terminated */
+} cmd_val_type_t;
+
+typedef struct
+{
+    const char *cKey;
+    const char *cValue;
+    uint8_t    u8type;      /* cmd_val_type_t */
+} cmd_field_t;
+
+typedef struct
+{
+    cmd_field_t field[CMD_FIELDS_MAX];
+    uint8_t     u8count;
+} cmd_args_t;
+
+/**
+ * @brief Split a flat JSON object into its top level members, in place.
+ *
+ * Keys and string values are unescaped inside pcJson and terminated there, scalars are terminated
+ * by overwriting their delimiter. No DOM is built: the fields point into pcJson, which must outlive them.
+ * Nested objects and arrays are skipped and reported as CMD_VAL_RAW.
+ *
+ * @param pcJson Message text, modified.
+ * @param len    Length of the text.
+ * @param args   Filled with up to CMD_FIELDS_MAX members.
+ * @return false if the text is not a JSON object, has too many members or a bare value that is not true,
+ *         false, null or a JSON number within float range (nan, inf and hex are not).
+ */
+bool cmd_tokenize(char *pcJson, size_t len, cmd_args_t *args);
+
+/**
+ * @brief Get a string member, NULL if missing or not a string.
+ */
+const char *cmd_get_str(const cmd_args_t *args, const char *cKey);
+
+/**
+ * @brief Get an integer member, given as a number or as a string of digits.
+ *
+ * @return false if missing or not an integer, *pi32value is left alone then.
+ */
+bool cmd_get_int(const cmd_args_t *args, const char *cKey, int32_t *pi32value);
+
+/**
+ * @brief Get a number member.
+ *
+ * @return false if missing, not a number or not finite, *pfValue is left alone then.
+ */
+bool cmd_get_float(const cmd_args_t *args, const char *cKey, float *pfValue);
+
+/**
+ * @brief Get a true/false member.
+ *
+ * @return false if missing or not a boolean, *pbValue is left alone then.
+ */
+bool cmd_get_bool(const cmd_args_t *args, const char *cKey, bool *pbValue);
+
+/**
+ * @brief Create the message pool. Called by mqtt_func_init().
+ */
+void cmd_init(void);
+
+/**
+ * @brief Collect a command from MQTT_EVENT_DATA, never blocks.
+ *
+ * Fragments of a long message are assembled in a pool slot, which is handed to cmd_task by
+ * reference once complete. Messages are dropped when the pool is empty or they exceed CMD_MSG_MAX.
+ *
+ * @param pcData   Fragment.
+ * @param len      Fragment length.
+ * @param offset   Offset of the fragment in the message.
+ * @param total    Message length.
+ */
+void cmd_receive(const char *pcData, int len, int offset, int total);
+
+/**
+ * @brief Task running the received commands.
+ *
+ * Each command is checked against this device's thing_token and dispatched on its cmd_name:
+ * Bee.ota, Bee.interval, Bee.thresholds, Bee.heater, Bee.calibration, Bee.history, Bee.reboot. The result is
+ * published with the request's trans_code before any OTA or reboot starts. Bee.history publishes the samples
+ * first, so its result also marks the end of the stream.
+ */
+void cmd_task(void *pvParameters);
+
+#endif /* BEE_CMD_H */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
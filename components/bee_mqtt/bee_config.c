@@ -0,0 +1,196 @@
+/*****************************************************************************
+ *
+ * @file 	bee_config.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	versioned runtime configuration received on retained MQTT topics,
+ *          persisted in NVS and mirrored in RTC memory
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "bee_config.h"
+#include "bee_cmd.h"
+#include "bee_mqtt.h"
+#include "bee_nvs.h"
+#include "bee_deep_sleep.h"
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static RTC_DATA_ATTR bool bRestored = false;        /* Cleared by a cold boot only */
+static RTC_DATA_ATTR uint32_t u32version = 0;       /* Applied */
+static RTC_DATA_ATTR uint32_t u32rejected = 0;      /* Last one refused, not logged again on every redelivery */
+static RTC_DATA_ATTR bool bReported = true;
+
+static char cMsg[CMD_MSG_MAX + 1];                  /* MQTT task only */
+
+_Static_assert(sizeof(bee_config_t) <= NVS_APP_MAX, "bee_config_t does not fit in the NVS blob");
+
+static const char *TAG = "CONFIG";
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/* The settings in force, whatever set them */
+static void config_current(bee_config_t *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->u32version = u32version;
+    cfg->u16interval_s = deep_sleep_get_interval();
+    cfg->u8publish_every = deep_sleep_get_publish_every();
+    cfg->u8qos = (uint8_t)mqtt_get_telemetry_qos();
+    cfg->u8encoding = (uint8_t)mqtt_get_payload_encoding();
+    alarm_get_thresholds(&cfg->thresholds);
+}
+
+/* All or nothing: everything that can fail is checked before anything changes */
+static esp_err_t config_apply(const bee_config_t *cfg)
+{
+    if ((cfg->u16interval_s < DEEP_SLEEP_INTERVAL_MIN) || (cfg->u16interval_s > DEEP_SLEEP_INTERVAL_MAX) ||
+        (cfg->u8publish_every > DEEP_SLEEP_PUBLISH_MAX) || (cfg->u8qos > QoS_1) || (cfg->u8encoding > PAYLOAD_PACKED))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = alarm_set_thresholds(&cfg->thresholds);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    deep_sleep_set_interval(cfg->u16interval_s);
+    deep_sleep_set_publish_every(cfg->u8publish_every);
+    mqtt_set_telemetry_qos(cfg->u8qos);
+    mqtt_set_payload_encoding((payload_encoding_t)cfg->u8encoding);
+    return ESP_OK;
+}
+
+static bool get_u8(const cmd_args_t *args, const char *cKey, uint8_t *pu8value, bool *pbBad)
+{
+    int32_t i32value;
+    if (!cmd_get_int(args, cKey, &i32value))
+    {
+        return false;
+    }
+    *pbBad |= (i32value < 0) || (i32value > UINT8_MAX);
+    *pu8value = (uint8_t)i32value;
+    return true;
+}
+
+static void config_handle(char *pcJson, size_t len)
+{
+    cmd_args_t args;
+    int32_t i32version;
+    if (!cmd_tokenize(pcJson, len, &args) || !cmd_get_int(&args, "config_version", &i32version) || (i32version <= 0))
+    {
+        ESP_LOGW(TAG, "Malformed config dropped");
+        return;
+    }
+    /* The retained config comes again with every new subscription */
+    if (((uint32_t)i32version <= u32version) || ((uint32_t)i32version == u32rejected))
+    {
+        return;
+    }
+    const char *cToken = cmd_get_str(&args, "thing_token"); // Group configs have none
+    if ((cToken != NULL) && (strcmp(cToken, mqtt_get_thing_token()) != 0))
+    {
+        ESP_LOGW(TAG, "Config for another device dropped");
+        return;
+    }
+
+    bee_config_t cfg;
+    bool bBad = false;
+    int32_t i32interval;
+    config_current(&cfg);
+    cfg.u32version = (uint32_t)i32version;
+    if (cmd_get_int(&args, "interval", &i32interval))
+    {
+        bBad |= (i32interval < 0) || (i32interval > UINT16_MAX);
+        cfg.u16interval_s = (uint16_t)i32interval;
+    }
+    get_u8(&args, "publish_every", &cfg.u8publish_every, &bBad);
+    get_u8(&args, "qos", &cfg.u8qos, &bBad);
+    get_u8(&args, "encoding", &cfg.u8encoding, &bBad);
+    cmd_get_float(&args, "temp_high", &cfg.thresholds.fTemp_high);
+    cmd_get_float(&args, "temp_low", &cfg.thresholds.fTemp_low);
+    cmd_get_float(&args, "humi_high", &cfg.thresholds.fHumi_high);
+    cmd_get_float(&args, "humi_low", &cfg.thresholds.fHumi_low);
+    cmd_get_float(&args, "temp_hyst", &cfg.thresholds.fTemp_hyst);
+    cmd_get_float(&args, "humi_hyst", &cfg.thresholds.fHumi_hyst);
+
+    esp_err_t err = bBad ? ESP_ERR_INVALID_ARG : config_apply(&cfg);
+    if (err != ESP_OK)
+    {
+        u32rejected = cfg.u32version;
+        ESP_LOGW(TAG, "Config %lu rejected: %s", cfg.u32version, esp_err_to_name(err));
+        return;
+    }
+    save_config_to_nvs(&cfg, sizeof(cfg)); // The only NVS write, once per version
+    u32version = cfg.u32version;
+    bReported = false;
+    ESP_LOGI(TAG, "Config %lu applied", u32version);
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+void config_init(void)
+{
+    if (bRestored)
+    {
+        return;
+    }
+    bRestored = true;
+
+    bee_config_t cfg;
+    if (load_config_from_nvs(&cfg, sizeof(cfg)) && (cfg.u32version != 0))
+    {
+        if (config_apply(&cfg) == ESP_OK)
+        {
+            u32version = cfg.u32version;
+            ESP_LOGI(TAG, "Config %lu restored", u32version);
+        }
+    }
+}
+
+void config_receive(const char *pcData, int len, int offset, int total)
+{
+    /* An empty message clears the retained config, the settings in force stay */
+    if ((total <= 0) || (total > CMD_MSG_MAX) || (offset < 0) || (offset + len > total))
+    {
+        return;
+    }
+    memcpy(&cMsg[offset], pcData, len);
+    if (offset + len == total)
+    {
+        cMsg[total] = '\0';
+        config_handle(cMsg, (size_t)total);
+    }
+}
+
+uint32_t config_get_version(void)
+{
+    return u32version;
+}
+
+bool config_is_reported(void)
+{
+    return bReported;
+}
+
+void config_reported(void)
+{
+    bReported = true;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
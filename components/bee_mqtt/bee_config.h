@@ -0,0 +1,76 @@
+/*****************************************************************************
+ *
+ * @file 	bee_config.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	versioned runtime configuration received on retained MQTT topics,
+ *          persisted in NVS and mirrored in RTC memory
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef BEE_CONFIG_H
+#define BEE_CONFIG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#include "bee_alarm.h"
+
+#define BEE_CONFIG_GROUP    "default"   /* Group of .../SMH/group/<group>/config this firmware listens to */
+
+typedef struct
+{
+    uint32_t u32version;                /* 0: compiled defaults, nothing received yet */
+    uint16_t u16interval_s;             /* deep_sleep_set_interval() */
+    uint8_t  u8publish_every;           /* deep_sleep_set_publish_every() */
+    uint8_t  u8qos;                     /* mqtt_set_telemetry_qos() */
+    uint8_t  u8encoding;                /* mqtt_set_payload_encoding() */
+    uint8_t  u8reserved[3];
+    alarm_thresholds_t thresholds;      /* alarm_set_thresholds() */
+} bee_config_t;
+
+/**
+ * @brief Restore the applied configuration.
+ *
+ * Every setting already lives in RTC memory, so after a deep sleep wake this does nothing. After a cold
+ * boot the configuration last applied is read back from NVS and applied again.
+ */
+void config_init(void);
+
+/**
+ * @brief Collect a configuration message from MQTT_EVENT_DATA, runs in the MQTT task.
+ *
+ * The message is a flat JSON object with a config_version and any of: interval, publish_every, qos,
+ * encoding, temp_high, temp_low, humi_high, humi_low, temp_hyst, humi_hyst. Settings it leaves out keep
+ * their current value. It is applied only if its version is above the applied one, and only as a whole:
+ * one invalid setting rejects it. An applied configuration is written to NVS once.
+ *
+ * @param pcData   Fragment.
+ * @param len      Fragment length.
+ * @param offset   Offset of the fragment in the message.
+ * @param total    Message length, at most CMD_MSG_MAX.
+ */
+void config_receive(const char *pcData, int len, int offset, int total);
+
+/**
+ * @brief Version of the applied configuration, 0 if none was received.
+ */
+uint32_t config_get_version(void);
+
+/**
+ * @brief Whether the applied version still has to be acknowledged in a telemetry message.
+ */
+bool config_is_reported(void);
+
+/**
+ * @brief Called once a telemetry message carrying config_get_version() was acknowledged.
+ */
+void config_reported(void);
+
+#endif /* BEE_CONFIG_H */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,196 @@
+/*****************************************************************************
+ *
+ * @file 	bee_manifest.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	firmware manifest received on retained MQTT topics, the update
+ *          it announces is downloaded in the following upload wakes
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_app_desc.h"
+
+#include "bee_manifest.h"
+#include "bee_cmd.h"
+#include "bee_mqtt.h"
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static RTC_DATA_ATTR bee_manifest_t manifest;                   /* Announced, no version: nothing announced */
+static RTC_DATA_ATTR char cScheduled[MANIFEST_VERSION_MAX];     /* Handed to bee_ota */
+static RTC_DATA_ATTR char cFailed[MANIFEST_VERSION_MAX];        /* Its update failed, not tried again */
+static RTC_DATA_ATTR uint8_t u8compared[32];                    /* Manifest hash last compared with the running image */
+static RTC_DATA_ATTR bool bCompared = false;
+static RTC_DATA_ATTR bool bRunning = false;                     /* and whether it is that image */
+
+static char cMsg[MANIFEST_MSG_MAX + 1];                         /* MQTT task only */
+
+static const char *TAG = "MANIFEST";
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static int hex_digit(char c)
+{
+    if ((c >= '0') && (c <= '9'))
+    {
+        return c - '0';
+    }
+    c |= 0x20;
+    return ((c >= 'a') && (c <= 'f')) ? c - 'a' + 10 : -1;
+}
+
+static bool parse_sha256(const char *cHex, uint8_t *pu8Sha256)
+{
+    if ((cHex == NULL) || (strlen(cHex) != 64))
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < 32; i++)
+    {
+        int hi = hex_digit(cHex[2 * i]);
+        int lo = hex_digit(cHex[2 * i + 1]);
+        if ((hi < 0) || (lo < 0))
+        {
+            return false;
+        }
+        pu8Sha256[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return true;
+}
+
+static void manifest_handle(bool bGroup, char *pcJson, size_t len)
+{
+    cmd_args_t args;
+    bee_manifest_t next = {.bDevice = !bGroup};
+    const char *cVersion = NULL;
+    const char *cUrl = NULL;
+    int32_t i32size;
+
+    if (cmd_tokenize(pcJson, len, &args))
+    {
+        cVersion = cmd_get_str(&args, "version");
+        cUrl = cmd_get_str(&args, "url");
+    }
+    if ((cVersion == NULL) || (cVersion[0] == '\0') || (strlen(cVersion) >= sizeof(next.cVersion)) ||
+        (cUrl == NULL) || (cUrl[0] == '\0') || (strlen(cUrl) >= sizeof(next.cUrl)) ||
+        !parse_sha256(cmd_get_str(&args, "sha256"), next.u8sha256) ||
+        !cmd_get_int(&args, "size", &i32size) || (i32size <= 0))
+    {
+        ESP_LOGW(TAG, "Malformed manifest dropped");
+        return;
+    }
+    const char *cToken = cmd_get_str(&args, "thing_token"); // Group manifests have none
+    if ((cToken != NULL) && (strcmp(cToken, mqtt_get_thing_token()) != 0))
+    {
+        ESP_LOGW(TAG, "Manifest for another device dropped");
+        return;
+    }
+    if (bGroup && manifest.bDevice && (manifest.cVersion[0] != '\0'))
+    {
+        return; // The device topic has the last word
+    }
+
+    if (strcmp(cVersion, esp_app_get_description()->version) == 0)
+    {
+        memset(&manifest, 0, sizeof(manifest)); // Up to date
+        return;
+    }
+    strcpy(next.cVersion, cVersion);
+    strcpy(next.cUrl, cUrl);
+    next.u32size = (uint32_t)i32size;
+    if (memcmp(&next, &manifest, sizeof(next)) != 0)
+    {
+        manifest = next;
+        ESP_LOGI(TAG, "%s announced on the %s topic", manifest.cVersion, bGroup ? "group" : "device");
+    }
+}
+
+/* An update that succeeded under the version it replaced: the version string alone would ask for it again */
+static bool manifest_running(void)
+{
+    if (!bCompared || (memcmp(u8compared, manifest.u8sha256, sizeof(u8compared)) != 0))
+    {
+        memcpy(u8compared, manifest.u8sha256, sizeof(u8compared));
+        bRunning = ota_image_running(manifest.u8sha256, manifest.u32size); // Hashed once per boot and manifest
+        bCompared = true;
+    }
+    return bRunning;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+void manifest_receive(bool bGroup, const char *pcData, int len, int offset, int total)
+{
+    /* An empty message withdraws the retained manifest of its topic */
+    if ((total == 0) && (manifest.bDevice == !bGroup))
+    {
+        memset(&manifest, 0, sizeof(manifest));
+        return;
+    }
+    if ((total <= 0) || (total > MANIFEST_MSG_MAX) || (offset < 0) || (offset + len > total))
+    {
+        return;
+    }
+    memcpy(&cMsg[offset], pcData, len);
+    if (offset + len == total)
+    {
+        cMsg[total] = '\0';
+        manifest_handle(bGroup, cMsg, (size_t)total);
+    }
+}
+
+bool manifest_check(void)
+{
+    if ((manifest.cVersion[0] == '\0') || (strcmp(manifest.cVersion, cFailed) == 0))
+    {
+        return false;
+    }
+    if (strcmp(manifest.cVersion, cScheduled) == 0)
+    {
+        if (!ota_pending()) // Dropped by bee_ota, a success would have restarted into it
+        {
+            strcpy(cFailed, cScheduled);
+            ESP_LOGW(TAG, "Update to %s failed, waiting for another version", cFailed);
+        }
+        return false;
+    }
+    if (!manifest_power_ok())
+    {
+        ESP_LOGI(TAG, "Update to %s deferred, not enough power", manifest.cVersion);
+        return false;
+    }
+    if (manifest_running())
+    {
+        ESP_LOGW(TAG, "%s is the image running, its version is %s", manifest.cVersion,
+                 esp_app_get_description()->version);
+        return false;
+    }
+    if (ota_schedule(manifest.cUrl, manifest.u8sha256, manifest.u32size) != ESP_OK)
+    {
+        return false;
+    }
+    strcpy(cScheduled, manifest.cVersion);
+    ESP_LOGI(TAG, "Updating from %s to %s", esp_app_get_description()->version, manifest.cVersion);
+    return true;
+}
+
+__attribute__((weak)) bool manifest_power_ok(void)
+{
+    return true;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,69 @@
+/*****************************************************************************
+ *
+ * @file 	bee_manifest.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	firmware manifest received on retained MQTT topics, the update
+ *          it announces is downloaded in the following upload wakes
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef BEE_MANIFEST_H
+#define BEE_MANIFEST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bee_ota.h"
+
+#define MANIFEST_VERSION_MAX    32      /* Longest version string, as esp_app_desc_t */
+#define MANIFEST_MSG_MAX        512
+
+typedef struct
+{
+    char     cVersion[MANIFEST_VERSION_MAX];
+    char     cUrl[OTA_URL_MAX];
+    uint8_t  u8sha256[32];              /* Of the image the download makes, whatever its format */
+    uint32_t u32size;                   /* Of that image */
+    bool     bDevice;                   /* From the device topic, a group manifest does not replace it */
+} bee_manifest_t;
+
+/**
+ * @brief Collect a manifest message from MQTT_EVENT_DATA, runs in the MQTT task.
+ *
+ * The message is a flat JSON object: version, url, sha256 (64 hex digits) and size, and a thing_token on
+ * the device topic. A manifest whose version is the app version (PROJECT_VER) announces nothing. An empty retained
+ * message withdraws the manifest of its topic; an update already started goes on.
+ *
+ * @param bGroup   From the group topic.
+ * @param pcData   Fragment.
+ * @param len      Fragment length.
+ * @param offset   Offset of the fragment in the message.
+ * @param total    Message length, at most MANIFEST_MSG_MAX.
+ */
+void manifest_receive(bool bGroup, const char *pcData, int len, int offset, int total);
+
+/**
+ * @brief Queue the announced update for ota_resume(), in an upload wake once the telemetry is out.
+ *
+ * Nothing happens unless a manifest announced another version and manifest_power_ok() agrees. An image
+ * that is the running one is not downloaded whatever its version, nor is a version whose update failed
+ * until the next cold boot or another version.
+ *
+ * @return true if an update was queued now.
+ */
+bool manifest_check(void);
+
+/**
+ * @brief Whether the supply allows an update now, true unless the board overrides it.
+ *
+ * Weak: a board with a battery gauge defines its own, e.g. false under a voltage threshold.
+ */
+bool manifest_power_ok(void);
+
+#endif /* BEE_MANIFEST_H */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -10,29 +10,91 @@
 /***        Include files                                                 ***/
 /****************************************************************************/
 
+#include <string.h>
+#include <stdlib.h>
 #include "mqtt_client.h"
+#if CONFIG_MQTT_PROTOCOL_5
+#include "mqtt5_client.h"
+#endif
 #include "esp_wifi.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "cJSON.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
 
 #include "bee_mqtt.h"
 #include "bee_ota.h"
+#include "bee_wifi.h"
+#include "bee_payload.h"
+#include "bee_outbox.h"
+#include "bee_tls.h"
+#include "bee_cmd.h"
+#include "bee_config.h"
+#include "bee_manifest.h"
+#include "bee_deep_sleep.h"
+
+#if MQTT_PAYLOAD_BENCHMARK
+#include "cJSON.h"
+#include "esp_cpu.h"
+#include "esp_system.h"
+#endif
+
+#define MQTT_PUBLISHED_EVENT        BIT0
+#define MQTT_DISCONNECTED_EVENT     BIT1
+#define MQTT_CONNECTED_EVENT        BIT2
+
+#define MQTT_MSG_ID_SKIP            (-2)    /* Outbox window slot that needs no PUBACK */
 
 extern bool bButton_task;
+
+static void publish_presence(void);
 /****************************************************************************/
 /***        Local Variables                                               ***/
 /****************************************************************************/
-static bool bMQTT_connected = false;
+#if CONFIG_MQTT_PROTOCOL_5
+static uint8_t u8alias_sent = 0;                            /* Bit n: alias n is known to the broker in this session */
+static bool bAlias_off = false;                             /* The broker refused our aliases */
+#endif
+static int64_t i64start_us = 0;                            /* esp_mqtt_client_start() */
+static mqtt_profile_t profile;
 static RTC_DATA_ATTR uint8_t u8trans_code = 0;
+static RTC_DATA_ATTR uint16_t u16seq = 0;                   /* Sequence number of the binary encodings */
+static RTC_DATA_ATTR uint8_t u8encoding = MQTT_TELEMETRY_ENCODING;
+static RTC_DATA_ATTR uint8_t u8telemetry_qos = QoS_1;       /* QoS of batches */
+static RTC_DATA_ATTR bool bCmd_subscribed = false;          /* The session kept by the broker holds the command subscription */
+static RTC_DATA_ATTR bool bCfg_subscribed = false;          /* ... and the config and manifest subscriptions */
+static RTC_DATA_ATTR uint32_t u32presence_crc = 0;          /* CRC of the retained presence message the broker acknowledged */
+static RTC_DATA_ATTR bool bClean_disconnect = false;        /* The last connection ended with our DISCONNECT, the will did not fire */
+static RTC_DATA_ATTR uint32_t u32telemetry_dropped = 0;     /* Neither published nor taken by the outbox since the cold boot */
 
 static char cMac_str[13];
 static char cTopic_pub[64] = "VB/DMP/VBEEON/CUSTOM/SMH/DeviceID/telemetry";
+static char cTopic_telemetry[72];                           /* cTopic_pub plus the suffix of the encoding */
 static char cTopic_sub[64] = "VB/DMP/VBEEON/CUSTOM/SMH/DeviceID/Command";
-static char rxBuffer_MQTT[800];
-static QueueHandle_t mqtt_cmd_queue;
+static char cTopic_presence[64];
+static char cTopic_config[64];                              /* Retained, this device */
+static char cTopic_group_config[64];                        /* Retained, every device of BEE_CONFIG_GROUP */
+static char cTopic_ota[64];                                 /* Retained firmware manifests, this device */
+static char cTopic_group_ota[64];                           /* ... and every device of BEE_CONFIG_GROUP */
+static int cmd_sub_msg_id = -1;
+static int cfg_sub_msg_id = -1;                             /* The last of the config and manifest subscriptions */
+static bool bData_config = false;                           /* The message being received is a config */
+static bool bData_manifest = false;                         /* ... or a manifest */
+static bool bData_group = false;                            /* ... for the group */
+static char cPresence[MQTT_PRESENCE_MAX];                   /* Birth message, only touched by the MQTT task */
+static char cWill[MQTT_PRESENCE_MAX];
+static uint32_t u32presence_pending = 0;                    /* CRC of the birth message in flight */
+static int presence_msg_id = -1;
+static char cPayload[MQTT_PAYLOAD_MAX];         /* Shared output buffer of the payload writer */
+static StaticSemaphore_t payload_mutex_buf;
+static SemaphoreHandle_t payload_mutex = NULL;
+static EventGroupHandle_t mqtt_event_group;
+static volatile int acked_msg_id[MQTT_ACK_RING];            /* Last QoS1 ids acknowledged by the broker */
+static volatile uint8_t u8acked_head = 0;
 
 static const char *TAG_MQTT = "MQTT";
 
@@ -51,23 +113,56 @@ void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event
     {
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(TAG_MQTT, "MQTT_EVENT_CONNECTED");
-            bMQTT_connected = true;
-            
-            if (bButton_task)
+            if (profile.u32connect_ms == 0)
+            {
+                profile.u32connect_ms = (uint32_t)((esp_timer_get_time() - i64start_us) / 1000);
+            }
+#if CONFIG_MQTT_PROTOCOL_5
+            u8alias_sent = 0; /* Topic aliases only live as long as the network connection */
+#endif
+            /* Before waking the publishers, nobody else touches the publish properties yet */
+            publish_presence();
+            xEventGroupClearBits(mqtt_event_group, MQTT_DISCONNECTED_EVENT);
+            xEventGroupSetBits(mqtt_event_group, MQTT_CONNECTED_EVENT); // Wakes any publisher waiting for CONNACK
+
+            /* A resumed session still holds the subscriptions made in it */
+            if (!event->session_present)
+            {
+                bCmd_subscribed = false;
+                bCfg_subscribed = false;
+            }
+            if (!bCfg_subscribed)
+            {
+                /* QoS1, so a kept session also queues config changes and releases published while we sleep */
+                esp_mqtt_client_subscribe(client, cTopic_config, QoS_1);
+                esp_mqtt_client_subscribe(client, cTopic_ota, QoS_1);
+                esp_mqtt_client_subscribe(client, cTopic_group_ota, QoS_1);
+                cfg_sub_msg_id = esp_mqtt_client_subscribe(client, cTopic_group_config, QoS_1);
+            }
+            if (bButton_task && !bCmd_subscribed)
             {
                 snprintf(cTopic_sub, sizeof(cTopic_sub),"VB/DMP/VBEEON/CUSTOM/SMH/%s/Command", cMac_str);
-                esp_mqtt_client_subscribe(client, cTopic_sub, 0);
+                cmd_sub_msg_id = esp_mqtt_client_subscribe(client, cTopic_sub, 0);
                 ESP_LOGI(TAG_MQTT, "Topic subscribe: %s\n", cTopic_sub);
             }
             break;
 
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(TAG_MQTT, "MQTT_EVENT_DISCONNECTED");
-            bMQTT_connected = false;
+            xEventGroupClearBits(mqtt_event_group, MQTT_CONNECTED_EVENT);
+            xEventGroupSetBits(mqtt_event_group, MQTT_DISCONNECTED_EVENT);
             break;
 
         case MQTT_EVENT_SUBSCRIBED:
             ESP_LOGI(TAG_MQTT, "MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
+            if (event->msg_id == cmd_sub_msg_id)
+            {
+                bCmd_subscribed = true;
+            }
+            else if (event->msg_id == cfg_sub_msg_id)
+            {
+                bCfg_subscribed = true;
+            }
             break;
 
         case MQTT_EVENT_UNSUBSCRIBED:
@@ -76,14 +171,42 @@ void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event
 
         case MQTT_EVENT_PUBLISHED:
             ESP_LOGI(TAG_MQTT, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+            if (event->msg_id == presence_msg_id)
+            {
+                u32presence_crc = u32presence_pending; /* Retained by the broker from now on */
+                presence_msg_id = -1;
+            }
+            acked_msg_id[u8acked_head] = event->msg_id;
+            u8acked_head = (u8acked_head + 1) % MQTT_ACK_RING;
+            xEventGroupSetBits(mqtt_event_group, MQTT_PUBLISHED_EVENT);
             break;
 
         case MQTT_EVENT_DATA:
             if ((event->data) != NULL)
             {
                 ESP_LOGI(TAG_MQTT, "MQTT_EVENT_DATA");
-                snprintf(rxBuffer_MQTT, event->data_len + 1, event->data);
-                xQueueSend(mqtt_cmd_queue, &rxBuffer_MQTT, portMAX_DELAY);
+                if (event->current_data_offset == 0) /* Only the first fragment carries the topic */
+                {
+                    bData_config = (event->topic_len > 7) &&
+                                   (memcmp(event->topic + event->topic_len - 7, "/config", 7) == 0);
+                    bData_manifest = (event->topic_len > 4) &&
+                                     (memcmp(event->topic + event->topic_len - 4, "/ota", 4) == 0);
+                    bData_group = ((size_t)event->topic_len == strlen(cTopic_group_ota)) &&
+                                  (memcmp(event->topic, cTopic_group_ota, event->topic_len) == 0);
+                }
+                if (bData_config)
+                {
+                    config_receive(event->data, event->data_len, event->current_data_offset, event->total_data_len);
+                }
+                else if (bData_manifest)
+                {
+                    manifest_receive(bData_group, event->data, event->data_len, event->current_data_offset,
+                                     event->total_data_len);
+                }
+                else
+                {
+                    cmd_receive(event->data, event->data_len, event->current_data_offset, event->total_data_len);
+                }
             }
 
             break;
@@ -98,16 +221,151 @@ void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event
     }
 }
 
-static void wait_MQTT_connect(uint16_t wait_max_ms)
+static void set_telemetry_topic(void)
+{
+    static const char *cSuffix[] = {"", "/cbor", "/bin"};
+    snprintf(cTopic_telemetry, sizeof(cTopic_telemetry), "%s%s", cTopic_pub, cSuffix[u8encoding]);
+}
+
+static bool mqtt_connected(void)
+{
+    return (xEventGroupGetBits(mqtt_event_group) & MQTT_CONNECTED_EVENT) != 0;
+}
+
+#if CONFIG_MQTT_PROTOCOL_5
+static const char *content_type_of(const char *cTopic)
+{
+    size_t len = strlen(cTopic);
+    if ((len > 5) && (strcmp(&cTopic[len - 5], "/cbor") == 0))
+    {
+        return "application/cbor";
+    }
+    if ((len > 4) && (strcmp(&cTopic[len - 4], "/bin") == 0))
+    {
+        return "application/octet-stream";
+    }
+    return "application/json";
+}
+
+/* Our two fixed topics get aliases, the full topic only goes out once per connection */
+static uint8_t alias_of(const char *cTopic)
+{
+    if (bAlias_off)
+    {
+        return 0;
+    }
+    if (strcmp(cTopic, cTopic_telemetry) == 0)
+    {
+        return MQTT5_ALIAS_TELEMETRY;
+    }
+    if (strcmp(cTopic, cTopic_pub) == 0)
+    {
+        return MQTT5_ALIAS_STATUS;
+    }
+    return 0;
+}
+#endif
+
+/* Single place where messages hit the client, adds the MQTT 5 publish properties */
+static int client_publish(const char *cTopic, const void *data, size_t len, int qos, int retain)
 {
-    TickType_t start_time = xTaskGetTickCount();
-    TickType_t wait_duration = 0;
+#if CONFIG_MQTT_PROTOCOL_5
+    esp_mqtt5_publish_property_config_t property = {0};
+    const char *cWire_topic = cTopic;
+    uint8_t u8alias = alias_of(cTopic);
+
+    property.topic_alias = u8alias;
+    if ((u8alias != 0) && (u8alias_sent & BIT(u8alias)))
+    {
+        cWire_topic = ""; /* Alias only, 2 bytes instead of the 45 byte topic */
+    }
+#if MQTT5_CONTENT_TYPE
+    property.content_type = content_type_of(cTopic);
+    property.payload_format_indicator = (strcmp(property.content_type, "application/json") == 0);
+#endif
+    esp_mqtt5_client_set_publish_property(client, &property); // Consumed by the next publish
+    int msg_id = esp_mqtt_client_publish(client, cWire_topic, data, len, qos, retain);
 
-    while (!bMQTT_connected && (wait_duration <= wait_max_ms))
+    if ((msg_id < 0) && (u8alias != 0) && mqtt_connected())
     {
-        wait_duration = xTaskGetTickCount() - start_time;
-        vTaskDelay(pdMS_TO_TICKS(20));
+        /* The broker's Topic Alias Maximum is too small, go on with full topics */
+        ESP_LOGW(TAG_MQTT, "Topic alias %u refused, aliases disabled", u8alias);
+        bAlias_off = true;
+        return client_publish(cTopic, data, len, qos, retain);
     }
+    if ((msg_id >= 0) && (u8alias != 0))
+    {
+        u8alias_sent |= BIT(u8alias);
+    }
+    return msg_id;
+#else
+    return esp_mqtt_client_publish(client, cTopic, data, len, qos, retain);
+#endif
+}
+
+/* Presence JSON of this device, "ONLINE" with what the backend needs to expect the next wake */
+static size_t write_presence(char *pcBuf, size_t size, bool bOnline)
+{
+    json_writer_t w;
+    json_writer_init(&w, pcBuf, size);
+    json_obj_begin(&w, NULL);
+    json_add_str(&w, "thing_token", cMac_str);
+    json_add_str(&w, "status", bOnline ? "ONLINE" : "OFFLINE");
+    if (bOnline)
+    {
+        json_add_str(&w, "fw_version", VERSION);
+        json_add_int(&w, "interval", deep_sleep_get_interval());
+        if (config_get_version() != 0)
+        {
+            json_add_int(&w, "config_version", (int32_t)config_get_version());
+        }
+    }
+    json_obj_end(&w);
+    return json_writer_finish(&w);
+}
+
+/* Retained birth message, sent again only when its content changed or the will may have replaced it */
+static void publish_presence(void)
+{
+    size_t len = write_presence(cPresence, sizeof(cPresence), true);
+    uint32_t u32crc = esp_rom_crc32_le(0, (const uint8_t *)cPresence, len);
+    bool bStale = !bClean_disconnect || (u32crc != u32presence_crc);
+
+    bClean_disconnect = false; /* Until this connection ends with a DISCONNECT */
+    if (!bStale || (len == 0))
+    {
+        return;
+    }
+    u32presence_pending = u32crc;
+    presence_msg_id = client_publish(cTopic_presence, cPresence, len, QoS_1, 1);
+    ESP_LOGI(TAG_MQTT, "Presence published, msg_id=%d", presence_msg_id);
+}
+
+/* Block until CONNACK or the deadline, whichever comes first */
+static bool wait_MQTT_connect(uint16_t wait_max_ms)
+{
+    EventBits_t bits = xEventGroupWaitBits(mqtt_event_group, MQTT_CONNECTED_EVENT, pdFALSE, pdFALSE,
+                                           pdMS_TO_TICKS(wait_max_ms));
+    return (bits & MQTT_CONNECTED_EVENT) != 0;
+}
+
+static bool msg_id_acked(int msg_id)
+{
+    for (uint8_t i = 0; i < MQTT_ACK_RING; i++)
+    {
+        if (acked_msg_id[i] == msg_id)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Milliseconds left until the deadline, 0 once it has passed */
+static uint16_t ms_left(TickType_t deadline)
+{
+    TickType_t now = xTaskGetTickCount();
+    return ((int32_t)(deadline - now) > 0) ? (uint16_t)((deadline - now) * portTICK_PERIOD_MS) : 0;
 }
 /****************************************************************************/
 /***        Exported Functions                                            ***/
@@ -115,7 +373,73 @@ static void wait_MQTT_connect(uint16_t wait_max_ms)
 
 void mqtt_disconnect()
 {
-    esp_mqtt_client_disconnect(client);
+    if (mqtt_connected())
+    {
+        /* The DISCONNECT is sent by the MQTT task, wait for it before the radio goes down */
+        xEventGroupClearBits(mqtt_event_group, MQTT_DISCONNECTED_EVENT);
+        esp_mqtt_client_disconnect(client);
+        EventBits_t bits = xEventGroupWaitBits(mqtt_event_group, MQTT_DISCONNECTED_EVENT, pdTRUE, pdFALSE,
+                                               pdMS_TO_TICKS(MQTT_DISCONNECT_TIMEOUT_MS));
+        bClean_disconnect = (bits & MQTT_DISCONNECTED_EVENT) != 0; /* The broker dropped the will, the birth message stands */
+    }
+    else
+    {
+        esp_mqtt_client_disconnect(client);
+    }
+}
+
+void mqtt_get_profile(mqtt_profile_t *out)
+{
+    *out = profile;
+}
+
+const char *mqtt_get_thing_token(void)
+{
+    return cMac_str;
+}
+
+mqtt_pub_result_t mqtt_publish(const char *cTopic, const void *data, size_t len, int qos, uint16_t u16timeout_ms)
+{
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(u16timeout_ms);
+
+    /* With CONFIG_MQTT_SKIP_PUBLISH_IF_DISCONNECTED a publish before CONNACK is dropped, so wait for it */
+    if (!wait_MQTT_connect(u16timeout_ms))
+    {
+        ESP_LOGW(TAG_MQTT, "Not connected, %s not sent", cTopic);
+        return MQTT_PUB_NOT_CONNECTED;
+    }
+
+    /* QoS0 returns once the packet is written to the socket, QoS1 once it is queued in the outbox */
+    int msg_id = client_publish(cTopic, data, len, qos, 0);
+    if (msg_id < 0)
+    {
+        return mqtt_connected() ? MQTT_PUB_ERROR : MQTT_PUB_NOT_CONNECTED;
+    }
+    if (profile.u32connack_to_pub_ms == 0)
+    {
+        profile.u32connack_to_pub_ms = (uint32_t)((esp_timer_get_time() - i64start_us) / 1000) - profile.u32connect_ms;
+    }
+    if (qos == QoS_0)
+    {
+        return MQTT_PUB_OK;
+    }
+
+    /* Clear before checking so an ack landing in between still wakes the wait */
+    for (;;)
+    {
+        xEventGroupClearBits(mqtt_event_group, MQTT_PUBLISHED_EVENT);
+        if (msg_id_acked(msg_id))
+        {
+            return MQTT_PUB_OK;
+        }
+        uint16_t u16left = ms_left(deadline);
+        if (u16left == 0)
+        {
+            ESP_LOGW(TAG_MQTT, "msg_id=%d not acknowledged in %u ms", msg_id, u16timeout_ms);
+            return MQTT_PUB_TIMEOUT;
+        }
+        xEventGroupWaitBits(mqtt_event_group, MQTT_PUBLISHED_EVENT, pdFALSE, pdFALSE, pdMS_TO_TICKS(u16left));
+    }
 }
 
 void mqtt_func_init(void)
@@ -124,132 +448,746 @@ void mqtt_func_init(void)
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri = BROKER_ADDRESS_URI,
         .credentials.username = USERNAME,
-        .credentials.authentication.password = PASSWORD
+        .credentials.authentication.password = PASSWORD,
+#if CONFIG_MQTT_PROTOCOL_5
+        .session.protocol_ver = MQTT_PROTOCOL_V_5,
+        .session.disable_clean_session = true, /* Resume the session kept for MQTT5_SESSION_EXPIRY_S */
+#endif
     };
-    client = esp_mqtt_client_init(&mqtt_cfg);
-    esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
-    esp_mqtt_client_start(client);
+    mqtt_event_group = xEventGroupCreate();
+    for (uint8_t i = 0; i < MQTT_ACK_RING; i++)
+    {
+        acked_msg_id[i] = -1;
+    }
 
     /* Get mac Address and set topic*/
     uint8_t u8mac[6];
     esp_wifi_get_mac(ESP_IF_WIFI_STA, u8mac);
     snprintf(cMac_str, sizeof(cMac_str), "%02X%02X%02X%02X%02X%02X", u8mac[0], u8mac[1], u8mac[2], u8mac[3], u8mac[4], u8mac[5]);
     snprintf(cTopic_pub, sizeof(cTopic_pub), "VB/DMP/VBEEON/CUSTOM/SMH/%s/telemetry", cMac_str);
+    snprintf(cTopic_presence, sizeof(cTopic_presence), "VB/DMP/VBEEON/CUSTOM/SMH/%s/presence", cMac_str);
+    snprintf(cTopic_config, sizeof(cTopic_config), "VB/DMP/VBEEON/CUSTOM/SMH/%s/config", cMac_str);
+    snprintf(cTopic_group_config, sizeof(cTopic_group_config), "VB/DMP/VBEEON/CUSTOM/SMH/group/%s/config", BEE_CONFIG_GROUP);
+    snprintf(cTopic_ota, sizeof(cTopic_ota), "VB/DMP/VBEEON/CUSTOM/SMH/%s/ota", cMac_str);
+    snprintf(cTopic_group_ota, sizeof(cTopic_group_ota), "VB/DMP/VBEEON/CUSTOM/SMH/group/%s/ota", BEE_CONFIG_GROUP);
+
+    /* Published by the broker in place of the birth message if the connection dies without a DISCONNECT */
+    mqtt_cfg.session.last_will.topic = cTopic_presence;
+    mqtt_cfg.session.last_will.msg = cWill;
+    mqtt_cfg.session.last_will.msg_len = (int)write_presence(cWill, sizeof(cWill), false);
+    mqtt_cfg.session.last_will.qos = QoS_1;
+    mqtt_cfg.session.last_will.retain = 1;
+
+    set_telemetry_topic();
+
+    ESP_LOGI(TAG_MQTT, "Topic publish: %s\n", cTopic_telemetry);
+
+    cmd_init();
+    payload_mutex = xSemaphoreCreateMutexStatic(&payload_mutex_buf);
+
+    if ((outbox_init() == ESP_OK) && (outbox_count() > 0))
+    {
+        ESP_LOGI(TAG_MQTT, "%lu messages waiting in the outbox", outbox_count());
+    }
 
-    ESP_LOGI(TAG_MQTT, "Topic publish: %s\n", cTopic_pub);
+#if MQTT_TLS
+    mqtt_cfg.network.transport = tls_transport_init(); /* Resumes the TLS session of the previous wake */
+#endif
 
-    mqtt_cmd_queue = xQueueCreate(2, sizeof(cJSON*));
+    /* Start last, the event handler uses the topics and the queue */
+    client = esp_mqtt_client_init(&mqtt_cfg);
+#if CONFIG_MQTT_PROTOCOL_5
+    esp_mqtt5_connection_property_config_t connect_property = {
+        .session_expiry_interval = MQTT5_SESSION_EXPIRY_S,
+        .topic_alias_maximum = 0, /* We do not take aliases from the broker */
+    };
+    esp_mqtt5_client_set_connect_property(client, &connect_property);
+#endif
+    esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    i64start_us = esp_timer_get_time();
+    esp_mqtt_client_start(client);
 }
 
-void pub_data(float fTemp, float fHumi)
+/* Telemetry lost since the cold boot: evicted from a full outbox, or never in it */
+static uint32_t telemetry_lost(void)
 {
-    cJSON *json_data = cJSON_CreateObject(); // Create a JSON object for the data
-    cJSON_AddStringToObject(json_data, "thing_token", cMac_str);
-    cJSON_AddStringToObject(json_data, "cmd_name", "Bee.data");
-    cJSON *values = cJSON_AddObjectToObject(json_data, "values"); // Create a nested JSON object for the 'values' field
-    cJSON_AddNumberToObject(values, "temperature", fTemp);
-    cJSON_AddNumberToObject(values, "humidity", fHumi);
-    cJSON_AddNumberToObject(json_data, "trans_code", u8trans_code++);
-    
-    char *json_str = cJSON_Print(json_data); // Convert the JSON object to a string
-    wait_MQTT_connect(100);
-    esp_mqtt_client_publish(client, cTopic_pub, json_str, 0, QoS_0, 0); // Publish the JSON string via MQTT
-    cJSON_Delete(json_data);
-    free(json_str);
+    return outbox_evicted() + u32telemetry_dropped;
 }
 
-void pub_warning(uint8_t u8Values, float fTemp, float fHumi)
+static void add_wifi_diag(json_writer_t *w)
 {
-    cJSON *json_warnings = cJSON_CreateObject();// Create a JSON object for the warning
-    cJSON_AddStringToObject(json_warnings, "thing_token", cMac_str);
-    cJSON_AddStringToObject(json_warnings, "cmd_name", "Bee.data");
-    cJSON_AddStringToObject(json_warnings, "object_type", "Bee.warning");
-    cJSON *json_values = cJSON_AddObjectToObject(json_warnings, "values");
-    cJSON_AddNumberToObject(json_values, "warning_values", u8Values);
-    cJSON_AddNumberToObject(json_values, "temperature", fTemp);
-    cJSON_AddNumberToObject(json_values, "humidity", fHumi);
-    cJSON_AddNumberToObject(json_warnings, "trans_code", u8trans_code++);
+    wifi_diag_t diag;
+    wifi_link_t link;
+    wifi_get_diag(&diag);
+    wifi_get_link(&link);
 
-    char *json_str = cJSON_Print(json_warnings); // Convert the JSON object to a string
-    wait_MQTT_connect(200);
-    esp_mqtt_client_publish(client, cTopic_pub, json_str, 0, QoS_1, 0); // Publish the JSON string via MQTT
-    cJSON_Delete(json_warnings);
-    free(json_str);
+    json_obj_begin(w, "wifi"); // Connection diagnostics since the last upload
+    json_add_int(w, "rssi", diag.i8last_rssi);
+    json_add_int(w, "reason", diag.u8last_reason);
+    json_add_int(w, "disc", diag.u16disconnects);
+    json_add_int(w, "retry", diag.u16retries);
+    json_add_int(w, "auth_fail", diag.u16auth_fail);
+    json_add_int(w, "no_ap", diag.u16no_ap);
+    json_add_int(w, "timeout", diag.u16timeouts);
+    json_add_int(w, "fail", diag.u16failures);
+    json_add_int(w, "tx_pwr", link.i8tx_power);
+    json_add_int(w, "pub_ok", link.u16pub_ok);
+    json_add_int(w, "pub_total", link.u16pub_total);
+    json_add_int(w, "radio_ms", link.u16radio_cnt ? link.u32radio_ms_sum / link.u16radio_cnt : 0);
+    json_add_int(w, "lost", (int32_t)telemetry_lost());
+    json_arr_begin(w, "lat_hist");
+    for (uint8_t i = 0; i < WIFI_LATENCY_BUCKETS; i++)
+    {
+        json_add_int(w, NULL, diag.u16latency_hist[i]);
+    }
+    json_arr_end(w);
+    json_obj_end(w);
 }
 
-void pub_keep_alive(void)
+/* Same fields as the "wifi" JSON object, positional to keep the CBOR small, "lost" comes last */
+static void add_wifi_diag_cbor(cbor_writer_t *w)
 {
-    cJSON *json_keep_alive = cJSON_CreateObject();
-    cJSON_AddStringToObject(json_keep_alive, "thing_token", cMac_str);
-    cJSON *json_values = cJSON_AddObjectToObject(json_keep_alive, "values");
-    cJSON_AddStringToObject(json_values, "eventType", "refresh");
-    cJSON_AddStringToObject(json_values, "status", "ONLINE");
-    cJSON_AddNumberToObject(json_keep_alive, "trans_code", u8trans_code++);
+    wifi_diag_t diag;
+    wifi_link_t link;
+    wifi_get_diag(&diag);
+    wifi_get_link(&link);
 
-    char *json_str = cJSON_Print(json_keep_alive);
-    esp_mqtt_client_publish(client, cTopic_pub, json_str, 0, QoS_0, 0);
+    cbor_arr_begin(w, 14);
+    cbor_add_int(w, diag.i8last_rssi);
+    cbor_add_uint(w, diag.u8last_reason);
+    cbor_add_uint(w, diag.u16disconnects);
+    cbor_add_uint(w, diag.u16retries);
+    cbor_add_uint(w, diag.u16auth_fail);
+    cbor_add_uint(w, diag.u16no_ap);
+    cbor_add_uint(w, diag.u16timeouts);
+    cbor_add_uint(w, diag.u16failures);
+    cbor_add_int(w, link.i8tx_power);
+    cbor_add_uint(w, link.u16pub_ok);
+    cbor_add_uint(w, link.u16pub_total);
+    cbor_add_uint(w, link.u16radio_cnt ? link.u32radio_ms_sum / link.u16radio_cnt : 0);
+    cbor_arr_begin(w, WIFI_LATENCY_BUCKETS);
+    for (uint8_t i = 0; i < WIFI_LATENCY_BUCKETS; i++)
+    {
+        cbor_add_uint(w, diag.u16latency_hist[i]);
+    }
+    cbor_add_uint(w, telemetry_lost());
+}
 
-    cJSON_Delete(json_keep_alive);
-    free(json_str);
+static void cbor_add_reading(cbor_writer_t *w, uint8_t u8type, const payload_reading_t *reading,
+                             uint8_t u8warning, bool bDiag)
+{
+    cbor_map_begin(w, 6 + (u8type == PAYLOAD_TYPE_WARNING) + bDiag);
+    cbor_add_uint(w, CBOR_KEY_VERSION);
+    cbor_add_uint(w, PAYLOAD_SCHEMA_VERSION);
+    cbor_add_uint(w, CBOR_KEY_TYPE);
+    cbor_add_uint(w, u8type);
+    cbor_add_uint(w, CBOR_KEY_SEQ);
+    cbor_add_uint(w, u16seq);
+    cbor_add_uint(w, CBOR_KEY_TIMESTAMP);
+    cbor_add_uint(w, reading->u32timestamp);
+    cbor_add_uint(w, CBOR_KEY_TEMP_TICKS);
+    cbor_add_uint(w, reading->u16temp_ticks);
+    cbor_add_uint(w, CBOR_KEY_HUMI_TICKS);
+    cbor_add_uint(w, reading->u16humi_ticks);
+    if (u8type == PAYLOAD_TYPE_WARNING)
+    {
+        cbor_add_uint(w, CBOR_KEY_WARNING);
+        cbor_add_uint(w, u8warning);
+    }
+    if (bDiag)
+    {
+        cbor_add_uint(w, CBOR_KEY_WIFI_DIAG);
+        add_wifi_diag_cbor(w);
+    }
 }
 
-void pub_ota_status(char *values)
+static void payload_lock(json_writer_t *w)
 {
-    cJSON *json_ota_status = cJSON_CreateObject(); // Create a JSON object for the OTA status
-    cJSON_AddStringToObject(json_ota_status, "thing_token", cMac_str);
-    cJSON_AddStringToObject(json_ota_status, "enity_type", "module_sht3x");
-    cJSON_AddStringToObject(json_ota_status, "cmd_name", "Bee_ota");
-    cJSON_AddStringToObject(json_ota_status, "object_type", "Bee.ota_info");
-    cJSON_AddStringToObject(json_ota_status, "status", values);
-    cJSON_AddNumberToObject(json_ota_status, "trans_code", u8trans_code++);
+    xSemaphoreTake(payload_mutex, portMAX_DELAY);
+    json_writer_init(w, cPayload, sizeof(cPayload));
+}
 
-    char *json_str = cJSON_Print(json_ota_status); // Convert the JSON object to a string
-    wait_MQTT_connect(500);
-    esp_mqtt_client_publish(client, cTopic_pub, json_str, 0, QoS_0, 0); // Publish the JSON string via MQTT
-    cJSON_Delete(json_ota_status);
-    free(json_str);
+/* Publish len bytes of cPayload and release the buffer */
+static mqtt_pub_result_t payload_send(const char *cTopic, size_t len, int qos, uint16_t u16timeout_ms)
+{
+    mqtt_pub_result_t result = MQTT_PUB_ERROR;
+    if (len > 0)
+    {
+        result = mqtt_publish(cTopic, cPayload, len, qos, u16timeout_ms);
+    }
+    else
+    {
+        ESP_LOGE(TAG_MQTT, "Payload does not fit in %d bytes", MQTT_PAYLOAD_MAX);
+    }
+    xSemaphoreGive(payload_mutex);
+    return result;
 }
 
-void rx_mqtt_ota_task(void *pvParameters)
+static mqtt_pub_result_t payload_publish(json_writer_t *w, int qos, uint16_t u16timeout_ms)
 {
-    TickType_t xMaxWaitTime_MQTT = pdMS_TO_TICKS(15000); // Max time to wait mqtt from server to ota is 15 sec
-    pub_ota_status("Check_ota");
+    return payload_send(cTopic_pub, json_writer_finish(w), qos, u16timeout_ms); // Publish the JSON string via MQTT
+}
+
+/* Republish the outbox with a window of QoS1 messages in flight, cPayload must be held */
+static mqtt_pub_result_t outbox_replay_locked(TickType_t deadline)
+{
+    static char cTopic[OUTBOX_TOPIC_MAX];
+    int inflight[MQTT_OUTBOX_WINDOW];
+    uint8_t u8first = 0;
+    uint8_t u8n = 0;
+    uint32_t u32sent = 0;
+    outbox_cursor_t cursor;
+    mqtt_pub_result_t result = MQTT_PUB_OK;
+
+    outbox_rewind(&cursor);
     for (;;)
     {
-        if (xQueueReceive(mqtt_cmd_queue, &rxBuffer_MQTT, xMaxWaitTime_MQTT)) // Wait for an MQTT message to be received
+        /* Keep the window full, no new publishes once the budget is spent */
+        while ((u8n < MQTT_OUTBOX_WINDOW) && (ms_left(deadline) > 0))
         {
-            cJSON *root = cJSON_Parse(rxBuffer_MQTT); // Parse the received MQTT message as a JSON object
-            if (root != NULL)
+            size_t len;
+            esp_err_t err = outbox_read(&cursor, cTopic, (uint8_t *)cPayload, sizeof(cPayload), &len);
+            if (err == ESP_ERR_NOT_FOUND)
             {
-                char *cThing_token = cJSON_GetObjectItemCaseSensitive(root, "thing_token")->valuestring;
-                char *cEntity_type = cJSON_GetObjectItemCaseSensitive(root, "enity_type")->valuestring;
-                char *cCmd_name = cJSON_GetObjectItemCaseSensitive(root, "cmd_name")->valuestring;
-                char *cObject_type = cJSON_GetObjectItemCaseSensitive(root, "object_type")->valuestring;
-                char *cUrl = cJSON_GetObjectItemCaseSensitive(root, "url")->valuestring;
-
-                // Check if the received command is an OTA update
-                if ((strcmp(cThing_token, cMac_str) == 0)       &&
-                    (strcmp(cEntity_type, "module_sht3x") == 0) &&
-                    (strcmp(cCmd_name, "Bee.ota") == 0)         &&
-                    (strcmp(cObject_type, "Bee.ota_info") == 0) &&)
-                {
-                    start_ota(cUrl); // Perform OTA update
-                }
-                else 
+                break;
+            }
+            int msg_id = MQTT_MSG_ID_SKIP; /* A corrupted record is dropped like a delivered one */
+            if (err == ESP_OK)
+            {
+                msg_id = client_publish(cTopic, cPayload, len, QoS_1, 0);
+                if (msg_id < 0)
                 {
-                    ESP_LOGI(TAG_MQTT, "WRONG CMD!!!");
-                    esp_restart();
+                    result = mqtt_connected() ? MQTT_PUB_ERROR : MQTT_PUB_NOT_CONNECTED;
+                    break;
                 }
-                cJSON_Delete(root);
+                u32sent++;
             }
+            inflight[(u8first + u8n) % MQTT_OUTBOX_WINDOW] = msg_id;
+            u8n++;
+        }
+        if ((u8n == 0) || (result != MQTT_PUB_OK))
+        {
+            break;
+        }
+
+        /* Pop in order, clear before checking so an ack landing in between still wakes the wait */
+        xEventGroupClearBits(mqtt_event_group, MQTT_PUBLISHED_EVENT);
+        bool bProgress = false;
+        while ((u8n > 0) && ((inflight[u8first] == MQTT_MSG_ID_SKIP) || msg_id_acked(inflight[u8first])))
+        {
+            outbox_pop();
+            u8first = (u8first + 1) % MQTT_OUTBOX_WINDOW;
+            u8n--;
+            bProgress = true;
+        }
+        if (bProgress)
+        {
+            continue;
         }
-        else
+
+        uint16_t u16left = ms_left(deadline);
+        if (!mqtt_connected())
         {
-            ESP_LOGI(TAG_MQTT, "TIME OUT!!!");
-            esp_restart();
+            result = MQTT_PUB_NOT_CONNECTED;
+            break;
         }
+        if (u16left == 0)
+        {
+            result = MQTT_PUB_TIMEOUT;
+            break;
+        }
+        xEventGroupWaitBits(mqtt_event_group, MQTT_PUBLISHED_EVENT | MQTT_DISCONNECTED_EVENT, pdFALSE, pdFALSE,
+                            pdMS_TO_TICKS(u16left));
+    }
+
+    /* Unacknowledged ones stay in the outbox, the broker may see them twice (QoS1 is at least once) */
+    ESP_LOGI(TAG_MQTT, "Outbox replay: %lu sent, %lu left", u32sent, outbox_count());
+    return (outbox_count() == 0) ? MQTT_PUB_OK : result;
+}
+
+/* Send telemetry in cPayload, falling back to the flash outbox, and release the buffer */
+static mqtt_pub_result_t telemetry_send(size_t len, int qos, uint16_t u16timeout_ms)
+{
+    mqtt_pub_result_t result = MQTT_PUB_ERROR;
+
+    if (len == 0)
+    {
+        return payload_send(cTopic_telemetry, len, qos, u16timeout_ms); // Reports the overflow
+    }
+
+    if (outbox_count() == 0)
+    {
+        result = mqtt_publish(cTopic_telemetry, cPayload, len, qos, u16timeout_ms);
+        if ((result == MQTT_PUB_NOT_CONNECTED) || (result == MQTT_PUB_TIMEOUT))
+        {
+            if (outbox_append(cTopic_telemetry, cPayload, len) == ESP_OK)
+            {
+                result = MQTT_PUB_QUEUED;
+            }
+        }
+    }
+    /* Older messages are waiting: queue behind them so the broker sees everything in order */
+    else if (outbox_append(cTopic_telemetry, cPayload, len) == ESP_OK)
+    {
+        result = MQTT_PUB_QUEUED;
+        if (wait_MQTT_connect(u16timeout_ms) &&
+            (outbox_replay_locked(xTaskGetTickCount() + pdMS_TO_TICKS(MQTT_OUTBOX_REPLAY_MS)) == MQTT_PUB_OK))
+        {
+            result = MQTT_PUB_OK;
+        }
+    }
+    else
+    {
+        /* The outbox cannot take it: replay the older ones, which reuses cPayload, then publish a copy */
+        char *pcCopy = malloc(len);
+        if (pcCopy != NULL)
+        {
+            memcpy(pcCopy, cPayload, len);
+            if (wait_MQTT_connect(u16timeout_ms))
+            {
+                outbox_replay_locked(xTaskGetTickCount() + pdMS_TO_TICKS(MQTT_OUTBOX_REPLAY_MS));
+            }
+            result = mqtt_publish(cTopic_telemetry, pcCopy, len, qos, u16timeout_ms);
+            free(pcCopy);
+        }
+    }
+
+    if ((result != MQTT_PUB_OK) && (result != MQTT_PUB_QUEUED))
+    {
+        u32telemetry_dropped++;
+        ESP_LOGE(TAG_MQTT, "Telemetry dropped, not sent and not queued (%lu since boot)", u32telemetry_dropped);
+    }
+    xSemaphoreGive(payload_mutex);
+    return result;
+}
+
+/* Encode a batch or a history reply into cPayload in the configured encoding, 0 if it does not fit.
+   payload_mutex held: the encoding and the topic do not change under it */
+static size_t encode_batch(uint8_t u8type, const payload_sample_t *samples, uint8_t u8count, bool bDiag)
+{
+    bool bConfig = bDiag && !config_is_reported(); /* The applied config version rides with the diagnostics */
+
+    if (u8encoding == PAYLOAD_PACKED)
+    {
+        return packed_encode_batch((uint8_t *)cPayload, sizeof(cPayload), u8type, u16seq, samples, u8count);
+    }
+
+    if (u8encoding == PAYLOAD_CBOR)
+    {
+        /* Plain deltas, CBOR already packs -24..23 in a single byte */
+        cbor_writer_t w;
+        cbor_writer_init(&w, (uint8_t *)cPayload, sizeof(cPayload));
+        cbor_map_begin(&w, 9 + bDiag + bConfig);
+        cbor_add_uint(&w, CBOR_KEY_VERSION);
+        cbor_add_uint(&w, PAYLOAD_SCHEMA_VERSION);
+        cbor_add_uint(&w, CBOR_KEY_TYPE);
+        cbor_add_uint(&w, u8type);
+        cbor_add_uint(&w, CBOR_KEY_SEQ);
+        cbor_add_uint(&w, u16seq);
+        cbor_add_uint(&w, CBOR_KEY_TIMESTAMP);
+        cbor_add_uint(&w, samples[0].u32timestamp);
+        cbor_add_uint(&w, CBOR_KEY_TEMP_TICKS);
+        cbor_add_uint(&w, samples[0].u16temp_ticks);
+        cbor_add_uint(&w, CBOR_KEY_HUMI_TICKS);
+        cbor_add_uint(&w, samples[0].u16humi_ticks);
+        cbor_add_uint(&w, CBOR_KEY_TS_DELTAS);
+        cbor_arr_begin(&w, u8count - 1);
+        for (uint8_t i = 1; i < u8count; i++)
+        {
+            cbor_add_int(&w, (int32_t)(samples[i].u32timestamp - samples[i - 1].u32timestamp));
+        }
+        cbor_add_uint(&w, CBOR_KEY_TEMP_DELTAS);
+        cbor_arr_begin(&w, u8count - 1);
+        for (uint8_t i = 1; i < u8count; i++)
+        {
+            cbor_add_int(&w, (int32_t)samples[i].u16temp_ticks - samples[i - 1].u16temp_ticks);
+        }
+        cbor_add_uint(&w, CBOR_KEY_HUMI_DELTAS);
+        cbor_arr_begin(&w, u8count - 1);
+        for (uint8_t i = 1; i < u8count; i++)
+        {
+            cbor_add_int(&w, (int32_t)samples[i].u16humi_ticks - samples[i - 1].u16humi_ticks);
+        }
+        if (bDiag)
+        {
+            cbor_add_uint(&w, CBOR_KEY_WIFI_DIAG);
+            add_wifi_diag_cbor(&w);
+        }
+        if (bConfig)
+        {
+            cbor_add_uint(&w, CBOR_KEY_CONFIG_VERSION);
+            cbor_add_uint(&w, config_get_version());
+        }
+        return cbor_writer_finish(&w);
+    }
+
+    json_writer_t w;
+    json_writer_init(&w, cPayload, sizeof(cPayload));
+    json_obj_begin(&w, NULL);
+    json_add_str(&w, "thing_token", cMac_str);
+    json_add_str(&w, "cmd_name", "Bee.data");
+    json_add_str(&w, "object_type", (u8type == PAYLOAD_TYPE_HISTORY) ? "Bee.history" : "Bee.batch");
+    json_add_int(&w, "ts", (int32_t)samples[0].u32timestamp);
+    json_arr_begin(&w, "dt");
+    for (uint8_t i = 1; i < u8count; i++)
+    {
+        json_add_int(&w, NULL, (int32_t)(samples[i].u32timestamp - samples[i - 1].u32timestamp));
+    }
+    json_arr_end(&w);
+    json_arr_begin(&w, "temperature");
+    for (uint8_t i = 0; i < u8count; i++)
+    {
+        json_add_float(&w, NULL, payload_temp_from_ticks(samples[i].u16temp_ticks), 2);
     }
+    json_arr_end(&w);
+    json_arr_begin(&w, "humidity");
+    for (uint8_t i = 0; i < u8count; i++)
+    {
+        json_add_float(&w, NULL, payload_humi_from_ticks(samples[i].u16humi_ticks), 2);
+    }
+    json_arr_end(&w);
+    json_add_int(&w, "trans_code", u8trans_code);
+    if (bDiag)
+    {
+        add_wifi_diag(&w);
+    }
+    if (bConfig)
+    {
+        json_add_int(&w, "config_version", (int32_t)config_get_version());
+    }
+    json_obj_end(&w);
+
+    size_t len = json_writer_finish(&w);
+    if (len > 0)
+    {
+        u8trans_code++;
+    }
+    return len;
+}
+
+/* Encode a reading in the configured encoding and publish it on the telemetry topic */
+static mqtt_pub_result_t pub_reading(uint8_t u8type, const payload_reading_t *reading, uint8_t u8warning,
+                                     int qos, uint16_t u16timeout_ms, bool *pbDiag_sent)
+{
+    size_t len = 0;
+    *pbDiag_sent = false;
+
+    xSemaphoreTake(payload_mutex, portMAX_DELAY);
+    if (u8encoding == PAYLOAD_CBOR)
+    {
+        cbor_writer_t w;
+        cbor_writer_init(&w, (uint8_t *)cPayload, sizeof(cPayload));
+        cbor_add_reading(&w, u8type, reading, u8warning, u8type == PAYLOAD_TYPE_DATA);
+        len = cbor_writer_finish(&w);
+        *pbDiag_sent = (u8type == PAYLOAD_TYPE_DATA);
+    }
+    else if (u8encoding == PAYLOAD_PACKED)
+    {
+        /* Diagnostics are not part of the packed record, they keep accumulating until a JSON or CBOR upload */
+        len = packed_encode_reading((uint8_t *)cPayload, sizeof(cPayload), u8type, u16seq, reading, u8warning);
+    }
+    else
+    {
+        json_writer_t w;
+        json_writer_init(&w, cPayload, sizeof(cPayload));
+        json_obj_begin(&w, NULL);
+        json_add_str(&w, "thing_token", cMac_str);
+        json_add_str(&w, "cmd_name", "Bee.data");
+        if (u8type == PAYLOAD_TYPE_WARNING)
+        {
+            json_add_str(&w, "object_type", "Bee.warning");
+        }
+        json_obj_begin(&w, "values");
+        if (u8type == PAYLOAD_TYPE_WARNING)
+        {
+            json_add_int(&w, "warning_values", u8warning);
+        }
+        json_add_float(&w, "temperature", reading->fTemp, 2);
+        json_add_float(&w, "humidity", reading->fHumi, 2);
+        json_obj_end(&w);
+        json_add_int(&w, "trans_code", u8trans_code++);
+        if (u8type == PAYLOAD_TYPE_DATA)
+        {
+            add_wifi_diag(&w);
+            *pbDiag_sent = true;
+        }
+        json_obj_end(&w);
+        len = json_writer_finish(&w);
+    }
+    u16seq++;
+
+    return telemetry_send(len, qos, u16timeout_ms);
+}
+
+mqtt_pub_result_t mqtt_outbox_replay(uint16_t u16budget_ms)
+{
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(u16budget_ms);
+    if (outbox_count() == 0)
+    {
+        return MQTT_PUB_OK;
+    }
+    if (!wait_MQTT_connect(u16budget_ms))
+    {
+        return MQTT_PUB_NOT_CONNECTED;
+    }
+
+    xSemaphoreTake(payload_mutex, portMAX_DELAY);
+    mqtt_pub_result_t result = outbox_replay_locked(deadline);
+    xSemaphoreGive(payload_mutex);
+    return result;
+}
+
+void mqtt_set_payload_encoding(payload_encoding_t encoding)
+{
+    if (encoding > PAYLOAD_PACKED)
+    {
+        return;
+    }
+    if (payload_mutex == NULL) /* Before mqtt_func_init() the topic is built there */
+    {
+        u8encoding = (uint8_t)encoding;
+        return;
+    }
+    /* The encoding and the topic change together, between two messages */
+    xSemaphoreTake(payload_mutex, portMAX_DELAY);
+    u8encoding = (uint8_t)encoding;
+    set_telemetry_topic();
+    xSemaphoreGive(payload_mutex);
+}
+
+payload_encoding_t mqtt_get_payload_encoding(void)
+{
+    return (payload_encoding_t)u8encoding;
+}
+
+void mqtt_set_telemetry_qos(int qos)
+{
+    if ((qos == QoS_0) || (qos == QoS_1))
+    {
+        u8telemetry_qos = (uint8_t)qos;
+    }
+}
+
+int mqtt_get_telemetry_qos(void)
+{
+    return u8telemetry_qos;
+}
+
+mqtt_pub_result_t pub_data(const payload_reading_t *reading)
+{
+    bool bDiag_sent;
+    mqtt_pub_result_t result = pub_reading(PAYLOAD_TYPE_DATA, reading, 0, QoS_0, MQTT_PUB_TIMEOUT_MS, &bDiag_sent);
+    wifi_link_report_publish(result == MQTT_PUB_OK);
+    if ((result == MQTT_PUB_OK) && bDiag_sent)
+    {
+        wifi_diag_reported();
+        wifi_link_reported();
+    }
+    return result;
+}
+
+mqtt_pub_result_t pub_warning(uint8_t u8Values, const payload_reading_t *reading)
+{
+    bool bDiag_sent;
+    mqtt_pub_result_t result = pub_reading(PAYLOAD_TYPE_WARNING, reading, u8Values, QoS_1, MQTT_PUB_TIMEOUT_MS, &bDiag_sent);
+    wifi_link_report_publish(result == MQTT_PUB_OK);
+    return result;
+}
+
+mqtt_pub_result_t pub_batch(const payload_sample_t *samples, uint8_t u8count, uint8_t *pu8done)
+{
+    mqtt_pub_result_t result = MQTT_PUB_OK;
+    bool bFirst = true;
+
+    *pu8done = 0;
+    while (u8count > 0)
+    {
+        /* As many samples as fit in one message, halving until they do */
+        xSemaphoreTake(payload_mutex, portMAX_DELAY);
+        bool bDiag = bFirst && (u8encoding != PAYLOAD_PACKED); /* Diagnostics ride on the first message */
+        uint8_t u8n = u8count;
+        size_t len = encode_batch(PAYLOAD_TYPE_BATCH, samples, u8n, bDiag);
+        while ((len == 0) && (u8n > 1))
+        {
+            u8n = (u8n + 1) / 2;
+            len = encode_batch(PAYLOAD_TYPE_BATCH, samples, u8n, bDiag);
+        }
+        u16seq++;
+
+        result = telemetry_send(len, u8telemetry_qos, MQTT_PUB_TIMEOUT_MS);
+        wifi_link_report_publish(result == MQTT_PUB_OK);
+        if ((result != MQTT_PUB_OK) && (result != MQTT_PUB_QUEUED))
+        {
+            break;
+        }
+        if (bDiag && (result == MQTT_PUB_OK))
+        {
+            wifi_diag_reported();
+            wifi_link_reported();
+            config_reported();
+        }
+        bFirst = false;
+        samples += u8n;
+        u8count -= u8n;
+        *pu8done += u8n;
+    }
+    return result;
+}
+
+mqtt_pub_result_t pub_history(const payload_sample_t *samples, uint8_t u8count)
+{
+    mqtt_pub_result_t result = MQTT_PUB_OK;
+
+    while ((u8count > 0) && (result == MQTT_PUB_OK))
+    {
+        xSemaphoreTake(payload_mutex, portMAX_DELAY);
+        uint8_t u8n = u8count;
+        size_t len = encode_batch(PAYLOAD_TYPE_HISTORY, samples, u8n, false);
+        while ((len == 0) && (u8n > 1))
+        {
+            u8n = (u8n + 1) / 2;
+            len = encode_batch(PAYLOAD_TYPE_HISTORY, samples, u8n, false);
+        }
+        u16seq++;
+
+        /* A reply to a request, pointless once the requester has given up: no outbox */
+        result = payload_send(cTopic_telemetry, len, QoS_1, MQTT_PUB_TIMEOUT_MS);
+        samples += u8n;
+        u8count -= u8n;
+    }
+    return result;
+}
+
+void pub_ota_status(char *values)
+{
+    json_writer_t w;
+    payload_lock(&w);
+    json_obj_begin(&w, NULL);
+    json_add_str(&w, "thing_token", cMac_str);
+    json_add_str(&w, "enity_type", "module_sht3x");
+    json_add_str(&w, "cmd_name", "Bee_ota");
+    json_add_str(&w, "object_type", "Bee.ota_info");
+    json_add_str(&w, "status", values);
+    json_add_int(&w, "trans_code", u8trans_code++);
+    json_obj_end(&w);
+
+    payload_publish(&w, QoS_0, MQTT_PUB_TIMEOUT_MS);
+}
+
+void pub_ota_progress(uint8_t u8percent)
+{
+    json_writer_t w;
+    payload_lock(&w);
+    json_obj_begin(&w, NULL);
+    json_add_str(&w, "thing_token", cMac_str);
+    json_add_str(&w, "enity_type", "module_sht3x");
+    json_add_str(&w, "cmd_name", "Bee_ota");
+    json_add_str(&w, "object_type", "Bee.ota_info");
+    json_add_str(&w, "status", "Downloading");
+    json_add_int(&w, "progress", u8percent);
+    json_add_int(&w, "trans_code", u8trans_code++);
+    json_obj_end(&w);
+
+    payload_publish(&w, QoS_0, MQTT_PUB_TIMEOUT_MS);
+}
+
+void pub_ota_report(const char *cStatus, const ota_report_t *report)
+{
+    json_writer_t w;
+    payload_lock(&w);
+    json_obj_begin(&w, NULL);
+    json_add_str(&w, "thing_token", cMac_str);
+    json_add_str(&w, "enity_type", "module_sht3x");
+    json_add_str(&w, "cmd_name", "Bee_ota");
+    json_add_str(&w, "object_type", "Bee.ota_info");
+    json_add_str(&w, "status", cStatus);
+    json_add_int(&w, "download_bytes", (int32_t)report->u32download_bytes);
+    json_add_int(&w, "image_bytes", (int32_t)report->u32image_bytes);
+    json_add_int(&w, "elapsed_ms", (int32_t)report->u32elapsed_ms);
+    json_add_int(&w, "requests", (int32_t)report->u32requests);
+    json_add_int(&w, "net_ms", (int32_t)report->u32net_ms);
+    json_add_int(&w, "flash_ms", (int32_t)report->u32flash_ms);
+    json_add_int(&w, "trans_code", u8trans_code++);
+    json_obj_end(&w);
+
+    payload_publish(&w, QoS_1, MQTT_PUB_TIMEOUT_MS); // Acknowledged before the restart
+}
+
+void pub_cmd_result(const char *cCmd_name, int32_t i32trans_code, esp_err_t err)
+{
+    json_writer_t w;
+    payload_lock(&w);
+    json_obj_begin(&w, NULL);
+    json_add_str(&w, "thing_token", cMac_str);
+    json_add_str(&w, "enity_type", "module_sht3x");
+    json_add_str(&w, "cmd_name", cCmd_name);
+    json_add_str(&w, "object_type", "Bee.cmd_result");
+    json_add_str(&w, "status", (err == ESP_OK) ? "OK" : esp_err_to_name(err));
+    json_add_int(&w, "trans_code", (i32trans_code >= 0) ? i32trans_code : u8trans_code++);
+    json_obj_end(&w);
+
+    payload_publish(&w, QoS_1, MQTT_PUB_TIMEOUT_MS); // Acknowledged before a reboot or OTA can cut the connection
+}
+
+#if MQTT_PAYLOAD_BENCHMARK
+void mqtt_payload_benchmark(void)
+{
+    const float fTemp = 23.45f;
+    const float fHumi = 61.27f;
+    const uint32_t u32rounds = 100;
+
+    /* cJSON tree + cJSON_Print, as pub_data did before */
+    uint32_t u32heap_min = esp_get_minimum_free_heap_size();
+    uint32_t u32start = esp_cpu_get_cycle_count();
+    size_t cjson_len = 0;
+    for (uint32_t i = 0; i < u32rounds; i++)
+    {
+        cJSON *json_data = cJSON_CreateObject();
+        cJSON_AddStringToObject(json_data, "thing_token", cMac_str);
+        cJSON_AddStringToObject(json_data, "cmd_name", "Bee.data");
+        cJSON *values = cJSON_AddObjectToObject(json_data, "values");
+        cJSON_AddNumberToObject(values, "temperature", fTemp);
+        cJSON_AddNumberToObject(values, "humidity", fHumi);
+        cJSON_AddNumberToObject(json_data, "trans_code", 17);
+        char *json_str = cJSON_Print(json_data);
+        cjson_len = strlen(json_str);
+        cJSON_Delete(json_data);
+        free(json_str);
+    }
+    uint32_t u32cjson_cycles = (esp_cpu_get_cycle_count() - u32start) / u32rounds;
+
+    /* Streaming writer into the static buffer */
+    json_writer_t w;
+    size_t writer_len = 0;
+    u32start = esp_cpu_get_cycle_count();
+    for (uint32_t i = 0; i < u32rounds; i++)
+    {
+        json_writer_init(&w, cPayload, sizeof(cPayload));
+        json_obj_begin(&w, NULL);
+        json_add_str(&w, "thing_token", cMac_str);
+        json_add_str(&w, "cmd_name", "Bee.data");
+        json_obj_begin(&w, "values");
+        json_add_float(&w, "temperature", fTemp, 2);
+        json_add_float(&w, "humidity", fHumi, 2);
+        json_obj_end(&w);
+        json_add_int(&w, "trans_code", 17);
+        json_obj_end(&w);
+        writer_len = json_writer_finish(&w);
+    }
+    uint32_t u32writer_cycles = (esp_cpu_get_cycle_count() - u32start) / u32rounds;
+
+    ESP_LOGI(TAG_MQTT, "cJSON_Print: %u bytes, %lu cycles/msg | writer: %u bytes, %lu cycles/msg | min free heap %lu -> %lu",
+             cjson_len, u32cjson_cycles, writer_len, u32writer_cycles, u32heap_min, esp_get_minimum_free_heap_size());
+
+    /* Same reading in the binary encodings, without the diagnostics */
+    const payload_reading_t reading = {fTemp, fHumi, 0x6421, 0x9CD9, 1700000000};
+    cbor_writer_t cw;
+    cbor_writer_init(&cw, (uint8_t *)cPayload, sizeof(cPayload));
+    cbor_add_reading(&cw, PAYLOAD_TYPE_DATA, &reading, 0, false);
+    ESP_LOGI(TAG_MQTT, "CBOR: %u bytes | packed: %u bytes", cbor_writer_finish(&cw),
+             packed_encode_reading((uint8_t *)cPayload, sizeof(cPayload), PAYLOAD_TYPE_DATA, 17, &reading, 0));
 }
+#endif
 
 /****************************************************************************/
 /***        END OF FILE                                                   ***/
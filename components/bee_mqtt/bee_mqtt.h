@@ -9,20 +9,99 @@
 
 /****************************************************************************/
 #include <stdint.h>
+#include <stddef.h>
 #ifndef BEE_MQTT_H
 #define BEE_MQTT_H
 
+#include "esp_err.h"
+#include "bee_payload.h"
+#include "bee_ota.h"
+
 #define MAC_ADDR_SIZE 6
 #define QoS_0 0
 #define QoS_1 1
 #define QoS_2 2
 
+#ifndef MQTT_TLS
+#define MQTT_TLS            1       /* Connect through bee_tls, 0 falls back to the plain TCP listener */
+#endif
+#if MQTT_TLS
+#define BROKER_ADDRESS_URI  "mqtts://61.28.238.97:8883"
+#else
 #define BROKER_ADDRESS_URI  "mqtt://61.28.238.97:1993"
+#endif
 #define USERNAME            "VBeeHome"
 #define PASSWORD            "123abcA@!"
 
+#define MQTT_PAYLOAD_MAX        1024    /* Size of the static payload buffer, bounds the samples per batch message */
+#define MQTT_BATCH_MAX          64      /* Samples buffered between uploads */
+#define MQTT_PAYLOAD_BENCHMARK  0       /* Build mqtt_payload_benchmark() */
+#define MQTT_TELEMETRY_ENCODING PAYLOAD_JSON    /* Encoding of data and warnings after a cold boot */
+
+#define MQTT_PUB_TIMEOUT_MS         3000    /* Connect + write (QoS0) or connect + PUBACK (QoS1) per message */
+#define MQTT_DISCONNECT_TIMEOUT_MS  300
+#define MQTT_ACK_RING               8       /* QoS1 message ids remembered after their PUBACK */
+#define MQTT_OUTBOX_WINDOW          4       /* QoS1 replays in flight, at most MQTT_ACK_RING */
+#define MQTT_OUTBOX_REPLAY_MS       2000    /* Replay budget per wake, the rest waits for the next one */
+#define MQTT_PRESENCE_MAX           128     /* Retained birth message and Last Will on .../<MAC>/presence */
+
+/* MQTT 5 only, enable CONFIG_MQTT_PROTOCOL_5 in menuconfig (Component config > ESP-MQTT) */
+#define MQTT5_SESSION_EXPIRY_S      3600    /* Broker keeps the session (and subscription) across wakes */
+#define MQTT5_ALIAS_TELEMETRY       1       /* Topic alias of the telemetry topic */
+#define MQTT5_ALIAS_STATUS          2       /* Topic alias of the JSON status topic */
+#define MQTT5_CONTENT_TYPE          1       /* Tag each publish with the media type of its encoding */
+
+typedef enum
+{
+    MQTT_PUB_OK = 0,            /* QoS0 written to the socket, QoS1 acknowledged by the broker */
+    MQTT_PUB_NOT_CONNECTED,     /* No connection before the deadline, nothing was sent */
+    MQTT_PUB_TIMEOUT,           /* Sent but not acknowledged before the deadline */
+    MQTT_PUB_ERROR,             /* Payload did not fit or the client refused it */
+    MQTT_PUB_QUEUED,            /* Stored in the flash outbox, replayed on a later connection */
+} mqtt_pub_result_t;
+
+typedef struct
+{
+    uint32_t u32connect_ms;         /* esp_mqtt_client_start() to CONNACK, 0 if not connected */
+    uint32_t u32connack_to_pub_ms;  /* CONNACK to the first publish written out, 0 if none */
+} mqtt_profile_t;
+
+/**
+ * @brief Disconnect from the broker.
+ *
+ * Waits up to MQTT_DISCONNECT_TIMEOUT_MS for the DISCONNECT to go out, so Wi-Fi can be stopped right after.
+ * After a clean DISCONNECT the broker drops the Last Will and the retained ONLINE message stands.
+ */
 void mqtt_disconnect();
 
+/**
+ * @brief Get the MQTT part of the wake profile.
+ *
+ * @param out Filled with the connect and connect-to-publish latencies of this wake.
+ */
+void mqtt_get_profile(mqtt_profile_t *out);
+
+/**
+ * @brief Get the thing_token of this device (its Wi-Fi MAC as 12 hex digits), set by mqtt_func_init().
+ */
+const char *mqtt_get_thing_token(void);
+
+/**
+ * @brief Publish a message and wait for its completion.
+ *
+ * Waits for the connection, then publishes. QoS0 completes when the packet is written to the socket,
+ * QoS1 when the broker's PUBACK arrives (MQTT_EVENT_PUBLISHED). Everything, connecting included,
+ * has to fit in u16timeout_ms.
+ *
+ * @param cTopic        Topic to publish on.
+ * @param data          Payload.
+ * @param len           Payload length in bytes.
+ * @param qos           QoS_0 or QoS_1.
+ * @param u16timeout_ms Deadline of the whole operation.
+ * @return MQTT_PUB_OK once delivered as far as the QoS allows, the failure otherwise.
+ */
+mqtt_pub_result_t mqtt_publish(const char *cTopic, const void *data, size_t len, int qos, uint16_t u16timeout_ms);
+
 /**
  * @brief   Initialize MQTT functionality.
  *
@@ -31,44 +110,127 @@ void mqtt_disconnect();
  * creates an MQTT command queue. The MAC address of the Wi-Fi station interface is retrieved to construct MQTT topics for
  * publishing and subscribing. Information about the topics and initialization progress is logged.
  *
+ * Presence goes to VB/DMP/VBEEON/CUSTOM/SMH/<MAC>/presence: a retained, QoS1 "ONLINE" birth message with the
+ * firmware version and wake interval, and a retained "OFFLINE" Last Will the broker publishes if the connection
+ * dies without a DISCONNECT. The birth message is only sent when its content changed or the previous connection
+ * did not end cleanly, so an ordinary wake costs no extra message.
+ *
+ * Runtime configuration is taken from the retained VB/DMP/VBEEON/CUSTOM/SMH/<MAC>/config and
+ * VB/DMP/VBEEON/CUSTOM/SMH/group/<BEE_CONFIG_GROUP>/config topics, see config_receive(). The newer
+ * config_version wins whichever topic it comes from.
+ *
  * @note    Make sure to customize the BROKER_ADDRESS_URI, USERNAME, and PASSWORD constants before using this function.
  */
 void mqtt_func_init(void);
 
+/**
+ * @brief Select the encoding of data and warning messages.
+ *
+ * Each encoding has its own topic so the backend can tell them apart without sniffing:
+ *  - PAYLOAD_JSON   .../telemetry       the original JSON schema
+ *  - PAYLOAD_CBOR   .../telemetry/cbor  CBOR map with integer keys, raw ticks, sequence and timestamp
+ *  - PAYLOAD_PACKED .../telemetry/bin   fixed PACKED_READING_SIZE byte record
+ * Both binary encodings start with PAYLOAD_SCHEMA_VERSION, tools/bee_decode.py decodes them.
+ * The choice is kept in RTC memory across deep sleep. OTA status messages stay JSON.
+ *
+ * @param encoding Encoding to use from the next message on.
+ */
+void mqtt_set_payload_encoding(payload_encoding_t encoding);
+
+/**
+ * @brief Get the encoding of data and warning messages.
+ */
+payload_encoding_t mqtt_get_payload_encoding(void);
+
+/**
+ * @brief Select the QoS of batch uploads, QoS_1 after a cold boot.
+ *
+ * With QoS_0 a batch counts as sent once written to the socket, only a failed connection sends it to the outbox.
+ * Warnings stay QoS_1. The choice is kept in RTC memory across deep sleep.
+ *
+ * @param qos QoS_0 or QoS_1, anything else is ignored.
+ */
+void mqtt_set_telemetry_qos(int qos);
+
+/**
+ * @brief Get the QoS of batch uploads.
+ */
+int mqtt_get_telemetry_qos(void);
+
+/**
+ * @brief Replay the flash outbox in order.
+ *
+ * Messages are republished with QoS1, up to MQTT_OUTBOX_WINDOW in flight, and dropped from the
+ * outbox as their PUBACKs come in. Stops when the outbox is empty, the connection drops or the
+ * budget runs out.
+ *
+ * @param u16budget_ms Time allowed for the replay.
+ * @return MQTT_PUB_OK once the outbox is empty, the reason it is not otherwise.
+ */
+mqtt_pub_result_t mqtt_outbox_replay(uint16_t u16budget_ms);
+
 /**
  * @brief Publishes temperature and humidity data via MQTT.
  * 
- * This function creates a JSON object containing temperature and humidity data,
- * then publishes it using the MQTT client.
+ * This function encodes the reading in the selected encoding into a static buffer, then publishes it
+ * using the MQTT client. In JSON and CBOR the Wi-Fi connection diagnostics gathered since the last
+ * successful upload are attached and cleared once sent, the packed record leaves them for a later upload.
+ * A reading that cannot be delivered is kept in the flash outbox. While the outbox holds anything, new
+ * readings are appended behind it and the outbox is replayed, so the broker receives them in order.
+ * If the outbox cannot take a reading, it is published directly after the replay. A reading neither sent
+ * nor queued is counted in the "lost" diagnostic, along with the ones a full outbox evicted.
  * 
- * @param fTemp The temperature value to be published.
- * @param fHumi The humidity value to be published.
+ * @param reading The reading to be published.
+ * @return Result of mqtt_publish(), MQTT_PUB_QUEUED if it waits in the outbox.
+ */
+mqtt_pub_result_t pub_data(const payload_reading_t *reading);
+
+/**
+ * @brief Publishes a batch of timestamped samples in as few messages as possible.
+ *
+ * The samples are encoded as a base timestamp, the intervals between samples and the tick deltas of each
+ * series: plain JSON arrays, CBOR integer arrays, or zigzag varints (timestamps as delta-of-deltas) in the
+ * packed encoding, see packed_encode_batch(). When the samples do not fit in MQTT_PAYLOAD_MAX they are
+ * split over several messages. Batches are sent with the QoS of mqtt_set_telemetry_qos() and go through the
+ * outbox like single readings. After a remote config was applied, the first JSON or CBOR message carries
+ * its config_version until one is acknowledged.
+ *
+ * @param samples  Samples, oldest first.
+ * @param u8count  Number of samples.
+ * @param pu8done  Receives how many samples, from the front, were delivered or queued in the outbox.
+ * @return Result of the last message.
  */
-void pub_data(float temp, float humi);
+mqtt_pub_result_t pub_batch(const payload_sample_t *samples, uint8_t u8count, uint8_t *pu8done);
 
 /**
- * @brief Sends a keep-alive MQTT message to indicate device status.
+ * @brief Publishes samples read back from the history log, in answer to Bee.history.
+ *
+ * Encoded like pub_batch() in the selected encoding, but typed PAYLOAD_TYPE_HISTORY (object_type
+ * "Bee.history" in JSON) so the backend does not take them for live readings, and without diagnostics.
+ * Each message is sent with QoS1 and waited for, which paces the stream. Nothing goes to the outbox.
  *
- * This function constructs a JSON message containing device status information such as the thing token,
- * event type, and status. The message is then published to the MQTT broker using the configured client.
- * The transmission code is also incremented for each message sent.
+ * @param samples  Samples, oldest first.
+ * @param u8count  Number of samples.
+ * @return MQTT_PUB_OK once every message was acknowledged, the first failure otherwise.
  */
-void pub_keep_alive(void);
+mqtt_pub_result_t pub_history(const payload_sample_t *samples, uint8_t u8count);
 
 /**
  * @brief Publishes a warning message via MQTT.
  * 
- * This function creates a JSON object containing a warning message,
+ * This function encodes a warning message in the selected encoding into a static buffer,
  * then publishes it using the MQTT client.
  * 
- * @param u8Values The value associated with the warning.
+ * @param u8Values Bitmap of the active alarm rules, see alarm_evaluate().
+ * @param reading  The reading that raised the warning.
+ * @return Result of mqtt_publish(), MQTT_PUB_QUEUED if it waits in the outbox. Warnings are sent with QoS1.
  */
-void pub_warning(uint8_t u8Values, float fTemp, float fHumi);
+mqtt_pub_result_t pub_warning(uint8_t u8Values, const payload_reading_t *reading);
 
 /**
  * @brief Publishes an OTA status message via MQTT.
  * 
- * This function creates a JSON object containing an OTA status message,
+ * This function writes a compact JSON OTA status message into a static buffer,
  * then publishes it using the MQTT client.
  * 
  * @param values The OTA status values to be included in the message.
@@ -76,12 +238,43 @@ void pub_warning(uint8_t u8Values, float fTemp, float fHumi);
 void pub_ota_status(char *values);
 
 /**
- * @brief MQTT task for processing OTA updates and status messages.
- * 
- * This task listens for MQTT messages, processes OTA updates and status messages,
- * and responds accordingly.
+ * @brief Publish how far an OTA download got, status "Downloading" and progress in percent.
+ *
+ * QoS0, bee_ota bounds the rate.
+ */
+void pub_ota_progress(uint8_t u8percent);
+
+/**
+ * @brief Publish the outcome of an OTA with what it cost.
+ *
+ * Same message as pub_ota_status() with download_bytes, image_bytes, elapsed_ms and requests added, so compressed
+ * and plain updates can be compared from the backend. Sent with QoS1 and waited for, the chip restarts next.
+ *
+ * @param cStatus "Succeed" or "Failed".
+ * @param report  Counters of the download.
+ */
+void pub_ota_report(const char *cStatus, const ota_report_t *report);
+
+/**
+ * @brief Publish the result of a command received on the command topic.
+ *
+ * Sent with QoS1 and waited for, so it reaches the broker before a reboot or OTA that follows.
+ *
+ * @param cCmd_name     cmd_name of the request.
+ * @param i32trans_code trans_code of the request, so the sender can match the reply. Negative if the
+ *                      request had none, the next local code is used then.
+ * @param err           ESP_OK, otherwise its name is reported as the status.
+ */
+void pub_cmd_result(const char *cCmd_name, int32_t i32trans_code, esp_err_t err);
+
+#if MQTT_PAYLOAD_BENCHMARK
+/**
+ * @brief Compare bytes and CPU cycles per message of cJSON_Print and the streaming writer.
+ *
+ * Results are logged. Call after mqtt_func_init() so the MAC string is set.
  */
-void rx_mqtt_ota_task(void *pvParameters);
+void mqtt_payload_benchmark(void);
+#endif
 
 #endif /* BEE_MQTT_H */
 
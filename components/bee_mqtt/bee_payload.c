@@ -0,0 +1,445 @@
+/*****************************************************************************
+ *
+ * @file 	bee_payload.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	streaming payload writers for telemetry messages (JSON, CBOR and
+ *          packed binary), no heap use
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include <math.h>
+
+#include "bee_payload.h"
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void put_char(json_writer_t *w, char c)
+{
+    if (w->len + 1 < w->size)
+    {
+        w->pcBuf[w->len++] = c;
+    }
+    else
+    {
+        w->bOverflow = true;
+    }
+}
+
+static void put_raw(json_writer_t *w, const char *cStr, size_t len)
+{
+    if (w->len + len < w->size)
+    {
+        memcpy(&w->pcBuf[w->len], cStr, len);
+        w->len += len;
+    }
+    else
+    {
+        w->bOverflow = true;
+    }
+}
+
+static void put_string(json_writer_t *w, const char *cStr)
+{
+    static const char cHex[] = "0123456789abcdef";
+
+    put_char(w, '"');
+    for (; *cStr != '\0'; cStr++)
+    {
+        char c = *cStr;
+        if ((c == '"') || (c == '\\'))
+        {
+            put_char(w, '\\');
+            put_char(w, c);
+        }
+        else if ((uint8_t)c < 0x20)
+        {
+            put_raw(w, "\\u00", 4);
+            put_char(w, cHex[(c >> 4) & 0x0F]);
+            put_char(w, cHex[c & 0x0F]);
+        }
+        else
+        {
+            put_char(w, c);
+        }
+    }
+    put_char(w, '"');
+}
+
+static void put_uint(json_writer_t *w, uint32_t u32value, uint8_t u8min_digits)
+{
+    char cDigits[10];
+    uint8_t u8n = 0;
+
+    do
+    {
+        cDigits[u8n++] = (char)('0' + (u32value % 10));
+        u32value /= 10;
+    } while ((u32value != 0) || (u8n < u8min_digits));
+
+    while (u8n > 0)
+    {
+        put_char(w, cDigits[--u8n]);
+    }
+}
+
+/* Comma handling and the key of the next member */
+static void begin_member(json_writer_t *w, const char *cKey)
+{
+    uint8_t u8bit = (uint8_t)(1u << w->u8depth);
+    if (w->u8first_mask & u8bit)
+    {
+        w->u8first_mask &= (uint8_t)~u8bit;
+    }
+    else if (w->u8depth > 0)
+    {
+        put_char(w, ',');
+    }
+
+    if (cKey != NULL)
+    {
+        put_string(w, cKey);
+        put_char(w, ':');
+    }
+}
+
+static void open_scope(json_writer_t *w, const char *cKey, char cOpen)
+{
+    begin_member(w, cKey);
+    put_char(w, cOpen);
+    if (w->u8depth + 1 < JSON_MAX_DEPTH)
+    {
+        w->u8depth++;
+        w->u8first_mask |= (uint8_t)(1u << w->u8depth);
+    }
+    else
+    {
+        w->bOverflow = true;
+    }
+}
+
+static void close_scope(json_writer_t *w, char cClose)
+{
+    if (w->u8depth > 0)
+    {
+        w->u8depth--;
+    }
+    put_char(w, cClose);
+}
+
+/* Major type and argument, in the shortest encoding */
+static void cbor_put_head(cbor_writer_t *w, uint8_t u8major, uint32_t u32arg)
+{
+    uint8_t u8head[5];
+    size_t len;
+
+    u8major = (uint8_t)(u8major << 5);
+    if (u32arg < 24)
+    {
+        u8head[0] = u8major | (uint8_t)u32arg;
+        len = 1;
+    }
+    else if (u32arg <= UINT8_MAX)
+    {
+        u8head[0] = u8major | 24;
+        u8head[1] = (uint8_t)u32arg;
+        len = 2;
+    }
+    else if (u32arg <= UINT16_MAX)
+    {
+        u8head[0] = u8major | 25;
+        u8head[1] = (uint8_t)(u32arg >> 8);
+        u8head[2] = (uint8_t)u32arg;
+        len = 3;
+    }
+    else
+    {
+        u8head[0] = u8major | 26;
+        u8head[1] = (uint8_t)(u32arg >> 24);
+        u8head[2] = (uint8_t)(u32arg >> 16);
+        u8head[3] = (uint8_t)(u32arg >> 8);
+        u8head[4] = (uint8_t)u32arg;
+        len = 5;
+    }
+
+    if (w->len + len <= w->size)
+    {
+        memcpy(&w->pu8Buf[w->len], u8head, len);
+        w->len += len;
+    }
+    else
+    {
+        w->bOverflow = true;
+    }
+}
+
+static void cbor_put_raw(cbor_writer_t *w, const uint8_t *pu8Data, size_t len)
+{
+    if (w->len + len <= w->size)
+    {
+        memcpy(&w->pu8Buf[w->len], pu8Data, len);
+        w->len += len;
+    }
+    else
+    {
+        w->bOverflow = true;
+    }
+}
+
+static bool put_varint(uint8_t *pu8Buf, size_t size, size_t *pLen, int32_t i32value)
+{
+    uint32_t u32zigzag = ((uint32_t)i32value << 1) ^ (uint32_t)(i32value >> 31);
+    do
+    {
+        if (*pLen >= size)
+        {
+            return false;
+        }
+        uint8_t u8byte = u32zigzag & 0x7F;
+        u32zigzag >>= 7;
+        pu8Buf[(*pLen)++] = u8byte | ((u32zigzag != 0) ? 0x80 : 0x00);
+    } while (u32zigzag != 0);
+    return true;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+void json_writer_init(json_writer_t *w, char *pcBuf, size_t size)
+{
+    w->pcBuf = pcBuf;
+    w->size = size;
+    w->len = 0;
+    w->u8depth = 0;
+    w->u8first_mask = 0x01;
+    w->bOverflow = (size == 0);
+}
+
+void json_obj_begin(json_writer_t *w, const char *cKey)
+{
+    open_scope(w, cKey, '{');
+}
+
+void json_obj_end(json_writer_t *w)
+{
+    close_scope(w, '}');
+}
+
+void json_arr_begin(json_writer_t *w, const char *cKey)
+{
+    open_scope(w, cKey, '[');
+}
+
+void json_arr_end(json_writer_t *w)
+{
+    close_scope(w, ']');
+}
+
+void json_add_str(json_writer_t *w, const char *cKey, const char *cValue)
+{
+    begin_member(w, cKey);
+    put_string(w, cValue);
+}
+
+void json_add_int(json_writer_t *w, const char *cKey, int32_t i32value)
+{
+    begin_member(w, cKey);
+    if (i32value < 0)
+    {
+        put_char(w, '-');
+    }
+    put_uint(w, (i32value < 0) ? (uint32_t)(-(int64_t)i32value) : (uint32_t)i32value, 1);
+}
+
+void json_add_fixed(json_writer_t *w, const char *cKey, int32_t i32value, uint8_t u8decimals)
+{
+    static const uint32_t u32pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+    if (u8decimals >= sizeof(u32pow10) / sizeof(u32pow10[0]))
+    {
+        u8decimals = sizeof(u32pow10) / sizeof(u32pow10[0]) - 1;
+    }
+
+    begin_member(w, cKey);
+    uint32_t u32abs = (i32value < 0) ? (uint32_t)(-(int64_t)i32value) : (uint32_t)i32value;
+    if (i32value < 0)
+    {
+        put_char(w, '-');
+    }
+    put_uint(w, u32abs / u32pow10[u8decimals], 1);
+    if (u8decimals > 0)
+    {
+        put_char(w, '.');
+        put_uint(w, u32abs % u32pow10[u8decimals], u8decimals);
+    }
+}
+
+void json_add_float(json_writer_t *w, const char *cKey, float fValue, uint8_t u8decimals)
+{
+    static const float fPow10[] = {1.0f, 10.0f, 100.0f, 1000.0f, 10000.0f, 100000.0f, 1000000.0f};
+
+    if (u8decimals >= sizeof(fPow10) / sizeof(fPow10[0]))
+    {
+        u8decimals = sizeof(fPow10) / sizeof(fPow10[0]) - 1;
+    }
+
+    float fScaled = fValue * fPow10[u8decimals];
+    if (!isfinite(fScaled) || (fabsf(fScaled) >= 2147483648.0f)) /* No int32_t for it: a failed read or a runaway value */
+    {
+        begin_member(w, cKey);
+        put_raw(w, "null", 4);
+        return;
+    }
+    fScaled += (fScaled >= 0.0f) ? 0.5f : -0.5f;
+    json_add_fixed(w, cKey, (int32_t)fScaled, u8decimals);
+}
+
+size_t json_writer_finish(json_writer_t *w)
+{
+    if (w->size > 0)
+    {
+        w->pcBuf[(w->len < w->size) ? w->len : w->size - 1] = '\0';
+    }
+    return w->bOverflow ? 0 : w->len;
+}
+
+void cbor_writer_init(cbor_writer_t *w, uint8_t *pu8Buf, size_t size)
+{
+    w->pu8Buf = pu8Buf;
+    w->size = size;
+    w->len = 0;
+    w->bOverflow = false;
+}
+
+void cbor_map_begin(cbor_writer_t *w, uint32_t u32pairs)
+{
+    cbor_put_head(w, 5, u32pairs);
+}
+
+void cbor_arr_begin(cbor_writer_t *w, uint32_t u32items)
+{
+    cbor_put_head(w, 4, u32items);
+}
+
+void cbor_add_uint(cbor_writer_t *w, uint32_t u32value)
+{
+    cbor_put_head(w, 0, u32value);
+}
+
+void cbor_add_int(cbor_writer_t *w, int32_t i32value)
+{
+    if (i32value >= 0)
+    {
+        cbor_put_head(w, 0, (uint32_t)i32value);
+    }
+    else
+    {
+        cbor_put_head(w, 1, (uint32_t)(-(i32value + 1)));
+    }
+}
+
+void cbor_add_text(cbor_writer_t *w, const char *cText)
+{
+    size_t len = strlen(cText);
+    cbor_put_head(w, 3, (uint32_t)len);
+    cbor_put_raw(w, (const uint8_t *)cText, len);
+}
+
+void cbor_add_bytes(cbor_writer_t *w, const uint8_t *pu8Data, size_t len)
+{
+    cbor_put_head(w, 2, (uint32_t)len);
+    cbor_put_raw(w, pu8Data, len);
+}
+
+size_t cbor_writer_finish(cbor_writer_t *w)
+{
+    return w->bOverflow ? 0 : w->len;
+}
+
+size_t packed_encode_reading(uint8_t *pu8Buf, size_t size, uint8_t u8type, uint16_t u16seq,
+                             const payload_reading_t *reading, uint8_t u8warning)
+{
+    if (size < PACKED_READING_SIZE)
+    {
+        return 0;
+    }
+
+    /* Byte by byte, so the layout does not depend on struct packing or endianness */
+    pu8Buf[0] = PAYLOAD_SCHEMA_VERSION;
+    pu8Buf[1] = u8type;
+    pu8Buf[2] = (uint8_t)u16seq;
+    pu8Buf[3] = (uint8_t)(u16seq >> 8);
+    pu8Buf[4] = (uint8_t)reading->u32timestamp;
+    pu8Buf[5] = (uint8_t)(reading->u32timestamp >> 8);
+    pu8Buf[6] = (uint8_t)(reading->u32timestamp >> 16);
+    pu8Buf[7] = (uint8_t)(reading->u32timestamp >> 24);
+    pu8Buf[8] = (uint8_t)reading->u16temp_ticks;
+    pu8Buf[9] = (uint8_t)(reading->u16temp_ticks >> 8);
+    pu8Buf[10] = (uint8_t)reading->u16humi_ticks;
+    pu8Buf[11] = (uint8_t)(reading->u16humi_ticks >> 8);
+    pu8Buf[12] = u8warning;
+    return PACKED_READING_SIZE;
+}
+
+size_t packed_encode_batch(uint8_t *pu8Buf, size_t size, uint8_t u8type, uint16_t u16seq,
+                           const payload_sample_t *samples, uint8_t u8count)
+{
+    if ((u8count == 0) || (size < PACKED_BATCH_HEADER))
+    {
+        return 0;
+    }
+
+    pu8Buf[0] = PAYLOAD_SCHEMA_VERSION;
+    pu8Buf[1] = u8type;
+    pu8Buf[2] = (uint8_t)u16seq;
+    pu8Buf[3] = (uint8_t)(u16seq >> 8);
+    pu8Buf[4] = (uint8_t)samples[0].u32timestamp;
+    pu8Buf[5] = (uint8_t)(samples[0].u32timestamp >> 8);
+    pu8Buf[6] = (uint8_t)(samples[0].u32timestamp >> 16);
+    pu8Buf[7] = (uint8_t)(samples[0].u32timestamp >> 24);
+    pu8Buf[8] = u8count;
+    pu8Buf[9] = (uint8_t)samples[0].u16temp_ticks;
+    pu8Buf[10] = (uint8_t)(samples[0].u16temp_ticks >> 8);
+    pu8Buf[11] = (uint8_t)samples[0].u16humi_ticks;
+    pu8Buf[12] = (uint8_t)(samples[0].u16humi_ticks >> 8);
+
+    size_t len = PACKED_BATCH_HEADER;
+    int32_t i32prev_delta = 0;
+    bool bOk = true;
+    for (uint8_t i = 1; bOk && (i < u8count); i++)
+    {
+        int32_t i32delta = (int32_t)(samples[i].u32timestamp - samples[i - 1].u32timestamp);
+        bOk = put_varint(pu8Buf, size, &len, i32delta - i32prev_delta);
+        i32prev_delta = i32delta;
+    }
+    for (uint8_t i = 1; bOk && (i < u8count); i++)
+    {
+        bOk = put_varint(pu8Buf, size, &len, (int32_t)samples[i].u16temp_ticks - samples[i - 1].u16temp_ticks);
+    }
+    for (uint8_t i = 1; bOk && (i < u8count); i++)
+    {
+        bOk = put_varint(pu8Buf, size, &len, (int32_t)samples[i].u16humi_ticks - samples[i - 1].u16humi_ticks);
+    }
+    return bOk ? len : 0;
+}
+
+float payload_temp_from_ticks(uint16_t u16ticks)
+{
+    return (175.0f * u16ticks / 65535.0f) - 45.0f;
+}
+
+float payload_humi_from_ticks(uint16_t u16ticks)
+{
+    return 100.0f * u16ticks / 65535.0f;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
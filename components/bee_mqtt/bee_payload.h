@@ -0,0 +1,235 @@
+/*****************************************************************************
+ *
+ * @file 	bee_payload.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	streaming payload writers for telemetry messages (JSON, CBOR and
+ *          packed binary), no heap use
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef BEE_PAYLOAD_H
+#define BEE_PAYLOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSON_MAX_DEPTH      8
+
+/* Binary encodings, bump PAYLOAD_SCHEMA_VERSION on any layout change and teach tools/bee_decode.py */
+#define PAYLOAD_SCHEMA_VERSION  1
+#define PAYLOAD_TYPE_DATA       1
+#define PAYLOAD_TYPE_WARNING    2
+#define PAYLOAD_TYPE_BATCH      3
+#define PAYLOAD_TYPE_HISTORY    4       /* Same layout as a batch, read back from bee_history on request */
+#define PACKED_READING_SIZE     13
+#define PACKED_BATCH_HEADER     13
+
+/* Integer keys of the CBOR map */
+#define CBOR_KEY_VERSION        0
+#define CBOR_KEY_TYPE           1
+#define CBOR_KEY_SEQ            2
+#define CBOR_KEY_TIMESTAMP      3
+#define CBOR_KEY_TEMP_TICKS     4
+#define CBOR_KEY_HUMI_TICKS     5
+#define CBOR_KEY_WARNING        6
+#define CBOR_KEY_WIFI_DIAG      7
+#define CBOR_KEY_TS_DELTAS      8       /* Batch: seconds between consecutive samples */
+#define CBOR_KEY_TEMP_DELTAS    9       /* Batch: tick deltas after the first temperature */
+#define CBOR_KEY_HUMI_DELTAS    10      /* Batch: tick deltas after the first humidity */
+#define CBOR_KEY_CONFIG_VERSION 11      /* Batch: remote config applied since the last acknowledged upload */
+
+typedef enum
+{
+    PAYLOAD_JSON = 0,       /* .../telemetry, the original schema */
+    PAYLOAD_CBOR,           /* .../telemetry/cbor */
+    PAYLOAD_PACKED,         /* .../telemetry/bin */
+} payload_encoding_t;
+
+typedef struct
+{
+    float    fTemp;
+    float    fHumi;
+    uint16_t u16temp_ticks;     /* Raw SHT3x words, T = -45 + 175 * ticks / 65535 */
+    uint16_t u16humi_ticks;     /* RH = 100 * ticks / 65535 */
+    uint32_t u32timestamp;      /* Unix time in seconds, 0 if the clock is not set */
+} payload_reading_t;
+
+typedef struct
+{
+    uint32_t u32timestamp;      /* Unix time in seconds, samples taken before the clock was set are held until it is */
+    uint16_t u16temp_ticks;
+    uint16_t u16humi_ticks;
+} payload_sample_t;
+
+typedef struct
+{
+    char     *pcBuf;
+    size_t   size;
+    size_t   len;
+    uint8_t  u8depth;
+    uint8_t  u8first_mask;      /* Bit n set: the next member at depth n is the first one */
+    bool     bOverflow;
+} json_writer_t;
+
+/**
+ * @brief Start writing compact JSON into a caller provided buffer.
+ *
+ * The writer never allocates. Once the buffer is full every further call is ignored
+ * and json_writer_finish() reports the overflow.
+ *
+ * @param w     Writer state.
+ * @param pcBuf Output buffer.
+ * @param size  Size of the output buffer, including the terminating NUL.
+ */
+void json_writer_init(json_writer_t *w, char *pcBuf, size_t size);
+
+/**
+ * @brief Open an object. Pass cKey NULL for the root object or for an array element.
+ */
+void json_obj_begin(json_writer_t *w, const char *cKey);
+
+/**
+ * @brief Close the innermost object.
+ */
+void json_obj_end(json_writer_t *w);
+
+/**
+ * @brief Open an array. Pass cKey NULL for a nested array element.
+ */
+void json_arr_begin(json_writer_t *w, const char *cKey);
+
+/**
+ * @brief Close the innermost array.
+ */
+void json_arr_end(json_writer_t *w);
+
+/**
+ * @brief Add a string member, quotes, backslashes and control characters are escaped.
+ */
+void json_add_str(json_writer_t *w, const char *cKey, const char *cValue);
+
+/**
+ * @brief Add an integer member.
+ */
+void json_add_int(json_writer_t *w, const char *cKey, int32_t i32value);
+
+/**
+ * @brief Add a fixed point member.
+ *
+ * The value is given already scaled, e.g. 2345 with 2 decimals is written as 23.45.
+ * Formatting is done with integer arithmetic only.
+ *
+ * @param i32value   Value multiplied by 10^u8decimals.
+ * @param u8decimals Number of digits after the decimal point (0 to 6).
+ */
+void json_add_fixed(json_writer_t *w, const char *cKey, int32_t i32value, uint8_t u8decimals);
+
+/**
+ * @brief Add a float member rounded to a fixed number of decimals, null if it is NaN, infinite or out of range.
+ */
+void json_add_float(json_writer_t *w, const char *cKey, float fValue, uint8_t u8decimals);
+
+/**
+ * @brief Terminate the output.
+ *
+ * @return Length of the JSON text without the NUL, 0 if the buffer overflowed.
+ */
+size_t json_writer_finish(json_writer_t *w);
+
+typedef struct
+{
+    uint8_t  *pu8Buf;
+    size_t   size;
+    size_t   len;
+    bool     bOverflow;
+} cbor_writer_t;
+
+/**
+ * @brief Start writing CBOR (RFC 8949) into a caller provided buffer.
+ *
+ * Only definite length items are produced, so maps and arrays take their item count up front.
+ */
+void cbor_writer_init(cbor_writer_t *w, uint8_t *pu8Buf, size_t size);
+
+/**
+ * @brief Open a map of u32pairs key/value pairs.
+ */
+void cbor_map_begin(cbor_writer_t *w, uint32_t u32pairs);
+
+/**
+ * @brief Open an array of u32items items.
+ */
+void cbor_arr_begin(cbor_writer_t *w, uint32_t u32items);
+
+/**
+ * @brief Add an unsigned integer in its shortest form.
+ */
+void cbor_add_uint(cbor_writer_t *w, uint32_t u32value);
+
+/**
+ * @brief Add a signed integer in its shortest form.
+ */
+void cbor_add_int(cbor_writer_t *w, int32_t i32value);
+
+/**
+ * @brief Add a UTF-8 text string.
+ */
+void cbor_add_text(cbor_writer_t *w, const char *cText);
+
+/**
+ * @brief Add a byte string.
+ */
+void cbor_add_bytes(cbor_writer_t *w, const uint8_t *pu8Data, size_t len);
+
+/**
+ * @brief Finish the CBOR output.
+ *
+ * @return Encoded length, 0 if the buffer overflowed.
+ */
+size_t cbor_writer_finish(cbor_writer_t *w);
+
+/**
+ * @brief Encode a reading as a versioned packed little-endian record.
+ *
+ * Layout (PAYLOAD_SCHEMA_VERSION 1, PACKED_READING_SIZE bytes):
+ *  [0] schema version, [1] message type, [2..3] sequence number, [4..7] timestamp,
+ *  [8..9] temperature ticks, [10..11] humidity ticks, [12] warning bits.
+ *
+ * @return Encoded length, 0 if size is too small.
+ */
+size_t packed_encode_reading(uint8_t *pu8Buf, size_t size, uint8_t u8type, uint16_t u16seq,
+                             const payload_reading_t *reading, uint8_t u8warning);
+
+/**
+ * @brief Encode a batch of samples as a versioned packed record.
+ *
+ * Layout (PAYLOAD_SCHEMA_VERSION 1):
+ *  [0] schema version, [1] u8type, [2..3] sequence number, [4..7] timestamp of the first sample,
+ *  [8] sample count n, [9..10] first temperature ticks, [11..12] first humidity ticks, then three series of
+ *  n - 1 zigzag LEB128 varints: timestamp delta-of-deltas (the first one is the plain delta), temperature
+ *  tick deltas, humidity tick deltas. A steady cadence and a slowly moving signal cost 1 byte per value.
+ *
+ * @param u8type PAYLOAD_TYPE_BATCH or PAYLOAD_TYPE_HISTORY.
+ * @return Encoded length, 0 if it does not fit in size or n is 0.
+ */
+size_t packed_encode_batch(uint8_t *pu8Buf, size_t size, uint8_t u8type, uint16_t u16seq,
+                           const payload_sample_t *samples, uint8_t u8count);
+
+/**
+ * @brief Convert raw SHT3x temperature ticks to degrees Celsius.
+ */
+float payload_temp_from_ticks(uint16_t u16ticks);
+
+/**
+ * @brief Convert raw SHT3x humidity ticks to percent relative humidity.
+ */
+float payload_humi_from_ticks(uint16_t u16ticks);
+
+#endif /* BEE_PAYLOAD_H */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -17,39 +17,106 @@
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "stdint.h"
+#include <stdio.h>
 #include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_rom_crc.h"
+#include <string.h>
+#include <stddef.h>
+
+static RTC_DATA_ATTR nvs_blob_t blob;        // Survives deep sleep, zeroed (invalid) by a cold boot
+static bool bNvs_init = false;
 
 static const char *TAG = "NVS";
 
 /****************************************************************************/
-/***        Exported functions                                            ***/
+/***        Local functions                                               ***/
 /****************************************************************************/
 
-void nvs_flash_func_init()
+static uint32_t blob_crc(const nvs_blob_t *b)
 {
-    esp_err_t err = nvs_flash_init(); // Initialize NVS
-    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    return esp_rom_crc32_le(0, (const uint8_t *)b, offsetof(nvs_blob_t, u32crc));
+}
+
+static bool blob_valid(const nvs_blob_t *b)
+{
+    return (b->u16magic == NVS_BLOB_MAGIC) && (b->u8version == NVS_BLOB_VERSION) &&
+           (b->cred_list.u8count <= WIFI_CRED_MAX) && (b->u8app_len <= NVS_APP_MAX) && (b->u32crc == blob_crc(b));
+}
+
+static void load_legacy_wifi_cred(wifi_cred_list_t *list)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_WIFI_CRED, NVS_READONLY, &nvs_handle);
+
+    if (err == ESP_OK)
     {
-    ESP_ERROR_CHECK(nvs_flash_erase());
-    err = nvs_flash_init();
+        wifi_cred_t *cred = &list->creds[0];
+        size_t ssid_len = sizeof(cred->cSsid);
+        size_t password_len = sizeof(cred->cPassword);
+
+        err = nvs_get_str(nvs_handle, NVS_WIFI_SSID, cred->cSsid, &ssid_len);
+        err |= nvs_get_str(nvs_handle, NVS_WIFI_PASS, cred->cPassword, &password_len);
+        err |= nvs_get_u8(nvs_handle, NVS_WIFI_CHANNEL, &cred->u8channel);
+
+        if ((err == ESP_OK) && (strlen(cred->cSsid) > 0))
+        {
+            list->u8count = 1;
+        }
+        nvs_close(nvs_handle);
     }
-    ESP_ERROR_CHECK( err );
 }
 
-void save_wifi_cred_to_nvs(const char *cSsid, const char *cPassword, uint8_t u8channel)
+static void load_legacy_wifi_list(wifi_cred_list_t *list)
 {
     nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open(NVS_WIFI_CRED, NVS_READWRITE, &nvs_handle);
+    esp_err_t err = nvs_open(NVS_WIFI_CRED, NVS_READONLY, &nvs_handle);
 
     if (err == ESP_OK)
     {
-        err = nvs_set_str(nvs_handle, NVS_WIFI_SSID, cSsid);
-        err |= nvs_set_str(nvs_handle, NVS_WIFI_PASS, cPassword);
-        err |= nvs_set_u8(nvs_handle, NVS_WIFI_CHANNEL, u8channel);
+        size_t list_len = sizeof(wifi_cred_list_t);
+        err = nvs_get_blob(nvs_handle, NVS_WIFI_LIST, list, &list_len);
+        nvs_close(nvs_handle);
+
+        if ((err != ESP_OK) || (list_len != sizeof(wifi_cred_list_t)) || (list->u8count > WIFI_CRED_MAX))
+        {
+            memset(list, 0, sizeof(wifi_cred_list_t));
+            load_legacy_wifi_cred(list);
+        }
+    }
+}
+
+static void load_legacy_config(nvs_blob_t *b)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_CONFIG, NVS_READONLY, &nvs_handle) == ESP_OK)
+    {
+        size_t len = sizeof(b->u8app);
+        if (nvs_get_blob(nvs_handle, NVS_CONFIG_BLOB, b->u8app, &len) == ESP_OK)
+        {
+            b->u8app_len = (uint8_t)len;
+        }
+        nvs_close(nvs_handle);
+    }
+}
+
+/* Seal the RTC copy and store it */
+static bool blob_write(void)
+{
+    blob.u32crc = blob_crc(&blob);
+    nvs_flash_func_init();
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_CONFIG, NVS_READWRITE, &nvs_handle);
+
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(nvs_handle, NVS_BLOB, &blob, sizeof(blob));
+        err |= nvs_commit(nvs_handle);
 
         if (err != ESP_OK)
         {
-            ESP_LOGE(TAG, "Error saving wifi credentials to NVS! (%s)\n", esp_err_to_name(err));
+            ESP_LOGE(TAG, "Error saving config blob to NVS! (%s)\n", esp_err_to_name(err));
         }
 
         nvs_close(nvs_handle);
@@ -58,40 +125,200 @@ void save_wifi_cred_to_nvs(const char *cSsid, const char *cPassword, uint8_t u8c
     {
         ESP_LOGE(TAG, "Error opening NVS handle! (%s)\n", esp_err_to_name(err));
     }
+    return (err == ESP_OK);
 }
 
-void load_old_wifi_cred(char *cSsid, char *cPassword, uint8_t *u8channel)
+/* The RTC copy, read from NVS once after a cold boot */
+static nvs_blob_t *blob_get(void)
 {
+    if (blob_valid(&blob))
+    {
+        return &blob;
+    }
+    nvs_flash_func_init();
+
     nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open(NVS_WIFI_CRED, NVS_READONLY, &nvs_handle);
+    if (nvs_open(NVS_CONFIG, NVS_READONLY, &nvs_handle) == ESP_OK)
+    {
+        size_t len = sizeof(blob);
+        esp_err_t err = nvs_get_blob(nvs_handle, NVS_BLOB, &blob, &len);
+        nvs_close(nvs_handle);
+        if ((err == ESP_OK) && (len == sizeof(blob)) && blob_valid(&blob))
+        {
+            return &blob;
+        }
+    }
 
-    if (err == ESP_OK)
+    /* First boot with this layout: build it from the separate entries of older firmware */
+    memset(&blob, 0, sizeof(blob));
+    blob.u16magic = NVS_BLOB_MAGIC;
+    blob.u8version = NVS_BLOB_VERSION;
+    load_legacy_wifi_list(&blob.cred_list);
+    load_legacy_config(&blob);
+    blob_write();
+    ESP_LOGI(TAG, "Config blob built: %u networks, %u config bytes", blob.cred_list.u8count, blob.u8app_len);
+    return &blob;
+}
+
+/****************************************************************************/
+/***        Exported functions                                            ***/
+/****************************************************************************/
+
+void nvs_flash_func_init()
+{
+    if (bNvs_init)
     {
-        size_t ssid_len = 32;
-        size_t password_len = 64;
+        return;
+    }
+    bool bErased = false;
+    esp_err_t err = nvs_flash_init(); // Initialize NVS
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+    ESP_ERROR_CHECK(nvs_flash_erase());
+    err = nvs_flash_init();
+    bErased = true;
+    }
+    ESP_ERROR_CHECK( err );
+    bNvs_init = true;
+    if (bErased && blob_valid(&blob))
+    {
+        blob_write(); // The RTC copy outlived the erase
+    }
+}
+
+void load_wifi_cred_list(wifi_cred_list_t *list)
+{
+    *list = blob_get()->cred_list;
+
+    if (list->u8count == 0)
+    {
+        ESP_LOGE(TAG, "Wifi cred not found in NVS\n");
+    }
+}
 
-        err = nvs_get_str(nvs_handle, NVS_WIFI_SSID, cSsid, &ssid_len);
-        err |= nvs_get_str(nvs_handle, NVS_WIFI_PASS, cPassword, &password_len);
-        err |= nvs_get_u8(nvs_handle, NVS_WIFI_CHANNEL, u8channel);
+bool save_wifi_cred_list(const wifi_cred_list_t *list)
+{
+    nvs_blob_t *b = blob_get();
+    if (memcmp(&b->cred_list, list, sizeof(wifi_cred_list_t)) == 0)
+    {
+        return true;
+    }
+    b->cred_list = *list;
+    return blob_write();
+}
+
+bool load_config_from_nvs(void *pData, size_t len)
+{
+    const nvs_blob_t *b = blob_get();
+    if (b->u8app_len != len)
+    {
+        return false;
+    }
+    memcpy(pData, b->u8app, len);
+    return true;
+}
+
+void save_config_to_nvs(const void *pData, size_t len)
+{
+    nvs_blob_t *b = blob_get();
+    if ((len > NVS_APP_MAX) || ((b->u8app_len == len) && (memcmp(b->u8app, pData, len) == 0)))
+    {
+        return;
+    }
+    memcpy(b->u8app, pData, len);
+    b->u8app_len = (uint8_t)len;
+    blob_write();
+}
+
+uint8_t save_wifi_cred_to_nvs(const char *cSsid, const char *cPassword, uint8_t u8channel)
+{
+    wifi_cred_list_t list;
+    load_wifi_cred_list(&list);
 
-        if (err == ESP_OK)
+    uint8_t u8idx = WIFI_CRED_NONE;
+    for (uint8_t i = 0; i < list.u8count; i++)
+    {
+        if (strcmp(list.creds[i].cSsid, cSsid) == 0)
         {
-            // Process loaded data, if necessary
+            u8idx = i;
+            break;
         }
-        else if (err == ESP_ERR_NVS_NOT_FOUND)
+    }
+
+    if (u8idx == WIFI_CRED_NONE)
+    {
+        if (list.u8count < WIFI_CRED_MAX)
         {
-            ESP_LOGE(TAG, "Wifi cred not found in NVS\n");
+            u8idx = list.u8count++;
         }
         else
         {
-            ESP_LOGE(TAG, "Error reading wifi credentials from NVS! (%s)\n", esp_err_to_name(err));
+            /* Replace the network with the lowest success rate */
+            u8idx = 0;
+            for (uint8_t i = 1; i < list.u8count; i++)
+            {
+                if ((uint32_t)list.creds[i].u8successes * (list.creds[u8idx].u8attempts + 1) <
+                    (uint32_t)list.creds[u8idx].u8successes * (list.creds[i].u8attempts + 1))
+                {
+                    u8idx = i;
+                }
+            }
         }
+        memset(&list.creds[u8idx], 0, sizeof(wifi_cred_t));
+        snprintf(list.creds[u8idx].cSsid, sizeof(list.creds[u8idx].cSsid), "%s", cSsid);
+    }
+
+    snprintf(list.creds[u8idx].cPassword, sizeof(list.creds[u8idx].cPassword), "%s", cPassword);
+    list.creds[u8idx].u8channel = u8channel;
+
+    return save_wifi_cred_list(&list) ? u8idx : WIFI_CRED_NONE;
+}
+
+bool load_ota_checkpoint(void *pData, size_t len)
+{
+    nvs_flash_func_init();
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_CONFIG, NVS_READONLY, &nvs_handle) != ESP_OK)
+    {
+        return false;
+    }
+    size_t stored_len = len;
+    esp_err_t err = nvs_get_blob(nvs_handle, NVS_OTA_CKPT, pData, &stored_len);
+    nvs_close(nvs_handle);
+    return (err == ESP_OK) && (stored_len == len);
+}
+
+void save_ota_checkpoint(const void *pData, size_t len)
+{
+    nvs_flash_func_init();
 
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_CONFIG, NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(nvs_handle, NVS_OTA_CKPT, pData, len);
+        err |= nvs_commit(nvs_handle);
         nvs_close(nvs_handle);
     }
-    else
+    if (err != ESP_OK)
     {
-        ESP_LOGE(TAG, "Error opening NVS handle! (%s)\n", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Error saving OTA checkpoint to NVS! (%s)\n", esp_err_to_name(err));
+    }
+}
+
+void erase_ota_checkpoint(void)
+{
+    nvs_flash_func_init();
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_CONFIG, NVS_READWRITE, &nvs_handle) == ESP_OK)
+    {
+        if (nvs_erase_key(nvs_handle, NVS_OTA_CKPT) == ESP_OK)
+        {
+            nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
     }
 }
 
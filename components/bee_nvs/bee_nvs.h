@@ -13,17 +13,64 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #define NVS_WIFI_CRED           "wifi_cred"
 #define NVS_WIFI_PASS           "wifi_pass"
 #define NVS_WIFI_SSID           "wifi_ssid"
 #define NVS_WIFI_CHANNEL        "wifi_channel"
+#define NVS_WIFI_LIST           "wifi_list"
+#define NVS_CONFIG              "config"
+#define NVS_CONFIG_BLOB         "config_blob"   /* Remote config before the blob, migrated */
+#define NVS_BLOB                "bee_blob"
+#define NVS_OTA_CKPT            "ota_ckpt"      /* Update in progress, apart from the blob as it changes often */
+#define NVS_BLOB_MAGIC          0xB10B
+#define NVS_BLOB_VERSION        1               /* Bump when nvs_blob_t changes, the blob is rebuilt */
+#define NVS_APP_MAX             64              /* Room for the remote config */
+
+#define WIFI_CRED_MAX           4
+#define WIFI_CRED_NONE          0xFF
+
+typedef struct
+{
+    char     cSsid[33];
+    char     cPassword[65];
+    uint8_t  u8channel;     /* Last known channel */
+    int8_t   i8rssi;        /* Last known RSSI */
+    uint8_t  u8attempts;    /* Connect attempts, halved together with u8successes on overflow */
+    uint8_t  u8successes;
+} wifi_cred_t;
+
+typedef struct
+{
+    uint8_t     u8count;
+    wifi_cred_t creds[WIFI_CRED_MAX];
+} wifi_cred_list_t;
+
+/*
+ * Everything bee_nvs keeps, as one NVS entry under NVS_CONFIG/NVS_BLOB. It is read once after a cold
+ * boot into RTC memory, later wakes use that copy without touching NVS. Writes go through the copy
+ * to NVS, and only when the content changed.
+ */
+typedef struct
+{
+    uint16_t         u16magic;          /* NVS_BLOB_MAGIC */
+    uint8_t          u8version;         /* NVS_BLOB_VERSION */
+    uint8_t          u8app_len;         /* Bytes used in u8app */
+    wifi_cred_list_t cred_list;
+    uint8_t          u8app[NVS_APP_MAX];
+    uint32_t         u32crc;            /* CRC32 of everything above */
+} nvs_blob_t;
 
 /**
  * @brief   Initialize the Non-Volatile Storage (NVS) flash memory.
  *
  * This function initializes the NVS flash memory. If there are no free pages or a new version is found, it erases the NVS
  * and then attempts to initialize it again. Any errors encountered during initialization are checked and handled.
+ * A blob held in RTC memory is written back after an erase. Calls after the first one return at once.
+ *
+ * The blob functions below initialize NVS themselves when they need it, i.e. after a cold boot or for a write.
+ * It is still initialized before Wi-Fi starts, as the PHY reads its RF calibration data from it.
  *
  * @note    The function assumes that NVS flash memory initialization is crucial for proper system operation.
  *
@@ -35,25 +82,72 @@ void nvs_flash_func_init();
 /**
  * @brief Save Wi-Fi credentials to NVS.
  *
- * This function saves the provided Wi-Fi SSID and password to the NVS (Non-Volatile Storage).
+ * This function adds the provided network to the credential list in NVS (Non-Volatile Storage),
+ * or updates its password and channel if the SSID is already known. When the list is full, the
+ * entry with the lowest success rate is replaced.
  *
  * @param cSsid     Pointer to the Wi-Fi SSID string.
  * @param cPassword Pointer to the Wi-Fi password string.
+ * @param u8channel Channel the network was seen on.
+ * @return Index of the network in the credential list, WIFI_CRED_NONE if writing or committing NVS failed.
  */
-void save_wifi_cred_to_nvs(const char *cSsid, const char *cPassword, uint8_t u8channel);
+uint8_t save_wifi_cred_to_nvs(const char *cSsid, const char *cPassword, uint8_t u8channel);
 
 /**
- * @brief Load old Wi-Fi credentials from NVS.
+ * @brief Load the Wi-Fi credential list from the blob.
  *
- * This function loads the old Wi-Fi SSID and password from the Non-Volatile Storage (NVS).
- * It first opens the NVS, then reads the SSID and password values if they exist.
- * If not found or if any error occurs, appropriate error messages are printed.
- * The NVS handle is then closed.
+ * If the blob does not exist yet it is built from what older firmware saved: the NVS_WIFI_LIST blob,
+ * or the single network under NVS_WIFI_SSID/NVS_WIFI_PASS/NVS_WIFI_CHANNEL.
+ *
+ * @param list Buffer to store the loaded list, u8count is 0 when nothing is stored.
+ */
+void load_wifi_cred_list(wifi_cred_list_t *list);
+
+/**
+ * @brief Save the Wi-Fi credential list, including the learned statistics, to the blob.
+ *
+ * NVS is only written if the list differs from the one in the blob.
+ *
+ * @param list Pointer to the list to store.
+ * @return true if NVS holds the list, false if writing or committing it failed.
+ */
+bool save_wifi_cred_list(const wifi_cred_list_t *list);
+
+/**
+ * @brief Load the remote configuration from the blob.
  *
- * @param cSsid Buffer to store the loaded Wi-Fi SSID.
- * @param cPassword Buffer to store the loaded Wi-Fi password.
+ * @param pData Buffer for the configuration.
+ * @param len   Expected size, a stored configuration of another size is ignored.
+ * @return true if one of that size was read, the caller still checks its content.
+ */
+bool load_config_from_nvs(void *pData, size_t len);
+
+/**
+ * @brief Save the remote configuration in the blob, NVS is only written if it changed.
+ *
+ * @param pData Configuration to store.
+ * @param len   Its size, at most NVS_APP_MAX.
+ */
+void save_config_to_nvs(const void *pData, size_t len);
+
+/**
+ * @brief Load the checkpoint of an interrupted OTA.
+ *
+ * @param pData Buffer for the checkpoint.
+ * @param len   Expected size, a stored checkpoint of another size is ignored.
+ * @return true if one of that size was read, the caller still checks its content.
+ */
+bool load_ota_checkpoint(void *pData, size_t len);
+
+/**
+ * @brief Save the checkpoint of an OTA in progress, a few times per update.
+ */
+void save_ota_checkpoint(const void *pData, size_t len);
+
+/**
+ * @brief Remove the OTA checkpoint, NVS is only written if there is one.
  */
-void load_old_wifi_cred(char *cSsid, char *cPassword, uint8_t *u8channel);
+void erase_ota_checkpoint(void);
 
 #endif /* BEE_NVS_H */
 
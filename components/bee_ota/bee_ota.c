@@ -10,22 +10,104 @@
 /****************************************************************************/
 /***        Include files                                                 ***/
 /****************************************************************************/
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_system.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_rom_crc.h"
+#include "esp_partition.h"
 #include "esp_ota_ops.h"
 #include "esp_http_client.h"
-#include "esp_https_ota.h"
+#include "mbedtls/sha256.h"
+#include "rom/miniz.h"
 
 #include "bee_ota.h"
 #include "bee_nvs.h"
 #include "bee_wifi.h"
 #include "bee_mqtt.h"
+#include "bee_tls.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define IMAGE_MAGIC         0xE9        /* First byte of an app image */
+#define OTA_SESSION_MAGIC   0x07A5E551
+#define OTA_FORMAT_PLAIN    0
+#define OTA_FORMAT_PACKED   1
+#define OTA_NO_BUDGET       UINT32_MAX
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/* An update in progress, its checkpoint is where a Range request picks it up again */
+typedef struct
+{
+    uint32_t u32magic;              /* OTA_SESSION_MAGIC, anything else means no update */
+    uint8_t  u8format;              /* OTA_FORMAT_xxx, known once the first bytes are in */
+    uint8_t  u8stalls;              /* Requests in a row that wrote nothing */
+    uint8_t  u8progress;            /* Percent last published */
+    uint8_t  u8reserved;
+    char     cUrl[OTA_URL_MAX];
+    uint32_t u32file_size;          /* Whole download, 0 until the first response */
+    uint32_t u32file_offset;        /* Download bytes consumed up to the checkpoint */
+    uint32_t u32image_bytes;        /* Slot bytes written up to the checkpoint */
+    ota_pack_header_t header;       /* Of a container */
+    ota_delta_header_t delta;       /* Of a delta container */
+    ota_report_t report;            /* Every request of the update together */
+    uint32_t u32expect_size;        /* Image a manifest announced, 0 without one */
+    uint8_t  u8expect_sha256[32];
+    uint32_t u32crc;                /* CRC32 of everything above */
+} ota_session_t;
+
+typedef struct
+{
+    esp_http_client_handle_t client;
+    const esp_partition_t *partition;
+    const esp_partition_t *base;    /* Running partition, a delta applies to it */
+    uint32_t u32file_pos;           /* Download bytes consumed */
+    uint32_t u32image_pos;          /* Slot bytes written */
+    uint32_t u32erased;             /* Slot bytes erased from the start */
+    uint32_t u32buf_len;            /* Of each buffer, the tuning when the request started */
+    uint32_t u32nvs_image;          /* u32image_bytes of the checkpoint in NVS */
+    uint32_t u32range_start;        /* Content-Range of the response */
+    uint32_t u32range_total;
+    int64_t  i64deadline_us;
+    int64_t  i64progress_us;        /* Last progress message */
+    int64_t  i64net_us;             /* Time of this request in the HTTP client */
+    int64_t  i64flash_us;           /* and in flash erases and writes */
+    bool     bFatal;                /* The update cannot succeed, as opposed to a network error */
+    ota_patch_op_t op;              /* Delta record being applied */
+    uint8_t  u8op_have;             /* Bytes of its header in, sizeof(op) once complete */
+    uint8_t  *pu8buf;               /* Receive buffer, on the heap for the length of a request */
+    uint8_t  *pu8base;              /* Base bytes plus the delta, same length */
+} ota_ctx_t;
+
+typedef esp_err_t (*ota_sink_t)(const uint8_t *pu8Data, size_t len);
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static RTC_DATA_ATTR ota_session_t session;
+static RTC_DATA_ATTR bool bChecked = false;    /* NVS was looked at since the cold boot */
+static RTC_DATA_ATTR ota_tuning_t tuning = {.u16rx_buf = OTA_RX_BUF, .u32erase_unit = OTA_ERASE_UNIT};
+static ota_ctx_t ctx;               /* Off the stack of the calling task */
 
 static const char *TAG = "OTA";
-extern const uint8_t server_cert_pem_start[] asm("_binary_ca_cert_pem_start");
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
 
 esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
     switch (evt->event_id) {
@@ -40,6 +122,15 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
         break;
     case HTTP_EVENT_ON_HEADER:
         ESP_LOGD(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", evt->header_key, evt->header_value);
+        if (strcasecmp(evt->header_key, "Content-Range") == 0)
+        {
+            unsigned long start, total;
+            if (sscanf(evt->header_value, "bytes %lu-%*u/%lu", &start, &total) == 2)
+            {
+                ctx.u32range_start = (uint32_t)start;
+                ctx.u32range_total = (uint32_t)total;
+            }
+        }
         break;
     case HTTP_EVENT_ON_DATA:
         ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
@@ -57,6 +148,666 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
     return ESP_OK;
 }
 
+static uint32_t session_crc(void)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)&session, offsetof(ota_session_t, u32crc));
+}
+
+static bool session_valid(void)
+{
+    return (session.u32magic == OTA_SESSION_MAGIC) && (session.u32crc == session_crc());
+}
+
+static void session_seal(void)
+{
+    session.u32crc = session_crc();
+}
+
+/* The RTC copy is always current, NVS only every OTA_NVS_EVERY bytes and when a request ends */
+static void session_store(void)
+{
+    session_seal();
+    save_ota_checkpoint(&session, sizeof(session));
+    ctx.u32nvs_image = session.u32image_bytes;
+}
+
+static void session_clear(void)
+{
+    memset(&session, 0, sizeof(session));
+    erase_ota_checkpoint();
+}
+
+static void session_new(const char *cUrl, const uint8_t *pu8Sha256, uint32_t u32size)
+{
+    memset(&session, 0, sizeof(session));
+    session.u32magic = OTA_SESSION_MAGIC;
+    snprintf(session.cUrl, sizeof(session.cUrl), "%s", cUrl);
+    if (pu8Sha256 != NULL)
+    {
+        session.u32expect_size = u32size;
+        memcpy(session.u8expect_sha256, pu8Sha256, sizeof(session.u8expect_sha256));
+    }
+    session_store();
+}
+
+/* A point a Range request can start again from */
+static void checkpoint(void)
+{
+    session.u32file_offset = ctx.u32file_pos;
+    session.u32image_bytes = ctx.u32image_pos;
+    session_seal();
+    if (session.u32image_bytes - ctx.u32nvs_image >= OTA_NVS_EVERY)
+    {
+        session_store();
+    }
+}
+
+static uint8_t progress_percent(void)
+{
+    return (session.u32file_size > 0) ? (uint8_t)((uint64_t)ctx.u32file_pos * 100 / session.u32file_size) : 0;
+}
+
+/* Bounded rate: OTA_PROGRESS_STEP percent and OTA_PROGRESS_MS apart, bForce skips the time */
+static void progress(bool bForce)
+{
+    uint8_t u8percent = progress_percent();
+    int64_t i64now_us = esp_timer_get_time();
+    if ((u8percent >= session.u8progress + OTA_PROGRESS_STEP) &&
+        (bForce || (i64now_us - ctx.i64progress_us >= OTA_PROGRESS_MS * 1000LL)))
+    {
+        pub_ota_progress(u8percent);
+        session.u8progress = u8percent;
+        ctx.i64progress_us = i64now_us;
+    }
+}
+
+static bool out_of_time(void)
+{
+    return esp_timer_get_time() >= ctx.i64deadline_us;
+}
+
+/* Whatever the connection has, up to len bytes, 0 at the end of the body */
+static int http_read(uint8_t *pu8Buf, size_t len)
+{
+    int64_t i64start_us = esp_timer_get_time();
+    int n = esp_http_client_read(ctx.client, (char *)pu8Buf, len);
+    ctx.i64net_us += esp_timer_get_time() - i64start_us;
+    if (n > 0)
+    {
+        ctx.u32file_pos += n;
+        session.report.u32download_bytes += n;
+    }
+    return n;
+}
+
+/* The body ended before the bytes expected: the connection dropped, or the file is short of its own header */
+static esp_err_t cut_short(void)
+{
+    ctx.bFatal |= esp_http_client_is_complete_data_received(ctx.client);
+    return ESP_ERR_INVALID_SIZE;
+}
+
+static esp_err_t http_read_exact(uint8_t *pu8Buf, size_t len)
+{
+    while (len > 0)
+    {
+        int n = http_read(pu8Buf, len);
+        if (n <= 0)
+        {
+            return cut_short();
+        }
+        pu8Buf += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+/* Size of the image, 0 until the response or the container header tells */
+static uint32_t image_size(void)
+{
+    return (session.u8format == OTA_FORMAT_PACKED) ? session.header.u32image_size : session.u32file_size;
+}
+
+/* End of the next erase: one unit on, never past the sector the image ends in */
+static uint32_t erase_end(void)
+{
+    uint32_t u32limit = ctx.partition->size;
+    if ((image_size() > 0) && (image_size() < u32limit))
+    {
+        u32limit = (image_size() + OTA_SECTOR_SIZE - 1) & ~(OTA_SECTOR_SIZE - 1);
+    }
+    uint32_t u32end = (tuning.u32erase_unit == OTA_ERASE_IMAGE) ? u32limit :
+                      (ctx.u32erased / tuning.u32erase_unit + 1) * tuning.u32erase_unit;
+    u32end = (u32end < u32limit) ? u32end : u32limit;
+    return (u32end > ctx.u32erased) ? u32end : ctx.u32erased + OTA_SECTOR_SIZE; // Past its size, it fails later
+}
+
+/* Straight to the partition, esp_ota_begin() would erase what earlier wakes wrote */
+static esp_err_t image_write(const uint8_t *pu8Data, size_t len)
+{
+    if ((ctx.u32image_pos == 0) && (len > 0) && (pu8Data[0] != IMAGE_MAGIC))
+    {
+        ctx.bFatal = true;
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    if (len > ctx.partition->size - ctx.u32image_pos)
+    {
+        ctx.bFatal = true;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    int64_t i64start_us = esp_timer_get_time();
+    esp_err_t err = ESP_OK;
+    while ((err == ESP_OK) && (ctx.u32erased < ctx.u32image_pos + len))
+    {
+        uint32_t u32end = erase_end();
+        err = esp_partition_erase_range(ctx.partition, ctx.u32erased, u32end - ctx.u32erased);
+        ctx.u32erased = (err == ESP_OK) ? u32end : ctx.u32erased;
+    }
+    err = (err == ESP_OK) ? esp_partition_write(ctx.partition, ctx.u32image_pos, pu8Data, len) : err;
+    ctx.i64flash_us += esp_timer_get_time() - i64start_us;
+    if (err == ESP_OK)
+    {
+        ctx.u32image_pos += len;
+        session.report.u32image_bytes += len;
+    }
+    return err;
+}
+
+/* Inflated delta records in, image bytes out, a record may be split anywhere */
+static esp_err_t patch_feed(const uint8_t *pu8Data, size_t len)
+{
+    esp_err_t err = ESP_OK;
+
+    while ((err == ESP_OK) && (len > 0))
+    {
+        size_t n;
+        if (ctx.u8op_have < sizeof(ctx.op))
+        {
+            n = sizeof(ctx.op) - ctx.u8op_have;
+            n = (n < len) ? n : len;
+            memcpy((uint8_t *)&ctx.op + ctx.u8op_have, pu8Data, n);
+            ctx.u8op_have += n;
+            if ((ctx.u8op_have == sizeof(ctx.op)) && ((ctx.op.u32copy_len > session.delta.u32base_size) ||
+                (ctx.op.u32src > session.delta.u32base_size - ctx.op.u32copy_len)))
+            {
+                ctx.bFatal = true;
+                err = ESP_ERR_INVALID_ARG;
+            }
+        }
+        else if (ctx.op.u32copy_len > 0)
+        {
+            n = (ctx.op.u32copy_len < len) ? ctx.op.u32copy_len : len;
+            n = (n < ctx.u32buf_len) ? n : ctx.u32buf_len;
+            err = esp_partition_read(ctx.base, ctx.op.u32src, ctx.pu8base, n);
+            for (size_t i = 0; i < n; i++)
+            {
+                ctx.pu8base[i] += pu8Data[i];
+            }
+            err = (err == ESP_OK) ? image_write(ctx.pu8base, n) : err;
+            ctx.op.u32src += n;
+            ctx.op.u32copy_len -= n;
+        }
+        else
+        {
+            n = (ctx.op.u32literal_len < len) ? ctx.op.u32literal_len : len;
+            err = image_write(pu8Data, n);
+            ctx.op.u32literal_len -= n;
+        }
+        if ((ctx.u8op_have == sizeof(ctx.op)) && (ctx.op.u32copy_len == 0) && (ctx.op.u32literal_len == 0))
+        {
+            ctx.u8op_have = 0;
+        }
+        pu8Data += n;
+        len -= n;
+    }
+    return err;
+}
+
+/* A plain image, the first `have` bytes of this response are already in the buffer */
+static esp_err_t copy_plain(size_t have)
+{
+    esp_err_t err = image_write(ctx.pu8buf, have);
+    while ((err == ESP_OK) && (ctx.u32file_pos < session.u32file_size))
+    {
+        checkpoint();
+        progress(false);
+        if (out_of_time())
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+        int n = http_read(ctx.pu8buf, ctx.u32buf_len);
+        if (n <= 0)
+        {
+            return (n < 0) ? ESP_FAIL : ESP_ERR_INVALID_SIZE;
+        }
+        err = image_write(ctx.pu8buf, n);
+    }
+    if (err == ESP_OK)
+    {
+        checkpoint();
+    }
+    return err;
+}
+
+/* One chunk: a zlib stream of u32comp_len bytes, inflated through the dictionary into the sink */
+static esp_err_t inflate_chunk(tinfl_decompressor *inflator, uint8_t *pu8Dict, ota_sink_t sink, uint32_t u32comp_len,
+                               uint32_t u32raw_len)
+{
+    uint32_t u32start = ctx.u32image_pos;
+    size_t in_len = 0;
+    size_t in_pos = 0;
+    size_t dict_pos = 0;
+    tinfl_status status = TINFL_STATUS_NEEDS_MORE_INPUT;
+
+    tinfl_init(inflator);
+    while (status != TINFL_STATUS_DONE)
+    {
+        if ((in_pos == in_len) && (u32comp_len > 0))
+        {
+            size_t want = (u32comp_len < ctx.u32buf_len) ? u32comp_len : ctx.u32buf_len;
+            int n = http_read(ctx.pu8buf, want);
+            if (n <= 0)
+            {
+                return cut_short();
+            }
+            in_len = n;
+            in_pos = 0;
+            u32comp_len -= n;
+        }
+
+        size_t in_size = in_len - in_pos;
+        size_t out_size = TINFL_LZ_DICT_SIZE - dict_pos;
+        status = tinfl_decompress(inflator, &ctx.pu8buf[in_pos], &in_size, pu8Dict, &pu8Dict[dict_pos], &out_size,
+                                  TINFL_FLAG_PARSE_ZLIB_HEADER | ((u32comp_len > 0) ? TINFL_FLAG_HAS_MORE_INPUT : 0));
+        in_pos += in_size;
+        if (out_size > 0)
+        {
+            esp_err_t err = sink(&pu8Dict[dict_pos], out_size);
+            if (err != ESP_OK)
+            {
+                return err;
+            }
+            dict_pos = (dict_pos + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+        if ((status < TINFL_STATUS_DONE) ||
+            ((status == TINFL_STATUS_NEEDS_MORE_INPUT) && (in_pos == in_len) && (u32comp_len == 0)))
+        {
+            ESP_LOGE(TAG, "Chunk at %lu does not inflate (%d)", u32start, status);
+            ctx.bFatal = true;
+            return ESP_ERR_INVALID_CRC;
+        }
+    }
+    /* A delta chunk ends with a whole record */
+    if ((in_pos != in_len) || (u32comp_len != 0) || (ctx.u32image_pos - u32start != u32raw_len) || (ctx.u8op_have != 0))
+    {
+        ctx.bFatal = true;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+/* SHA-256 of the first u32size bytes of a partition, read through the buffer given */
+static esp_err_t partition_sha256(const esp_partition_t *partition, uint32_t u32size, uint8_t *pu8Sha256,
+                                  uint8_t *pu8Buf, size_t buf_len)
+{
+    mbedtls_sha256_context sha;
+    esp_err_t err = ESP_OK;
+
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    for (uint32_t u32off = 0; (err == ESP_OK) && (u32off < u32size); u32off += buf_len)
+    {
+        size_t len = u32size - u32off;
+        len = (len < buf_len) ? len : buf_len;
+        err = esp_partition_read(partition, u32off, pu8Buf, len);
+        mbedtls_sha256_update(&sha, pu8Buf, len);
+    }
+    mbedtls_sha256_finish(&sha, pu8Sha256);
+    mbedtls_sha256_free(&sha);
+    return err;
+}
+
+/* SHA-256 of the slot as written, whatever number of wakes it took */
+static esp_err_t check_slot_hash(const uint8_t *pu8Expected, uint32_t u32size)
+{
+    uint8_t u8sha256[32];
+    esp_err_t err = partition_sha256(ctx.partition, u32size, u8sha256, ctx.pu8buf, ctx.u32buf_len);
+    if ((err == ESP_OK) && (memcmp(u8sha256, pu8Expected, sizeof(u8sha256)) != 0))
+    {
+        ESP_LOGE(TAG, "Image SHA-256 mismatch");
+        err = ESP_ERR_INVALID_CRC;
+    }
+    return err;
+}
+
+/* The image a manifest announced, the container header only vouches for itself */
+static esp_err_t check_expected(void)
+{
+    if (session.u32expect_size == 0)
+    {
+        return ESP_OK;
+    }
+    if (ctx.u32image_pos != session.u32expect_size)
+    {
+        ESP_LOGE(TAG, "Image of %lu bytes, the manifest says %lu", ctx.u32image_pos, session.u32expect_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if ((session.u8format == OTA_FORMAT_PACKED) &&
+        (memcmp(session.header.u8sha256, session.u8expect_sha256, sizeof(session.u8expect_sha256)) == 0))
+    {
+        return ESP_OK; // The same hash was just checked
+    }
+    return check_slot_hash(session.u8expect_sha256, session.u32expect_size);
+}
+
+/* A delta is only good for the image it was made from */
+static esp_err_t check_base_hash(void)
+{
+    uint8_t u8sha256[32];
+    if ((ctx.base == NULL) || (session.delta.u32base_size > ctx.base->size))
+    {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    esp_err_t err = partition_sha256(ctx.base, session.delta.u32base_size, u8sha256, ctx.pu8buf, ctx.u32buf_len);
+    if ((err == ESP_OK) && (memcmp(u8sha256, session.delta.u8base_sha256, sizeof(u8sha256)) != 0))
+    {
+        ESP_LOGE(TAG, "Delta made for another image than the running one");
+        err = ESP_ERR_INVALID_VERSION;
+    }
+    return err;
+}
+
+/* The container header, the first `have` bytes of it are already in the buffer */
+static esp_err_t read_pack_header(size_t have)
+{
+    ota_pack_header_t *header = &session.header;
+
+    memcpy(header, ctx.pu8buf, have);
+    esp_err_t err = http_read_exact((uint8_t *)header + have, sizeof(*header) - have);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if ((header->u8version != OTA_PACK_VERSION) || (header->u8kind > OTA_PACK_KIND_DELTA) ||
+        (header->u32chunk_size == 0) || (header->u32chunk_size % OTA_SECTOR_SIZE != 0) ||
+        (header->u32chunk_size > OTA_PACK_CHUNK_MAX) || (header->u32image_size > ctx.partition->size))
+    {
+        ctx.bFatal = true;
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (header->u8kind == OTA_PACK_KIND_DELTA)
+    {
+        err = http_read_exact((uint8_t *)&session.delta, sizeof(session.delta));
+        err = (err == ESP_OK) ? check_base_hash() : err;
+        if (err != ESP_OK)
+        {
+            ctx.bFatal |= (err == ESP_ERR_INVALID_VERSION);
+            return err;
+        }
+    }
+    session.u8format = OTA_FORMAT_PACKED;
+    checkpoint();
+    return ESP_OK;
+}
+
+/* The chunks of a container from the current one, each one a checkpoint */
+static esp_err_t copy_packed(void)
+{
+    const ota_pack_header_t *header = &session.header;
+    ota_sink_t sink = (header->u8kind == OTA_PACK_KIND_DELTA) ? patch_feed : image_write;
+    tinfl_decompressor *inflator = malloc(sizeof(tinfl_decompressor));
+    uint8_t *pu8Dict = malloc(TINFL_LZ_DICT_SIZE);
+    esp_err_t err = ((inflator != NULL) && (pu8Dict != NULL)) ? ESP_OK : ESP_ERR_NO_MEM;
+
+    while ((err == ESP_OK) && (ctx.u32image_pos < header->u32image_size))
+    {
+        progress(false);
+        if (out_of_time())
+        {
+            err = ESP_ERR_TIMEOUT;
+            break;
+        }
+        uint32_t u32comp_len;
+        uint32_t u32raw_len = header->u32image_size - ctx.u32image_pos;
+        if (u32raw_len > header->u32chunk_size)
+        {
+            u32raw_len = header->u32chunk_size;
+        }
+        err = http_read_exact((uint8_t *)&u32comp_len, sizeof(u32comp_len));
+        if (err == ESP_OK)
+        {
+            err = inflate_chunk(inflator, pu8Dict, sink, u32comp_len, u32raw_len);
+        }
+        if (err == ESP_OK)
+        {
+            checkpoint();
+        }
+    }
+    free(inflator);
+    free(pu8Dict);
+    return err;
+}
+
+static bool download_done(void)
+{
+    return (session.u32file_size > 0) && (ctx.u32file_pos == session.u32file_size) &&
+           ((session.u8format == OTA_FORMAT_PLAIN) || (ctx.u32image_pos == session.header.u32image_size));
+}
+
+/* Back to the checkpoint: the sector or chunk it is in is erased and written again */
+static void rewind_to_checkpoint(void)
+{
+    uint32_t u32image = session.u32image_bytes;
+    uint32_t u32file = session.u32file_offset;
+    if (session.u8format == OTA_FORMAT_PLAIN)
+    {
+        u32image &= ~(OTA_SECTOR_SIZE - 1);
+        u32file = u32image;
+    }
+    ctx.u32image_pos = u32image;
+    ctx.u32file_pos = u32file;
+    ctx.u32erased = u32image; /* A chunk starts on a sector */
+    ctx.u32nvs_image = u32image;
+    ctx.u8op_have = 0;
+}
+
+static void start_over(void)
+{
+    session.u32file_offset = 0;
+    session.u32image_bytes = 0;
+    session.u8format = OTA_FORMAT_PLAIN;
+    rewind_to_checkpoint();
+}
+
+/* Host of the URL, the name the server certificate must carry */
+static void url_host(const char *cUrl, char *cHost, size_t size)
+{
+    const char *p = strstr(cUrl, "://");
+    p = (p != NULL) ? p + 3 : cUrl;
+    size_t len = strcspn(p, ":/?#");
+    len = (len < size) ? len : size - 1;
+    memcpy(cHost, p, len);
+    cHost[len] = '\0';
+}
+
+/* One request, from the checkpoint to the end of the image or of the time */
+static esp_err_t download(void)
+{
+    char cRange[32];
+    char cHost[TLS_HOST_MAX];
+    esp_http_client_config_t config =
+    {
+        .url = session.cUrl,
+        .crt_bundle_attach = tls_https_attach, // Same CA and server name check as the MQTT connection
+        .event_handler = _http_event_handler,
+        .keep_alive_enable = true,
+        .buffer_size = ctx.u32buf_len,
+    };
+    url_host(session.cUrl, cHost, sizeof(cHost));
+    tls_https_expect(cHost);
+
+    if (download_done())
+    {
+        return ESP_OK; // The last request ended with the last byte
+    }
+    ctx.client = esp_http_client_init(&config);
+    if (ctx.client == NULL)
+    {
+        return ESP_FAIL;
+    }
+    if (ctx.u32file_pos > 0)
+    {
+        snprintf(cRange, sizeof(cRange), "bytes=%lu-", (unsigned long)ctx.u32file_pos);
+        esp_http_client_set_header(ctx.client, "Range", cRange);
+    }
+    session.report.u32requests++;
+    ctx.u32range_start = 0;
+    ctx.u32range_total = 0;
+
+    int64_t i64start_us = esp_timer_get_time();
+    esp_err_t err = esp_http_client_open(ctx.client, 0);
+    if (err == ESP_OK)
+    {
+        int64_t i64length = esp_http_client_fetch_headers(ctx.client);
+        ctx.i64net_us += esp_timer_get_time() - i64start_us;
+        int status = esp_http_client_get_status_code(ctx.client);
+        if ((status == 206) && (ctx.u32file_pos > 0) && (ctx.u32range_start == ctx.u32file_pos) &&
+            (ctx.u32range_total == session.u32file_size))
+        {
+            ESP_LOGI(TAG, "Resuming at %lu of %lu", ctx.u32file_pos, session.u32file_size);
+        }
+        else if ((status == 200) && (i64length > 0) && (i64length <= UINT32_MAX))
+        {
+            if (ctx.u32file_pos > 0)
+            {
+                ESP_LOGW(TAG, "No range support, starting over");
+                start_over();
+            }
+            session.u32file_size = (uint32_t)i64length;
+        }
+        else
+        {
+            /* A server error may pass, anything else will not: another file, no file, no length */
+            ESP_LOGE(TAG, "HTTP status %d", status);
+            ctx.bFatal = (status < 500);
+            err = ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+
+    if ((err == ESP_OK) && (ctx.u32file_pos == 0))
+    {
+        /* The first bytes tell a plain image from a container */
+        err = http_read_exact(ctx.pu8buf, sizeof(OTA_PACK_MAGIC) - 1);
+        if (err == ESP_OK)
+        {
+            if (ctx.pu8buf[0] == IMAGE_MAGIC)
+            {
+                session.u8format = OTA_FORMAT_PLAIN;
+                err = copy_plain(sizeof(OTA_PACK_MAGIC) - 1);
+            }
+            else if (memcmp(ctx.pu8buf, OTA_PACK_MAGIC, sizeof(OTA_PACK_MAGIC) - 1) == 0)
+            {
+                err = read_pack_header(sizeof(OTA_PACK_MAGIC) - 1);
+                err = (err == ESP_OK) ? copy_packed() : err;
+            }
+            else
+            {
+                ctx.bFatal = true;
+                err = ESP_ERR_NOT_SUPPORTED;
+            }
+        }
+    }
+    else if (err == ESP_OK)
+    {
+        err = (session.u8format == OTA_FORMAT_PLAIN) ? copy_plain(0) : copy_packed();
+    }
+    esp_http_client_close(ctx.client);
+    esp_http_client_cleanup(ctx.client);
+    return err;
+}
+
+/* The next OTA slot, or the factory slot when the table is the factory + ota_0 one of the first releases */
+static const esp_partition_t *update_slot(const esp_partition_t *running)
+{
+    const esp_partition_t *next = esp_ota_get_next_update_partition(NULL);
+    if ((next != NULL) && (next == running))
+    {
+        const esp_partition_t *factory = esp_partition_find_first(ESP_PARTITION_TYPE_APP,
+                                                                  ESP_PARTITION_SUBTYPE_APP_FACTORY, NULL);
+        if ((factory != NULL) && (factory != running))
+        {
+            ESP_LOGW(TAG, "Partition table without ota_1, installing in \"%s\"", factory->label);
+            return factory; // esp_ota_set_boot_partition() boots it by erasing otadata
+        }
+    }
+    return next;
+}
+
+/* One request of the session and what follows from it */
+static esp_err_t run(uint32_t u32budget_ms)
+{
+    int64_t i64start_us = esp_timer_get_time();
+    uint32_t u32image_before = session.u32image_bytes;
+
+    ctx.base = esp_ota_get_running_partition();
+    ctx.partition = update_slot(ctx.base);
+    ctx.bFatal = false;
+    ctx.i64progress_us = i64start_us;
+    ctx.i64deadline_us = (u32budget_ms == OTA_NO_BUDGET) ? INT64_MAX : i64start_us + u32budget_ms * 1000LL;
+    ctx.i64net_us = 0;
+    ctx.i64flash_us = 0;
+    ctx.u32buf_len = tuning.u16rx_buf;
+    ctx.pu8buf = malloc(2 * ctx.u32buf_len);
+    ctx.pu8base = (ctx.pu8buf != NULL) ? &ctx.pu8buf[ctx.u32buf_len] : NULL;
+    rewind_to_checkpoint();
+
+    ESP_LOGI(TAG, "Attempting to download update from %s", session.cUrl);
+    esp_err_t err = (ctx.partition == NULL) ? ESP_ERR_NOT_FOUND :
+                    (ctx.partition == ctx.base) ? ESP_ERR_OTA_PARTITION_CONFLICT : // A single app slot, running
+                    (ctx.pu8buf == NULL) ? ESP_ERR_NO_MEM : download();
+    ctx.bFatal |= (ctx.partition == NULL) || (ctx.partition == ctx.base);
+    if (err == ESP_OK)
+    {
+        if (session.u8format == OTA_FORMAT_PACKED)
+        {
+            err = check_slot_hash(session.header.u8sha256, session.header.u32image_size);
+        }
+        err = (err == ESP_OK) ? check_expected() : err;
+        err = (err == ESP_OK) ? esp_ota_set_boot_partition(ctx.partition) : err; // Verifies the image
+        ctx.bFatal = (err != ESP_OK);
+    }
+    free(ctx.pu8buf);
+    ctx.pu8buf = NULL;
+    ctx.pu8base = NULL;
+    session.report.u32elapsed_ms += (uint32_t)((esp_timer_get_time() - i64start_us) / 1000);
+    session.report.u32net_ms += (uint32_t)(ctx.i64net_us / 1000);
+    session.report.u32flash_ms += (uint32_t)(ctx.i64flash_us / 1000);
+    ESP_LOGI(TAG, "%lu of %lu bytes downloaded, %lu bytes of image written: %s", ctx.u32file_pos,
+             session.u32file_size, ctx.u32image_pos, esp_err_to_name(err));
+
+    if ((err != ESP_OK) && !ctx.bFatal)
+    {
+        session.u8stalls = (session.u32image_bytes > u32image_before) ? 0 : session.u8stalls + 1;
+        ctx.bFatal = (session.u8stalls >= OTA_STALL_MAX);
+        if (!ctx.bFatal)
+        {
+            progress(true);
+            session_store();
+            err = ESP_ERR_TIMEOUT; // Paused, the checkpoint is kept
+        }
+    }
+    return err;
+}
+
+/* The update is over one way or the other, the report is the last message before the restart */
+static void finish(esp_err_t err)
+{
+    ota_report_t report = session.report;
+    session_clear();
+    pub_ota_report((err == ESP_OK) ? "Succeed" : "Failed", &report);
+    vTaskDelay(1000 / portTICK_PERIOD_MS);
+}
+
 /****************************************************************************/
 /***        Exported Function                                             ***/
 /****************************************************************************/
@@ -66,37 +817,107 @@ void start_ota(char *cUrl)
     ESP_LOGI(TAG, "Starting OTA task");
     pub_ota_status(VERSION);
 
-    // Configure the HTTP client for OTA update
-    esp_http_client_config_t config =
+    if (!ota_pending() || (strncmp(session.cUrl, cUrl, sizeof(session.cUrl)) != 0))
     {
-        .url = cUrl,
-        .cert_pem = (char *)server_cert_pem_start,
-        .event_handler = _http_event_handler,
-        .keep_alive_enable = true,
-    };
-
-    config.skip_cert_common_name_check = true; // Skip common name check for server certificate
+        session_new(cUrl, NULL, 0);
+    }
+    esp_err_t ret = ESP_ERR_TIMEOUT;
+    ctx.bFatal = false;
+    for (uint8_t i = 0; (i < OTA_ATTEMPTS) && (ret == ESP_ERR_TIMEOUT) && !ctx.bFatal; i++)
+    {
+        ret = run(OTA_NO_BUDGET);
+    }
 
-    // Initiate OTA update
-    esp_https_ota_config_t ota_config = {
-        .http_config = &config,
-    };
-    ESP_LOGI(TAG, "Attempting to download update from %s", config.url);
-    esp_err_t ret = esp_https_ota(&ota_config);
     if (ret == ESP_OK)
     {
-        pub_ota_status("Succeed"); // Publish OTA status as "Succeed"
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        finish(ret); // Publish OTA status as "Succeed"
         ESP_LOGI(TAG, "OTA Succeed, Rebooting...");
-        esp_restart();
     }
-    else
+    else if (ctx.bFatal)
     {
-        pub_ota_status("Failed"); // Publish OTA status as "Failed"
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        finish(ret); // Publish OTA status as "Failed"
         ESP_LOGE(TAG, "Firmware upgrade failed");
-        esp_restart();
     }
+    else
+    {
+        ESP_LOGW(TAG, "Firmware upgrade paused at %u%%, continuing in the next wakes", progress_percent());
+    }
+    esp_restart();
+}
+
+esp_err_t ota_schedule(const char *cUrl, const uint8_t *pu8Sha256, uint32_t u32size)
+{
+    if ((cUrl == NULL) || (strlen(cUrl) >= sizeof(session.cUrl)) || (pu8Sha256 == NULL) || (u32size == 0))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ota_pending() && (strcmp(session.cUrl, cUrl) == 0) && (session.u32expect_size == u32size) &&
+        (memcmp(session.u8expect_sha256, pu8Sha256, sizeof(session.u8expect_sha256)) == 0))
+    {
+        return ESP_OK; // Already on it, the progress is kept
+    }
+    session_new(cUrl, pu8Sha256, u32size);
+    return ESP_OK;
+}
+
+bool ota_image_running(const uint8_t *pu8Sha256, uint32_t u32size)
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    uint8_t *pu8Buf = malloc(OTA_RX_BUF);
+    uint8_t u8sha256[32];
+    bool bSame = (running != NULL) && (pu8Buf != NULL) && (u32size <= running->size) &&
+                 (partition_sha256(running, u32size, u8sha256, pu8Buf, OTA_RX_BUF) == ESP_OK) &&
+                 (memcmp(u8sha256, pu8Sha256, sizeof(u8sha256)) == 0);
+    free(pu8Buf);
+    return bSame;
+}
+
+esp_err_t ota_set_tuning(const ota_tuning_t *pTuning)
+{
+    if ((pTuning->u16rx_buf < OTA_RX_BUF_MIN) || (pTuning->u16rx_buf > OTA_RX_BUF_MAX) ||
+        (pTuning->u32erase_unit % OTA_SECTOR_SIZE != 0))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    tuning = *pTuning;
+    return ESP_OK;
+}
+
+void ota_get_tuning(ota_tuning_t *pTuning)
+{
+    *pTuning = tuning;
+}
+
+bool ota_pending(void)
+{
+    if (!bChecked)
+    {
+        bChecked = true;
+        if (!load_ota_checkpoint(&session, sizeof(session)) || !session_valid())
+        {
+            memset(&session, 0, sizeof(session));
+        }
+    }
+    return session_valid();
+}
+
+esp_err_t ota_resume(uint32_t u32budget_ms)
+{
+    if (!ota_pending())
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_err_t ret = run(u32budget_ms);
+    if ((ret == ESP_OK) || ctx.bFatal)
+    {
+        finish(ret);
+        if (ret == ESP_OK)
+        {
+            ESP_LOGI(TAG, "OTA Succeed, Rebooting...");
+            esp_restart();
+        }
+    }
+    return ret;
 }
 
 /****************************************************************************/
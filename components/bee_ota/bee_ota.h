@@ -10,17 +10,179 @@
 #ifndef BEE_OTA_H_
 #define BEE_OTA_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
 #define VERSION "Version 1.0"
 
+#define OTA_RX_BUF          4096        /* HTTP receive buffer, also the read size of the download loop */
+#define OTA_RX_BUF_MIN      512
+#define OTA_RX_BUF_MAX      16384       /* A whole TLS record, CONFIG_MBEDTLS_SSL_IN_CONTENT_LEN */
+#define OTA_PACK_MAGIC      "BOTA"      /* Compressed image container, see tools/ota_pack.py */
+#define OTA_PACK_VERSION    1
+#define OTA_PACK_KIND_FULL  0
+#define OTA_PACK_KIND_DELTA 1           /* Patch against the running image, see ota_patch_op_t */
+#define OTA_PACK_CHUNK_MAX  0x10000     /* Largest chunk tools/ota_pack.py writes, bounds nothing in RAM */
+#define OTA_SECTOR_SIZE     4096        /* Chunks are a multiple of it, so every chunk starts on a blank sector */
+#define OTA_ERASE_BLOCK     0x10000     /* One block erase of the flash chip, 16 sector erases take several times longer */
+#define OTA_ERASE_IMAGE     0           /* Erase unit: the whole image before its first byte is written */
+#define OTA_ERASE_UNIT      OTA_ERASE_BLOCK
+#define OTA_URL_MAX         200
+#define OTA_WAKE_BUDGET_MS  8000        /* Download time an upload wake spends on a pending update */
+#define OTA_ATTEMPTS        3           /* Requests start_ota() makes before it leaves the rest to the wakes */
+#define OTA_STALL_MAX       10          /* Requests in a row without progress before an update is dropped */
+#define OTA_NVS_EVERY       0x20000     /* Image bytes between two checkpoints in NVS, RTC memory has every one */
+#define OTA_PROGRESS_STEP   10          /* Percent between two progress messages */
+#define OTA_PROGRESS_MS     5000        /* and at least this long */
+
+/*
+ * Compressed container, little-endian:
+ *  [0..3] OTA_PACK_MAGIC, [4] OTA_PACK_VERSION, [5] kind (OTA_PACK_KIND_xxx), [6..7] reserved,
+ *  [8..11] image size, [12..15] chunk size (a multiple of OTA_SECTOR_SIZE), [16..47] SHA-256 of the image,
+ *  a delta has an ota_delta_header_t next,
+ *  then chunks: [0..3] compressed length, then a zlib stream of chunk size image bytes (less for the last),
+ *  or for a delta of the ota_patch_op_t records that make those image bytes.
+ * Every chunk is an independent zlib stream, so the inflater needs no state from the previous one and an
+ * interrupted download resumes at the chunk it was in.
+ * A plain image (first byte 0xE9) is accepted as well and written as it comes.
+ */
+typedef struct __attribute__((packed))
+{
+    char     cMagic[4];
+    uint8_t  u8version;
+    uint8_t  u8kind;
+    uint16_t u16reserved;
+    uint32_t u32image_size;
+    uint32_t u32chunk_size;
+    uint8_t  u8sha256[32];
+} ota_pack_header_t;
+
+/* The image a delta applies to, the running one or the delta is refused before anything is written */
+typedef struct __attribute__((packed))
+{
+    uint32_t u32base_size;
+    uint8_t  u8base_sha256[32];
+} ota_delta_header_t;
+
+/*
+ * A delta record, bsdiff style: u32copy_len bytes follow, each added to the base byte at u32src onwards,
+ * then u32literal_len bytes taken as they are. Code that moved differs from the base mostly by the
+ * addresses in it, so the added bytes are mostly zeros and compress to next to nothing.
+ * Records never cross a chunk.
+ */
+typedef struct __attribute__((packed))
+{
+    uint32_t u32copy_len;
+    uint32_t u32src;
+    uint32_t u32literal_len;
+} ota_patch_op_t;
+
+typedef struct
+{
+    uint32_t u32download_bytes;     /* Received over HTTP */
+    uint32_t u32image_bytes;        /* Written to the OTA slot, parts written again after a resume included */
+    uint32_t u32elapsed_ms;         /* From the request to the image verified, wakes in between left out */
+    uint32_t u32requests;           /* HTTP requests it took */
+    uint32_t u32net_ms;             /* Of u32elapsed_ms, waiting on the connection */
+    uint32_t u32flash_ms;           /* and erasing and writing the slot, the rest is inflating and hashing */
+} ota_report_t;
+
+/*
+ * Download tuning, OTA_RX_BUF and OTA_ERASE_UNIT unless set. The TLS input buffer is not part of it:
+ * CONFIG_MBEDTLS_SSL_IN_CONTENT_LEN is 16384 in sdkconfig already, the largest record a server may send.
+ */
+typedef struct
+{
+    uint16_t u16rx_buf;             /* OTA_RX_BUF_MIN to OTA_RX_BUF_MAX bytes */
+    uint32_t u32erase_unit;         /* Slot bytes erased ahead at a time, a multiple of OTA_SECTOR_SIZE or OTA_ERASE_IMAGE */
+} ota_tuning_t;
+
 /**
  * @brief Start OTA (Over-The-Air) firmware update.
- * 
+ *
  * This function initiates the OTA firmware update process by configuring the
  * HTTP client with the provided URL and necessary settings. After downloading
  * the firmware update, the device is rebooted.
- * 
+ *
+ * The download is either a plain image or an OTA_PACK_MAGIC container, told apart by their first bytes.
+ * A container is inflated chunk by chunk as it streams in (the ROM miniz inflater, a fixed 43 KB of heap
+ * whatever the image size) and the image read back from the slot is checked against its SHA-256.
+ * A delta container is checked against the running partition first and its records are applied to it.
+ * Either way esp_ota_set_boot_partition() verifies the image and the download size and time are reported
+ * with the final status.
+ *
+ * The update is a session kept in RTC memory and checkpointed in NVS every OTA_NVS_EVERY bytes. A dropped
+ * connection is resumed with a Range request from the last sector or chunk written, OTA_ATTEMPTS times
+ * here. If it is still not done the chip restarts anyway and ota_resume() carries on in the next wakes.
+ * The same URL continues the session in progress, another one replaces it.
+ * Updates alternate between ota_0 and ota_1. On the factory + ota_0 table of the first releases they alternate
+ * between factory and ota_0 instead. An update partition that is the running one is refused.
+ *
  * @param cUrl The URL to download the firmware update from.
  */
 void start_ota(char *cUrl);
 
-#endif
\ No newline at end of file
+/**
+ * @brief Queue an update for ota_resume() without downloading anything now.
+ *
+ * Used for an update a manifest announced: the image the download makes, plain, compressed or delta,
+ * must have that size and SHA-256 or it is not booted. The same URL and image leave an update in
+ * progress as it is, anything else replaces it.
+ *
+ * @param cUrl      Download URL, shorter than OTA_URL_MAX.
+ * @param pu8Sha256 SHA-256 of the image.
+ * @param u32size   Size of the image.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a URL too long.
+ */
+esp_err_t ota_schedule(const char *cUrl, const uint8_t *pu8Sha256, uint32_t u32size);
+
+/**
+ * @brief Whether the running partition holds that image, an update that succeeded already for one.
+ *
+ * The first u32size bytes are hashed the way a download is checked, so the hash of a manifest compares.
+ * esp_partition_get_sha256() would not: for an app it is the hash appended to the image, which leaves
+ * the last 32 bytes out.
+ *
+ * @param pu8Sha256 SHA-256 of the whole image.
+ * @param u32size   Size of the image.
+ */
+bool ota_image_running(const uint8_t *pu8Sha256, uint32_t u32size);
+
+/**
+ * @brief Set the receive buffer and the erase unit of the downloads that follow.
+ *
+ * A larger buffer means fewer reads and fewer flash writes per image, allocated for the length of a download.
+ * The slot is erased a unit ahead of the writes, block erases being the fastest per byte. OTA_ERASE_IMAGE
+ * erases everything up to the end of the image at once, again from the checkpoint in every resumed request.
+ *
+ * @param pTuning Kept in RTC memory until the next cold boot.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a value out of range.
+ */
+esp_err_t ota_set_tuning(const ota_tuning_t *pTuning);
+
+/**
+ * @brief The tuning in use.
+ */
+void ota_get_tuning(ota_tuning_t *pTuning);
+
+/**
+ * @brief Whether an update was interrupted and waits for ota_resume().
+ *
+ * Reads the NVS checkpoint once after a cold boot, RTC memory afterwards.
+ */
+bool ota_pending(void);
+
+/**
+ * @brief Continue the pending update for a while, in a wake that has the network up already.
+ *
+ * Progress is published at most every OTA_PROGRESS_STEP percent and OTA_PROGRESS_MS. When the image is
+ * complete and verified the final report is published and the chip restarts into it. An update that
+ * cannot succeed (bad image, wrong hash, OTA_STALL_MAX requests without progress) is dropped and reported.
+ *
+ * @param u32budget_ms Download time allowed, the request in flight ends at the next sector or chunk.
+ * @return ESP_ERR_TIMEOUT if it is not done yet, ESP_ERR_NOT_FOUND without an update, else why it failed.
+ */
+esp_err_t ota_resume(uint32_t u32budget_ms);
+
+#endif
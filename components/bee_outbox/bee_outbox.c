@@ -0,0 +1,338 @@
+/*****************************************************************************
+ *
+ * @file 	bee_outbox.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	store-and-forward outbox for telemetry that could not be sent,
+ *          kept as an append-only log in the "outbox" data partition
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include <stddef.h>
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+
+#include "bee_outbox.h"
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+typedef struct
+{
+    uint32_t u32magic;          /* OUTBOX_STATE_MAGIC, anything else means cold boot */
+    uint32_t u32size;           /* Partition size the offsets belong to */
+    uint32_t u32head;           /* Offset of the next append */
+    uint32_t u32tail;           /* Offset of the oldest pending record */
+    uint32_t u32count;          /* Pending records */
+    uint32_t u32next_seq;
+    uint32_t u32evicted;
+} outbox_state_t;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static RTC_DATA_ATTR outbox_state_t state;
+static RTC_DATA_ATTR bool bMissing_logged = false;      /* The missing partition was reported */
+static const esp_partition_t *partition = NULL;
+
+static const char *TAG = "OUTBOX";
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static uint32_t rec_size(const outbox_rec_t *rec)
+{
+    return (sizeof(outbox_rec_t) + rec->u8topic_len + rec->u16len + 3) & ~3u;
+}
+
+static uint32_t next_sector(uint32_t u32offset)
+{
+    u32offset = (u32offset & ~(OUTBOX_SECTOR_SIZE - 1)) + OUTBOX_SECTOR_SIZE;
+    return (u32offset >= state.u32size) ? 0 : u32offset;
+}
+
+static uint32_t advance(uint32_t u32offset, uint32_t u32bytes)
+{
+    u32offset += u32bytes;
+    return (u32offset >= state.u32size) ? u32offset - state.u32size : u32offset;
+}
+
+/* A header is valid when it was fully programmed and the record fits in its sector */
+static bool read_header(uint32_t u32offset, outbox_rec_t *rec)
+{
+    uint32_t u32in_sector = u32offset % OUTBOX_SECTOR_SIZE;
+    if ((u32in_sector + sizeof(outbox_rec_t) > OUTBOX_SECTOR_SIZE) ||
+        (esp_partition_read(partition, u32offset, rec, sizeof(outbox_rec_t)) != ESP_OK))
+    {
+        return false;
+    }
+    return (rec->u16magic == OUTBOX_REC_MAGIC) && (rec->u8topic_len < OUTBOX_TOPIC_MAX) &&
+           (u32in_sector + rec_size(rec) <= OUTBOX_SECTOR_SIZE);
+}
+
+/* Offset of the first record at or after u32offset, skipping blank sector ends */
+static uint32_t locate(uint32_t u32offset, outbox_rec_t *rec)
+{
+    for (uint32_t i = 0; i <= state.u32size / OUTBOX_SECTOR_SIZE; i++)
+    {
+        if (read_header(u32offset, rec))
+        {
+            break;
+        }
+        u32offset = next_sector(u32offset);
+    }
+    return u32offset;
+}
+
+static uint32_t rec_crc(const outbox_rec_t *rec, const char *cTopic, const void *data)
+{
+    uint32_t u32crc = esp_rom_crc32_le(0, &rec->u8topic_len, offsetof(outbox_rec_t, u32crc) - offsetof(outbox_rec_t, u8topic_len));
+    u32crc = esp_rom_crc32_le(u32crc, (const uint8_t *)cTopic, rec->u8topic_len);
+    return esp_rom_crc32_le(u32crc, data, rec->u16len);
+}
+
+static void tail_advance(void)
+{
+    outbox_rec_t rec;
+    state.u32tail = locate(state.u32tail, &rec);
+    state.u32tail = advance(state.u32tail, rec_size(&rec));
+    state.u32count--;
+    if (state.u32count > 0)
+    {
+        state.u32tail = locate(state.u32tail, &rec);
+    }
+    else
+    {
+        state.u32tail = state.u32head;
+    }
+}
+
+/* Rebuild head and tail from the record headers after a power loss */
+static void scan(void)
+{
+    outbox_rec_t rec;
+    bool bFound = false;
+    uint32_t u32max_seq = 0;
+    uint32_t u32min_pending = UINT32_MAX;
+
+    state.u32head = 0;
+    state.u32tail = 0;
+    state.u32count = 0;
+    state.u32evicted = 0;
+
+    for (uint32_t u32sector = 0; u32sector < state.u32size; u32sector += OUTBOX_SECTOR_SIZE)
+    {
+        uint32_t u32offset = u32sector;
+        while ((u32offset < u32sector + OUTBOX_SECTOR_SIZE) && read_header(u32offset, &rec)) // A full sector ends at its edge
+        {
+            if (!bFound || (rec.u32seq >= u32max_seq))
+            {
+                u32max_seq = rec.u32seq;
+                state.u32head = u32offset;
+                bFound = true;
+            }
+            if (rec.u8flags == OUTBOX_FLAG_PENDING)
+            {
+                state.u32count++;
+                if (rec.u32seq < u32min_pending)
+                {
+                    u32min_pending = rec.u32seq;
+                    state.u32tail = u32offset;
+                }
+            }
+            u32offset += rec_size(&rec);
+        }
+    }
+
+    /* The end of the newest sector may hold a torn write, continue in a freshly erased one */
+    state.u32head = bFound ? next_sector(state.u32head) : 0;
+    state.u32next_seq = bFound ? u32max_seq + 1 : 0;
+    if (state.u32count == 0)
+    {
+        state.u32tail = state.u32head;
+    }
+    ESP_LOGI(TAG, "Recovered %lu pending messages", state.u32count);
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+esp_err_t outbox_init(void)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, OUTBOX_PARTITION_SUBTYPE, OUTBOX_PARTITION_LABEL);
+    if (partition == NULL)
+    {
+        if (!bMissing_logged) // The table cannot change before a serial flash, once per cold boot is enough
+        {
+            ESP_LOGW(TAG, "No \"%s\" partition in the partition table, unsent telemetry is dropped", OUTBOX_PARTITION_LABEL);
+            bMissing_logged = true;
+        }
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint32_t u32size = partition->size & ~(OUTBOX_SECTOR_SIZE - 1);
+    if ((state.u32magic != OUTBOX_STATE_MAGIC) || (state.u32size != u32size))
+    {
+        state.u32size = u32size;
+        scan();
+        state.u32magic = OUTBOX_STATE_MAGIC;
+    }
+    return ESP_OK;
+}
+
+esp_err_t outbox_append(const char *cTopic, const void *data, size_t len)
+{
+    if (partition == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    outbox_rec_t rec =
+    {
+        .u16magic = OUTBOX_REC_MAGIC,
+        .u8flags = OUTBOX_FLAG_PENDING,
+        .u8topic_len = (uint8_t)strnlen(cTopic, OUTBOX_TOPIC_MAX - 1),
+        .u16len = (uint16_t)len,
+        .u16reserved = 0xFFFF,
+        .u32seq = state.u32next_seq,
+    };
+    uint32_t u32size = rec_size(&rec);
+    if ((len > UINT16_MAX) || (u32size > OUTBOX_SECTOR_SIZE))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    rec.u32crc = rec_crc(&rec, cTopic, data);
+
+    if ((state.u32head % OUTBOX_SECTOR_SIZE) + u32size > OUTBOX_SECTOR_SIZE)
+    {
+        state.u32head = next_sector(state.u32head);
+    }
+
+    if (state.u32head % OUTBOX_SECTOR_SIZE == 0)
+    {
+        /* Erase ahead of the head, the oldest messages go if the ring is full */
+        uint32_t u32evicted = state.u32evicted;
+        while ((state.u32count > 0) && ((state.u32tail & ~(OUTBOX_SECTOR_SIZE - 1)) == state.u32head))
+        {
+            tail_advance();
+            state.u32evicted++;
+        }
+        if (state.u32evicted != u32evicted)
+        {
+            ESP_LOGW(TAG, "Outbox full, %lu oldest messages evicted", state.u32evicted - u32evicted);
+        }
+        esp_err_t err = esp_partition_erase_range(partition, state.u32head, OUTBOX_SECTOR_SIZE);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+
+    /* Body first, header last: a torn write leaves a blank header and ends the sector */
+    uint32_t u32offset = state.u32head;
+    esp_err_t err = esp_partition_write(partition, u32offset + sizeof(rec), cTopic, rec.u8topic_len);
+    if (err == ESP_OK)
+    {
+        err = esp_partition_write(partition, u32offset + sizeof(rec) + rec.u8topic_len, data, len);
+    }
+    if (err == ESP_OK)
+    {
+        err = esp_partition_write(partition, u32offset, &rec, sizeof(rec));
+    }
+    if (err != ESP_OK)
+    {
+        state.u32head = next_sector(state.u32head); /* Leave whatever was written behind */
+        return err;
+    }
+
+    if (state.u32count == 0)
+    {
+        state.u32tail = u32offset;
+    }
+    state.u32head = advance(u32offset, u32size);
+    state.u32count++;
+    state.u32next_seq++;
+    return ESP_OK;
+}
+
+uint32_t outbox_count(void)
+{
+    return (partition != NULL) ? state.u32count : 0;
+}
+
+uint32_t outbox_evicted(void)
+{
+    return state.u32evicted;
+}
+
+void outbox_rewind(outbox_cursor_t *cursor)
+{
+    cursor->u32offset = state.u32tail;
+    cursor->u32left = outbox_count();
+}
+
+esp_err_t outbox_read(outbox_cursor_t *cursor, char *cTopic, uint8_t *pu8Data, size_t data_size, size_t *pLen)
+{
+    outbox_rec_t rec;
+
+    if (cursor->u32left == 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint32_t u32offset = locate(cursor->u32offset, &rec);
+    cursor->u32offset = advance(u32offset, rec_size(&rec));
+    cursor->u32left--;
+
+    if (rec.u16len > data_size)
+    {
+        return ESP_ERR_INVALID_CRC; /* Cannot be ours, treat it as corrupted */
+    }
+
+    u32offset += sizeof(rec);
+    esp_err_t err = esp_partition_read(partition, u32offset, cTopic, rec.u8topic_len);
+    if (err == ESP_OK)
+    {
+        err = esp_partition_read(partition, u32offset + rec.u8topic_len, pu8Data, rec.u16len);
+    }
+    cTopic[rec.u8topic_len] = '\0';
+
+    if ((err != ESP_OK) || (rec_crc(&rec, cTopic, pu8Data) != rec.u32crc))
+    {
+        ESP_LOGE(TAG, "Record %lu is corrupted", rec.u32seq);
+        return ESP_ERR_INVALID_CRC;
+    }
+    *pLen = rec.u16len;
+    return ESP_OK;
+}
+
+esp_err_t outbox_pop(void)
+{
+    outbox_rec_t rec;
+    const uint8_t u8delivered = OUTBOX_FLAG_DELIVERED;
+
+    if (outbox_count() == 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* Clearing a bit needs no erase, it only matters for the scan after a power loss */
+    state.u32tail = locate(state.u32tail, &rec);
+    esp_err_t err = esp_partition_write(partition, state.u32tail + offsetof(outbox_rec_t, u8flags), &u8delivered, 1);
+    tail_advance();
+    return err;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
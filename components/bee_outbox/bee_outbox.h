@@ -0,0 +1,109 @@
+/*****************************************************************************
+ *
+ * @file 	bee_outbox.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	store-and-forward outbox for telemetry that could not be sent,
+ *          kept as an append-only log in the "outbox" data partition
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef BEE_OUTBOX_H
+#define BEE_OUTBOX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define OUTBOX_PARTITION_LABEL      "outbox"
+#define OUTBOX_PARTITION_SUBTYPE    0x40        /* Custom data subtype, see partitions.csv */
+#define OUTBOX_SECTOR_SIZE          4096
+#define OUTBOX_REC_MAGIC            0xB0E5
+#define OUTBOX_STATE_MAGIC          0x0B0C5A7E
+#define OUTBOX_FLAG_PENDING         0xFF        /* As programmed */
+#define OUTBOX_FLAG_DELIVERED       0x7F        /* Bit 7 cleared in place once the broker acknowledged it */
+#define OUTBOX_TOPIC_MAX            72
+
+/*
+ * Log layout: the partition is a ring of sectors, records never cross a sector boundary.
+ * A sector is erased just before the head enters it, evicting the oldest records if the
+ * tail is still in there, so every sector is erased once per trip around the ring.
+ */
+typedef struct
+{
+    uint16_t u16magic;          /* OUTBOX_REC_MAGIC */
+    uint8_t  u8flags;           /* OUTBOX_FLAG_*, not covered by the CRC */
+    uint8_t  u8topic_len;
+    uint16_t u16len;            /* Payload length */
+    uint16_t u16reserved;
+    uint32_t u32seq;            /* Append order, survives power loss */
+    uint32_t u32crc;            /* CRC32 of u8topic_len..u32seq, the topic and the payload */
+} outbox_rec_t;
+
+typedef struct
+{
+    uint32_t u32offset;         /* Next record to read */
+    uint32_t u32left;           /* Records left */
+} outbox_cursor_t;
+
+/**
+ * @brief Open the outbox partition.
+ *
+ * The head and tail are kept in RTC memory across deep sleep. After a power loss they are rebuilt
+ * by scanning the record headers, delivered records are recognised by their flag.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if the partition table has no outbox.
+ */
+esp_err_t outbox_init(void);
+
+/**
+ * @brief Append a message, evicting the oldest ones if the log is full.
+ *
+ * @param cTopic Topic, at most OUTBOX_TOPIC_MAX - 1 characters.
+ * @param data   Encoded payload.
+ * @param len    Payload length.
+ * @return ESP_OK or the flash error.
+ */
+esp_err_t outbox_append(const char *cTopic, const void *data, size_t len);
+
+/**
+ * @brief Number of messages waiting for delivery.
+ */
+uint32_t outbox_count(void);
+
+/**
+ * @brief Number of messages evicted unsent since the last cold boot.
+ */
+uint32_t outbox_evicted(void);
+
+/**
+ * @brief Position a cursor on the oldest pending message.
+ */
+void outbox_rewind(outbox_cursor_t *cursor);
+
+/**
+ * @brief Read the message under the cursor and move to the next one.
+ *
+ * Reading does not remove anything, several messages can be read ahead and popped once acknowledged.
+ *
+ * @param cursor     Cursor from outbox_rewind().
+ * @param cTopic     Receives the NUL terminated topic, OUTBOX_TOPIC_MAX bytes.
+ * @param pu8Data    Receives the payload.
+ * @param data_size  Size of pu8Data.
+ * @param pLen       Receives the payload length.
+ * @return ESP_OK, ESP_ERR_NOT_FOUND past the last message, ESP_ERR_INVALID_CRC for a corrupted
+ *         message (the cursor still moves past it, pop it like a delivered one).
+ */
+esp_err_t outbox_read(outbox_cursor_t *cursor, char *cTopic, uint8_t *pu8Data, size_t data_size, size_t *pLen);
+
+/**
+ * @brief Mark the oldest pending message delivered and drop it.
+ */
+esp_err_t outbox_pop(void);
+
+#endif /* BEE_OUTBOX_H */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
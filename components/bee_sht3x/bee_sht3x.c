@@ -30,6 +30,9 @@
 
 static const char *SHT3X_TAG = "sht3x";
 
+static RTC_DATA_ATTR int16_t i16temp_offset_ticks = 0; // Calibration, added to the raw words
+static RTC_DATA_ATTR int16_t i16humi_offset_ticks = 0;
+
 // Single Shot Data Acquisition
 uint8_t clock_stretching_enabled_repeatability_high[]     = {0x2C, 0x06};
 uint8_t clock_stretching_enabled_repeatability_medium[]   = {0x2C, 0x0D};
@@ -83,6 +86,16 @@ static uint8_t calculate_crc(const uint8_t* data, uint8_t data_len) {
     return crc;
 }
 
+static uint16_t apply_offset(uint16_t u16ticks, int16_t i16offset)
+{
+    int32_t i32ticks = (int32_t)u16ticks + i16offset;
+    if (i32ticks < 0)
+    {
+        return 0;
+    }
+    return (i32ticks > UINT16_MAX) ? UINT16_MAX : (uint16_t)i32ticks;
+}
+
 /*
 * For the send command sequences, after writing the address and/or data to the sensor
 * and sending the ACK bit, the sensor needs the execution time to respond to the I2C read header with an ACK bit.
@@ -161,8 +174,12 @@ esp_err_t sht3x_read_measurement(sht3x_sensors_values_t *sensors_values)
         return ESP_ERR_INVALID_CRC;
     }
 
-    sensors_values->temperature = (175.0 * (((measurements.temperature.value.msb << 8) + measurements.temperature.value.lsb) / 65535.0)) - 45.0;
-    sensors_values->humidity = 100.0 * ((measurements.humidity.value.msb << 8) + measurements.humidity.value.lsb) / 65535.0;
+    sensors_values->temperature_ticks = apply_offset((uint16_t)((measurements.temperature.value.msb << 8) + measurements.temperature.value.lsb),
+                                                     i16temp_offset_ticks);
+    sensors_values->humidity_ticks = apply_offset((uint16_t)((measurements.humidity.value.msb << 8) + measurements.humidity.value.lsb),
+                                                  i16humi_offset_ticks);
+    sensors_values->temperature = (175.0 * (sensors_values->temperature_ticks / 65535.0)) - 45.0;
+    sensors_values->humidity = 100.0 * sensors_values->humidity_ticks / 65535.0;
 
     return err;
 }
@@ -221,25 +238,16 @@ esp_err_t sht3x_read_singleshot(sht3x_sensors_values_t *sensors_values)
     return sht3x_read_measurement(sensors_values);
 }
 
-RTC_DATA_ATTR int u8warning_values;
-uint8_t check_warning(float Temp, float Humi)
+esp_err_t sht3x_set_calibration(float fTemp_offset, float fHumi_offset)
 {
-    bool bH_Temp_threshold = Temp > H_TEMP_THRESHOLD;
-    bool bL_Temp_threshold = Temp < L_TEMP_THRESHOLD;
-    bool bH_Humi_threshold = Humi > H_HUMI_THRESHOLD;
-    bool bL_Humi_threshold = Humi < L_HUMI_THRESHOLD;
-
-    uint8_t u8tmp_warning_values = (bH_Temp_threshold << 3) | (bL_Temp_threshold << 2) | (bH_Humi_threshold << 1) | bL_Humi_threshold;
-
-    if (u8tmp_warning_values != u8warning_values)
-    {
-        u8warning_values = u8tmp_warning_values;
-        return u8warning_values;
-    }
-    else
+    if ((fabsf(fTemp_offset) > SHT3X_TEMP_OFFSET_MAX) || (fabsf(fHumi_offset) > SHT3X_HUMI_OFFSET_MAX))
     {
-        return NO_WARNING;
+        return ESP_ERR_INVALID_ARG;
     }
+    i16temp_offset_ticks = (int16_t)lroundf(fTemp_offset * 65535.0f / 175.0f);
+    i16humi_offset_ticks = (int16_t)lroundf(fHumi_offset * 65535.0f / 100.0f);
+    ESP_LOGI(SHT3X_TAG, "Calibration: temperature %+.2f, humidity %+.2f", fTemp_offset, fHumi_offset);
+    return ESP_OK;
 }
 
 /****************************************************************************/
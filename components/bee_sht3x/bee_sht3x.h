@@ -33,12 +33,8 @@
 /***        Macro Definitions                                             ***/
 /****************************************************************************/
 
-//Define warning threshold
-#define H_TEMP_THRESHOLD    30
-#define H_HUMI_THRESHOLD    80
-#define L_TEMP_THRESHOLD    25
-#define L_HUMI_THRESHOLD    60
-#define NO_WARNING 255
+#define SHT3X_TEMP_OFFSET_MAX   10      /* Calibration limits, degrees Celsius and %RH */
+#define SHT3X_HUMI_OFFSET_MAX   20
 
 #define I2C_MASTER_TIMEOUT_MS   1000
 #define I2C_MASTER_NUM          0
@@ -83,6 +79,8 @@ typedef struct sht3x_sensors_values
 {
     float temperature;
     float humidity;
+    uint16_t temperature_ticks;     /* Raw sensor words, kept for compact telemetry */
+    uint16_t humidity_ticks;
 } sht3x_sensors_values_t;
 
 typedef struct measurements
@@ -225,23 +223,16 @@ esp_err_t sht3x_clear_status_register();
 esp_err_t sht3x_read_singleshot(sht3x_sensors_values_t *sensors_values);
 
 /**
- * @brief Check warnings based on temperature and humidity.
+ * @brief Set the calibration offsets added to every measurement.
  *
- * This function checks predefined thresholds for temperature and humidity,
- * and returns a warning value based on the comparison of the measured temperature and humidity with the thresholds.
+ * The offsets are applied to the raw words, so the ticks in compact telemetry are calibrated too.
+ * They are kept in RTC memory across deep sleep.
  *
- * @param[in] Temp Measured temperature.
- * @param[in] Humi Measured humidity.
- *
- * @return Warning value:
- *  - NO_WARNING if there are no warnings.
- *  - A different value represents a specific warning based on bits:
- *    - Bit 3: High-temperature warning.
- *    - Bit 2: Low-temperature warning.
- *    - Bit 1: High-humidity warning.
- *    - Bit 0: Low-humidity warning.
+ * @param fTemp_offset Degrees Celsius, at most SHT3X_TEMP_OFFSET_MAX either way.
+ * @param fHumi_offset %RH, at most SHT3X_HUMI_OFFSET_MAX either way.
+ * @return ESP_ERR_INVALID_ARG if an offset is out of range.
  */
-uint8_t check_warning(float Temp, float Humi);
+esp_err_t sht3x_set_calibration(float fTemp_offset, float fHumi_offset);
 
 #endif /* __SHT3x_H__ */
 /****************************************************************************/
@@ -0,0 +1,472 @@
+/*****************************************************************************
+ *
+ * @file 	bee_tls.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	TLS transport for the MQTT client, resumes the last session across
+ *          deep sleep instead of doing a full handshake on every wake
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <arpa/inet.h>
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/x509_crt.h"
+
+#include "bee_tls.h"
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+typedef struct
+{
+    uint16_t u16len;            /* 0 when nothing is cached */
+    uint16_t u16port;
+    char     cHost[TLS_HOST_MAX];
+    uint8_t  u8session[TLS_SESSION_MAX];
+} tls_cache_t;
+
+typedef struct
+{
+    uint32_t u32full_sum_ms;
+    uint32_t u32resumed_sum_ms;
+    uint16_t u16full;
+    uint16_t u16resumed;
+} tls_stats_t;
+
+typedef struct
+{
+    bool    bIp;                /* The expected server name is an IPv4 address */
+    uint8_t u8ip[4];
+} tls_peer_t;
+
+typedef struct
+{
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config  conf;
+    mbedtls_x509_crt    ca;
+    mbedtls_net_context net;
+    bool bConnected;
+    bool bCert_seen;            /* The verify callback ran: the server sent its certificate, full handshake */
+    tls_peer_t peer;
+} tls_ctx_t;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+extern const char ca_cert_pem_start[] asm("_binary_ca_cert_pem_start");
+
+/* ECDSA certificates keep the handshake short, RSA ones are still accepted */
+static const int ciphersuites[] =
+{
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256,
+    0
+};
+
+/* X25519 is the cheapest key agreement without an ECC accelerator */
+static const uint16_t groups[] =
+{
+    MBEDTLS_SSL_IANA_TLS_GROUP_X25519,
+    MBEDTLS_SSL_IANA_TLS_GROUP_SECP256R1,
+    MBEDTLS_SSL_IANA_TLS_GROUP_NONE
+};
+
+static RTC_DATA_ATTR tls_cache_t cache;
+static RTC_DATA_ATTR tls_stats_t stats;
+static uint32_t u32last_ms = 0;
+static bool bLast_resumed = false;
+static tls_peer_t https_peer;               /* Server of the next esp_http_client connection */
+static mbedtls_x509_crt https_ca;           /* Parsed on the first one, kept */
+static bool bHttps_ca = false;
+
+static const char *TAG = "TLS";
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static int tls_random(void *arg, unsigned char *pu8Buf, size_t len)
+{
+    esp_fill_random(pu8Buf, len); // True random while the radio is on
+    return 0;
+}
+
+/* An iPAddress subject alternative name equal to the address, mbedTLS only matches names against the CN and dNSName */
+static bool san_has_ip(const mbedtls_x509_crt *crt, const uint8_t *pu8ip)
+{
+    for (const mbedtls_x509_sequence *san = &crt->subject_alt_names; san != NULL; san = san->next)
+    {
+        if ((san->buf.tag == (MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_X509_SAN_IP_ADDRESS)) && (san->buf.len == 4) &&
+            (memcmp(san->buf.p, pu8ip, 4) == 0))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void peer_expect(tls_peer_t *peer, const char *cName)
+{
+    peer->bIp = (inet_pton(AF_INET, cName, peer->u8ip) == 1);
+}
+
+/* Clear the name mismatch of an IPv4 server named in the end certificate */
+static void peer_check(const tls_peer_t *peer, const mbedtls_x509_crt *crt, int depth, uint32_t *pu32flags)
+{
+    if ((depth == 0) && peer->bIp && (*pu32flags & MBEDTLS_X509_BADCERT_CN_MISMATCH) && san_has_ip(crt, peer->u8ip))
+    {
+        *pu32flags &= ~MBEDTLS_X509_BADCERT_CN_MISMATCH;
+    }
+}
+
+static int tls_verify(void *arg, mbedtls_x509_crt *crt, int depth, uint32_t *pu32flags)
+{
+    tls_ctx_t *ctx = arg;
+    ctx->bCert_seen = true;
+    peer_check(&ctx->peer, crt, depth, pu32flags);
+    return 0; // Keep the other flags, MBEDTLS_SSL_VERIFY_REQUIRED fails the handshake on them
+}
+
+static int https_verify(void *arg, mbedtls_x509_crt *crt, int depth, uint32_t *pu32flags)
+{
+    peer_check(arg, crt, depth, pu32flags);
+    return 0;
+}
+
+static bool offer_session(tls_ctx_t *ctx, const char *cHost, int port)
+{
+    if ((cache.u16len == 0) || (cache.u16port != port) || (strncmp(cache.cHost, cHost, sizeof(cache.cHost)) != 0))
+    {
+        return false;
+    }
+
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    bool bOk = (mbedtls_ssl_session_load(&session, cache.u8session, cache.u16len) == 0) &&
+               (mbedtls_ssl_set_session(&ctx->ssl, &session) == 0);
+    mbedtls_ssl_session_free(&session);
+    if (!bOk)
+    {
+        cache.u16len = 0; // Built by another firmware, or corrupted
+    }
+    return bOk;
+}
+
+/* Called after every handshake, a resumed one may come with a fresh ticket */
+static void save_session(tls_ctx_t *ctx, const char *cHost, int port)
+{
+    mbedtls_ssl_session session;
+    size_t len = 0;
+
+    cache.u16len = 0;
+    if (strlen(cHost) >= sizeof(cache.cHost))
+    {
+        return;
+    }
+
+    mbedtls_ssl_session_init(&session);
+    if ((mbedtls_ssl_get_session(&ctx->ssl, &session) == 0) &&
+        (mbedtls_ssl_session_save(&session, cache.u8session, sizeof(cache.u8session), &len) == 0))
+    {
+        strcpy(cache.cHost, cHost);
+        cache.u16port = (uint16_t)port;
+        cache.u16len = (uint16_t)len;
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Session not cached (%u bytes, room for %u)", len, TLS_SESSION_MAX);
+    }
+    mbedtls_ssl_session_free(&session);
+}
+
+static void record_handshake(uint32_t u32ms, bool bResumed)
+{
+    u32last_ms = u32ms;
+    bLast_resumed = bResumed;
+    if (bResumed)
+    {
+        stats.u32resumed_sum_ms += u32ms;
+        stats.u16resumed++;
+    }
+    else
+    {
+        stats.u32full_sum_ms += u32ms;
+        stats.u16full++;
+    }
+    ESP_LOGI(TAG, "%s handshake in %lu ms (average full %lu ms, resumed %lu ms)", bResumed ? "Resumed" : "Full", u32ms,
+             stats.u16full ? stats.u32full_sum_ms / stats.u16full : 0,
+             stats.u16resumed ? stats.u32resumed_sum_ms / stats.u16resumed : 0);
+}
+
+static int tls_poll(tls_ctx_t *ctx, bool bWrite, int timeout_ms)
+{
+    if (!bWrite && (mbedtls_ssl_get_bytes_avail(&ctx->ssl) > 0))
+    {
+        return 1; // Already decrypted, the socket may well be empty
+    }
+
+    fd_set fds;
+    fd_set errfds;
+    FD_ZERO(&fds);
+    FD_ZERO(&errfds);
+    FD_SET(ctx->net.fd, &fds);
+    FD_SET(ctx->net.fd, &errfds);
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+
+    int ret = select(ctx->net.fd + 1, bWrite ? NULL : &fds, bWrite ? &fds : NULL, &errfds, (timeout_ms < 0) ? NULL : &tv);
+    if ((ret > 0) && FD_ISSET(ctx->net.fd, &errfds))
+    {
+        return -1;
+    }
+    return ret;
+}
+
+static int tls_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    return tls_poll(esp_transport_get_context_data(t), false, timeout_ms);
+}
+
+static int tls_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    return tls_poll(esp_transport_get_context_data(t), true, timeout_ms);
+}
+
+static int tls_close(esp_transport_handle_t t)
+{
+    tls_ctx_t *ctx = esp_transport_get_context_data(t);
+    if (ctx->bConnected)
+    {
+        mbedtls_ssl_close_notify(&ctx->ssl);
+        ctx->bConnected = false;
+    }
+    mbedtls_ssl_free(&ctx->ssl);
+    mbedtls_net_free(&ctx->net);
+    return 0;
+}
+
+static int tls_connect(esp_transport_handle_t t, const char *cHost, int port, int timeout_ms)
+{
+    tls_ctx_t *ctx = esp_transport_get_context_data(t);
+    char cPort[8];
+
+    tls_close(t);
+    int64_t i64start_us = esp_timer_get_time();
+    mbedtls_net_init(&ctx->net);
+    mbedtls_ssl_init(&ctx->ssl);
+    ctx->bCert_seen = false;
+    mbedtls_ssl_conf_read_timeout(&ctx->conf, timeout_ms);
+
+    /* The end certificate is checked against this name, a mismatch fails the handshake */
+    const char *cName = (TLS_SERVER_NAME != NULL) ? TLS_SERVER_NAME : cHost;
+    peer_expect(&ctx->peer, cName);
+    int ret = mbedtls_ssl_setup(&ctx->ssl, &ctx->conf);
+    if (ret == 0)
+    {
+        ret = mbedtls_ssl_set_hostname(&ctx->ssl, cName);
+    }
+    bool bOffered = (ret == 0) && offer_session(ctx, cHost, port);
+    if (ret == 0)
+    {
+        snprintf(cPort, sizeof(cPort), "%d", port);
+        ret = mbedtls_net_connect(&ctx->net, cHost, cPort, MBEDTLS_NET_PROTO_TCP);
+    }
+    if (ret == 0)
+    {
+        mbedtls_ssl_set_bio(&ctx->ssl, &ctx->net, mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
+        do
+        {
+            ret = mbedtls_ssl_handshake(&ctx->ssl);
+        } while ((ret == MBEDTLS_ERR_SSL_WANT_READ) || (ret == MBEDTLS_ERR_SSL_WANT_WRITE));
+    }
+
+    if (ret != 0)
+    {
+        ESP_LOGE(TAG, "Connection to %s:%d failed, -0x%04X", cHost, port, (unsigned int)-ret);
+        if (bOffered)
+        {
+            tls_forget_session(); // Do not let a stale session fail the next attempt too
+        }
+        tls_close(t);
+        return -1;
+    }
+
+    ctx->bConnected = true;
+    record_handshake((uint32_t)((esp_timer_get_time() - i64start_us) / 1000), bOffered && !ctx->bCert_seen);
+    save_session(ctx, cHost, port);
+    return 0;
+}
+
+static int tls_read(esp_transport_handle_t t, char *pcBuf, int len, int timeout_ms)
+{
+    tls_ctx_t *ctx = esp_transport_get_context_data(t);
+
+    int ret = tls_poll(ctx, false, timeout_ms);
+    if (ret <= 0)
+    {
+        return ret; // 0 is ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT
+    }
+
+    ret = mbedtls_ssl_read(&ctx->ssl, (unsigned char *)pcBuf, len);
+    if (ret > 0)
+    {
+        return ret;
+    }
+    if ((ret == MBEDTLS_ERR_SSL_WANT_READ) || (ret == MBEDTLS_ERR_SSL_TIMEOUT))
+    {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if ((ret == 0) || (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY))
+    {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    ESP_LOGE(TAG, "Read failed, -0x%04X", (unsigned int)-ret);
+    return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+}
+
+static int tls_write(esp_transport_handle_t t, const char *pcBuf, int len, int timeout_ms)
+{
+    tls_ctx_t *ctx = esp_transport_get_context_data(t);
+
+    int ret = tls_poll(ctx, true, timeout_ms);
+    if (ret <= 0)
+    {
+        return ret;
+    }
+
+    int written = 0;
+    while (written < len)
+    {
+        ret = mbedtls_ssl_write(&ctx->ssl, (const unsigned char *)pcBuf + written, len - written);
+        if (ret > 0)
+        {
+            written += ret;
+        }
+        else if ((ret != MBEDTLS_ERR_SSL_WANT_WRITE) && (ret != MBEDTLS_ERR_SSL_WANT_READ))
+        {
+            ESP_LOGE(TAG, "Write failed, -0x%04X", (unsigned int)-ret);
+            return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+        }
+    }
+    return written;
+}
+
+static int tls_destroy(esp_transport_handle_t t)
+{
+    tls_ctx_t *ctx = esp_transport_get_context_data(t);
+    tls_close(t);
+    mbedtls_x509_crt_free(&ctx->ca);
+    mbedtls_ssl_config_free(&ctx->conf);
+    free(ctx);
+    return 0;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+const char *tls_ca_pem(void)
+{
+    return ca_cert_pem_start;
+}
+
+esp_transport_handle_t tls_transport_init(void)
+{
+    tls_ctx_t *ctx = calloc(1, sizeof(tls_ctx_t));
+    if (ctx == NULL)
+    {
+        return NULL;
+    }
+
+    mbedtls_net_init(&ctx->net);
+    mbedtls_ssl_init(&ctx->ssl);
+    mbedtls_ssl_config_init(&ctx->conf);
+    mbedtls_x509_crt_init(&ctx->ca);
+
+    /* Parsed once, reused by every reconnect */
+    int ret = mbedtls_x509_crt_parse(&ctx->ca, (const unsigned char *)ca_cert_pem_start, strlen(ca_cert_pem_start) + 1);
+    if (ret == 0)
+    {
+        ret = mbedtls_ssl_config_defaults(&ctx->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    esp_transport_handle_t t = (ret == 0) ? esp_transport_init() : NULL;
+    if (t == NULL)
+    {
+        ESP_LOGE(TAG, "TLS setup failed, -0x%04X", (unsigned int)-ret);
+        mbedtls_x509_crt_free(&ctx->ca);
+        mbedtls_ssl_config_free(&ctx->conf);
+        free(ctx);
+        return NULL;
+    }
+    mbedtls_ssl_conf_ca_chain(&ctx->conf, &ctx->ca, NULL);
+    mbedtls_ssl_conf_authmode(&ctx->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_verify(&ctx->conf, tls_verify, ctx);
+    mbedtls_ssl_conf_rng(&ctx->conf, tls_random, NULL);
+    mbedtls_ssl_conf_ciphersuites(&ctx->conf, ciphersuites);
+    mbedtls_ssl_conf_groups(&ctx->conf, groups);
+    mbedtls_ssl_conf_session_tickets(&ctx->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+
+    esp_transport_set_func(t, tls_connect, tls_read, tls_write, tls_close, tls_poll_read, tls_poll_write, tls_destroy);
+    esp_transport_set_context_data(t, ctx);
+    esp_transport_set_default_port(t, 8883);
+    return t;
+}
+
+void tls_https_expect(const char *cHost)
+{
+    peer_expect(&https_peer, cHost);
+}
+
+esp_err_t tls_https_attach(void *conf)
+{
+    if (!bHttps_ca)
+    {
+        mbedtls_x509_crt_init(&https_ca);
+        if (mbedtls_x509_crt_parse(&https_ca, (const unsigned char *)ca_cert_pem_start, strlen(ca_cert_pem_start) + 1) != 0)
+        {
+            mbedtls_x509_crt_free(&https_ca);
+            return ESP_FAIL;
+        }
+        bHttps_ca = true;
+    }
+    mbedtls_ssl_conf_ca_chain(conf, &https_ca, NULL);
+    mbedtls_ssl_conf_verify(conf, https_verify, &https_peer);
+    return ESP_OK;
+}
+
+void tls_forget_session(void)
+{
+    cache.u16len = 0;
+}
+
+void tls_get_profile(tls_profile_t *out)
+{
+    out->u32handshake_ms = u32last_ms;
+    out->bResumed = bLast_resumed;
+    out->u32full_avg_ms = stats.u16full ? stats.u32full_sum_ms / stats.u16full : 0;
+    out->u32resumed_avg_ms = stats.u16resumed ? stats.u32resumed_sum_ms / stats.u16resumed : 0;
+    out->u16full = stats.u16full;
+    out->u16resumed = stats.u16resumed;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,84 @@
+/*****************************************************************************
+ *
+ * @file 	bee_tls.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	TLS transport for the MQTT client, resumes the last session across
+ *          deep sleep instead of doing a full handshake on every wake
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef BEE_TLS_H
+#define BEE_TLS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_transport.h"
+
+#define TLS_SESSION_MAX         384     /* Serialized session (ticket included) kept in RTC memory */
+#define TLS_HOST_MAX            64
+#define TLS_SERVER_NAME         NULL    /* Name the server certificate must carry, NULL for the host connected to */
+
+typedef struct
+{
+    uint32_t u32handshake_ms;   /* TCP connect + handshake of the last connection, 0 if none */
+    bool     bResumed;          /* The last handshake resumed the cached session */
+    uint32_t u32full_avg_ms;    /* Running averages since the cold boot */
+    uint32_t u32resumed_avg_ms;
+    uint16_t u16full;           /* Handshakes since the cold boot */
+    uint16_t u16resumed;
+} tls_profile_t;
+
+/**
+ * @brief Get the CA certificate (PEM, NUL terminated) trusted by the MQTT and OTA connections.
+ */
+const char *tls_ca_pem(void);
+
+/**
+ * @brief Create the TLS transport to pass in esp_mqtt_client_config_t.network.transport.
+ *
+ * Certificates are verified against tls_ca_pem() and must name the server: TLS_SERVER_NAME or the host
+ * connected to in the common name or a DNS subject alternative name, or an IPv4 host in an IP address
+ * subject alternative name. ECDHE-ECDSA suites are offered first, ECDHE-RSA
+ * stays as a fallback for RSA server certificates. After each full handshake the session (ticket or
+ * session id) is saved in RTC memory and offered on the next connection to the same host, so a wake
+ * from deep sleep skips the certificate exchange and the ECDHE key agreement.
+ *
+ * @return Transport handle, owned by the MQTT client. NULL if out of memory.
+ */
+esp_transport_handle_t tls_transport_init(void);
+
+/**
+ * @brief Set the server name the next esp_http_client connection must present, normally the URL host.
+ */
+void tls_https_expect(const char *cHost);
+
+/**
+ * @brief Give an esp_http_client connection the same certificate checks as the MQTT one.
+ *
+ * For esp_http_client_config_t.crt_bundle_attach: trusts tls_ca_pem() only, and accepts an IPv4 host of
+ * tls_https_expect() in an IP address subject alternative name. esp-tls checks the URL host against the
+ * common name and DNS names itself unless skip_cert_common_name_check is set.
+ *
+ * @param conf The mbedtls_ssl_config of the connection.
+ * @return ESP_OK, ESP_FAIL if the CA does not parse.
+ */
+esp_err_t tls_https_attach(void *conf);
+
+/**
+ * @brief Drop the cached session, the next connection does a full handshake.
+ */
+void tls_forget_session(void);
+
+/**
+ * @brief Get the handshake times of this wake and the full/resumed averages.
+ */
+void tls_get_profile(tls_profile_t *out);
+
+#endif /* BEE_TLS_H */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -12,12 +12,20 @@
 /****************************************************************************/
 #include <stdio.h>
 #include <string.h>
+#include <sys/param.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/event_groups.h>
 #include <esp_log.h>
+#include <esp_system.h>
 #include <esp_wifi.h>
 #include <esp_event.h>
+#include <esp_netif.h>
+#include <esp_timer.h>
+#include <esp_bt.h>
+#include <esp_sntp.h>
+#include <sys/time.h>
+#include <mbedtls/pkcs5.h>
 
 #include <wifi_provisioning/manager.h>
 #include <wifi_provisioning/scheme_ble.h>
@@ -32,13 +40,47 @@ extern bool bButton_task;
 /****************************************************************************/
 static const char *TAG = "Wifi";
 const int WIFI_CONNECTED_EVENT = BIT0;
+const int WIFI_FAIL_EVENT = BIT1;
 
 bool bProv = false; 
 
+/* Fast reconnect cache, kept in RTC memory so it survives deep sleep */
+typedef struct
+{
+    uint32_t u32magic;
+    uint8_t  u8bssid[6];
+    uint8_t  u8channel;
+    bool     bPmk_valid;
+    uint8_t  u8pmk[32];
+    bool     bIp_valid;
+    uint32_t u32ip;
+    uint32_t u32gw;
+    uint32_t u32netmask;
+    uint32_t u32dns;
+    uint16_t u16lease_reuse; /* Fast connects made on this lease without DHCP */
+} wifi_fast_cache_t;
+
+static RTC_DATA_ATTR wifi_fast_cache_t fast_cache;
+static RTC_DATA_ATTR wifi_connect_stats_t connect_stats;
+static RTC_DATA_ATTR wifi_diag_t wifi_diag;
+static RTC_DATA_ATTR uint8_t u8last_good_idx = WIFI_CRED_NONE;  /* Credential entry of the last working network */
+static RTC_DATA_ATTR wifi_link_t wifi_link = {
+    .i8tx_power = WIFI_TX_POWER_MAX,
+    .i8rssi_avg = WIFI_RSSI_STRONG
+};
+static int64_t i64radio_on_us = 0;
+static bool bFast_attempt = false;
+static bool bConnecting = false;
+static bool bSta_started = false;
+static uint8_t u8retry_cnt = 0;
+static bool bProv_mgr_init = false;
+static bool bBt_mem_released = false;
+
 /****************************************************************************/
 /***        List of handle                                      ***/
 /****************************************************************************/
 static EventGroupHandle_t wifi_event_group;
+static esp_netif_t *sta_netif = NULL;
 static TaskHandle_t prov_timeout_handle = NULL;
 static TaskHandle_t prov_fail_handle = NULL;
 
@@ -49,6 +91,15 @@ char cReceived_ssid[32];
 char cReceived_password[64];
 uint8_t u8Received_channel;
 
+static bool is_auth_failure(uint8_t u8reason)
+{
+    return (u8reason == WIFI_REASON_AUTH_FAIL)               ||
+           (u8reason == WIFI_REASON_802_1X_AUTH_FAILED)      ||
+           (u8reason == WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT)  ||
+           (u8reason == WIFI_REASON_HANDSHAKE_TIMEOUT)       ||
+           (u8reason == WIFI_REASON_MIC_FAILURE);
+}
+
 static void event_handler(void* arg, esp_event_base_t event_base,
                           int32_t event_id, void* event_data)
 {
@@ -97,7 +148,9 @@ static void event_handler(void* arg, esp_event_base_t event_base,
                 wifi_ap_record_t ap_info;
                 esp_wifi_sta_get_ap_info(&ap_info);
                 u8Received_channel = ap_info.primary;
-                save_wifi_cred_to_nvs(cReceived_ssid, cReceived_password, u8Received_channel);
+                /* Try the freshly provisioned network first next time; the cached BSSID/lease no longer apply */
+                u8last_good_idx = save_wifi_cred_to_nvs(cReceived_ssid, cReceived_password, u8Received_channel);
+                fast_cache.u32magic = 0;
 
                 if (xTaskGetHandle("prov_timeout") != NULL)
                 {
@@ -126,7 +179,46 @@ static void event_handler(void* arg, esp_event_base_t event_base,
                 esp_wifi_connect();
                 break;
             case WIFI_EVENT_STA_DISCONNECTED:
+            {
+                wifi_event_sta_disconnected_t *disconnected = (wifi_event_sta_disconnected_t *)event_data;
+                if (!bConnecting || (disconnected->reason == WIFI_REASON_ASSOC_LEAVE))
+                {
+                    break; /* Our own disconnect, or a drop outside of connect_wifi() */
+                }
+
+                wifi_diag.u8last_reason = disconnected->reason;
+                wifi_diag.i8last_rssi = disconnected->rssi;
+                wifi_diag.u16disconnects++;
+                ESP_LOGW(TAG, "Disconnected, reason %u, rssi %d", disconnected->reason, disconnected->rssi);
+
+                if (bFast_attempt)
+                {
+                    /* Do not wait out the timeout, fall back to a full connect at once */
+                    xEventGroupSetBits(wifi_event_group, WIFI_FAIL_EVENT);
+                }
+                else if (is_auth_failure(disconnected->reason))
+                {
+                    /* Retrying with the same credentials cannot succeed, give up this wake */
+                    wifi_diag.u16auth_fail++;
+                    xEventGroupSetBits(wifi_event_group, WIFI_FAIL_EVENT);
+                }
+                else if (disconnected->reason == WIFI_REASON_NO_AP_FOUND)
+                {
+                    wifi_diag.u16no_ap++;
+                    xEventGroupSetBits(wifi_event_group, WIFI_FAIL_EVENT);
+                }
+                else if (u8retry_cnt < WIFI_MAX_RETRY)
+                {
+                    u8retry_cnt++;
+                    wifi_diag.u16retries++;
+                    esp_wifi_connect();
+                }
+                else
+                {
+                    xEventGroupSetBits(wifi_event_group, WIFI_FAIL_EVENT);
+                }
                 break;
+            }
         }
     }
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
@@ -195,32 +287,431 @@ static void cnt_timeout(uint8_t *u8time)
     ESP_LOGI(TAG,"TIMEOUT!!!\n");
 }
 
-static void connect_wifi(void)
+static void record_connect_latency(uint32_t u32duration_ms)
+{
+    static const uint16_t u16bucket_ms[WIFI_LATENCY_BUCKETS - 1] = {250, 500, 1000, 2000, 4000};
+    uint8_t u8bucket = 0;
+    while ((u8bucket < WIFI_LATENCY_BUCKETS - 1) && (u32duration_ms >= u16bucket_ms[u8bucket]))
+    {
+        u8bucket++;
+    }
+    wifi_diag.u16latency_hist[u8bucket]++;
+}
+
+static bool fast_cache_valid(void)
+{
+    return (fast_cache.u32magic == WIFI_FAST_CACHE_MAGIC) && (fast_cache.u8channel != 0);
+}
+
+static void fast_cache_apply_ip(void)
+{
+    esp_netif_ip_info_t ip_info = {
+        .ip.addr = fast_cache.u32ip,
+        .gw.addr = fast_cache.u32gw,
+        .netmask.addr = fast_cache.u32netmask
+    };
+    esp_netif_dns_info_t dns_info = {
+        .ip.u_addr.ip4.addr = fast_cache.u32dns,
+        .ip.type = ESP_IPADDR_TYPE_V4
+    };
+
+    esp_netif_dhcpc_stop(sta_netif);
+    esp_netif_set_ip_info(sta_netif, &ip_info);
+    esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns_info);
+}
+
+static void fast_cache_fill(const char *cSsid, const char *cPassword, bool bDhcp)
+{
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK)
+    {
+        return;
+    }
+
+    bool bSame_pmk = fast_cache_valid() && fast_cache.bPmk_valid;
+    fast_cache.u32magic = WIFI_FAST_CACHE_MAGIC;
+    memcpy(fast_cache.u8bssid, ap_info.bssid, sizeof(fast_cache.u8bssid));
+    fast_cache.u8channel = ap_info.primary;
+
+    /* PBKDF2 costs as much as the driver's own derivation, so only run it when the cache is cold */
+    size_t password_len = strlen(cPassword);
+    if (!bSame_pmk && (password_len >= 8) && (password_len < 64))
+    {
+        fast_cache.bPmk_valid = (mbedtls_pkcs5_pbkdf2_hmac_ext(MBEDTLS_MD_SHA1,
+                                    (const unsigned char *)cPassword, password_len,
+                                    (const unsigned char *)cSsid, strlen(cSsid),
+                                    4096, sizeof(fast_cache.u8pmk), fast_cache.u8pmk) == 0);
+    }
+    else if (!bSame_pmk)
+    {
+        fast_cache.bPmk_valid = false;
+    }
+
+    if (bDhcp)
+    {
+        esp_netif_ip_info_t ip_info;
+        esp_netif_dns_info_t dns_info;
+        esp_netif_get_ip_info(sta_netif, &ip_info);
+        esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns_info);
+        fast_cache.u32ip = ip_info.ip.addr;
+        fast_cache.u32gw = ip_info.gw.addr;
+        fast_cache.u32netmask = ip_info.netmask.addr;
+        fast_cache.u32dns = dns_info.ip.u_addr.ip4.addr;
+        fast_cache.bIp_valid = (ip_info.ip.addr != 0);
+        fast_cache.u16lease_reuse = 0;
+    }
+}
+
+static void record_connect_time(bool bFast, uint32_t u32duration_ms)
+{
+    connect_stats.u32last_ms = u32duration_ms;
+    connect_stats.bLast_fast = bFast;
+    if (bFast)
+    {
+        connect_stats.u16fast_cnt++;
+        connect_stats.u32fast_ms_sum += u32duration_ms;
+    }
+    else
+    {
+        connect_stats.u16full_cnt++;
+        connect_stats.u32full_ms_sum += u32duration_ms;
+    }
+
+    ESP_LOGI(TAG, "%s connect: %lu ms (avg fast %lu ms x%u, full %lu ms x%u, fallbacks %u)",
+             bFast ? "Fast" : "Full", u32duration_ms,
+             connect_stats.u16fast_cnt ? connect_stats.u32fast_ms_sum / connect_stats.u16fast_cnt : 0,
+             connect_stats.u16fast_cnt,
+             connect_stats.u16full_cnt ? connect_stats.u32full_ms_sum / connect_stats.u16full_cnt : 0,
+             connect_stats.u16full_cnt,
+             connect_stats.u16fallback_cnt);
+}
+
+static void link_apply(void)
+{
+    /* Near an AP 802.11n gains nothing on a 200 byte publish, at the edge it only costs retries */
+    uint8_t u8protocol = WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G;
+    if (!wifi_link.bLow_rate)
+    {
+        u8protocol |= WIFI_PROTOCOL_11N;
+    }
+    esp_wifi_set_protocol(WIFI_IF_STA, u8protocol);
+}
+
+static void link_update(bool bConnected, uint8_t u8failed_attempts)
+{
+    if (bConnected)
+    {
+        wifi_link.i8rssi_avg = (int8_t)((3 * wifi_link.i8rssi_avg + wifi_diag.i8last_rssi) / 4);
+    }
+
+    if (!bConnected || (u8failed_attempts > 0) || (u8retry_cnt > 0))
+    {
+        /* Retries climbing: restore power quickly */
+        wifi_link.i8tx_power = MIN(wifi_link.i8tx_power + 2 * WIFI_TX_POWER_STEP, WIFI_TX_POWER_MAX);
+        wifi_link.u8strong_cnt = 0;
+    }
+    else if (wifi_link.i8rssi_avg > WIFI_RSSI_STRONG)
+    {
+        /* Strong, clean link: step down slowly */
+        if (++wifi_link.u8strong_cnt >= WIFI_STRONG_WAKES_TO_STEP_DOWN)
+        {
+            wifi_link.i8tx_power = MAX(wifi_link.i8tx_power - WIFI_TX_POWER_STEP, WIFI_TX_POWER_MIN);
+            wifi_link.u8strong_cnt = 0;
+        }
+    }
+    else
+    {
+        wifi_link.u8strong_cnt = 0;
+    }
+
+    if (wifi_link.i8rssi_avg < WIFI_RSSI_EDGE)
+    {
+        wifi_link.bLow_rate = true;
+    }
+    else if (wifi_link.i8rssi_avg > WIFI_RSSI_EDGE + WIFI_RSSI_HYSTERESIS)
+    {
+        wifi_link.bLow_rate = false;
+    }
+
+    ESP_LOGI(TAG, "Link: rssi avg %d dBm, next tx power %d.%02d dBm, %s rates",
+             wifi_link.i8rssi_avg, wifi_link.i8tx_power / 4, (wifi_link.i8tx_power % 4) * 25,
+             wifi_link.bLow_rate ? "11b/g" : "11b/g/n");
+}
+
+static void sta_start_or_connect(void)
+{
+    if (!bSta_started)
+    {
+        ESP_ERROR_CHECK(esp_wifi_start()); /* WIFI_EVENT_STA_START triggers the connect */
+        esp_wifi_set_max_tx_power(wifi_link.i8tx_power);
+        i64radio_on_us = esp_timer_get_time();
+        bSta_started = true;
+    }
+    else
+    {
+        esp_wifi_connect();
+    }
+}
+
+static bool connect_to(const wifi_cred_t *cred, bool bTry_fast)
 {
     wifi_config_t wifi_sta_cfg;
 
-    char cSsid[32];
-    char cPassword[64];
-    uint8_t u8channel;
+    // Thiết lập cấu hình Wi-Fi với thông tin từ NVS
+    memset(&wifi_sta_cfg, 0, sizeof(wifi_config_t));
+    strncpy((char*)wifi_sta_cfg.sta.ssid, cred->cSsid, sizeof(wifi_sta_cfg.sta.ssid));
+    strncpy((char*)wifi_sta_cfg.sta.password, cred->cPassword, sizeof(wifi_sta_cfg.sta.password));
+    wifi_sta_cfg.sta.channel = cred->u8channel;
 
-    load_old_wifi_cred(cSsid, cPassword, &u8channel );
+    int64_t i64start_us = esp_timer_get_time();
+    bool bUse_static_ip = false;
+    EventBits_t bits = 0;
 
-    if (strlen(cSsid) > 0)
+    bConnecting = true;
+    u8retry_cnt = 0;
+    xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_EVENT | WIFI_FAIL_EVENT);
+    if (bSta_started)
     {
-        // Thiết lập cấu hình Wi-Fi với thông tin từ NVS
-        memset(&wifi_sta_cfg, 0, sizeof(wifi_config_t));
-        strncpy((char*)wifi_sta_cfg.sta.ssid, cSsid, sizeof(wifi_sta_cfg.sta.ssid));
-        strncpy((char*)wifi_sta_cfg.sta.password, cPassword, sizeof(wifi_sta_cfg.sta.password));
-        wifi_sta_cfg.sta.channel = u8channel;
+        esp_wifi_disconnect(); /* Leave the network of the previous candidate */
+    }
+
+    bFast_attempt = bTry_fast && fast_cache_valid();
+    if (bFast_attempt)
+    {
+        /* Skip the scan and the 4096-round PBKDF2: go straight to the known BSSID with the cached PMK */
+        wifi_config_t wifi_fast_cfg = wifi_sta_cfg;
+        memcpy(wifi_fast_cfg.sta.bssid, fast_cache.u8bssid, sizeof(wifi_fast_cfg.sta.bssid));
+        wifi_fast_cfg.sta.bssid_set = true;
+        wifi_fast_cfg.sta.channel = fast_cache.u8channel;
+        if (fast_cache.bPmk_valid)
+        {
+            /* A 64 hex digit password is taken by the supplicant as the PSK itself */
+            static const char cHex[] = "0123456789abcdef";
+            for (uint8_t i = 0; i < sizeof(fast_cache.u8pmk); i++)
+            {
+                wifi_fast_cfg.sta.password[2 * i] = cHex[fast_cache.u8pmk[i] >> 4];
+                wifi_fast_cfg.sta.password[2 * i + 1] = cHex[fast_cache.u8pmk[i] & 0x0F];
+            }
+        }
+
+        bUse_static_ip = fast_cache.bIp_valid && (fast_cache.u16lease_reuse < WIFI_FAST_MAX_LEASE_REUSE);
+        if (bUse_static_ip)
+        {
+            fast_cache_apply_ip();
+        }
 
-        wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-        ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+        ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_fast_cfg));
+        sta_start_or_connect();
+        bits = xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_EVENT | WIFI_FAIL_EVENT,
+                                   true, false, pdMS_TO_TICKS(WIFI_FAST_CONNECT_TIMEOUT_MS));
+        bFast_attempt = false;
 
-        // Khởi tạo Wi-Fi ở chế độ STA với cấu hình đã đọc từ NVS
-        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+        if (!(bits & WIFI_CONNECTED_EVENT))
+        {
+            ESP_LOGW(TAG, "Fast reconnect failed, falling back to scan + DHCP");
+            fast_cache.u32magic = 0;
+            connect_stats.u16fallback_cnt++;
+            esp_wifi_disconnect();
+            if (bUse_static_ip)
+            {
+                esp_netif_dhcpc_start(sta_netif);
+                bUse_static_ip = false;
+            }
+            ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_sta_cfg));
+            xEventGroupClearBits(wifi_event_group, WIFI_FAIL_EVENT);
+            esp_wifi_connect();
+        }
+    }
+    else
+    {
+        fast_cache.u32magic = 0; /* The cache, if any, belongs to another network */
         ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_sta_cfg));
-        ESP_ERROR_CHECK(esp_wifi_start());
+        sta_start_or_connect();
+    }
+
+    if (!(bits & WIFI_CONNECTED_EVENT))
+    {
+        bits = xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_EVENT | WIFI_FAIL_EVENT, true, false,
+                                   pdMS_TO_TICKS(WIFI_CONNECT_TIMEOUT_MS));
+    }
+    bConnecting = false;
+
+    uint32_t u32duration_ms = (uint32_t)((esp_timer_get_time() - i64start_us) / 1000);
+    if (bits & WIFI_CONNECTED_EVENT)
+    {
+        bool bFast = fast_cache_valid();
+        wifi_ap_record_t ap_info;
+        if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK)
+        {
+            wifi_diag.i8last_rssi = ap_info.rssi;
+        }
+        record_connect_latency(u32duration_ms);
+        record_connect_time(bFast, u32duration_ms);
+        fast_cache_fill(cred->cSsid, cred->cPassword, !bUse_static_ip);
+        if (bUse_static_ip)
+        {
+            fast_cache.u16lease_reuse++;
+        }
+        return true;
+    }
+
+    if (!(bits & WIFI_FAIL_EVENT))
+    {
+        wifi_diag.u16timeouts++;
+    }
+    wifi_diag.u16failures++;
+    record_connect_latency(u32duration_ms);
+    ESP_LOGE(TAG, "Connect to %s failed after %lu ms, last reason %u", cred->cSsid, u32duration_ms, wifi_diag.u8last_reason);
+    return false;
+}
+
+/* Success rate with a +1/+2 prior, so untried networks rank in the middle */
+static uint16_t cred_score(const wifi_cred_t *cred)
+{
+    return (uint16_t)(((uint32_t)cred->u8successes + 1) * 256 / ((uint32_t)cred->u8attempts + 2));
+}
+
+static uint8_t rank_creds(const wifi_cred_list_t *list, uint8_t *u8order)
+{
+    uint8_t u8n = 0;
+    if (u8last_good_idx < list->u8count)
+    {
+        u8order[u8n++] = u8last_good_idx;
+    }
+
+    for (uint8_t i = 0; i < list->u8count; i++)
+    {
+        if (i == u8last_good_idx)
+        {
+            continue;
+        }
+        /* Insertion sort on (success rate, last RSSI), the list holds at most WIFI_CRED_MAX entries */
+        uint8_t j = u8n;
+        while ((j > 0) && (u8order[j - 1] != u8last_good_idx))
+        {
+            const wifi_cred_t *prev = &list->creds[u8order[j - 1]];
+            const wifi_cred_t *cur = &list->creds[i];
+            if ((cred_score(prev) > cred_score(cur)) ||
+                ((cred_score(prev) == cred_score(cur)) && (prev->i8rssi >= cur->i8rssi)))
+            {
+                break;
+            }
+            u8order[j] = u8order[j - 1];
+            j--;
+        }
+        u8order[j] = i;
+        u8n++;
+    }
+    return u8n;
+}
+
+static void cred_record_attempt(wifi_cred_t *cred, bool bSuccess)
+{
+    if (cred->u8attempts == UINT8_MAX)
+    {
+        /* Halve both counters so the rate follows recent behaviour */
+        cred->u8attempts /= 2;
+        cred->u8successes /= 2;
+    }
+    cred->u8attempts++;
+    if (bSuccess)
+    {
+        wifi_ap_record_t ap_info;
+        cred->u8successes++;
+        if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK)
+        {
+            cred->i8rssi = ap_info.rssi;
+            cred->u8channel = ap_info.primary;
+        }
+    }
+}
+
+/* The RTC keeps the clock through deep sleep, so SNTP only runs until the first sync */
+static void time_sync_start(void)
+{
+    if ((wifi_get_unix_time() != 0) || esp_sntp_enabled())
+    {
+        return;
     }
+    esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, WIFI_SNTP_SERVER);
+    esp_sntp_init(); /* Non blocking, the reply normally lands while the first publish is in flight */
+}
+
+static void connect_wifi(void)
+{
+    wifi_cred_list_t cred_list;
+    load_wifi_cred_list(&cred_list);
+
+    if (cred_list.u8count == 0)
+    {
+        ESP_LOGI(TAG, "Not provisioned, Wi-Fi STA stays idle");
+        return;
+    }
+
+    // Khởi tạo Wi-Fi ở chế độ STA với cấu hình đã đọc từ NVS
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    link_apply();
+
+    uint8_t u8order[WIFI_CRED_MAX];
+    uint8_t u8n = rank_creds(&cred_list, u8order);
+    uint8_t u8failed = 0;
+    bool bConnected = false;
+    bool bPersist = false;
+
+    for (uint8_t i = 0; i < u8n; i++)
+    {
+        uint8_t u8idx = u8order[i];
+        bConnected = connect_to(&cred_list.creds[u8idx], u8idx == u8last_good_idx);
+        cred_record_attempt(&cred_list.creds[u8idx], bConnected);
+
+        if (bConnected)
+        {
+            /* A fast connect to the usual network is the common case and is not worth a flash write */
+            bPersist |= (u8idx != u8last_good_idx) || !connect_stats.bLast_fast;
+            u8last_good_idx = u8idx;
+            break;
+        }
+        u8failed++;
+        bPersist = true;
+    }
+    link_update(bConnected, u8failed);
+    if (bConnected)
+    {
+        time_sync_start();
+    }
+
+    if (bPersist)
+    {
+        save_wifi_cred_list(&cred_list);
+    }
+}
+
+/* The provisioning manager and the NimBLE stack are only needed on the button path */
+static esp_err_t prov_mgr_init(void)
+{
+    if (bProv_mgr_init)
+    {
+        return ESP_OK;
+    }
+    if (bBt_mem_released)
+    {
+        ESP_LOGW(TAG, "BT memory was released on this wake, wake up by button to provision");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_PROV_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(PROTOCOMM_TRANSPORT_BLE_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL));
+
+    /* Configuration for the provisioning manager */
+    wifi_prov_mgr_config_t config =
+    {
+        .scheme = wifi_prov_scheme_ble,
+        .scheme_event_handler = WIFI_PROV_SCHEME_BLE_EVENT_HANDLER_FREE_BTDM
+    };
+    ESP_ERROR_CHECK(wifi_prov_mgr_init(config));
+    bProv_mgr_init = true;
+    return ESP_OK;
 }
 
 /****************************************************************************/
@@ -238,52 +729,46 @@ void wifi_func_init()
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     wifi_event_group = xEventGroupCreate();
 
-    /* Register our event handler for Wi-Fi, IP and Provisioning related events */
-    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_PROV_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL));
-    ESP_ERROR_CHECK(esp_event_handler_register(PROTOCOMM_TRANSPORT_BLE_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL));
+    /* Register our event handler for Wi-Fi and IP events, provisioning ones are added on demand */
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL));
 
     /* Initialize Wi-Fi including netif with default config */
-    esp_netif_create_default_wifi_sta();
+    sta_netif = esp_netif_create_default_wifi_sta();
  
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    cfg.nvs_enable = 0; /* Credentials come from the bee_nvs blob, the driver's own NVS copy would only cost flash accesses */
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
-    /* Configuration for the provisioning manager */
-    wifi_prov_mgr_config_t config =
-    {
-        .scheme = wifi_prov_scheme_ble,
-        .scheme_event_handler = WIFI_PROV_SCHEME_BLE_EVENT_HANDLER_FREE_BTDM
-    };
-
-    /*Kiểm tra trạng thái cấu hình wifi đã tồn tại hay chưa*/
-    ESP_ERROR_CHECK(wifi_prov_mgr_init(config));
-    bool provisioned = false;
-    ESP_ERROR_CHECK(wifi_prov_mgr_is_provisioned(&provisioned));
-    if (provisioned)
-    {
-        ESP_LOGI(TAG, "Already provisioned, starting Wi-Fi STA");
-        wifi_prov_mgr_stop_provisioning();
-        connect_wifi();
-        const TickType_t xMaxDelay = pdMS_TO_TICKS(6000);
-        xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_EVENT, true, true, xMaxDelay);
-    }
-    else
-    {
-        wifi_prov_mgr_stop_provisioning();
-    }
+    connect_wifi();
 
     wifi_end_time = xTaskGetTickCount();
     TickType_t wifi_connect_duration = wifi_end_time - wifi_start_time;
     double seconds = (double)wifi_connect_duration / configTICK_RATE_HZ;
     ESP_LOGI(TAG,"wifi_connect_duration: %.2f seconds\n", seconds);
+    ESP_LOGI(TAG, "Free heap after Wi-Fi init: %lu bytes", esp_get_free_heap_size());
+}
+
+void wifi_release_bt_mem(void)
+{
+    uint32_t u32heap_before = esp_get_free_heap_size();
+    if (esp_bt_controller_mem_release(ESP_BT_MODE_BLE) == ESP_OK)
+    {
+        bBt_mem_released = true;
+        ESP_LOGI(TAG, "Released BT controller memory: %lu bytes", esp_get_free_heap_size() - u32heap_before);
+    }
 }
 
 void wifi_prov(void)
 {
     if (!bProv)
     {
+        if (prov_mgr_init() != ESP_OK)
+        {
+            bButton_task = false;
+            return;
+        }
+
         ESP_LOGI(TAG, "Start prov\n");
         bProv = true;
 
@@ -315,6 +800,76 @@ void wifi_prov(void)
     }
 }
 
+void wifi_get_connect_stats(wifi_connect_stats_t *stats)
+{
+    *stats = connect_stats;
+}
+
+uint32_t wifi_get_unix_time(void)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec >= WIFI_TIME_VALID_EPOCH) ? (uint32_t)now.tv_sec : 0;
+}
+
+void wifi_get_diag(wifi_diag_t *diag)
+{
+    *diag = wifi_diag;
+}
+
+void wifi_link_report_publish(bool bOk)
+{
+    wifi_link.u16pub_total++;
+    if (bOk)
+    {
+        wifi_link.u16pub_ok++;
+    }
+    else
+    {
+        wifi_link.i8tx_power = MIN(wifi_link.i8tx_power + 2 * WIFI_TX_POWER_STEP, WIFI_TX_POWER_MAX);
+        wifi_link.u8strong_cnt = 0;
+    }
+}
+
+void wifi_get_link(wifi_link_t *link)
+{
+    *link = wifi_link;
+}
+
+void wifi_link_reported(void)
+{
+    wifi_link.u16pub_total = 0;
+    wifi_link.u16pub_ok = 0;
+    wifi_link.u32radio_ms_sum = 0;
+    wifi_link.u16radio_cnt = 0;
+}
+
+void wifi_radio_off(void)
+{
+    esp_wifi_disconnect();
+    if (bSta_started)
+    {
+        esp_wifi_stop();
+        bSta_started = false;
+        wifi_link.u32radio_last_ms = (uint32_t)((esp_timer_get_time() - i64radio_on_us) / 1000);
+        wifi_link.u32radio_ms_sum += wifi_link.u32radio_last_ms;
+        wifi_link.u16radio_cnt++;
+        ESP_LOGI(TAG, "Radio on for %lu ms (avg %lu ms), publish success %u/%u",
+                 wifi_link.u32radio_last_ms, wifi_link.u32radio_ms_sum / wifi_link.u16radio_cnt,
+                 wifi_link.u16pub_ok, wifi_link.u16pub_total);
+    }
+}
+
+void wifi_diag_reported(void)
+{
+    /* Keep the last reason/RSSI, restart the counters for the next report */
+    uint8_t u8last_reason = wifi_diag.u8last_reason;
+    int8_t i8last_rssi = wifi_diag.i8last_rssi;
+    memset(&wifi_diag, 0, sizeof(wifi_diag));
+    wifi_diag.u8last_reason = u8last_reason;
+    wifi_diag.i8last_rssi = i8last_rssi;
+}
+
 /****************************************************************************/
 /***        Tasks                                                         ***/
 /****************************************************************************/
@@ -13,16 +13,77 @@
 #ifndef BEE_WIFI_H_
 #define BEE_WIFI_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #define PRE_FIX "BEE_"
 #define PASS_PROV "Bee@1234"
 
+#define WIFI_CONNECT_TIMEOUT_MS         6000
+#define WIFI_FAST_CONNECT_TIMEOUT_MS    1500
+#define WIFI_FAST_MAX_LEASE_REUSE       288     /* Renew the DHCP lease about once a day at a 5 min publish cadence */
+#define WIFI_FAST_CACHE_MAGIC           0xBEEFA57C
+#define WIFI_MAX_RETRY                  2
+#define WIFI_LATENCY_BUCKETS            6       /* <250, <500, <1000, <2000, <4000, >=4000 ms */
+#define WIFI_SNTP_SERVER                "pool.ntp.org"
+#define WIFI_TIME_VALID_EPOCH           1672531200  /* 2023-01-01, anything earlier means the clock was never set */
+
+/* Link adaptation, TX power in units of 0.25 dBm as taken by esp_wifi_set_max_tx_power() */
+#define WIFI_TX_POWER_MAX               68      /* 17 dBm, the sdkconfig maximum */
+#define WIFI_TX_POWER_MIN               34      /* 8.5 dBm */
+#define WIFI_TX_POWER_STEP              8       /* 2 dBm */
+#define WIFI_RSSI_STRONG                (-55)   /* Lower TX power above this average RSSI */
+#define WIFI_RSSI_EDGE                  (-80)   /* Drop 802.11n below this average RSSI */
+#define WIFI_RSSI_HYSTERESIS            5
+#define WIFI_STRONG_WAKES_TO_STEP_DOWN  3
+
+typedef struct
+{
+    uint32_t u32last_ms;        /* Duration of the last successful connect */
+    bool     bLast_fast;        /* Last connect used the RTC fast reconnect cache */
+    uint16_t u16fast_cnt;
+    uint16_t u16full_cnt;
+    uint16_t u16fallback_cnt;   /* Fast attempts that had to fall back to scan + DHCP */
+    uint32_t u32fast_ms_sum;
+    uint32_t u32full_ms_sum;
+} wifi_connect_stats_t;
+
+typedef struct
+{
+    uint8_t  u8last_reason;     /* wifi_err_reason_t of the last disconnect */
+    int8_t   i8last_rssi;       /* RSSI of the last connect or disconnect */
+    uint16_t u16disconnects;
+    uint16_t u16retries;
+    uint16_t u16auth_fail;
+    uint16_t u16no_ap;
+    uint16_t u16timeouts;
+    uint16_t u16failures;       /* Wakes that ended without a connection */
+    uint16_t u16latency_hist[WIFI_LATENCY_BUCKETS];
+} wifi_diag_t;
+
+typedef struct
+{
+    int8_t   i8tx_power;        /* Current max TX power, 0.25 dBm units */
+    int8_t   i8rssi_avg;        /* Moving average of the RSSI over recent wakes */
+    uint8_t  u8strong_cnt;      /* Consecutive clean wakes above WIFI_RSSI_STRONG */
+    bool     bLow_rate;         /* 802.11n disabled, the link uses the 11b/g rates only */
+    uint16_t u16pub_total;      /* Publishes attempted since the last report */
+    uint16_t u16pub_ok;
+    uint32_t u32radio_ms_sum;   /* Radio-on time of the wakes since the last report */
+    uint16_t u16radio_cnt;
+    uint32_t u32radio_last_ms;
+} wifi_link_t;
+
 /**
  * @brief   Initialize Wi-Fi functionality, event handlers, and provisioning.
  *
- * This function initializes the TCP/IP stack, creates the event loop, sets up event handlers for Wi-Fi, IP, and provisioning events,
- * initializes the default Wi-Fi station interface, and configures the Wi-Fi provisioning manager. 
- * If the device is already provisioned, it starts the Wi-Fi station; otherwise, it stops provisioning.
- * The function blocks until the device is connected to Wi-Fi.
+ * This function initializes the TCP/IP stack, creates the event loop, sets up event handlers for Wi-Fi and IP events
+ * and initializes the default Wi-Fi station interface. The provisioning manager and the BLE stack are not touched here,
+ * they are brought up by wifi_prov() on the button path only.
+ * If Wi-Fi credentials are stored, it starts the Wi-Fi station; otherwise the station stays idle.
+ * When the RTC fast reconnect cache is valid, the station connects straight to the cached BSSID and
+ * channel with the cached PMK and a static IP from the previous lease, falling back to a full scan
+ * plus DHCP on failure. The function blocks until the device is connected to Wi-Fi.
  *
  * @param   timeout_connect_wifi max time in sec to connect wifi
  * @return  None
@@ -36,13 +97,102 @@ void wifi_func_init();
  * for provisioning, including security settings and service name. If the provisioning process starts successfully, it registers
  * an endpoint for handling custom provisioning data and creates a task to monitor the provisioning timeout.
  *
- * @note    This function will have no effect if provisioning is already in progress.
+ * The provisioning manager, its event handlers and the NimBLE stack are initialized lazily on the first call.
+ *
+ * @note    This function will have no effect if provisioning is already in progress, or if the BT memory
+ *          has been released by wifi_release_bt_mem() on this wake.
  *
  * @param   None
  * @return  None
  */
 void wifi_prov();
 
+/**
+ * @brief   Release the BT controller memory to the heap.
+ *
+ * Call this on wakes that never provision (timer wakes). Once released, BLE provisioning
+ * is unavailable until the next reset.
+ *
+ * @param   None
+ * @return  None
+ */
+void wifi_release_bt_mem(void);
+
+/**
+ * @brief   Get the Wi-Fi connect time statistics.
+ *
+ * The statistics live in RTC memory and accumulate across deep sleep cycles, so the
+ * average fast reconnect time can be compared with the average full scan + DHCP time.
+ *
+ * @param   stats Pointer to the structure to be filled.
+ * @return  None
+ */
+void wifi_get_connect_stats(wifi_connect_stats_t *stats);
+
+/**
+ * @brief   Get the wall clock time.
+ *
+ * The clock is set by SNTP after the first successful connect and kept by the RTC through deep sleep.
+ *
+ * @return  Unix time in seconds, 0 if the clock has not been set yet.
+ */
+uint32_t wifi_get_unix_time(void);
+
+/**
+ * @brief   Get the Wi-Fi connection diagnostics.
+ *
+ * Disconnect reasons, RSSI, retry counts and the connect latency histogram are kept in RTC
+ * memory until they have been reported with wifi_diag_reported().
+ *
+ * @param   diag Pointer to the structure to be filled.
+ * @return  None
+ */
+void wifi_get_diag(wifi_diag_t *diag);
+
+/**
+ * @brief   Mark the Wi-Fi diagnostics as reported.
+ *
+ * Clears the counters and the histogram after a successful upload, the last reason and RSSI are kept.
+ *
+ * @param   None
+ * @return  None
+ */
+void wifi_diag_reported(void);
+
+/**
+ * @brief   Report the outcome of a publish to the link adaptation policy.
+ *
+ * A failed publish raises the TX power on the next wake.
+ *
+ * @param   bOk true if the publish went out.
+ * @return  None
+ */
+void wifi_link_report_publish(bool bOk);
+
+/**
+ * @brief   Get the link adaptation state, including publish success and radio-on time.
+ *
+ * @param   link Pointer to the structure to be filled.
+ * @return  None
+ */
+void wifi_get_link(wifi_link_t *link);
+
+/**
+ * @brief   Mark the link statistics as reported and restart the publish/radio-on counters.
+ *
+ * @param   None
+ * @return  None
+ */
+void wifi_link_reported(void);
+
+/**
+ * @brief   Disconnect and stop the Wi-Fi radio, recording the radio-on time of this wake.
+ *
+ * @param   None
+ * @return  None
+ */
+void wifi_radio_off(void);
+
 /**
  * @brief   Task for handling provisioning timeout.
  *
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""Reference decoder for the compact telemetry encodings of the SHT3x node.
+
+Decodes the payloads published on .../telemetry/cbor and .../telemetry/bin
+(see bee_payload.h) into JSON, one object per line.
+
+    bee_decode.py cbor a6000101010218...            # hex on the command line
+    bee_decode.py bin < payload.bin                  # raw bytes on stdin, single readings or batches
+    mosquitto_sub -t 'VB/DMP/VBEEON/CUSTOM/SMH/+/telemetry/bin' -F '%x' | bee_decode.py bin -
+
+Only the Python standard library is used.
+"""
+
+import argparse
+import json
+import struct
+import sys
+from datetime import datetime, timezone
+
+SCHEMA_VERSION = 1
+TYPES = {1: "data", 2: "warning", 3: "batch", 4: "history"}
+CBOR_KEYS = {0: "version", 1: "type", 2: "seq", 3: "timestamp",
+             4: "temp_ticks", 5: "humi_ticks", 6: "warning", 7: "wifi",
+             8: "ts_deltas", 9: "temp_deltas", 10: "humi_deltas",
+             11: "config_version"}
+WIFI_FIELDS = ("rssi", "reason", "disc", "retry", "auth_fail", "no_ap", "timeout",
+               "fail", "tx_pwr", "pub_ok", "pub_total", "radio_ms", "lat_hist")
+PACKED = struct.Struct("<BBHIHHB")
+PACKED_BATCH = struct.Struct("<BBHIBHH")
+VALID_EPOCH = 1672531200  # Anything earlier is uptime, the clock was never synced
+
+
+def temp_from_ticks(ticks):
+    return round(-45.0 + 175.0 * ticks / 65535.0, 2)
+
+
+def humi_from_ticks(ticks):
+    return round(100.0 * ticks / 65535.0, 2)
+
+
+def cbor_decode(data, pos=0):
+    """Decode one CBOR item, returns (value, next position). Only the subset the node emits."""
+    head = data[pos]
+    major, info = head >> 5, head & 0x1F
+    pos += 1
+    if info < 24:
+        arg = info
+    elif info in (24, 25, 26, 27):
+        size = 1 << (info - 24)
+        arg = int.from_bytes(data[pos:pos + size], "big")
+        pos += size
+    else:
+        raise ValueError("unsupported CBOR additional info %d" % info)
+
+    if major == 0:
+        return arg, pos
+    if major == 1:
+        return -1 - arg, pos
+    if major == 2:
+        return data[pos:pos + arg].hex(), pos + arg
+    if major == 3:
+        return data[pos:pos + arg].decode("utf-8"), pos + arg
+    if major == 4:
+        items = []
+        for _ in range(arg):
+            item, pos = cbor_decode(data, pos)
+            items.append(item)
+        return items, pos
+    if major == 5:
+        pairs = {}
+        for _ in range(arg):
+            key, pos = cbor_decode(data, pos)
+            pairs[key], pos = cbor_decode(data, pos)
+        return pairs, pos
+    raise ValueError("unsupported CBOR major type %d" % major)
+
+
+def read_varint(data, pos):
+    """Read one zigzag LEB128 varint, returns (value, next position)."""
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return (value >> 1) ^ -(value & 1), pos
+
+
+def accumulate(first, deltas):
+    values = [first]
+    for delta in deltas:
+        values.append(values[-1] + delta)
+    return values
+
+
+def sample(timestamp, temp_ticks, humi_ticks):
+    item = {"timestamp": timestamp, "temperature": temp_from_ticks(temp_ticks),
+            "humidity": humi_from_ticks(humi_ticks)}
+    if timestamp >= VALID_EPOCH:
+        item["time"] = datetime.fromtimestamp(timestamp, timezone.utc).isoformat()
+    return item
+
+
+def finish(msg):
+    if msg.get("version") != SCHEMA_VERSION:
+        raise ValueError("unknown schema version %r" % msg.get("version"))
+    msg["type"] = TYPES.get(msg["type"], msg["type"])
+    if msg["type"] in ("batch", "history"):
+        times = accumulate(msg.pop("timestamp"), msg.pop("ts_deltas"))
+        temps = accumulate(msg.pop("temp_ticks"), msg.pop("temp_deltas"))
+        humis = accumulate(msg.pop("humi_ticks"), msg.pop("humi_deltas"))
+        if not len(times) == len(temps) == len(humis):
+            raise ValueError("batch series differ in length")
+        msg["samples"] = [sample(*s) for s in zip(times, temps, humis)]
+        return msg
+    msg["temperature"] = temp_from_ticks(msg["temp_ticks"])
+    msg["humidity"] = humi_from_ticks(msg["humi_ticks"])
+    if msg.get("timestamp"):
+        msg["time"] = datetime.fromtimestamp(msg["timestamp"], timezone.utc).isoformat()
+    return msg
+
+
+def decode_cbor(data):
+    raw, end = cbor_decode(data)
+    if end != len(data):
+        raise ValueError("%d trailing bytes" % (len(data) - end))
+    msg = {CBOR_KEYS.get(k, k): v for k, v in raw.items()}
+    if "wifi" in msg:
+        msg["wifi"] = dict(zip(WIFI_FIELDS, msg["wifi"]))
+    return finish(msg)
+
+
+def decode_bin_batch(data):
+    version, kind, seq, ts, count, temp, humi = PACKED_BATCH.unpack_from(data)
+    pos = PACKED_BATCH.size
+    series = []
+    for _ in range(3):
+        values = []
+        for _ in range(count - 1):
+            value, pos = read_varint(data, pos)
+            values.append(value)
+        series.append(values)
+    if pos != len(data):
+        raise ValueError("%d trailing bytes" % (len(data) - pos))
+    # Timestamps are sent as delta-of-deltas, turn them back into plain deltas
+    ts_deltas = accumulate(0, series[0])[1:]
+    return finish({"version": version, "type": kind, "seq": seq, "timestamp": ts,
+                   "temp_ticks": temp, "humi_ticks": humi, "ts_deltas": ts_deltas,
+                   "temp_deltas": series[1], "humi_deltas": series[2]})
+
+
+def decode_bin(data):
+    if len(data) >= 2 and data[1] in (3, 4):
+        return decode_bin_batch(data)
+    if len(data) != PACKED.size:
+        raise ValueError("packed record is %d bytes, expected %d" % (len(data), PACKED.size))
+    version, kind, seq, ts, temp, humi, warning = PACKED.unpack(data)
+    msg = {"version": version, "type": kind, "seq": seq, "timestamp": ts,
+           "temp_ticks": temp, "humi_ticks": humi}
+    if kind == 2:
+        msg["warning"] = warning
+    return finish(msg)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("format", choices=("cbor", "bin"))
+    parser.add_argument("payload", nargs="*",
+                        help="hex payloads, '-' reads hex lines from stdin, none reads raw bytes from stdin")
+    args = parser.parse_args()
+    decode = decode_cbor if args.format == "cbor" else decode_bin
+
+    if not args.payload:
+        payloads = [sys.stdin.buffer.read()]
+    elif args.payload == ["-"]:
+        payloads = [bytes.fromhex(line.strip()) for line in sys.stdin if line.strip()]
+    else:
+        payloads = [bytes.fromhex(p) for p in args.payload]
+
+    status = 0
+    for data in payloads:
+        try:
+            print(json.dumps(decode(data)))
+        except (ValueError, IndexError, KeyError) as err:
+            print("error: %s: %s" % (data.hex(), err), file=sys.stderr)
+            status = 1
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
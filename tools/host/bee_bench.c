@@ -0,0 +1,1066 @@
+/*****************************************************************************
+ *
+ * @file 	bee_bench.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	host bench of the telemetry pipeline (bee_mqtt, bee_payload,
+ *          bee_outbox, bee_cmd) against the loopback broker stand-in
+ *
+ *          Measures connect-to-PUBACK latency per wake, bytes per reading for
+ *          each encoding and outbox replay throughput, then checks delivery
+ *          through a dropped CONNACK, a slow PUBACK, a disconnect in the middle
+ *          of a PUBLISH, presence through the Last Will, the history log,
+ *          firmware manifests and a command round trip.
+ *          Exits non-zero if a check fails.
+ *
+ *          Usage: bee_bench [-n wakes] [-r rtt_ms] [-v]
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_app_desc.h"
+#include "esp_partition.h"
+
+#include "bee_mqtt.h"
+#include "bee_outbox.h"
+#include "bee_history.h"
+#include "bee_cmd.h"
+#include "bee_deep_sleep.h"
+#include "bee_alarm.h"
+#include "bee_config.h"
+#include "bee_manifest.h"
+#include "broker.h"
+#include "host_shim.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define BENCH_WAKES         50
+#define BENCH_BATCH         10      /* Samples per wake, 5 min of 30 s readings */
+#define BENCH_REPLAY_MSGS   200     /* Batches queued for the throughput runs */
+#define BENCH_TS_BASE       1700000000
+#define BENCH_ALARM_WAKES   1000    /* Readings hovering on the high temperature limit */
+#define BENCH_HISTORY       40000   /* Readings appended to the history log, more than it holds */
+#define BENCH_OUTBOX_REC    64      /* Record size, a sector holds OUTBOX_SECTOR_SIZE / 64 of them exactly */
+#define BENCH_OUTBOX_RECS   70      /* One full sector and a few more */
+#define BENCH_HISTORY_WAKES 11      /* Readings per upload wake, history_maintain() runs on those */
+#define BENCH_TOPIC         "VB/DMP/VBEEON/CUSTOM/SMH/240AC4123456"
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+extern bool bButton_task;
+
+static uint32_t u32checks = 0;
+static uint32_t u32failed = 0;
+static uint32_t u32ts = BENCH_TS_BASE;
+static bool bPower_ok = true;
+
+/****************************************************************************/
+/***        Firmware stand-ins                                            ***/
+/****************************************************************************/
+
+/* A board with a battery gauge, replaces the weak one of bee_manifest */
+bool manifest_power_ok(void)
+{
+    return bPower_ok;
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void check(bool bOk, const char *cWhat)
+{
+    u32checks++;
+    if (!bOk)
+    {
+        u32failed++;
+    }
+    printf("  [%s] %s\n", bOk ? "PASS" : "FAIL", cWhat);
+}
+
+static double ms_since(int64_t i64start_us)
+{
+    return (double)(esp_timer_get_time() - i64start_us) / 1000.0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double d = *(const double *)a - *(const double *)b;
+    return (d > 0) - (d < 0);
+}
+
+/* Slowly moving readings every 30 s, consecutive calls continue the series */
+static void make_samples(payload_sample_t *samples, uint8_t u8count)
+{
+    static uint16_t u16temp = 0x6400;
+    static uint16_t u16humi = 0x8000;
+    for (uint8_t i = 0; i < u8count; i++)
+    {
+        u16temp += (uint16_t)((rand() % 9) - 4);
+        u16humi += (uint16_t)((rand() % 17) - 8);
+        samples[i].u32timestamp = u32ts;
+        samples[i].u16temp_ticks = u16temp;
+        samples[i].u16humi_ticks = u16humi;
+        u32ts += 30;
+    }
+}
+
+static void make_reading(payload_reading_t *reading)
+{
+    payload_sample_t sample;
+    make_samples(&sample, 1);
+    reading->u16temp_ticks = sample.u16temp_ticks;
+    reading->u16humi_ticks = sample.u16humi_ticks;
+    reading->u32timestamp = sample.u32timestamp;
+    reading->fTemp = payload_temp_from_ticks(sample.u16temp_ticks);
+    reading->fHumi = payload_humi_from_ticks(sample.u16humi_ticks);
+}
+
+static void set_faults(int drop_connack, uint32_t u32puback_delay_ms, int close_on_publish, uint32_t u32rtt_ms)
+{
+    broker_faults_t faults = {
+        .drop_connack = drop_connack,
+        .u32puback_delay_ms = u32puback_delay_ms,
+        .close_on_publish = close_on_publish,
+        .u32rtt_ms = u32rtt_ms,
+    };
+    broker_set_faults(&faults);
+}
+
+/* Deep sleep and wake up: drop the connection, then dial again like the next boot would */
+static void next_wake(void)
+{
+    mqtt_disconnect();
+    host_mqtt_restart();
+}
+
+static bool wait_until(bool (*fnCond)(void), uint32_t u32timeout_ms)
+{
+    int64_t i64start = esp_timer_get_time();
+    while (!fnCond())
+    {
+        if (ms_since(i64start) > u32timeout_ms)
+        {
+            return false;
+        }
+        usleep(1000);
+    }
+    return true;
+}
+
+static bool connected(void)
+{
+    host_mqtt_stats_t stats;
+    host_mqtt_get_stats(&stats);
+    return stats.i64connack_us != 0;
+}
+
+/* Index-th telemetry message of the broker log, presence messages are skipped */
+static bool telemetry_get(uint32_t u32index, broker_msg_t *msg)
+{
+    for (uint32_t i = 0; broker_log_get(i, msg); i++)
+    {
+        if ((strstr(msg->cTopic, "/telemetry") != NULL) && (u32index-- == 0))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t telemetry_count(void)
+{
+    broker_msg_t msg;
+    uint32_t u32count = 0;
+    while (telemetry_get(u32count, &msg))
+    {
+        u32count++;
+    }
+    return u32count;
+}
+
+/* Sequence number of a packed telemetry message in the broker log */
+static int packed_seq(const broker_msg_t *msg)
+{
+    return (msg->u16len >= 4) ? (msg->u8payload[2] | (msg->u8payload[3] << 8)) : -1;
+}
+
+static uint32_t copies_of(int seq)
+{
+    uint32_t u32copies = 0;
+    broker_msg_t msg;
+    for (uint32_t i = 0; telemetry_get(i, &msg); i++)
+    {
+        u32copies += (packed_seq(&msg) == seq);
+    }
+    return u32copies;
+}
+
+static bool find_in_log(const char *cNeedle, const char *cAlso, broker_msg_t *out)
+{
+    broker_msg_t msg;
+    for (uint32_t i = 0; broker_log_get(i, &msg); i++)
+    {
+        msg.u8payload[(msg.u16len < BROKER_PAYLOAD_MAX) ? msg.u16len : BROKER_PAYLOAD_MAX - 1] = '\0';
+        if (strstr((char *)msg.u8payload, cNeedle) && ((cAlso == NULL) || strstr((char *)msg.u8payload, cAlso)))
+        {
+            if (out != NULL)
+            {
+                *out = msg;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Last telemetry message the broker logged */
+static bool last_msg(broker_msg_t *msg)
+{
+    uint32_t u32count = telemetry_count();
+    return (u32count > 0) && telemetry_get(u32count - 1, msg);
+}
+
+/****************************************************************************/
+/***        Scenarios                                                     ***/
+/****************************************************************************/
+
+static void bench_latency(uint32_t u32wakes, uint32_t u32rtt_ms)
+{
+    double *pdConnect = calloc(u32wakes, sizeof(double));
+    double *pdPuback = calloc(u32wakes, sizeof(double));
+    uint32_t u32ok = 0;
+
+    printf("\nConnect-to-PUBACK, %lu wakes of %u samples, JSON, rtt %lu ms\n",
+           (unsigned long)u32wakes, BENCH_BATCH, (unsigned long)u32rtt_ms);
+    set_faults(0, 0, 0, u32rtt_ms);
+    mqtt_set_payload_encoding(PAYLOAD_JSON);
+    for (uint32_t i = 0; i < u32wakes; i++)
+    {
+        payload_sample_t samples[BENCH_BATCH];
+        uint8_t u8done;
+        make_samples(samples, BENCH_BATCH);
+
+        mqtt_disconnect();
+        int64_t i64start = esp_timer_get_time();
+        host_mqtt_restart();
+        mqtt_pub_result_t result = pub_batch(samples, BENCH_BATCH, &u8done);
+        double dTotal = ms_since(i64start);
+
+        host_mqtt_stats_t stats;
+        host_mqtt_get_stats(&stats);
+        if (result == MQTT_PUB_OK)
+        {
+            pdConnect[u32ok] = (double)(stats.i64connack_us - i64start) / 1000.0;
+            pdPuback[u32ok] = dTotal;
+            u32ok++;
+        }
+    }
+    set_faults(0, 0, 0, 0);
+
+    qsort(pdConnect, u32ok, sizeof(double), cmp_double);
+    qsort(pdPuback, u32ok, sizeof(double), cmp_double);
+    if (u32ok > 0)
+    {
+        printf("  %-22s %8s %8s %8s %8s\n", "ms", "min", "median", "p95", "max");
+        printf("  %-22s %8.3f %8.3f %8.3f %8.3f\n", "start to CONNACK",
+               pdConnect[0], pdConnect[u32ok / 2], pdConnect[(u32ok * 95) / 100], pdConnect[u32ok - 1]);
+        printf("  %-22s %8.3f %8.3f %8.3f %8.3f\n", "start to PUBACK",
+               pdPuback[0], pdPuback[u32ok / 2], pdPuback[(u32ok * 95) / 100], pdPuback[u32ok - 1]);
+    }
+    check(u32ok == u32wakes, "every wake delivered its batch");
+    free(pdConnect);
+    free(pdPuback);
+}
+
+static void bench_bytes(void)
+{
+    static const char *cName[] = {"json", "cbor", "packed"};
+
+    printf("\nBytes per reading (steady state, second message of each kind)\n");
+    printf("  %-8s %14s %14s %20s %20s\n", "encoding", "single payload", "single wire",
+           "batch/reading payload", "batch/reading wire");
+    for (uint8_t enc = PAYLOAD_JSON; enc <= PAYLOAD_PACKED; enc++)
+    {
+        payload_reading_t reading;
+        payload_sample_t samples[BENCH_BATCH];
+        broker_msg_t single = {0}, batch = {0};
+        uint8_t u8done;
+
+        mqtt_set_payload_encoding((payload_encoding_t)enc);
+        for (uint8_t i = 0; i < 2; i++) /* The first one may carry the full topic next to its MQTT 5 alias */
+        {
+            make_reading(&reading);
+            pub_data(&reading);
+            usleep(20000); /* QoS0 completes on the write, let the broker read it */
+            last_msg(&single);
+            make_samples(samples, BENCH_BATCH);
+            pub_batch(samples, BENCH_BATCH, &u8done);
+            last_msg(&batch);
+        }
+        printf("  %-8s %14u %14lu %20.1f %20.1f\n", cName[enc], single.u16len, (unsigned long)single.u32wire,
+               (double)batch.u16len / BENCH_BATCH, (double)batch.u32wire / BENCH_BATCH);
+    }
+    mqtt_set_payload_encoding(PAYLOAD_JSON);
+
+    payload_reading_t reading;
+    broker_msg_t msg = {0};
+    make_reading(&reading);
+    reading.fTemp = NAN;
+    reading.fHumi = 3e9f;
+    pub_data(&reading);
+    usleep(20000);
+    check(last_msg(&msg) && (memmem(msg.u8payload, msg.u16len, "\"temperature\":null,\"humidity\":null", 34) != NULL),
+          "nan and out of range readings sent as null");
+}
+
+/* Queue BENCH_REPLAY_MSGS packed batches while offline, as after a long outage */
+static void fill_outbox(void)
+{
+    uint8_t u8payload[MQTT_PAYLOAD_MAX];
+    for (uint32_t i = 0; i < BENCH_REPLAY_MSGS; i++)
+    {
+        payload_sample_t samples[BENCH_BATCH];
+        make_samples(samples, BENCH_BATCH);
+        size_t len = packed_encode_batch(u8payload, sizeof(u8payload), PAYLOAD_TYPE_BATCH, (uint16_t)(0x8000 + i),
+                                         samples, BENCH_BATCH);
+        outbox_append(BENCH_TOPIC "/telemetry/bin", u8payload, len);
+    }
+}
+
+static void bench_throughput(void)
+{
+    static const uint32_t u32delays[] = {0, 5, 20};
+
+    printf("\nOutbox replay, %u batches of %u samples, window %u\n", BENCH_REPLAY_MSGS, BENCH_BATCH, MQTT_OUTBOX_WINDOW);
+    printf("  %-14s %10s %12s %14s %12s\n", "PUBACK delay", "msgs/s", "readings/s", "wire kB/s", "serial msg/s");
+    for (uint8_t d = 0; d < sizeof(u32delays) / sizeof(u32delays[0]); d++)
+    {
+        mqtt_disconnect();
+        fill_outbox();
+        set_faults(0, u32delays[d], 0, 0);
+        host_mqtt_restart();
+        wait_until(connected, 2000);
+        broker_log_clear();
+
+        int64_t i64start = esp_timer_get_time();
+        mqtt_pub_result_t result = MQTT_PUB_OK;
+        for (uint8_t u8try = 0; (u8try < 10) && (outbox_count() > 0); u8try++)
+        {
+            result = mqtt_outbox_replay(60000);
+        }
+        double dMs = ms_since(i64start);
+        broker_stats_t stats;
+        broker_get_stats(&stats);
+
+        /* The same messages one at a time, waiting for each PUBACK */
+        uint8_t u8payload[MQTT_PAYLOAD_MAX];
+        payload_sample_t samples[BENCH_BATCH];
+        uint32_t u32serial = (u32delays[d] == 0) ? BENCH_REPLAY_MSGS : 20;
+        int64_t i64serial = esp_timer_get_time();
+        for (uint32_t i = 0; i < u32serial; i++)
+        {
+            make_samples(samples, BENCH_BATCH);
+            size_t len = packed_encode_batch(u8payload, sizeof(u8payload), PAYLOAD_TYPE_BATCH, (uint16_t)i,
+                                             samples, BENCH_BATCH);
+            mqtt_publish(BENCH_TOPIC "/telemetry/bin", u8payload, len, QoS_1, MQTT_PUB_TIMEOUT_MS);
+        }
+        double dSerial_ms = ms_since(i64serial);
+
+        char cDelay[16];
+        snprintf(cDelay, sizeof(cDelay), "%lu ms", (unsigned long)u32delays[d]);
+        printf("  %-14s %10.0f %12.0f %14.1f %12.0f\n", cDelay, BENCH_REPLAY_MSGS * 1000.0 / dMs,
+               BENCH_REPLAY_MSGS * BENCH_BATCH * 1000.0 / dMs, stats.u32bytes_in / dMs, u32serial * 1000.0 / dSerial_ms);
+        check((result == MQTT_PUB_OK) && (outbox_count() == 0) && (stats.u32publishes >= BENCH_REPLAY_MSGS),
+              "outbox drained");
+    }
+    set_faults(0, 0, 0, 0);
+}
+
+static void fault_dropped_connack(void)
+{
+    payload_sample_t samples[BENCH_BATCH];
+    uint8_t u8done;
+    broker_msg_t msg;
+    broker_stats_t stats;
+
+    printf("\nFault: dropped CONNACK\n");
+    mqtt_set_payload_encoding(PAYLOAD_PACKED);
+    broker_log_clear();
+    set_faults(1, 0, 0, 0);
+    int64_t i64start = esp_timer_get_time();
+    make_samples(samples, BENCH_BATCH);
+    mqtt_disconnect();
+    host_mqtt_restart();
+    mqtt_pub_result_t result = pub_batch(samples, BENCH_BATCH, &u8done);
+    broker_get_stats(&stats);
+    printf("  one CONNACK lost: result %d after %.0f ms, %lu CONNECTs\n", result, ms_since(i64start),
+           (unsigned long)stats.u32connects);
+    check((result == MQTT_PUB_OK) && (stats.u32connects == 2) && (telemetry_count() == 1),
+          "second CONNECT delivers the batch within the same wake");
+
+    /* No CONNACK at all this wake: the batch waits in flash for the next one */
+    broker_log_clear();
+    set_faults(1000, 0, 0, 0);
+    make_samples(samples, BENCH_BATCH);
+    next_wake();
+    result = pub_batch(samples, BENCH_BATCH, &u8done);
+    check((result == MQTT_PUB_QUEUED) && (outbox_count() == 1), "no CONNACK: batch kept in the outbox");
+
+    set_faults(0, 0, 0, 0);
+    next_wake();
+    result = mqtt_outbox_replay(MQTT_OUTBOX_REPLAY_MS);
+    check((result == MQTT_PUB_OK) && (outbox_count() == 0) && last_msg(&msg) && (msg.u16len > 0),
+          "next wake replays it");
+}
+
+static void fault_slow_puback(void)
+{
+    payload_sample_t samples[BENCH_BATCH];
+    uint8_t u8done;
+
+    printf("\nFault: PUBACK slower than MQTT_PUB_TIMEOUT_MS (%d ms)\n", MQTT_PUB_TIMEOUT_MS);
+    broker_log_clear();
+    set_faults(0, MQTT_PUB_TIMEOUT_MS + 1000, 0, 0);
+    make_samples(samples, BENCH_BATCH);
+    next_wake();
+    mqtt_pub_result_t result = pub_batch(samples, BENCH_BATCH, &u8done);
+    broker_msg_t msg;
+    int seq = last_msg(&msg) ? packed_seq(&msg) : -1;
+    check((result == MQTT_PUB_QUEUED) && (outbox_count() == 1), "unacknowledged batch kept in the outbox");
+
+    set_faults(0, 0, 0, 0);
+    result = mqtt_outbox_replay(MQTT_OUTBOX_REPLAY_MS);
+    uint32_t u32copies = copies_of(seq);
+    printf("  seq %d received %lu times\n", seq, (unsigned long)u32copies);
+    check((result == MQTT_PUB_OK) && (outbox_count() == 0) && (u32copies >= 1), "replayed, at least once");
+}
+
+static void fault_disconnect_mid_publish(void)
+{
+    payload_sample_t samples[BENCH_BATCH];
+    uint8_t u8done;
+    broker_stats_t stats;
+
+    printf("\nFault: connection closed in the middle of a PUBLISH\n");
+    broker_log_clear();
+    set_faults(0, 0, 1, 0);
+    make_samples(samples, BENCH_BATCH);
+    next_wake();
+    int64_t i64start = esp_timer_get_time();
+    mqtt_pub_result_t result = pub_batch(samples, BENCH_BATCH, &u8done);
+    broker_get_stats(&stats);
+    printf("  result %d after %.0f ms, %lu connections closed\n", result, ms_since(i64start), (unsigned long)stats.u32closed);
+    check((result == MQTT_PUB_QUEUED) && (outbox_count() == 1) && (telemetry_count() == 0),
+          "cut message kept in the outbox");
+
+    result = mqtt_outbox_replay(MQTT_OUTBOX_REPLAY_MS); /* The client dialed again on its own */
+    broker_msg_t msg;
+    check((result == MQTT_PUB_OK) && (outbox_count() == 0) && (telemetry_count() == 1) && last_msg(&msg) &&
+          (packed_seq(&msg) >= 0), "redelivered once after the reconnect");
+
+    /* Newer readings queue behind it and arrive in order */
+    set_faults(0, 0, 1, 0);
+    broker_log_clear();
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        make_samples(samples, BENCH_BATCH);
+        pub_batch(samples, BENCH_BATCH, &u8done);
+    }
+    mqtt_outbox_replay(MQTT_OUTBOX_REPLAY_MS);
+    bool bOrdered = telemetry_count() == 3;
+    broker_msg_t prev;
+    for (uint32_t i = 1; bOrdered && (i < 3); i++)
+    {
+        telemetry_get(i - 1, &prev);
+        telemetry_get(i, &msg);
+        bOrdered = (uint16_t)(packed_seq(&prev) + 1) == (uint16_t)packed_seq(&msg);
+    }
+    check(bOrdered && (outbox_count() == 0), "later batches delivered in order behind it");
+    set_faults(0, 0, 0, 0);
+    mqtt_set_payload_encoding(PAYLOAD_JSON);
+}
+
+/* The outbox cannot take a batch while an older one waits: the older one goes first, then the batch directly */
+static void fault_outbox_write(void)
+{
+    payload_sample_t samples[BENCH_BATCH];
+    uint8_t u8done;
+    broker_msg_t prev;
+    broker_msg_t msg;
+    char cLost[24];
+
+    printf("\nFault: outbox writes failing\n");
+    mqtt_set_payload_encoding(PAYLOAD_PACKED);
+    broker_log_clear();
+    set_faults(1000, 0, 0, 0);
+    make_samples(samples, BENCH_BATCH);
+    next_wake();
+    mqtt_pub_result_t result = pub_batch(samples, BENCH_BATCH, &u8done);
+
+    set_faults(0, 0, 0, 0);
+    next_wake();
+    host_flash_fail_label = OUTBOX_PARTITION_LABEL;
+    make_samples(samples, BENCH_BATCH);
+    result = (result == MQTT_PUB_QUEUED) ? pub_batch(samples, BENCH_BATCH, &u8done) : MQTT_PUB_ERROR;
+    check((result == MQTT_PUB_OK) && (outbox_count() == 0) && (telemetry_count() == 2) && telemetry_get(0, &prev) &&
+          telemetry_get(1, &msg) && ((uint16_t)(packed_seq(&prev) + 1) == (uint16_t)packed_seq(&msg)),
+          "queued batch replayed, then the new one published directly");
+
+    /* No CONNACK either: nowhere to put it, counted in the diagnostics of the next reading */
+    set_faults(1000, 0, 0, 0);
+    make_samples(samples, BENCH_BATCH);
+    next_wake();
+    result = pub_batch(samples, BENCH_BATCH, &u8done);
+    host_flash_fail_label = NULL;
+    set_faults(0, 0, 0, 0);
+    mqtt_set_payload_encoding(PAYLOAD_JSON);
+    next_wake();
+    wait_until(connected, 1000);
+    payload_reading_t reading = {.fTemp = 25.0f, .fHumi = 50.0f};
+    pub_data(&reading);
+    usleep(20000); /* QoS0 completes on the write, let the broker read it */
+    snprintf(cLost, sizeof(cLost), "\"lost\":%lu", (unsigned long)(outbox_evicted() + 1));
+    check((result != MQTT_PUB_OK) && (result != MQTT_PUB_QUEUED) && last_msg(&msg) &&
+          (memmem(msg.u8payload, msg.u16len, cLost, strlen(cLost)) != NULL), "dropped batch counted as lost");
+}
+
+static uint32_t presence_count(void)
+{
+    broker_msg_t msg;
+    uint32_t u32count = 0;
+    for (uint32_t i = 0; broker_log_get(i, &msg); i++)
+    {
+        u32count += (strstr(msg.cTopic, "/presence") != NULL) && !msg.bWill;
+    }
+    return u32count;
+}
+
+static bool retained_status(const char *cStatus)
+{
+    broker_msg_t msg;
+    if (!broker_retained(BENCH_TOPIC "/presence", &msg))
+    {
+        return false;
+    }
+    msg.u8payload[(msg.u16len < BROKER_PAYLOAD_MAX) ? msg.u16len : BROKER_PAYLOAD_MAX - 1] = '\0';
+    return strstr((char *)msg.u8payload, cStatus) != NULL;
+}
+
+static bool retained_online(void)
+{
+    return retained_status("\"ONLINE\"");
+}
+
+static bool got_new_birth(void)
+{
+    return find_in_log("\"ONLINE\"", "\"interval\":60", NULL);
+}
+
+static void bench_presence(void)
+{
+    printf("\nPresence (retained birth message and Last Will)\n");
+    check(retained_online(), "retained ONLINE after the first connection");
+
+    broker_log_clear();
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        next_wake();
+        wait_until(connected, 1000);
+    }
+    mqtt_disconnect();
+    check(presence_count() == 0, "no presence message on ordinary wakes");
+
+    host_mqtt_restart();
+    wait_until(connected, 1000);
+    usleep(50000);
+    broker_kick(); /* Connection lost without a DISCONNECT */
+    check(retained_status("\"OFFLINE\""), "Last Will replaces it with OFFLINE");
+    check(wait_until(retained_online, 2000) && (presence_count() == 1), "reconnect publishes ONLINE again");
+
+    mqtt_disconnect();
+    deep_sleep_set_interval(60);
+    broker_log_clear();
+    host_mqtt_restart();
+    check(wait_until(got_new_birth, 2000) && (presence_count() == 1), "changed interval republished in the birth message");
+}
+
+static bool subscribed(void)
+{
+    broker_stats_t stats;
+    broker_get_stats(&stats);
+    return stats.u32subscribes > 0;
+}
+
+static bool got_reply_77(void)
+{
+    return find_in_log("Bee.cmd_result", "\"trans_code\":77", NULL);
+}
+
+static bool got_reply_78(void)
+{
+    return find_in_log("Bee.cmd_result", "\"trans_code\":78", NULL);
+}
+
+static bool got_reply_79(void)
+{
+    return find_in_log("Bee.cmd_result", "\"trans_code\":79", NULL);
+}
+
+/* Samples in the packed history replies of the broker log */
+static uint32_t history_samples(void)
+{
+    broker_msg_t msg;
+    uint32_t u32samples = 0;
+    for (uint32_t i = 0; telemetry_get(i, &msg); i++)
+    {
+        if ((msg.u16len > PACKED_BATCH_HEADER) && (msg.u8payload[1] == PAYLOAD_TYPE_HISTORY))
+        {
+            u32samples += msg.u8payload[8];
+        }
+    }
+    return u32samples;
+}
+
+/* One wake of deep_sleep_task: a reading, then confirming ones while a rule is pending */
+static uint8_t alarm_wake(float fTemp, float fNoise, uint32_t u32now)
+{
+    float fJitter = fNoise * (float)((rand() % 201) - 100) / 100.0f;
+    uint8_t u8value = alarm_evaluate(fTemp + fJitter, 70.0f, u32now);
+    for (uint8_t i = 0; (i < ALARM_CONFIRM_READS) && (u8value == ALARM_NO_CHANGE) && alarm_pending(); i++)
+    {
+        fJitter = fNoise * (float)((rand() % 201) - 100) / 100.0f;
+        u8value = alarm_evaluate(fTemp + fJitter, 70.0f, u32now);
+    }
+    return u8value;
+}
+
+/* Radio sessions caused by a reading hovering on a limit, and how soon a real step is reported */
+static void bench_alarm(void)
+{
+    uint32_t u32now = BENCH_TS_BASE;
+    uint32_t u32plain = 0;
+    uint32_t u32rules = 0;
+    bool bLast = false;
+
+    printf("\nAlarm rules (%u wakes at %.1f +/- 0.2 C)\n", BENCH_ALARM_WAKES, ALARM_TEMP_HIGH);
+    int64_t i64start = esp_timer_get_time();
+    for (uint32_t i = 0; i < BENCH_ALARM_WAKES; i++, u32now += 30)
+    {
+        float fTemp = ALARM_TEMP_HIGH + 0.2f * (float)((rand() % 201) - 100) / 100.0f;
+        bool bHigh = fTemp > ALARM_TEMP_HIGH; /* What a plain comparison would report on a change */
+        u32plain += (bHigh != bLast);
+        bLast = bHigh;
+        u32rules += (alarm_wake(ALARM_TEMP_HIGH, 0.2f, u32now) != ALARM_NO_CHANGE);
+    }
+    printf("  warning sessions: %lu plain comparison, %lu rules, %.2f us per wake\n", (unsigned long)u32plain,
+           (unsigned long)u32rules, ms_since(i64start) * 1000.0 / BENCH_ALARM_WAKES);
+    check(u32rules <= 2, "hysteresis and debounce stop the flapping");
+
+    uint8_t u8cleared = alarm_wake(ALARM_TEMP_HIGH - 3 * ALARM_TEMP_HYST, 0.05f, u32now += 600);
+    uint8_t u8set = alarm_wake(ALARM_TEMP_HIGH + 2.0f, 0.05f, u32now += 600);
+    check((u8cleared != ALARM_NO_CHANGE) && !(u8cleared & BIT3) && (u8set != ALARM_NO_CHANGE) && (u8set & BIT3),
+          "a real step is reported on the wake that first sees it");
+}
+
+/* Records of the range, checks they come back in order */
+static uint32_t history_range(uint32_t u32from, uint32_t u32to, uint32_t *pu32first, uint32_t *pu32last)
+{
+    history_rec_t recs[100];
+    history_cursor_t cursor;
+    uint32_t u32count = 0;
+    size_t n;
+
+    *pu32first = 0;
+    *pu32last = 0;
+    history_seek(&cursor, u32from, u32to);
+    while ((n = history_read(&cursor, recs, 100)) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            if ((recs[i].u32timestamp < u32from) || (recs[i].u32timestamp > u32to) ||
+                ((u32count > 0) && (recs[i].u32timestamp != *pu32last + 30)))
+            {
+                return 0;
+            }
+            *pu32first = (u32count == 0) ? recs[i].u32timestamp : *pu32first;
+            *pu32last = recs[i].u32timestamp;
+            u32count++;
+        }
+    }
+    return u32count;
+}
+
+/* Records of the range in any order */
+static uint32_t history_count(uint32_t u32from, uint32_t u32to)
+{
+    history_rec_t recs[100];
+    history_cursor_t cursor;
+    uint32_t u32count = 0;
+    size_t n;
+
+    history_seek(&cursor, u32from, u32to);
+    while ((n = history_read(&cursor, recs, 100)) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            u32count += (recs[i].u32timestamp >= u32from) && (recs[i].u32timestamp <= u32to);
+        }
+    }
+    return u32count;
+}
+
+/* Appends cost a staged copy and a page write per HISTORY_STAGE readings, erases happen on upload wakes */
+static void bench_history(void)
+{
+    host_flash_stats_t before;
+    host_flash_stats_t after;
+    uint32_t u32append_erases = 0;
+    uint32_t u32first;
+    uint32_t u32last;
+
+    printf("\nHistory log (%u readings, %u per page)\n", BENCH_HISTORY, (unsigned)HISTORY_RECS_PER_PAGE);
+    check(history_init() == ESP_OK, "history partition opened");
+    host_flash_get_stats(&before);
+    int64_t i64start = esp_timer_get_time();
+    for (uint32_t i = 0; i < BENCH_HISTORY; i++)
+    {
+        history_rec_t rec = {.u32timestamp = BENCH_TS_BASE + 30 * i, .u16temp_ticks = 0x6400, .u16humi_ticks = 0x8000};
+        host_flash_stats_t stats;
+        host_flash_get_stats(&stats);
+        history_append(&rec);
+        host_flash_get_stats(&after);
+        u32append_erases += after.u32erases - stats.u32erases;
+        if (i % BENCH_HISTORY_WAKES == 0)
+        {
+            history_maintain();
+        }
+    }
+    history_flush();
+    host_flash_get_stats(&after);
+    printf("  %.3f flash writes and %.4f erases per reading, %.2f us per append\n",
+           (double)(after.u32writes - before.u32writes) / BENCH_HISTORY,
+           (double)(after.u32erases - before.u32erases) / BENCH_HISTORY, ms_since(i64start) * 1000.0 / BENCH_HISTORY);
+    check((u32append_erases == 0) && (after.u32writes - before.u32writes <= BENCH_HISTORY / HISTORY_STAGE * 2),
+          "no erase when appending, one write per staged block");
+
+    uint32_t u32newest = BENCH_TS_BASE + 30 * (BENCH_HISTORY - 1);
+    uint32_t u32from = u32newest - 30 * 9999;
+    i64start = esp_timer_get_time();
+    uint32_t u32count = history_range(u32from - 10, u32newest - 30 * 4999 + 5, &u32first, &u32last);
+    printf("  %lu of the newest 10000 readings read back in %.2f ms\n", (unsigned long)u32count, ms_since(i64start));
+    check((u32count == 5001) && (u32first == u32from) && (u32last == u32newest - 30 * 4999), "range query by time");
+
+    u32count = history_range(0, UINT32_MAX, &u32first, &u32last);
+    check((u32count >= (HISTORY_PAGES_MAX - 2) * HISTORY_RECS_PER_PAGE) && (u32last == u32newest),
+          "wrapped log keeps the newest readings in order");
+
+    /* The clock set back a week: the readings of that hour are logged twice, both copies come back */
+    uint32_t u32back = u32newest - 30 * 20000;
+    for (uint32_t i = 0; i < 120; i++)
+    {
+        history_rec_t rec = {.u32timestamp = u32back + 30 * i, .u16temp_ticks = 0x6400, .u16humi_ticks = 0x8000};
+        history_append(&rec);
+    }
+    i64start = esp_timer_get_time();
+    u32count = history_count(u32back, u32back + 30 * 119);
+    printf("  clock set back %lu s: %lu readings of the hour read back in %.2f ms\n",
+           (unsigned long)(u32newest - u32back), (unsigned long)u32count, ms_since(i64start));
+    check((u32count == 240) && (history_range(u32from - 10, u32newest - 30 * 4999 + 5, &u32first, &u32last) == 5001),
+          "ranges stay complete after the clock went backwards");
+}
+
+static bool config_3_applied(void)
+{
+    return host_get_interval() == 45;
+}
+
+/* Retained config on the group and device topics, applied once, persisted once, acknowledged in telemetry */
+static void bench_config(void)
+{
+    static const char cGroup[] = "{\"config_version\":3,\"interval\":45,\"publish_every\":5,\"temp_high\":33}";
+    static const char cBad[] = "{\"config_version\":4,\"interval\":5}";
+    payload_sample_t samples[BENCH_BATCH];
+    alarm_thresholds_t thresholds;
+    uint8_t u8done;
+
+    printf("\nRemote configuration\n");
+    broker_retain("VB/DMP/VBEEON/CUSTOM/SMH/group/" BEE_CONFIG_GROUP "/config", cGroup, strlen(cGroup));
+    next_wake();
+    bool bApplied = wait_until(config_3_applied, 2000);
+    alarm_get_thresholds(&thresholds);
+    check(bApplied && (deep_sleep_get_publish_every() == 5) && (thresholds.fTemp_high == 33) &&
+          (config_get_version() == 3), "group config applied on the next wake");
+
+    broker_log_clear();
+    make_samples(samples, BENCH_BATCH);
+    pub_batch(samples, BENCH_BATCH, &u8done);
+    make_samples(samples, BENCH_BATCH);
+    pub_batch(samples, BENCH_BATCH, &u8done);
+    broker_msg_t msg;
+    check(telemetry_get(0, &msg) && (memmem(msg.u8payload, msg.u16len, "\"config_version\":3", 17) != NULL) &&
+          telemetry_get(1, &msg) && (memmem(msg.u8payload, msg.u16len, "config_version", 14) == NULL),
+          "applied version acknowledged in the next batch only");
+
+    broker_retain(BENCH_TOPIC "/config", cBad, strlen(cBad));
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        next_wake();
+        wait_until(connected, 1000);
+        usleep(50000);
+    }
+    check((config_get_version() == 3) && (host_get_interval() == 45), "invalid device config rejected as a whole");
+
+    /* NaN compares false against every limit, it would have disabled the rule */
+    static const char * const cNot_json[] = {"{\"config_version\":5,\"temp_high\":nan}",
+                                             "{\"config_version\":6,\"temp_high\":1e39}",
+                                             "{\"config_version\":7,\"temp_high\":0x21}"};
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        broker_retain(BENCH_TOPIC "/config", cNot_json[i], strlen(cNot_json[i]));
+        next_wake();
+        wait_until(connected, 1000);
+        usleep(50000);
+    }
+    alarm_get_thresholds(&thresholds);
+    check((config_get_version() == 3) && (thresholds.fTemp_high == 33), "nan, inf and hex thresholds rejected");
+    check(host_get_config_saves() == 1, "NVS written once, redelivery ignored");
+}
+
+/* An upload wake: whatever the broker queued for the session is in once the batch is acknowledged */
+static void upload_wake(void)
+{
+    next_wake();
+    wait_until(connected, 1000);
+    usleep(50000);
+}
+
+static bool scheduled(const char *cUrl)
+{
+    const char *cTaken = host_take_ota_schedule();
+    return (cUrl == NULL) ? (cTaken == NULL) : ((cTaken != NULL) && (strcmp(cTaken, cUrl) == 0));
+}
+
+/* Retained manifests on the group and device topics, an update queued once per version */
+static void bench_manifest(void)
+{
+    static const char cSha[] = "\"sha256\":\"5de0c0392a192b6244a0d5e37343f28b1015d02635eb6629174ecfe2b924276a\"";
+    static const char cCurrent[] = "{\"version\":\"" HOST_APP_VERSION "\",\"url\":\"https://fw/1.0.bin\",\"size\":1000,%s}";
+    static const char cGroup[] = "{\"version\":\"Version 1.1\",\"url\":\"https://fw/1.1.bin\",\"size\":1000,%s}";
+    static const char cDevice[] = "{\"thing_token\":\"240AC4123456\",\"version\":\"Version 1.2\","
+                                  "\"url\":\"https://fw/1.2.delta\",\"size\":1000,%s}";
+    static const char cGroup_next[] = "{\"version\":\"Version 1.3\",\"url\":\"https://fw/1.3.bin\",\"size\":1000,%s}";
+    static const char cBad_sha[] = "{\"version\":\"Version 1.4\",\"url\":\"https://fw/1.4.bin\",\"size\":1000,"
+                                   "\"sha256\":\"5de0\"}";
+    char cMsg[256];
+
+    printf("\nFirmware manifests\n");
+    snprintf(cMsg, sizeof(cMsg), cCurrent, cSha);
+    broker_retain("VB/DMP/VBEEON/CUSTOM/SMH/group/" BEE_CONFIG_GROUP "/ota", cMsg, strlen(cMsg));
+    upload_wake();
+    check(!manifest_check() && scheduled(NULL), "running version announced, nothing to do");
+
+    snprintf(cMsg, sizeof(cMsg), cGroup, cSha);
+    broker_retain("VB/DMP/VBEEON/CUSTOM/SMH/group/" BEE_CONFIG_GROUP "/ota", cMsg, strlen(cMsg));
+    upload_wake();
+    bPower_ok = false;
+    check(!manifest_check() && scheduled(NULL), "new version deferred while power is short");
+    bPower_ok = true;
+    check(manifest_check() && scheduled("https://fw/1.1.bin"), "group manifest queues the update");
+    upload_wake();
+    check(!manifest_check() && scheduled(NULL), "queued once, the next wakes resume it");
+
+    snprintf(cMsg, sizeof(cMsg), cDevice, cSha);
+    broker_retain(BENCH_TOPIC "/ota", cMsg, strlen(cMsg));
+    upload_wake();
+    check(manifest_check() && scheduled("https://fw/1.2.delta"), "device manifest replaces the group one");
+    snprintf(cMsg, sizeof(cMsg), cGroup_next, cSha);
+    broker_retain("VB/DMP/VBEEON/CUSTOM/SMH/group/" BEE_CONFIG_GROUP "/ota", cMsg, strlen(cMsg));
+    upload_wake();
+    check(!manifest_check() && scheduled(NULL), "group manifest does not override the device one");
+
+    host_ota_drop();
+    check(!manifest_check() && scheduled(NULL), "failed update noticed");
+    broker_retain(BENCH_TOPIC "/ota", cBad_sha, strlen(cBad_sha));
+    upload_wake();
+    check(!manifest_check() && scheduled(NULL), "failed version and malformed manifest not tried");
+
+    /* The update went in but its version string was not bumped, the restart lost what was scheduled */
+    static const char cStale[] = "{\"thing_token\":\"240AC4123456\",\"version\":\"Version 1.5\","
+                                 "\"url\":\"https://fw/1.5.bin\",\"size\":1000,\"sha256\":\""
+                                 "0101010101010101010101010101010101010101010101010101010101010101\"}";
+    uint8_t u8sha256[32];
+    memset(u8sha256, 0x01, sizeof(u8sha256));
+    snprintf(cMsg, sizeof(cMsg), "%s", cStale);
+    broker_retain(BENCH_TOPIC "/ota", cMsg, strlen(cMsg));
+    host_set_running_image(u8sha256);
+    upload_wake();
+    check(!manifest_check() && scheduled(NULL), "image running is not downloaded again under another version");
+}
+
+/* Last, cmd_task restarts (ends) the process CMD_LISTEN_MS after the last command */
+static void bench_command(void)
+{
+    static const char cInterval[] =
+        "{\"thing_token\":\"240AC4123456\",\"cmd_name\":\"Bee.interval\",\"interval\":120,\"trans_code\":77}";
+    static const char cUnknown[] =
+        "{\"thing_token\":\"240AC4123456\",\"cmd_name\":\"Bee.selfdestruct\",\"trans_code\":78}";
+    broker_msg_t msg;
+
+    printf("\nCommand round trip\n");
+    broker_log_clear();
+    bButton_task = true;
+    next_wake();
+    check(wait_until(subscribed, 2000), "command topic subscribed on the button wake");
+    xTaskCreate(cmd_task, "cmd_task", 4096, NULL, 5, NULL);
+    usleep(100000);
+
+    int64_t i64start = esp_timer_get_time();
+    broker_publish(BENCH_TOPIC "/Command", cInterval, strlen(cInterval));
+    bool bReply = wait_until(got_reply_77, 2000);
+    printf("  Bee.interval answered in %.1f ms\n", ms_since(i64start));
+    check(bReply && (host_get_interval() == 120), "Bee.interval applied and answered with its trans_code");
+
+    broker_publish(BENCH_TOPIC "/Command", cUnknown, strlen(cUnknown));
+    check(wait_until(got_reply_78, 2000) && find_in_log("\"trans_code\":78", "ESP_ERR_NOT_SUPPORTED", &msg),
+          "unknown command answered ESP_ERR_NOT_SUPPORTED");
+
+    char cHistory[160];
+    uint32_t u32newest = BENCH_TS_BASE + 30 * (BENCH_HISTORY - 1);
+    snprintf(cHistory, sizeof(cHistory), "{\"thing_token\":\"240AC4123456\",\"cmd_name\":\"Bee.history\","
+             "\"from\":%lu,\"to\":%lu,\"trans_code\":79}", (unsigned long)(u32newest - 30 * 299), (unsigned long)u32newest);
+    mqtt_set_payload_encoding(PAYLOAD_PACKED);
+    i64start = esp_timer_get_time();
+    broker_publish(BENCH_TOPIC "/Command", cHistory, strlen(cHistory));
+    bReply = wait_until(got_reply_79, 2000);
+    printf("  Bee.history streamed %lu samples in %.1f ms\n", (unsigned long)history_samples(), ms_since(i64start));
+    check(bReply && find_in_log("\"trans_code\":79", "\"OK\"", NULL) && (history_samples() == 300),
+          "Bee.history streams the requested window before its result");
+
+}
+
+/****************************************************************************/
+/***        Main                                                          ***/
+/****************************************************************************/
+
+/* A sector filled to its last byte, then a power loss: the scan must not run into the next sector */
+static void bench_outbox_power_loss(void)
+{
+    uint8_t u8payload[BENCH_OUTBOX_REC - sizeof(outbox_rec_t) - 1];
+    char cTopic[OUTBOX_TOPIC_MAX];
+    size_t len;
+    outbox_cursor_t cursor;
+    uint32_t u32ordered = 0;
+
+    printf("\nOutbox after a power loss (%u records of %u bytes)\n", BENCH_OUTBOX_RECS, BENCH_OUTBOX_REC);
+    host_rtc_power_loss();
+    outbox_init(); /* The head moves to a fresh sector */
+    while (outbox_pop() == ESP_OK) /* Anything an earlier failed pop left pending */
+    {
+    }
+    for (uint32_t i = 0; i < BENCH_OUTBOX_RECS; i++)
+    {
+        memset(u8payload, (int)i, sizeof(u8payload));
+        outbox_append("t", u8payload, sizeof(u8payload));
+    }
+    host_rtc_power_loss();
+    outbox_init();
+    uint32_t u32count = outbox_count();
+    outbox_rewind(&cursor);
+    while ((outbox_read(&cursor, cTopic, u8payload, sizeof(u8payload), &len) == ESP_OK) &&
+           (u8payload[0] == (uint8_t)u32ordered))
+    {
+        u32ordered++;
+    }
+    printf("  %lu pending after the scan, %lu replayed in order\n", (unsigned long)u32count, (unsigned long)u32ordered);
+    check((u32count == BENCH_OUTBOX_RECS) && (u32ordered == BENCH_OUTBOX_RECS), "full sector rescanned once, in order");
+    while (outbox_pop() == ESP_OK)
+    {
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t u32wakes = BENCH_WAKES;
+    uint32_t u32rtt_ms = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:v")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                u32wakes = (uint32_t)atoi(optarg);
+                break;
+            case 'r':
+                u32rtt_ms = (uint32_t)atoi(optarg);
+                break;
+            case 'v':
+                host_log_level = ESP_LOG_INFO;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n wakes] [-r rtt_ms] [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (u32wakes == 0)
+    {
+        u32wakes = 1;
+    }
+
+    srand(1);
+    host_mqtt_options.u16port = broker_start();
+    if (host_mqtt_options.u16port == 0)
+    {
+        fprintf(stderr, "Broker did not start\n");
+        return 1;
+    }
+    host_mqtt_options.u32connack_timeout_ms = 500;
+    host_mqtt_options.u32reconnect_ms = 100;
+
+#if CONFIG_MQTT_PROTOCOL_5
+    printf("bee_bench: MQTT 5, broker on 127.0.0.1:%u\n", host_mqtt_options.u16port);
+#else
+    printf("bee_bench: MQTT 3.1.1, broker on 127.0.0.1:%u\n", host_mqtt_options.u16port);
+#endif
+    mqtt_func_init();
+    wait_until(connected, 2000);
+
+    bench_latency(u32wakes, u32rtt_ms);
+    bench_bytes();
+    bench_throughput();
+    fault_dropped_connack();
+    fault_slow_puback();
+    fault_disconnect_mid_publish();
+    fault_outbox_write();
+    bench_alarm();
+    bench_presence();
+    bench_config();
+    bench_manifest();
+    bench_history();
+    bench_command();
+    bench_outbox_power_loss(); /* Last, the power loss resets every RTC variable */
+
+    printf("\n%lu/%lu checks passed\n", (unsigned long)(u32checks - u32failed), (unsigned long)u32checks);
+    fflush(stdout);
+    _exit((u32failed == 0) ? 0 : 1); /* cmd_task is still listening */
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
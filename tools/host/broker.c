@@ -0,0 +1,692 @@
+/*****************************************************************************
+ *
+ * @file 	broker.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	in-process MQTT 3.1.1/5 broker stand-in on loopback with fault
+ *          injection, for the host bench
+ *
+ *          One client at a time, QoS0 and QoS1, one kept session, MQTT 5
+ *          topic aliases. Every PUBLISH received is logged with its wire size.
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "esp_timer.h"
+
+#include "broker.h"
+#include "mqtt_wire.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define BROKER_SUBS_MAX     8
+#define BROKER_ACKS_MAX     64      /* Delayed PUBACKs waiting to go out */
+#define BROKER_POLL_MS      20
+#define BROKER_RETAINED_MAX 8
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+typedef struct
+{
+    bool     bValid;
+    char     cClient_id[64];
+    char     cSub[BROKER_SUBS_MAX][BROKER_TOPIC_MAX];
+    uint8_t  u8subs;
+} session_t;
+
+typedef struct
+{
+    uint16_t u16msg_id;
+    int64_t  i64due_us;
+} pending_ack_t;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t thread;
+static int listen_fd = -1;
+static int conn_fd = -1;
+static uint8_t u8level = WIRE_LEVEL_311;
+static bool bKeep_session = false;          /* Session outlives this connection */
+static char cAlias[BROKER_ALIAS_MAX + 1][BROKER_TOPIC_MAX];
+static session_t session;
+static pending_ack_t pending[BROKER_ACKS_MAX];
+static uint8_t u8pending = 0;
+static broker_faults_t faults;
+static broker_stats_t stats;
+static broker_msg_t msg_log[BROKER_LOG_MAX];
+static uint32_t u32log_count = 0;
+static broker_msg_t retained[BROKER_RETAINED_MAX];
+static uint8_t u8retained = 0;
+static bool bWill = false;                  /* The connection registered a Last Will */
+static broker_msg_t will;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void send_locked(uint8_t u8header, const wire_buf_t *body)
+{
+    uint8_t u8packet[WIRE_PACKET_MAX];
+    size_t len = wire_frame(u8packet, sizeof(u8packet), u8header, body);
+    if ((len > 0) && (conn_fd >= 0))
+    {
+        wire_write(conn_fd, u8packet, len);
+    }
+}
+
+/* Log a message and keep it if it is retained */
+static void deliver_locked(const broker_msg_t *msg)
+{
+    if (u32log_count < BROKER_LOG_MAX)
+    {
+        msg_log[u32log_count++] = *msg;
+    }
+    if (!msg->bRetain)
+    {
+        return;
+    }
+    uint8_t i = 0;
+    while ((i < u8retained) && (strcmp(retained[i].cTopic, msg->cTopic) != 0))
+    {
+        i++;
+    }
+    if (msg->u16len == 0) /* An empty retained message clears the topic */
+    {
+        if (i < u8retained)
+        {
+            retained[i] = retained[--u8retained];
+        }
+        return;
+    }
+    if (i == u8retained)
+    {
+        if (u8retained == BROKER_RETAINED_MAX)
+        {
+            return;
+        }
+        u8retained++;
+    }
+    retained[i] = *msg;
+}
+
+/* Drop the connection, the Last Will goes out unless the client sent DISCONNECT */
+static void close_locked(void)
+{
+    if (conn_fd < 0)
+    {
+        return;
+    }
+    if (bWill)
+    {
+        will.i64t_us = esp_timer_get_time();
+        deliver_locked(&will);
+        bWill = false;
+    }
+    close(conn_fd);
+    conn_fd = -1;
+    u8pending = 0; /* PUBACKs not sent yet are lost with the connection */
+    memset(cAlias, 0, sizeof(cAlias));
+    if (!bKeep_session)
+    {
+        session.bValid = false;
+    }
+}
+
+static void copy_str(char *cOut, size_t size, const uint8_t *pu8, uint16_t u16len)
+{
+    size_t len = (u16len < size) ? u16len : size - 1;
+    memcpy(cOut, pu8, len);
+    cOut[len] = '\0';
+}
+
+/* MQTT topic filter matching with + and # */
+static bool topic_matches(const char *cFilter, const char *cTopic)
+{
+    while (*cFilter != '\0')
+    {
+        if (*cFilter == '#')
+        {
+            return true;
+        }
+        if (*cFilter == '+')
+        {
+            while ((*cTopic != '\0') && (*cTopic != '/'))
+            {
+                cTopic++;
+            }
+            cFilter++;
+            continue;
+        }
+        if (*cFilter != *cTopic)
+        {
+            return false;
+        }
+        cFilter++;
+        cTopic++;
+    }
+    return *cTopic == '\0';
+}
+
+/* QoS0 PUBLISH to the client, lock held */
+static bool send_publish_locked(const char *cTopic, const void *data, size_t len, bool bRetain)
+{
+    uint8_t u8body[WIRE_PACKET_MAX];
+    wire_buf_t b = {.pu8 = u8body, .size = sizeof(u8body)};
+
+    wire_str(&b, cTopic);
+    if (u8level == WIRE_LEVEL_5)
+    {
+        wire_varint(&b, 0);
+    }
+    wire_bytes(&b, data, len);
+    send_locked((WIRE_PUBLISH << 4) | (bRetain ? 0x01 : 0), &b);
+    return !b.bOverflow;
+}
+
+static void sleep_ms(uint32_t u32ms)
+{
+    if (u32ms > 0)
+    {
+        usleep(u32ms * 1000);
+    }
+}
+
+static void handle_connect(const uint8_t *pu8body, uint32_t u32len)
+{
+    wire_rd_t r = {.pu8 = pu8body, .left = u32len};
+    uint16_t u16len;
+    uint32_t u32expiry = 0;
+
+    wire_rd_str(&r, &u16len);                   /* "MQTT" */
+    uint8_t u8proto = wire_rd_u8(&r);
+    uint8_t u8flags = wire_rd_u8(&r);
+    wire_rd_u16(&r);                            /* Keep alive, not enforced */
+    if (u8proto == WIRE_LEVEL_5)
+    {
+        wire_rd_t props;
+        wire_prop_t prop;
+        wire_rd_props(&r, &props);
+        while (wire_prop_next(&props, &prop))
+        {
+            if (prop.u8id == WIRE_PROP_SESSION_EXPIRY)
+            {
+                u32expiry = prop.u32value;
+            }
+        }
+    }
+    const uint8_t *pu8id = wire_rd_str(&r, &u16len);
+    char cClient_id[64];
+    copy_str(cClient_id, sizeof(cClient_id), pu8id, u16len);
+
+    bool bHas_will = (u8flags & 0x04) != 0;
+    memset(&will, 0, sizeof(will));
+    if (bHas_will)
+    {
+        if (u8proto == WIRE_LEVEL_5)
+        {
+            wire_rd_t props;
+            wire_rd_props(&r, &props);
+        }
+        const uint8_t *pu8topic = wire_rd_str(&r, &u16len);
+        copy_str(will.cTopic, sizeof(will.cTopic), pu8topic, u16len);
+        const uint8_t *pu8msg = wire_rd_str(&r, &u16len);
+        will.u16len = (u16len < BROKER_PAYLOAD_MAX) ? u16len : BROKER_PAYLOAD_MAX;
+        if (pu8msg != NULL)
+        {
+            memcpy(will.u8payload, pu8msg, will.u16len);
+        }
+        will.u8qos = (u8flags >> 3) & 0x03;
+        will.bRetain = (u8flags & 0x20) != 0;
+        will.bWill = true;
+        will.u8level = u8proto;
+    }
+    if (r.bBad)
+    {
+        close_locked();
+        return;
+    }
+
+    bool bClean = (u8flags & 0x02) != 0;
+    bool bPresent = !bClean && session.bValid && (strcmp(session.cClient_id, cClient_id) == 0);
+
+    u8level = u8proto;
+    bKeep_session = (u8proto == WIRE_LEVEL_5) ? (u32expiry > 0) : !bClean;
+    if (!bPresent)
+    {
+        memset(&session, 0, sizeof(session));
+        strcpy(session.cClient_id, cClient_id);
+    }
+    session.bValid = true;
+    stats.u32connects++;
+
+    if (faults.drop_connack > 0)
+    {
+        faults.drop_connack--; /* Leave the client waiting, it gives up and dials again */
+        return;
+    }
+    bWill = bHas_will; /* Only an accepted connection has a will */
+
+    uint8_t u8out[16];
+    wire_buf_t b = {.pu8 = u8out, .size = sizeof(u8out)};
+    wire_u8(&b, bPresent ? 0x01 : 0x00);
+    wire_u8(&b, 0x00);
+    if (u8level == WIRE_LEVEL_5)
+    {
+        wire_varint(&b, 3);
+        wire_u8(&b, WIRE_PROP_ALIAS_MAX);
+        wire_u16(&b, BROKER_ALIAS_MAX);
+    }
+    pthread_mutex_unlock(&lock);
+    sleep_ms(faults.u32rtt_ms);
+    pthread_mutex_lock(&lock);
+    send_locked(WIRE_CONNACK << 4, &b);
+    stats.u32connacks++;
+}
+
+static void send_puback_locked(uint16_t u16msg_id)
+{
+    uint8_t u8out[2];
+    wire_buf_t b = {.pu8 = u8out, .size = sizeof(u8out)};
+    wire_u16(&b, u16msg_id);
+    send_locked(WIRE_PUBACK << 4, &b);
+    stats.u32pubacks++;
+}
+
+static void handle_publish(uint8_t u8header, const uint8_t *pu8body, uint32_t u32len, uint32_t u32wire)
+{
+    wire_rd_t r = {.pu8 = pu8body, .left = u32len};
+    uint8_t u8qos = (u8header >> 1) & 0x03;
+    uint16_t u16topic_len;
+    uint16_t u16alias = 0;
+    const uint8_t *pu8topic = wire_rd_str(&r, &u16topic_len);
+    uint16_t u16msg_id = (u8qos > 0) ? wire_rd_u16(&r) : 0;
+
+    if (u8level == WIRE_LEVEL_5)
+    {
+        wire_rd_t props;
+        wire_prop_t prop;
+        wire_rd_props(&r, &props);
+        while (wire_prop_next(&props, &prop))
+        {
+            if (prop.u8id == WIRE_PROP_TOPIC_ALIAS)
+            {
+                u16alias = (uint16_t)prop.u32value;
+            }
+        }
+    }
+    if (r.bBad || (u16alias > BROKER_ALIAS_MAX))
+    {
+        close_locked(); /* Protocol error */
+        return;
+    }
+
+    char cTopic[BROKER_TOPIC_MAX];
+    copy_str(cTopic, sizeof(cTopic), pu8topic, u16topic_len);
+    if (u16alias != 0)
+    {
+        if (u16topic_len > 0)
+        {
+            strcpy(cAlias[u16alias], cTopic);
+        }
+        else if (cAlias[u16alias][0] == '\0')
+        {
+            close_locked(); /* Alias never set in this connection */
+            return;
+        }
+        else
+        {
+            strcpy(cTopic, cAlias[u16alias]);
+        }
+    }
+
+    static broker_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.i64t_us = esp_timer_get_time();
+    strcpy(msg.cTopic, cTopic);
+    msg.u16len = (r.left < BROKER_PAYLOAD_MAX) ? (uint16_t)r.left : BROKER_PAYLOAD_MAX;
+    memcpy(msg.u8payload, r.pu8, msg.u16len);
+    msg.u16topic_len = u16topic_len;
+    msg.u32wire = u32wire;
+    msg.u8qos = u8qos;
+    msg.u8level = u8level;
+    msg.bRetain = (u8header & 0x01) != 0;
+    stats.u32publishes++;
+    deliver_locked(&msg);
+
+    if (u8qos == 0)
+    {
+        return;
+    }
+    uint32_t u32delay_ms = faults.u32puback_delay_ms + faults.u32rtt_ms;
+    if ((u32delay_ms == 0) && (u8pending == 0))
+    {
+        send_puback_locked(u16msg_id);
+    }
+    else if (u8pending < BROKER_ACKS_MAX)
+    {
+        pending[u8pending].u16msg_id = u16msg_id;
+        pending[u8pending].i64due_us = esp_timer_get_time() + (int64_t)u32delay_ms * 1000;
+        u8pending++;
+    }
+}
+
+static void handle_subscribe(const uint8_t *pu8body, uint32_t u32len)
+{
+    wire_rd_t r = {.pu8 = pu8body, .left = u32len};
+    uint8_t u8out[64];
+    wire_buf_t b = {.pu8 = u8out, .size = sizeof(u8out)};
+    uint8_t u8new = 0;
+
+    wire_u16(&b, wire_rd_u16(&r));
+    if (u8level == WIRE_LEVEL_5)
+    {
+        wire_rd_t props;
+        wire_rd_props(&r, &props);
+        wire_varint(&b, 0);
+    }
+    while (!r.bBad && (r.left > 0))
+    {
+        uint16_t u16len;
+        const uint8_t *pu8filter = wire_rd_str(&r, &u16len);
+        uint8_t u8options = wire_rd_u8(&r);
+        if (r.bBad)
+        {
+            break;
+        }
+        if (session.u8subs < BROKER_SUBS_MAX)
+        {
+            copy_str(session.cSub[session.u8subs++], BROKER_TOPIC_MAX, pu8filter, u16len);
+            u8new++;
+        }
+        wire_u8(&b, ((u8options & 0x03) > 1) ? 1 : (u8options & 0x03));
+    }
+    stats.u32subscribes++;
+    pthread_mutex_unlock(&lock);
+    sleep_ms(faults.u32rtt_ms);
+    pthread_mutex_lock(&lock);
+    send_locked(WIRE_SUBACK << 4, &b);
+
+    /* Retained messages matching the new filters follow the SUBACK */
+    for (uint8_t i = session.u8subs - u8new; i < session.u8subs; i++)
+    {
+        for (uint8_t j = 0; j < u8retained; j++)
+        {
+            if (topic_matches(session.cSub[i], retained[j].cTopic))
+            {
+                send_publish_locked(retained[j].cTopic, retained[j].u8payload, retained[j].u16len, true);
+            }
+        }
+    }
+}
+
+/* Read and handle one packet, lock held */
+static void handle_packet(void)
+{
+    static uint8_t u8body[WIRE_PACKET_MAX];
+    uint8_t u8header;
+    uint32_t u32len, u32hdr_len;
+
+    int r = wire_read_header(conn_fd, &u8header, &u32len, &u32hdr_len, 0);
+    if (r == 0)
+    {
+        return;
+    }
+    if ((r < 0) || (u32len > sizeof(u8body)))
+    {
+        close_locked();
+        return;
+    }
+    if (((u8header >> 4) == WIRE_PUBLISH) && (faults.close_on_publish > 0) && (--faults.close_on_publish == 0))
+    {
+        stats.u32closed++;
+        close_locked(); /* Mid-packet, the body is never read */
+        return;
+    }
+    if (wire_read_exact(conn_fd, u8body, u32len) != 0)
+    {
+        close_locked();
+        return;
+    }
+    stats.u32bytes_in += u32hdr_len + u32len;
+
+    switch (u8header >> 4)
+    {
+        case WIRE_CONNECT:
+            handle_connect(u8body, u32len);
+            break;
+
+        case WIRE_PUBLISH:
+            handle_publish(u8header, u8body, u32len, u32hdr_len + u32len);
+            break;
+
+        case WIRE_SUBSCRIBE:
+            handle_subscribe(u8body, u32len);
+            break;
+
+        case WIRE_PINGREQ:
+        {
+            wire_buf_t b = {0};
+            send_locked(WIRE_PINGRESP << 4, &b);
+            break;
+        }
+
+        case WIRE_DISCONNECT:
+            bWill = false; /* Normal disconnection, the will is dropped */
+            close_locked();
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* Send the delayed PUBACKs that are due, in order, lock held */
+static void flush_acks_locked(void)
+{
+    int64_t i64now = esp_timer_get_time();
+    uint8_t u8sent = 0;
+    while ((u8sent < u8pending) && (pending[u8sent].i64due_us <= i64now))
+    {
+        send_puback_locked(pending[u8sent].u16msg_id);
+        u8sent++;
+    }
+    if (u8sent > 0)
+    {
+        memmove(pending, &pending[u8sent], (u8pending - u8sent) * sizeof(pending_ack_t));
+        u8pending -= u8sent;
+    }
+}
+
+static void *broker_thread(void *arg)
+{
+    for (;;)
+    {
+        pthread_mutex_lock(&lock);
+        int timeout_ms = BROKER_POLL_MS;
+        if (u8pending > 0)
+        {
+            int64_t i64wait_us = pending[0].i64due_us - esp_timer_get_time();
+            timeout_ms = (i64wait_us <= 0) ? 0 : (int)((i64wait_us + 999) / 1000);
+            timeout_ms = (timeout_ms < BROKER_POLL_MS) ? timeout_ms : BROKER_POLL_MS;
+        }
+        struct pollfd pfd[2] = {
+            {.fd = listen_fd, .events = POLLIN},
+            {.fd = conn_fd, .events = POLLIN},
+        };
+        pthread_mutex_unlock(&lock);
+
+        poll(pfd, (pfd[1].fd >= 0) ? 2 : 1, timeout_ms);
+
+        pthread_mutex_lock(&lock);
+        if (pfd[0].revents & POLLIN)
+        {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd >= 0)
+            {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                close_locked(); /* Session takeover */
+                conn_fd = fd;
+                u8level = WIRE_LEVEL_311;
+            }
+        }
+        else if ((pfd[1].fd >= 0) && (pfd[1].fd == conn_fd) && (pfd[1].revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            handle_packet();
+        }
+        flush_acks_locked();
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+uint16_t broker_start(void)
+{
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+    {
+        return 0;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = 0, /* Ephemeral */
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t addr_len = sizeof(addr);
+    if ((bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(listen_fd, 4) != 0) ||
+        (getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) ||
+        (pthread_create(&thread, NULL, broker_thread, NULL) != 0))
+    {
+        close(listen_fd);
+        listen_fd = -1;
+        return 0;
+    }
+    pthread_detach(thread);
+    return ntohs(addr.sin_port);
+}
+
+void broker_set_faults(const broker_faults_t *in)
+{
+    pthread_mutex_lock(&lock);
+    faults = *in;
+    pthread_mutex_unlock(&lock);
+}
+
+bool broker_publish(const char *cTopic, const void *data, size_t len)
+{
+    bool bSent = false;
+
+    pthread_mutex_lock(&lock);
+    for (uint8_t i = 0; (i < session.u8subs) && (conn_fd >= 0); i++)
+    {
+        if (topic_matches(session.cSub[i], cTopic))
+        {
+            bSent = send_publish_locked(cTopic, data, len, false);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return bSent;
+}
+
+void broker_retain(const char *cTopic, const void *data, size_t len)
+{
+    broker_msg_t msg = {.i64t_us = esp_timer_get_time(), .bRetain = true};
+
+    snprintf(msg.cTopic, sizeof(msg.cTopic), "%s", cTopic);
+    msg.u16len = (len < BROKER_PAYLOAD_MAX) ? (uint16_t)len : BROKER_PAYLOAD_MAX;
+    memcpy(msg.u8payload, data, msg.u16len);
+    pthread_mutex_lock(&lock);
+    deliver_locked(&msg);
+    pthread_mutex_unlock(&lock);
+    broker_publish(cTopic, data, len);
+}
+
+bool broker_retained(const char *cTopic, broker_msg_t *msg)
+{
+    bool bFound = false;
+    pthread_mutex_lock(&lock);
+    for (uint8_t i = 0; i < u8retained; i++)
+    {
+        if (strcmp(retained[i].cTopic, cTopic) == 0)
+        {
+            *msg = retained[i];
+            bFound = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return bFound;
+}
+
+uint32_t broker_log_count(void)
+{
+    pthread_mutex_lock(&lock);
+    uint32_t u32count = u32log_count;
+    pthread_mutex_unlock(&lock);
+    return u32count;
+}
+
+bool broker_log_get(uint32_t u32index, broker_msg_t *msg)
+{
+    pthread_mutex_lock(&lock);
+    bool bFound = u32index < u32log_count;
+    if (bFound)
+    {
+        *msg = msg_log[u32index];
+    }
+    pthread_mutex_unlock(&lock);
+    return bFound;
+}
+
+void broker_log_clear(void)
+{
+    pthread_mutex_lock(&lock);
+    u32log_count = 0;
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&lock);
+}
+
+void broker_get_stats(broker_stats_t *out)
+{
+    pthread_mutex_lock(&lock);
+    *out = stats;
+    pthread_mutex_unlock(&lock);
+}
+
+void broker_kick(void)
+{
+    pthread_mutex_lock(&lock);
+    if (conn_fd >= 0)
+    {
+        stats.u32closed++;
+        close_locked();
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,118 @@
+/*****************************************************************************
+ *
+ * @file 	broker.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	in-process MQTT 3.1.1/5 broker stand-in on loopback with fault
+ *          injection, for the host bench
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef BROKER_H
+#define BROKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BROKER_LOG_MAX      4096    /* PUBLISH packets remembered */
+#define BROKER_TOPIC_MAX    96
+#define BROKER_PAYLOAD_MAX  1100
+#define BROKER_ALIAS_MAX    4       /* Topic Alias Maximum granted to MQTT 5 clients */
+
+typedef struct
+{
+    int      drop_connack;          /* CONNECTs still to leave unanswered */
+    uint32_t u32puback_delay_ms;    /* Hold every PUBACK this long, later packets are still read */
+    int      close_on_publish;      /* Close the connection after the fixed header of the Nth next PUBLISH, 0 never */
+    uint32_t u32rtt_ms;             /* Added before CONNACK, SUBACK and PUBACK, a slower network */
+} broker_faults_t;
+
+typedef struct
+{
+    int64_t  i64t_us;               /* esp_timer_get_time() when the packet was read */
+    char     cTopic[BROKER_TOPIC_MAX];  /* Resolved through the topic alias */
+    uint8_t  u8payload[BROKER_PAYLOAD_MAX];
+    uint16_t u16len;
+    uint16_t u16topic_len;          /* Topic bytes on the wire, 0 when only the alias was sent */
+    uint32_t u32wire;               /* Whole packet, fixed header included */
+    uint8_t  u8qos;
+    uint8_t  u8level;               /* Protocol level of the connection */
+    bool     bRetain;
+    bool     bWill;                 /* Published by the broker for a connection that died */
+} broker_msg_t;
+
+typedef struct
+{
+    uint32_t u32connects;
+    uint32_t u32connacks;
+    uint32_t u32publishes;
+    uint32_t u32pubacks;
+    uint32_t u32subscribes;
+    uint32_t u32closed;             /* Connections the broker closed on purpose */
+    uint32_t u32bytes_in;
+} broker_stats_t;
+
+/**
+ * @brief Start the broker thread on 127.0.0.1.
+ *
+ * @return The port it listens on, 0 on failure.
+ */
+uint16_t broker_start(void);
+
+/**
+ * @brief Replace the fault settings, taking effect from the next packet.
+ */
+void broker_set_faults(const broker_faults_t *faults);
+
+/**
+ * @brief Publish to the connected client with QoS0 if it subscribed to a matching filter.
+ *
+ * @return true if the message was written.
+ */
+bool broker_publish(const char *cTopic, const void *data, size_t len);
+
+/**
+ * @brief Store a retained message for the topic, as a backend would publish it, and send it on if subscribed.
+ *
+ * Every later subscription matching the topic receives it after its SUBACK.
+ */
+void broker_retain(const char *cTopic, const void *data, size_t len);
+
+/**
+ * @brief Get the retained message of a topic.
+ *
+ * @return false if the topic has none.
+ */
+bool broker_retained(const char *cTopic, broker_msg_t *msg);
+
+/**
+ * @brief Number of PUBLISH packets in the log.
+ */
+uint32_t broker_log_count(void);
+
+/**
+ * @brief Copy a logged PUBLISH, oldest first.
+ */
+bool broker_log_get(uint32_t u32index, broker_msg_t *msg);
+
+/**
+ * @brief Empty the log and the counters.
+ */
+void broker_log_clear(void);
+
+void broker_get_stats(broker_stats_t *stats);
+
+/**
+ * @brief Close the client connection without a DISCONNECT, as a NAT timeout or a dead device would.
+ *
+ * The Last Will of the client is published.
+ */
+void broker_kick(void);
+
+#endif /* BROKER_H */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,301 @@
+/*****************************************************************************
+ *
+ * @file 	httpd.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	in-process HTTP/1.1 file server stand-in on loopback with Range
+ *          requests and fault injection, the firmware host of the OTA bench
+ *
+ *          One connection at a time, GET only, one request per connection,
+ *          "Range: bytes=<first>-" only.
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "esp_timer.h"
+
+#include "httpd.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define HTTPD_HEAD_MAX      2048
+#define HTTPD_SLICE         1460    /* One TCP segment when throttled */
+#define HTTPD_WRITE_MAX     65536
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+typedef struct
+{
+    char        cPath[HTTPD_PATH_MAX];
+    const void  *data;
+    size_t      len;
+} httpd_file_t;
+
+typedef struct
+{
+    char        cPath[HTTPD_PATH_MAX];
+    bool        bRange;
+    size_t      first;              /* First byte asked for */
+} httpd_request_t;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t thread;
+static int listen_fd = -1;
+static httpd_file_t files[HTTPD_FILES_MAX];
+static uint8_t u8files = 0;
+static httpd_faults_t faults;
+static httpd_stats_t stats;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static bool send_all(int fd, const void *data, size_t len)
+{
+    const uint8_t *pu8 = data;
+    while (len > 0)
+    {
+        ssize_t n = send(fd, pu8, len, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return false;
+        }
+        pu8 += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Read the request head, false if the client went away first */
+static bool read_request(int fd, httpd_request_t *req)
+{
+    char cHead[HTTPD_HEAD_MAX];
+    size_t len = 0;
+
+    while ((len < sizeof(cHead) - 1))
+    {
+        ssize_t n = recv(fd, &cHead[len], sizeof(cHead) - 1 - len, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        len += n;
+        cHead[len] = '\0';
+        if (strstr(cHead, "\r\n\r\n") != NULL)
+        {
+            break;
+        }
+    }
+    char *pcRange = strcasestr(cHead, "\r\nRange: bytes=");
+    unsigned long first = 0;
+    req->bRange = (pcRange != NULL) && (sscanf(pcRange, "\r\n%*[^=]=%lu-", &first) == 1);
+    req->first = first;
+    return sscanf(cHead, "GET %63s HTTP/1.%*d", req->cPath) == 1;
+}
+
+/* Body of a response, paced to the rate limit */
+static void send_body(int fd, const uint8_t *pu8Data, size_t len, const httpd_faults_t *f)
+{
+    int64_t i64start_us = esp_timer_get_time();
+    size_t sent = 0;
+
+    while (sent < len)
+    {
+        size_t slice = (f->u32rate_Bps > 0) ? HTTPD_SLICE : HTTPD_WRITE_MAX;
+        slice = (slice < len - sent) ? slice : len - sent;
+        if (f->u32cut_after > 0)
+        {
+            if (sent == f->u32cut_after)
+            {
+                break; /* The connection dies here */
+            }
+            slice = (slice < f->u32cut_after - sent) ? slice : f->u32cut_after - sent;
+        }
+        if (f->u32rate_Bps > 0)
+        {
+            int64_t i64due_us = i64start_us + (int64_t)(sent + slice) * 1000000 / f->u32rate_Bps;
+            int64_t i64wait_us = i64due_us - esp_timer_get_time();
+            if (i64wait_us > 0)
+            {
+                usleep((useconds_t)i64wait_us);
+            }
+        }
+        if (!send_all(fd, &pu8Data[sent], slice))
+        {
+            break;
+        }
+        sent += slice;
+    }
+
+    pthread_mutex_lock(&lock);
+    stats.u32body_bytes += sent;
+    pthread_mutex_unlock(&lock);
+}
+
+static void serve(int fd)
+{
+    httpd_request_t req;
+    char cHead[256];
+
+    if (!read_request(fd, &req))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    httpd_faults_t f = faults;
+    const httpd_file_t *file = NULL;
+    for (uint8_t i = 0; i < u8files; i++)
+    {
+        if (strcmp(files[i].cPath, req.cPath) == 0)
+        {
+            file = &files[i];
+        }
+    }
+    httpd_file_t found = (file != NULL) ? *file : (httpd_file_t){0};
+    stats.u32requests++;
+    stats.u32not_found += (file == NULL);
+    pthread_mutex_unlock(&lock);
+
+    if (file == NULL)
+    {
+        static const char cNot_found[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        send_all(fd, cNot_found, sizeof(cNot_found) - 1);
+        return;
+    }
+    int n;
+    size_t first = 0;
+    if (req.bRange && !f.bNo_range)
+    {
+        if (req.first >= found.len)
+        {
+            n = snprintf(cHead, sizeof(cHead), "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%zu\r\n"
+                         "Content-Length: 0\r\nConnection: close\r\n\r\n", found.len);
+            send_all(fd, cHead, n);
+            return;
+        }
+        first = req.first;
+        n = snprintf(cHead, sizeof(cHead),
+                     "HTTP/1.1 206 Partial Content\r\nContent-Type: application/octet-stream\r\nContent-Length: %zu\r\n"
+                     "Content-Range: bytes %zu-%zu/%zu\r\nConnection: close\r\n\r\n",
+                     found.len - first, first, found.len - 1, found.len);
+        pthread_mutex_lock(&lock);
+        stats.u32ranges++;
+        pthread_mutex_unlock(&lock);
+    }
+    else
+    {
+        n = snprintf(cHead, sizeof(cHead),
+                     "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %zu\r\n"
+                     "Connection: close\r\n\r\n", found.len);
+    }
+    if (send_all(fd, cHead, n))
+    {
+        send_body(fd, (const uint8_t *)found.data + first, found.len - first, &f);
+    }
+}
+
+static void *httpd_thread(void *arg)
+{
+    for (;;)
+    {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            continue;
+        }
+        serve(fd);
+        shutdown(fd, SHUT_WR);
+        close(fd);
+    }
+    return NULL;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+uint16_t httpd_start(void)
+{
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+    {
+        return 0;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = 0, /* Ephemeral */
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t addr_len = sizeof(addr);
+    if ((bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(listen_fd, 4) != 0) ||
+        (getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) ||
+        (pthread_create(&thread, NULL, httpd_thread, NULL) != 0))
+    {
+        close(listen_fd);
+        listen_fd = -1;
+        return 0;
+    }
+    pthread_detach(thread);
+    return ntohs(addr.sin_port);
+}
+
+void httpd_add_file(const char *cPath, const void *data, size_t len)
+{
+    pthread_mutex_lock(&lock);
+    uint8_t i = 0;
+    while ((i < u8files) && (strcmp(files[i].cPath, cPath) != 0))
+    {
+        i++;
+    }
+    if (i < HTTPD_FILES_MAX)
+    {
+        snprintf(files[i].cPath, sizeof(files[i].cPath), "%s", cPath);
+        files[i].data = data;
+        files[i].len = len;
+        u8files += (i == u8files);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void httpd_set_faults(const httpd_faults_t *in)
+{
+    pthread_mutex_lock(&lock);
+    faults = *in;
+    pthread_mutex_unlock(&lock);
+}
+
+void httpd_get_stats(httpd_stats_t *out)
+{
+    pthread_mutex_lock(&lock);
+    *out = stats;
+    pthread_mutex_unlock(&lock);
+}
+
+void httpd_clear_stats(void)
+{
+    pthread_mutex_lock(&lock);
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&lock);
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,69 @@
+/*****************************************************************************
+ *
+ * @file 	httpd.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	in-process HTTP/1.1 file server stand-in on loopback with Range
+ *          requests and fault injection, the firmware host of the OTA bench
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef HTTPD_H
+#define HTTPD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HTTPD_FILES_MAX     8
+#define HTTPD_PATH_MAX      64
+
+typedef struct
+{
+    uint32_t u32rate_Bps;           /* Body bytes per second, 0 as fast as loopback goes */
+    uint32_t u32cut_after;          /* Close every connection after this many body bytes, 0 never */
+    bool     bNo_range;             /* Answer Range requests with the whole file, as some servers do */
+} httpd_faults_t;
+
+typedef struct
+{
+    uint32_t u32requests;
+    uint32_t u32ranges;             /* Requests answered with 206 */
+    uint32_t u32not_found;
+    uint32_t u32body_bytes;         /* Response bodies sent */
+} httpd_stats_t;
+
+/**
+ * @brief Start the server thread on 127.0.0.1.
+ *
+ * @return The port it listens on, 0 on failure.
+ */
+uint16_t httpd_start(void);
+
+/**
+ * @brief Serve a file, replacing the one at the same path.
+ *
+ * @param cPath Absolute path, e.g. "/fw.bin".
+ * @param data  Contents, kept by the caller while served.
+ * @param len   Size of data.
+ */
+void httpd_add_file(const char *cPath, const void *data, size_t len);
+
+/**
+ * @brief Replace the fault settings, taking effect from the next request.
+ */
+void httpd_set_faults(const httpd_faults_t *faults);
+
+void httpd_get_stats(httpd_stats_t *stats);
+
+/**
+ * @brief Zero the counters.
+ */
+void httpd_clear_stats(void);
+
+#endif /* HTTPD_H */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,10 @@
+/* Host stand-in for driver/gpio.h */
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+
+#endif /* HOST_DRIVER_GPIO_H */
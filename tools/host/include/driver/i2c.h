@@ -0,0 +1,10 @@
+/* Host stand-in for driver/i2c.h */
+#ifndef HOST_DRIVER_I2C_H
+#define HOST_DRIVER_I2C_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef int i2c_port_t;
+
+#endif /* HOST_DRIVER_I2C_H */
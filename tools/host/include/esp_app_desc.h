@@ -0,0 +1,15 @@
+/* Host stand-in for esp_app_desc.h */
+#ifndef HOST_ESP_APP_DESC_H
+#define HOST_ESP_APP_DESC_H
+
+#define HOST_APP_VERSION    "1.0.0"     /* PROJECT_VER of the host build */
+
+typedef struct
+{
+    char version[32];
+    char project_name[32];
+} esp_app_desc_t;
+
+const esp_app_desc_t *esp_app_get_description(void);
+
+#endif /* HOST_ESP_APP_DESC_H */
@@ -0,0 +1,9 @@
+/* Host stand-in for esp_attr.h, RTC memory is a section host_rtc_power_loss() puts back to its initial values */
+#ifndef HOST_ESP_ATTR_H
+#define HOST_ESP_ATTR_H
+
+#define RTC_DATA_ATTR   __attribute__((section("rtc_data")))
+#define RTC_NOINIT_ATTR
+#define IRAM_ATTR
+
+#endif /* HOST_ESP_ATTR_H */
@@ -0,0 +1,46 @@
+/* Host stand-in for esp_ota_ops.h over the RAM app partitions ota_0 and ota_1, as partitions.csv */
+#ifndef HOST_ESP_OTA_OPS_H
+#define HOST_ESP_OTA_OPS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#define ESP_ERR_OTA_BASE                0x1500
+#define ESP_ERR_OTA_PARTITION_CONFLICT  (ESP_ERR_OTA_BASE + 0x01)
+#define ESP_ERR_OTA_SELECT_INFO_INVALID (ESP_ERR_OTA_BASE + 0x02)
+#define ESP_ERR_OTA_VALIDATE_FAILED     (ESP_ERR_OTA_BASE + 0x03)
+
+#define OTA_SIZE_UNKNOWN                0xffffffff
+#define OTA_WITH_SEQUENTIAL_WRITES      0xfffffffe  /* Erase sector by sector as the writes reach them */
+
+typedef uint32_t esp_ota_handle_t;
+
+/*
+ * There is no image parser on the host: a test image is IMAGE_MAGIC, its total length in bytes [1..4]
+ * little-endian, any content and the SHA-256 of everything before it in the last 32 bytes, the way
+ * esp_image_verify() checks the hash appended to a real image.
+ */
+#define HOST_IMAGE_MAGIC                0xE9
+#define HOST_IMAGE_MIN                  (5 + 32)
+
+const esp_partition_t *esp_ota_get_running_partition(void);
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from_partition);
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition);
+const esp_partition_t *esp_ota_get_boot_partition(void);
+
+/* OTA slots esp_ota_get_next_update_partition() goes round, 2 unless a bench sets 1 (a table with ota_0 only) */
+extern uint8_t host_ota_slots;
+
+/* Boot partition back to the running one, no handle open */
+void host_ota_reset(void);
+
+/* Restart into the boot partition, ota_0 until the first call */
+void host_ota_boot(void);
+
+#endif /* HOST_ESP_OTA_OPS_H */
@@ -0,0 +1,49 @@
+/* Host stand-in for esp_partition.h, a RAM image with NOR flash semantics */
+#ifndef HOST_ESP_PARTITION_H
+#define HOST_ESP_PARTITION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef int esp_partition_subtype_t;
+
+#define ESP_PARTITION_SUBTYPE_APP_FACTORY   0x00
+#define ESP_PARTITION_SUBTYPE_APP_OTA_0     0x10
+#define ESP_PARTITION_SUBTYPE_APP_OTA_1     0x11
+
+typedef struct
+{
+    esp_partition_type_t    type;
+    esp_partition_subtype_t subtype;
+    uint32_t                address;
+    uint32_t                size;
+    uint32_t                erase_size;
+    char                    label[17];
+} esp_partition_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+
+/* Erase the whole RAM image, freshly flashed partitions */
+void host_partition_reset(void);
+
+/* Called after every esp_partition_write() when set, e.g. to cut the power at some point of an update */
+extern void (*host_flash_write_hook)(const esp_partition_t *partition, size_t offset, size_t size);
+
+/* The factory + ota_0 table of the first releases: factory found, ota_1, outbox and history not */
+extern bool host_partition_legacy;
+
+/* esp_partition_write() to the partition of this label fails and programs nothing, NULL for none */
+extern const char *host_flash_fail_label;
+
+#endif /* HOST_ESP_PARTITION_H */
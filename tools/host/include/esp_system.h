@@ -0,0 +1,14 @@
+/* Host stand-in for esp_system.h */
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Calls host_restart_hook when set, exits the process otherwise */
+void esp_restart(void);
+extern void (*host_restart_hook)(void);
+
+uint32_t esp_get_minimum_free_heap_size(void);
+
+#endif /* HOST_ESP_SYSTEM_H */
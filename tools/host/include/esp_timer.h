@@ -0,0 +1,10 @@
+/* Host stand-in for esp_timer.h */
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+/* Microseconds of CLOCK_MONOTONIC */
+int64_t esp_timer_get_time(void);
+
+#endif /* HOST_ESP_TIMER_H */
@@ -0,0 +1,7 @@
+/* Host stand-in for esp_transport.h, the host client speaks plain TCP */
+#ifndef HOST_ESP_TRANSPORT_H
+#define HOST_ESP_TRANSPORT_H
+
+typedef struct esp_transport_item_t *esp_transport_handle_t;
+
+#endif /* HOST_ESP_TRANSPORT_H */
@@ -0,0 +1,17 @@
+/* Host stand-in for esp_wifi.h, only the station MAC */
+#ifndef HOST_ESP_WIFI_H
+#define HOST_ESP_WIFI_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_IF_WIFI_STA = 0,
+    ESP_IF_WIFI_AP,
+} wifi_interface_t;
+
+/* Always 24:0A:C4:12:34:56 */
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6]);
+
+#endif /* HOST_ESP_WIFI_H */
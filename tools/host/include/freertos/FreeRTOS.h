@@ -0,0 +1,35 @@
+/*****************************************************************************
+ *
+ * @file 	FreeRTOS.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	host stand-in for the FreeRTOS types used by the components,
+ *          implemented on pthreads in shim/freertos.c
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_attr.h"
+#include "esp_bit_defs.h"
+
+typedef uint32_t TickType_t;
+typedef int32_t  BaseType_t;
+typedef uint32_t UBaseType_t;
+
+#define configTICK_RATE_HZ  1000    /* 1 ms ticks, the target runs at 100 Hz */
+#define portTICK_PERIOD_MS  (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define portMAX_DELAY       ((TickType_t)0xFFFFFFFF)
+
+#define pdFALSE     ((BaseType_t)0)
+#define pdTRUE      ((BaseType_t)1)
+#define pdPASS      pdTRUE
+#define pdFAIL      pdFALSE
+
+#endif /* HOST_FREERTOS_H */
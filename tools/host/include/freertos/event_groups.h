@@ -0,0 +1,17 @@
+/* Host stand-in for freertos/event_groups.h */
+#ifndef HOST_FREERTOS_EVENT_GROUPS_H
+#define HOST_FREERTOS_EVENT_GROUPS_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef uint32_t EventBits_t;
+typedef struct host_event_group *EventGroupHandle_t;
+
+EventGroupHandle_t xEventGroupCreate(void);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, EventBits_t uxBitsToSet);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, EventBits_t uxBitsToClear);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t xEventGroup);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup, EventBits_t uxBitsToWaitFor,
+                                BaseType_t xClearOnExit, BaseType_t xWaitForAllBits, TickType_t xTicksToWait);
+
+#endif /* HOST_FREERTOS_EVENT_GROUPS_H */
@@ -0,0 +1,18 @@
+/* Host stand-in for freertos/semphr.h, mutexes only */
+#ifndef HOST_FREERTOS_SEMPHR_H
+#define HOST_FREERTOS_SEMPHR_H
+
+#include <pthread.h>
+#include "freertos/FreeRTOS.h"
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+} StaticSemaphore_t;
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *pxMutexBuffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore);
+
+#endif /* HOST_FREERTOS_SEMPHR_H */
@@ -0,0 +1,107 @@
+/*****************************************************************************
+ *
+ * @file 	host_shim.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	knobs and probes of the host stand-ins, used by the bench harness
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct
+{
+    uint16_t u16port;               /* Loopback port of the broker, the URI host is ignored */
+    uint32_t u32connack_timeout_ms; /* Give up on a CONNACK after this long (esp-mqtt network.timeout_ms) */
+    uint32_t u32reconnect_ms;       /* Delay before dialing again (esp-mqtt network.reconnect_timeout_ms) */
+} host_mqtt_options_t;
+
+typedef struct
+{
+    uint32_t u32connects;           /* CONNECT packets sent */
+    uint32_t u32connacks;           /* Accepted CONNACKs */
+    uint32_t u32publishes;          /* PUBLISH packets written */
+    uint32_t u32bytes_out;          /* Every byte written to the socket */
+    int64_t  i64connack_us;         /* esp_timer_get_time() of the last CONNACK */
+} host_mqtt_stats_t;
+
+typedef struct
+{
+    uint32_t u32writes;             /* esp_partition_write() calls, any partition */
+    uint32_t u32erases;             /* Sectors erased */
+    uint32_t u32erase_calls;        /* esp_partition_erase_range() calls */
+} host_flash_stats_t;
+
+/* Time the RAM partitions take, all zero (the default) for none */
+typedef struct
+{
+    uint32_t u32sector_erase_us;    /* 4 KB */
+    uint32_t u32block_erase_us;     /* 64 KB, for the aligned blocks of an erase as esp_flash_erase_region() does */
+    uint32_t u32page_program_us;    /* 256 bytes, per page a write touches */
+} host_flash_timing_t;
+
+extern host_mqtt_options_t host_mqtt_options;
+extern host_flash_timing_t host_flash_timing;
+
+/**
+ * @brief Start the last client created again after mqtt_disconnect(), i.e. the next wake.
+ */
+void host_mqtt_restart(void);
+
+/**
+ * @brief Counters of the last client created.
+ */
+void host_mqtt_get_stats(host_mqtt_stats_t *stats);
+
+/**
+ * @brief Last value given to deep_sleep_set_interval(), 0 if never called.
+ */
+uint16_t host_get_interval(void);
+
+/**
+ * @brief Number of save_config_to_nvs() calls.
+ */
+uint32_t host_get_config_saves(void);
+
+/**
+ * @brief URL of the last ota_schedule() call, NULL if none since the last call of this.
+ */
+const char *host_take_ota_schedule(void);
+
+/**
+ * @brief SHA-256 ota_image_running() takes for the running image, all zeros until set.
+ */
+void host_set_running_image(const uint8_t *pu8Sha256);
+
+/**
+ * @brief Forget the update ota_schedule() queued, as bee_ota does with one that fails.
+ */
+void host_ota_drop(void);
+
+/**
+ * @brief Flash operations on the RAM partitions since the start.
+ */
+void host_flash_get_stats(host_flash_stats_t *stats);
+
+/**
+ * @brief Put every RTC_DATA_ATTR variable back to its initial value, as a power loss does.
+ *
+ * Flash, i.e. the partitions and whatever stands in for NVS, keeps its content.
+ */
+void host_rtc_power_loss(void);
+
+/**
+ * @brief Drop the connection of the HTTP client in use without closing the client, as a power loss does.
+ */
+void host_http_power_loss(void);
+
+#endif /* HOST_SHIM_H */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
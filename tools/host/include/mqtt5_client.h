@@ -0,0 +1,36 @@
+/* Host stand-in for the esp-mqtt MQTT 5 property API used by bee_mqtt */
+#ifndef HOST_MQTT5_CLIENT_H
+#define HOST_MQTT5_CLIENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mqtt_client.h"
+
+typedef struct
+{
+    bool       payload_format_indicator;
+    uint32_t   message_expiry_interval;
+    uint16_t   topic_alias;
+    const char *response_topic;
+    const char *correlation_data;
+    uint16_t   correlation_data_len;
+    const char *content_type;
+} esp_mqtt5_publish_property_config_t;
+
+typedef struct
+{
+    uint32_t session_expiry_interval;
+    uint32_t maximum_packet_size;
+    uint16_t receive_maximum;
+    uint16_t topic_alias_maximum;
+    bool     request_resp_info;
+    bool     request_problem_info;
+} esp_mqtt5_connection_property_config_t;
+
+/* Applies to the next publish only, like esp-mqtt */
+esp_err_t esp_mqtt5_client_set_publish_property(esp_mqtt_client_handle_t client,
+                                                const esp_mqtt5_publish_property_config_t *property);
+esp_err_t esp_mqtt5_client_set_connect_property(esp_mqtt_client_handle_t client,
+                                                const esp_mqtt5_connection_property_config_t *connect_property);
+
+#endif /* HOST_MQTT5_CLIENT_H */
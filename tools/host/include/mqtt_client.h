@@ -0,0 +1,124 @@
+/*****************************************************************************
+ *
+ * @file 	mqtt_client.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	host stand-in for the esp-mqtt client API used by bee_mqtt,
+ *          a plain TCP MQTT 3.1.1/5 client in shim/mqtt_client.c
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef HOST_MQTT_CLIENT_H
+#define HOST_MQTT_CLIENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_transport.h"
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+typedef enum
+{
+    MQTT_EVENT_ANY = -1,
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+    MQTT_EVENT_BEFORE_CONNECT,
+    MQTT_EVENT_DELETED,
+} esp_mqtt_event_id_t;
+
+typedef enum
+{
+    MQTT_PROTOCOL_UNDEFINED = 0,
+    MQTT_PROTOCOL_V_3_1,
+    MQTT_PROTOCOL_V_3_1_1,
+    MQTT_PROTOCOL_V_5,
+} esp_mqtt_protocol_ver_t;
+
+typedef struct
+{
+    esp_mqtt_event_id_t      event_id;
+    esp_mqtt_client_handle_t client;
+    char                     *data;
+    int                      data_len;
+    int                      total_data_len;
+    int                      current_data_offset;
+    char                     *topic;
+    int                      topic_len;
+    int                      msg_id;
+    int                      session_present;
+    int                      qos;
+    bool                     retain;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+typedef struct
+{
+    struct
+    {
+        struct
+        {
+            const char *uri;    /* The host client always dials host_mqtt_options.u16port on loopback */
+        } address;
+    } broker;
+    struct
+    {
+        const char *username;
+        const char *client_id;
+        struct
+        {
+            const char *password;
+        } authentication;
+    } credentials;
+    struct
+    {
+        struct
+        {
+            const char *topic;
+            const char *msg;
+            int        msg_len;
+            int        qos;
+            int        retain;
+        } last_will;
+        esp_mqtt_protocol_ver_t protocol_ver;
+        bool                    disable_clean_session;
+        int                     keepalive;
+    } session;
+    struct
+    {
+        int                    reconnect_timeout_ms;
+        int                    timeout_ms;
+        esp_transport_handle_t transport;
+    } network;
+} esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config);
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
+
+/**
+ * @brief Publish like esp-mqtt with CONFIG_MQTT_SKIP_PUBLISH_IF_DISCONNECTED.
+ *
+ * @return Message id, 0 for QoS0, -1 when disconnected or the packet could not be written.
+ */
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain);
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos);
+
+#endif /* HOST_MQTT_CLIENT_H */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,43 @@
+/* Host stand-in for the tinfl part of the ROM miniz (rom/miniz.h), inflating with zlib */
+#ifndef HOST_ROM_MINIZ_H
+#define HOST_ROM_MINIZ_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE                  32768
+
+#define TINFL_FLAG_PARSE_ZLIB_HEADER        1
+#define TINFL_FLAG_HAS_MORE_INPUT           2
+#define TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF 4
+
+typedef enum
+{
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+/* The ROM one is 11 KB of tables, this one a zlib stream told to restart by tinfl_init() */
+typedef struct
+{
+    z_stream strm;
+    int bInit;
+    int bDone;
+} tinfl_decompressor;
+
+#define tinfl_init(r)   do { (r)->bInit = 0; (r)->bDone = 0; } while (0)
+
+/*
+ * pOut_buf_start is the circular dictionary of TINFL_LZ_DICT_SIZE bytes, pOut_buf_next points into it.
+ * Sizes are in/out like the ROM: bytes available in, bytes consumed/produced out.
+ */
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size,
+                              uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size,
+                              const uint32_t decomp_flags);
+
+#endif /* HOST_ROM_MINIZ_H */
@@ -0,0 +1,290 @@
+/*****************************************************************************
+ *
+ * @file 	mqtt_wire.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	MQTT 3.1.1/5 packet building and parsing shared by the host
+ *          client and the broker stand-in
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "mqtt_wire.h"
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/* Bytes taken by the value of a property, -1 for the variable length ones, 0 if unknown */
+static int prop_size(uint8_t u8id)
+{
+    switch (u8id)
+    {
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+            return 1;
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            return 2;
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            return 4;
+        case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+void wire_bytes(wire_buf_t *b, const void *data, size_t len)
+{
+    if (b->bOverflow || (len > b->size - b->len))
+    {
+        b->bOverflow = true;
+        return;
+    }
+    memcpy(&b->pu8[b->len], data, len);
+    b->len += len;
+}
+
+void wire_u8(wire_buf_t *b, uint8_t u8value)
+{
+    wire_bytes(b, &u8value, 1);
+}
+
+void wire_u16(wire_buf_t *b, uint16_t u16value)
+{
+    uint8_t u8be[2] = {u16value >> 8, u16value & 0xFF};
+    wire_bytes(b, u8be, sizeof(u8be));
+}
+
+void wire_u32(wire_buf_t *b, uint32_t u32value)
+{
+    uint8_t u8be[4] = {u32value >> 24, (u32value >> 16) & 0xFF, (u32value >> 8) & 0xFF, u32value & 0xFF};
+    wire_bytes(b, u8be, sizeof(u8be));
+}
+
+void wire_varint(wire_buf_t *b, uint32_t u32value)
+{
+    do
+    {
+        uint8_t u8byte = u32value & 0x7F;
+        u32value >>= 7;
+        wire_u8(b, u8byte | ((u32value != 0) ? 0x80 : 0));
+    } while (u32value != 0);
+}
+
+void wire_str(wire_buf_t *b, const char *cText)
+{
+    size_t len = strlen(cText);
+    wire_u16(b, (uint16_t)len);
+    wire_bytes(b, cText, len);
+}
+
+size_t wire_frame(uint8_t *pu8out, size_t size, uint8_t u8header, const wire_buf_t *body)
+{
+    wire_buf_t out = {.pu8 = pu8out, .size = size};
+    if (body->bOverflow)
+    {
+        return 0;
+    }
+    wire_u8(&out, u8header);
+    wire_varint(&out, (uint32_t)body->len);
+    wire_bytes(&out, body->pu8, body->len);
+    return out.bOverflow ? 0 : out.len;
+}
+
+const uint8_t *wire_rd_bytes(wire_rd_t *r, size_t len)
+{
+    if (r->bBad || (len > r->left))
+    {
+        r->bBad = true;
+        return NULL;
+    }
+    const uint8_t *pu8 = r->pu8;
+    r->pu8 += len;
+    r->left -= len;
+    return pu8;
+}
+
+uint8_t wire_rd_u8(wire_rd_t *r)
+{
+    const uint8_t *pu8 = wire_rd_bytes(r, 1);
+    return (pu8 != NULL) ? pu8[0] : 0;
+}
+
+uint16_t wire_rd_u16(wire_rd_t *r)
+{
+    const uint8_t *pu8 = wire_rd_bytes(r, 2);
+    return (pu8 != NULL) ? (uint16_t)((pu8[0] << 8) | pu8[1]) : 0;
+}
+
+uint32_t wire_rd_u32(wire_rd_t *r)
+{
+    const uint8_t *pu8 = wire_rd_bytes(r, 4);
+    return (pu8 != NULL) ? ((uint32_t)pu8[0] << 24) | ((uint32_t)pu8[1] << 16) | ((uint32_t)pu8[2] << 8) | pu8[3] : 0;
+}
+
+uint32_t wire_rd_varint(wire_rd_t *r)
+{
+    uint32_t u32value = 0;
+    for (uint8_t u8shift = 0; u8shift < 28; u8shift += 7)
+    {
+        uint8_t u8byte = wire_rd_u8(r);
+        u32value |= (uint32_t)(u8byte & 0x7F) << u8shift;
+        if ((u8byte & 0x80) == 0)
+        {
+            return u32value;
+        }
+    }
+    r->bBad = true;
+    return 0;
+}
+
+const uint8_t *wire_rd_str(wire_rd_t *r, uint16_t *pu16len)
+{
+    *pu16len = wire_rd_u16(r);
+    return wire_rd_bytes(r, *pu16len);
+}
+
+void wire_rd_props(wire_rd_t *r, wire_rd_t *props)
+{
+    uint32_t u32len = wire_rd_varint(r);
+    props->pu8 = wire_rd_bytes(r, u32len);
+    props->left = (props->pu8 != NULL) ? u32len : 0;
+    props->bBad = r->bBad;
+}
+
+bool wire_prop_next(wire_rd_t *props, wire_prop_t *prop)
+{
+    if (props->bBad || (props->left == 0))
+    {
+        return false;
+    }
+    memset(prop, 0, sizeof(*prop));
+    prop->u8id = wire_rd_u8(props);
+    switch (prop_size(prop->u8id))
+    {
+        case 1:
+            prop->u32value = wire_rd_u8(props);
+            break;
+        case 2:
+            prop->u32value = wire_rd_u16(props);
+            break;
+        case 4:
+            prop->u32value = wire_rd_u32(props);
+            break;
+        case -1:
+            prop->pu8data = wire_rd_str(props, &prop->u16len);
+            break;
+        default:
+            if (prop->u8id == 0x0B) /* Subscription identifier */
+            {
+                prop->u32value = wire_rd_varint(props);
+                break;
+            }
+            if (prop->u8id == 0x26) /* User property, a string pair */
+            {
+                uint16_t u16len;
+                wire_rd_str(props, &u16len);
+                prop->pu8data = wire_rd_str(props, &prop->u16len);
+                break;
+            }
+            props->bBad = true;
+            break;
+    }
+    return !props->bBad;
+}
+
+int wire_write(int fd, const void *data, size_t len)
+{
+    const uint8_t *pu8 = data;
+    while (len > 0)
+    {
+        ssize_t n = send(fd, pu8, len, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        pu8 += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int wire_read_exact(int fd, void *buf, size_t len)
+{
+    uint8_t *pu8 = buf;
+    while (len > 0)
+    {
+        ssize_t n = recv(fd, pu8, len, 0);
+        if (n == 0)
+        {
+            return -1;
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        pu8 += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int wire_read_header(int fd, uint8_t *pu8header, uint32_t *pu32len, uint32_t *pu32hdr_len, int timeout_ms)
+{
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    int r = poll(&pfd, 1, timeout_ms);
+    if (r == 0)
+    {
+        return 0;
+    }
+    if ((r < 0) && (errno == EINTR))
+    {
+        return 0;
+    }
+    if ((r < 0) || (wire_read_exact(fd, pu8header, 1) != 0))
+    {
+        return -1;
+    }
+
+    *pu32len = 0;
+    *pu32hdr_len = 1;
+    for (uint8_t u8shift = 0; u8shift < 28; u8shift += 7)
+    {
+        uint8_t u8byte;
+        if (wire_read_exact(fd, &u8byte, 1) != 0)
+        {
+            return -1;
+        }
+        (*pu32hdr_len)++;
+        *pu32len |= (uint32_t)(u8byte & 0x7F) << u8shift;
+        if ((u8byte & 0x80) == 0)
+        {
+            return 1;
+        }
+    }
+    return -1;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
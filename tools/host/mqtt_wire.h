@@ -0,0 +1,134 @@
+/*****************************************************************************
+ *
+ * @file 	mqtt_wire.h
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	MQTT 3.1.1/5 packet building and parsing shared by the host
+ *          client and the broker stand-in
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+#ifndef MQTT_WIRE_H
+#define MQTT_WIRE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define WIRE_CONNECT        1
+#define WIRE_CONNACK        2
+#define WIRE_PUBLISH        3
+#define WIRE_PUBACK         4
+#define WIRE_SUBSCRIBE      8
+#define WIRE_SUBACK         9
+#define WIRE_PINGREQ        12
+#define WIRE_PINGRESP       13
+#define WIRE_DISCONNECT     14
+
+#define WIRE_LEVEL_311      4
+#define WIRE_LEVEL_5        5
+
+/* MQTT 5 property identifiers used here */
+#define WIRE_PROP_PAYLOAD_FORMAT    0x01
+#define WIRE_PROP_CONTENT_TYPE      0x03
+#define WIRE_PROP_SESSION_EXPIRY    0x11
+#define WIRE_PROP_ALIAS_MAX         0x22
+#define WIRE_PROP_TOPIC_ALIAS       0x23
+
+#define WIRE_PACKET_MAX     4096    /* Largest packet either side takes */
+
+typedef struct
+{
+    uint8_t *pu8;
+    size_t  size;
+    size_t  len;
+    bool    bOverflow;
+} wire_buf_t;
+
+typedef struct
+{
+    const uint8_t *pu8;
+    size_t        left;
+    bool          bBad;     /* Read past the end */
+} wire_rd_t;
+
+typedef struct
+{
+    uint8_t       u8id;
+    uint32_t      u32value;     /* Integer properties */
+    const uint8_t *pu8data;     /* String and binary properties, not terminated */
+    uint16_t      u16len;
+} wire_prop_t;
+
+void wire_u8(wire_buf_t *b, uint8_t u8value);
+void wire_u16(wire_buf_t *b, uint16_t u16value);
+void wire_u32(wire_buf_t *b, uint32_t u32value);
+void wire_varint(wire_buf_t *b, uint32_t u32value);
+void wire_bytes(wire_buf_t *b, const void *data, size_t len);
+void wire_str(wire_buf_t *b, const char *cText);     /* Length prefixed UTF-8 string */
+
+/**
+ * @brief Put the fixed header in front of a packet body.
+ *
+ * @return Length of the whole packet in pu8out, 0 if it does not fit.
+ */
+size_t wire_frame(uint8_t *pu8out, size_t size, uint8_t u8header, const wire_buf_t *body);
+
+uint8_t wire_rd_u8(wire_rd_t *r);
+uint16_t wire_rd_u16(wire_rd_t *r);
+uint32_t wire_rd_u32(wire_rd_t *r);
+uint32_t wire_rd_varint(wire_rd_t *r);
+const uint8_t *wire_rd_bytes(wire_rd_t *r, size_t len);
+
+/**
+ * @brief Read a length prefixed string.
+ *
+ * @return Start of the string in the packet, not terminated, NULL if the packet is short.
+ */
+const uint8_t *wire_rd_str(wire_rd_t *r, uint16_t *pu16len);
+
+/**
+ * @brief Open the MQTT 5 property block at the read position.
+ *
+ * @param props Reader limited to the properties, the packet reader moves past them.
+ */
+void wire_rd_props(wire_rd_t *r, wire_rd_t *props);
+
+/**
+ * @brief Next property of a block opened with wire_rd_props().
+ *
+ * @return false at the end of the block or on an unknown identifier.
+ */
+bool wire_prop_next(wire_rd_t *props, wire_prop_t *prop);
+
+/**
+ * @brief Write the whole buffer to a socket.
+ *
+ * @return 0, -1 if the socket failed.
+ */
+int wire_write(int fd, const void *data, size_t len);
+
+/**
+ * @brief Wait for the fixed header of the next packet.
+ *
+ * @param pu8header   First byte of the packet.
+ * @param pu32len     Remaining length.
+ * @param pu32hdr_len Bytes taken by the fixed header.
+ * @param timeout_ms  How long to wait for the first byte.
+ * @return 1 with a header, 0 if nothing came in time, -1 if the socket closed or sent garbage.
+ */
+int wire_read_header(int fd, uint8_t *pu8header, uint32_t *pu32len, uint32_t *pu32hdr_len, int timeout_ms);
+
+/**
+ * @brief Read exactly len bytes, the rest of a packet.
+ *
+ * @return 0, -1 if the socket closed.
+ */
+int wire_read_exact(int fd, void *buf, size_t len);
+
+#endif /* MQTT_WIRE_H */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,1025 @@
+/*****************************************************************************
+ *
+ * @file 	ota_bench.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	host bench of bee_ota against the loopback HTTP server stand-in
+ *
+ *          Runs start_ota() on a plain image and on the same image in an
+ *          OTA_PACK_MAGIC container, reports the bytes downloaded and the
+ *          time of each at loopback speed and on a throttled link, then
+ *          checks that a corrupted or truncated container never boots.
+ *          Resumes updates cut by dropped connections, by the download
+ *          budget of upload wakes and by a power loss, and reports what
+ *          resuming costs in requests, bytes and NVS writes.
+ *          Downloads an update a manifest queued with ota_schedule() in the
+ *          following wakes and refuses one that is not the image announced.
+ *          Updates from a previous release, made from the image with a
+ *          few KB changed and the code after them moved, with a delta and
+ *          checks that a delta for another base is refused.
+ *          Updates again once running from ota_1, into ota_0, and checks
+ *          that a table with a single OTA slot never writes the running one.
+ *          Sweeps the receive buffer and the erase unit of ota_set_tuning()
+ *          on a flash that takes the time the chip does, and reports the
+ *          throughput, the CPU load and where the time goes.
+ *          Exits non-zero if a check fails.
+ *
+ *          Usage: ota_bench [-s size_kb] [-b rate_kBps] [-f image] [-p container] [-d delta] [-w] [-v]
+ *            -f  image to serve, wrapped into a test image unless it is one (see esp_ota_ops.h)
+ *            -p  container made from that image by tools/ota_pack.py, instead of packing here
+ *            -d  delta from base.bin to that image made by tools/ota_pack.py, instead of here
+ *            -w  write the image, the previous release and the containers made here to
+ *                fw.bin, base.bin, fw.bota and fw.delta
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <zlib.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "mbedtls/sha256.h"
+
+#include "bee_ota.h"
+#include "bee_mqtt.h"
+#include "bee_tls.h"
+#include "bee_nvs.h"
+#include "httpd.h"
+#include "host_shim.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define BENCH_IMAGE_KB      1024        /* Size of the firmware today */
+#define BENCH_RATE_KBPS     200         /* Throttled run, a weak Wi-Fi link through TLS */
+#define BENCH_CHUNK         0x8000      /* tools/ota_pack.py default */
+#define BENCH_CUT           150000      /* Body bytes a dropped connection lets through */
+#define BENCH_WAKE_MS       1000        /* Budget of the throttled wakes */
+#define BENCH_POWER_LOSS    400000      /* Slot offset the power goes at */
+#define BENCH_WAKES_MAX     50
+#define BENCH_MOVE          64          /* Bytes of code added to the previous release */
+#define BENCH_CHANGED       2048        /* Bytes rewritten */
+#define DELTA_MATCH         16          /* Shortest exact match a copy starts from, as tools/ota_pack.py */
+#define DELTA_SLACK         32          /* Mismatches over matches a copy extends through */
+#define DELTA_HASH_BITS     20
+#define TUNE_IMAGE_KB       256         /* Swept image, the sector erases alone take 3 s of it */
+#define TUNE_SECTOR_ERASE_US 45000      /* Typical of the 4 MB SPI NOR flash of ESP32-C3 modules */
+#define TUNE_BLOCK_ERASE_US 150000
+#define TUNE_PAGE_PROGRAM_US 400
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+typedef struct
+{
+    char cStatus[16];
+    ota_report_t report;
+} ota_result_t;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static uint32_t u32checks = 0;
+static uint32_t u32failed = 0;
+static uint16_t u16port = 0;
+static jmp_buf restart;
+static ota_result_t result;
+static uint8_t u8nvs[512];                  /* The OTA checkpoint entry */
+static size_t nvs_len = 0;
+static uint32_t u32nvs_saves = 0;
+static uint32_t u32progress_msgs = 0;
+static uint32_t u32power_at = 0;
+static char cExpected_host[64];           /* Name the server certificate must carry */
+
+/****************************************************************************/
+/***        Firmware stand-ins                                            ***/
+/****************************************************************************/
+
+void pub_ota_status(char *values)
+{
+}
+
+void pub_ota_progress(uint8_t u8percent)
+{
+    u32progress_msgs++;
+}
+
+/* The last thing start_ota() does before it restarts */
+void pub_ota_report(const char *cStatus, const ota_report_t *report)
+{
+    snprintf(result.cStatus, sizeof(result.cStatus), "%s", cStatus);
+    result.report = *report;
+    longjmp(restart, 1);
+}
+
+const char *tls_ca_pem(void)
+{
+    return NULL;
+}
+
+void tls_https_expect(const char *cHost)
+{
+    snprintf(cExpected_host, sizeof(cExpected_host), "%s", cHost);
+}
+
+esp_err_t tls_https_attach(void *conf)
+{
+    return ESP_OK;
+}
+
+bool load_ota_checkpoint(void *pData, size_t len)
+{
+    if (nvs_len != len)
+    {
+        return false;
+    }
+    memcpy(pData, u8nvs, len);
+    return true;
+}
+
+void save_ota_checkpoint(const void *pData, size_t len)
+{
+    nvs_len = (len <= sizeof(u8nvs)) ? len : 0;
+    memcpy(u8nvs, pData, nvs_len);
+    u32nvs_saves++;
+}
+
+void erase_ota_checkpoint(void)
+{
+    nvs_len = 0;
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void bench_restart(void)
+{
+    longjmp(restart, 1);
+}
+
+/* The power goes once the slot is written past u32power_at */
+static void power_loss_hook(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    if ((u32power_at > 0) && (partition == esp_ota_get_next_update_partition(NULL)) && (offset + size >= u32power_at))
+    {
+        u32power_at = 0;
+        host_http_power_loss();
+        host_rtc_power_loss();
+        longjmp(restart, 1);
+    }
+}
+
+static void check(bool bOk, const char *cWhat)
+{
+    u32checks++;
+    if (!bOk)
+    {
+        u32failed++;
+    }
+    printf("  [%s] %s\n", bOk ? "PASS" : "FAIL", cWhat);
+}
+
+static void put_u32(uint8_t *pu8, uint32_t u32)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        pu8[i] = (uint8_t)(u32 >> (8 * i));
+    }
+}
+
+/* Magic, length and the appended SHA-256 of a test image around whatever is in between */
+static void seal_image(uint8_t *pu8Image, uint32_t u32len)
+{
+    pu8Image[0] = HOST_IMAGE_MAGIC;
+    put_u32(&pu8Image[1], u32len);
+    mbedtls_sha256(pu8Image, u32len - 32, &pu8Image[u32len - 32], 0);
+}
+
+/*
+ * Something that compresses like an app image: code words drawn from a skewed vocabulary with random
+ * operands, a rodata share of repeated strings and zero padding between sections.
+ */
+static uint8_t *make_image(uint32_t u32len)
+{
+    static const char *cWords[] = {
+        "MQTT", "Bee.", "sensor", "error", "failed", "%s:%d ", "connect", "wifi", "OTA ", "config", "nvs ",
+        "esp_", "timeout", "publish", "alarm", "history", "partition", "invalid", "\n\0", "TAG",
+    };
+    uint32_t u32vocab[1024];
+    uint32_t u32rand = 12345;
+    uint8_t *pu8Image = malloc(u32len);
+
+    for (uint32_t i = 0; i < 1024; i++)
+    {
+        u32rand = u32rand * 1103515245 + 12345;
+        u32vocab[i] = u32rand;
+    }
+    uint32_t i = 0;
+    while (i + 4 <= u32len - 32)
+    {
+        u32rand = u32rand * 1103515245 + 12345;
+        uint32_t r = u32rand >> 8;
+        if ((i / 65536) % 8 == 7) /* rodata */
+        {
+            const char *cWord = cWords[r % (sizeof(cWords) / sizeof(cWords[0]))];
+            size_t len = strlen(cWord) + 1;
+            len = (i + len <= u32len - 32) ? len : u32len - 32 - i;
+            memcpy(&pu8Image[i], cWord, len);
+            i += len;
+        }
+        else if (r % 64 == 0) /* Alignment padding */
+        {
+            uint32_t u32pad = 4 * (1 + (r >> 6) % 8);
+            u32pad = (i + u32pad <= u32len - 32) ? u32pad : u32len - 32 - i;
+            memset(&pu8Image[i], 0, u32pad);
+            i += u32pad;
+        }
+        else
+        {
+            /* Products skew towards the start of the vocabulary, the low byte is an operand */
+            uint32_t u32word = u32vocab[((r & 0x3FF) * ((r >> 10) & 0x3FF)) >> 10];
+            if (r % 4 == 0)
+            {
+                u32word ^= (r >> 20) & 0xFF;
+            }
+            memcpy(&pu8Image[i], &u32word, 4);
+            i += 4;
+        }
+    }
+    memset(&pu8Image[i], 0, u32len - i);
+    seal_image(pu8Image, u32len);
+    return pu8Image;
+}
+
+/* The container tools/ota_pack.py writes, see bee_ota.h */
+static uint8_t *pack_image(const uint8_t *pu8Image, uint32_t u32len, uint32_t u32chunk, uint32_t *pu32packed)
+{
+    size_t size = sizeof(ota_pack_header_t) + compressBound(u32len) + 4 * (u32len / u32chunk + 1) + 64;
+    uint8_t *pu8Out = malloc(size);
+    ota_pack_header_t header = {
+        .cMagic = OTA_PACK_MAGIC,
+        .u8version = OTA_PACK_VERSION,
+        .u8kind = 0,
+        .u16reserved = 0,
+        .u32image_size = u32len,
+        .u32chunk_size = u32chunk,
+    };
+
+    mbedtls_sha256(pu8Image, u32len, header.u8sha256, 0);
+    memcpy(pu8Out, &header, sizeof(header));
+    size_t used = sizeof(header);
+    for (uint32_t u32off = 0; u32off < u32len; u32off += u32chunk)
+    {
+        uLongf comp_len = size - used - 4;
+        uint32_t u32raw = (u32len - u32off < u32chunk) ? u32len - u32off : u32chunk;
+        compress2(&pu8Out[used + 4], &comp_len, &pu8Image[u32off], u32raw, 9);
+        put_u32(&pu8Out[used], (uint32_t)comp_len);
+        used += 4 + comp_len;
+    }
+    *pu32packed = (uint32_t)used;
+    return pu8Out;
+}
+
+/*
+ * The previous release of an image: BENCH_CHANGED bytes were different, the BENCH_MOVE bytes added at a
+ * third were not there and every address past them was that much lower.
+ */
+static uint8_t *make_base(const uint8_t *pu8Image, uint32_t u32len, uint32_t *pu32base)
+{
+    uint32_t u32at = u32len / 3;
+    uint32_t u32base = u32len - BENCH_MOVE;
+    uint8_t *pu8Base = malloc(u32base);
+
+    memcpy(pu8Base, pu8Image, u32at);
+    memcpy(&pu8Base[u32at], &pu8Image[u32at + BENCH_MOVE], u32base - u32at);
+    for (uint32_t i = u32at; i + 4 <= u32base - 32; i += 256) /* One relocated address per 256 bytes */
+    {
+        uint32_t u32word;
+        memcpy(&u32word, &pu8Base[i], 4);
+        u32word -= BENCH_MOVE;
+        memcpy(&pu8Base[i], &u32word, 4);
+    }
+    uint32_t u32rand = 777;
+    for (uint32_t i = 0; i < BENCH_CHANGED; i++)
+    {
+        u32rand = u32rand * 1103515245 + 12345;
+        pu8Base[u32base * 2 / 3 + i] = (uint8_t)(u32rand >> 16);
+    }
+    seal_image(pu8Base, u32base);
+    *pu32base = u32base;
+    return pu8Base;
+}
+
+static uint32_t delta_hash(const uint8_t *pu8)
+{
+    uint64_t u64a, u64b;
+    memcpy(&u64a, pu8, 8);
+    memcpy(&u64b, &pu8[8], 8);
+    return (uint32_t)(((u64a * 0x9E3779B97F4A7C15ULL) ^ u64b) * 0xC2B2AE3D27D4EB4FULL >> (64 - DELTA_HASH_BITS));
+}
+
+static size_t delta_op(uint8_t *pu8Out, uint32_t u32copy, uint32_t u32src, uint32_t u32literal)
+{
+    ota_patch_op_t op = {.u32copy_len = u32copy, .u32src = u32src, .u32literal_len = u32literal};
+    memcpy(pu8Out, &op, sizeof(op));
+    return sizeof(op);
+}
+
+/*
+ * The delta tools/ota_pack.py makes, the same greedy matcher: the first DELTA_MATCH bytes found in the
+ * base, or the ones at the offset of the last copy, start a copy that extends while matches outnumber
+ * mismatches, the rest are literals.
+ */
+static uint8_t *make_delta(const uint8_t *pu8Base, uint32_t u32base, const uint8_t *pu8Image, uint32_t u32len,
+                           uint32_t u32chunk, uint32_t *pu32delta)
+{
+    int32_t *pi32index = malloc(sizeof(int32_t) << DELTA_HASH_BITS);
+    uint8_t *pu8Raw = malloc(3 * u32chunk + 64);    /* Records of one chunk, worst case all literals */
+    size_t size = sizeof(ota_pack_header_t) + sizeof(ota_delta_header_t) + compressBound(3 * u32chunk + 64) * (u32len / u32chunk + 1);
+    uint8_t *pu8Out = malloc(size);
+    ota_pack_header_t header = {
+        .cMagic = OTA_PACK_MAGIC,
+        .u8version = OTA_PACK_VERSION,
+        .u8kind = OTA_PACK_KIND_DELTA,
+        .u32image_size = u32len,
+        .u32chunk_size = u32chunk,
+    };
+    ota_delta_header_t delta = {.u32base_size = u32base};
+
+    memset(pi32index, 0xFF, sizeof(int32_t) << DELTA_HASH_BITS);
+    for (uint32_t j = 0; j + DELTA_MATCH <= u32base; j++)
+    {
+        uint32_t h = delta_hash(&pu8Base[j]);
+        pi32index[h] = (pi32index[h] < 0) ? (int32_t)j : pi32index[h];
+    }
+    mbedtls_sha256(pu8Image, u32len, header.u8sha256, 0);
+    mbedtls_sha256(pu8Base, u32base, delta.u8base_sha256, 0);
+    memcpy(pu8Out, &header, sizeof(header));
+    memcpy(&pu8Out[sizeof(header)], &delta, sizeof(delta));
+    size_t used = sizeof(header) + sizeof(delta);
+
+    int64_t i64shift = 0; /* Base offset minus image offset of the last copy */
+    for (uint32_t u32c0 = 0; u32c0 < u32len; u32c0 += u32chunk)
+    {
+        uint32_t u32c1 = (u32len - u32c0 < u32chunk) ? u32len : u32c0 + u32chunk;
+        uint32_t u32pos = u32c0;
+        uint32_t u32literal = u32c0;
+        size_t raw = 0;
+        while (u32pos < u32c1)
+        {
+            int64_t i64src = -1;
+            if (u32pos + DELTA_MATCH <= u32c1)
+            {
+                int32_t i32cand = pi32index[delta_hash(&pu8Image[u32pos])];
+                int64_t i64same = (int64_t)u32pos + i64shift;
+                if ((i32cand >= 0) && (memcmp(&pu8Base[i32cand], &pu8Image[u32pos], DELTA_MATCH) == 0))
+                {
+                    i64src = i32cand;
+                }
+                else if ((i64same >= 0) && (i64same + DELTA_MATCH <= u32base) &&
+                         (memcmp(&pu8Base[i64same], &pu8Image[u32pos], DELTA_MATCH) == 0))
+                {
+                    i64src = i64same;
+                }
+            }
+            if (i64src < 0)
+            {
+                u32pos++;
+                continue;
+            }
+
+            int32_t i32score = 0, i32best = 0;
+            uint32_t u32best = 0;
+            for (uint32_t n = 0; (u32pos + n < u32c1) && (i64src + n < u32base) && (i32score > i32best - DELTA_SLACK); n++)
+            {
+                i32score += (pu8Base[i64src + n] == pu8Image[u32pos + n]) ? 1 : -1;
+                if (i32score > i32best)
+                {
+                    i32best = i32score;
+                    u32best = n + 1;
+                }
+            }
+            if (u32pos > u32literal)
+            {
+                raw += delta_op(&pu8Raw[raw], 0, 0, u32pos - u32literal);
+                memcpy(&pu8Raw[raw], &pu8Image[u32literal], u32pos - u32literal);
+                raw += u32pos - u32literal;
+            }
+            raw += delta_op(&pu8Raw[raw], u32best, (uint32_t)i64src, 0);
+            for (uint32_t n = 0; n < u32best; n++)
+            {
+                pu8Raw[raw++] = pu8Image[u32pos + n] - pu8Base[i64src + n];
+            }
+            i64shift = i64src - u32pos;
+            u32pos += u32best;
+            u32literal = u32pos;
+        }
+        if (u32c1 > u32literal)
+        {
+            raw += delta_op(&pu8Raw[raw], 0, 0, u32c1 - u32literal);
+            memcpy(&pu8Raw[raw], &pu8Image[u32literal], u32c1 - u32literal);
+            raw += u32c1 - u32literal;
+        }
+        uLongf comp_len = size - used - 4;
+        compress2(&pu8Out[used + 4], &comp_len, pu8Raw, raw, 9);
+        put_u32(&pu8Out[used], (uint32_t)comp_len);
+        used += 4 + comp_len;
+    }
+    free(pi32index);
+    free(pu8Raw);
+    *pu32delta = (uint32_t)used;
+    return pu8Out;
+}
+
+/* The image the device runs, the one a delta applies to */
+static void install_base(const uint8_t *pu8Base, uint32_t u32base)
+{
+    const esp_partition_t *partition = esp_ota_get_running_partition();
+    esp_partition_erase_range(partition, 0, partition->size);
+    esp_partition_write(partition, 0, pu8Base, u32base);
+}
+
+static uint8_t *read_file(const char *cPath, uint32_t u32extra, uint32_t *pu32len)
+{
+    FILE *f = fopen(cPath, "rb");
+    if (f == NULL)
+    {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *pu8 = malloc(len + u32extra);
+    if ((pu8 != NULL) && (fread(pu8, 1, len, f) != (size_t)len))
+    {
+        free(pu8);
+        pu8 = NULL;
+    }
+    fclose(f);
+    *pu32len = (uint32_t)len;
+    return pu8;
+}
+
+static void write_file(const char *cPath, const uint8_t *pu8, uint32_t u32len)
+{
+    FILE *f = fopen(cPath, "wb");
+    if ((f == NULL) || (fwrite(pu8, 1, u32len, f) != u32len))
+    {
+        fprintf(stderr, "Cannot write %s\n", cPath);
+    }
+    if (f != NULL)
+    {
+        fclose(f);
+    }
+}
+
+static void set_faults(uint32_t u32rate_Bps, uint32_t u32cut_after, bool bNo_range)
+{
+    httpd_faults_t faults = {.u32rate_Bps = u32rate_Bps, .u32cut_after = u32cut_after, .bNo_range = bNo_range};
+    httpd_set_faults(&faults);
+}
+
+/* start_ota() from a command, the restart it ends with comes back here */
+static void run_ota(const char *cPath)
+{
+    char cUrl[96];
+
+    host_ota_reset();
+    memset(&result, 0, sizeof(result));
+    snprintf(cUrl, sizeof(cUrl), "http://127.0.0.1:%u%s", u16port, cPath);
+    if (setjmp(restart) == 0)
+    {
+        start_ota(cUrl);
+    }
+}
+
+/* An upload wake with an update pending, true once the final report is out */
+static bool wake(uint32_t u32budget_ms)
+{
+    memset(&result, 0, sizeof(result));
+    if (setjmp(restart) == 0)
+    {
+        ota_resume(u32budget_ms);
+    }
+    return result.cStatus[0] != '\0';
+}
+
+static uint32_t wake_until_done(uint32_t u32budget_ms)
+{
+    uint32_t u32wakes = 0;
+    while ((u32wakes < BENCH_WAKES_MAX) && ota_pending())
+    {
+        u32wakes++;
+        if (wake(u32budget_ms))
+        {
+            break;
+        }
+    }
+    return u32wakes;
+}
+
+static bool partition_holds(const esp_partition_t *partition, const uint8_t *pu8Image, uint32_t u32len)
+{
+    uint8_t *pu8Slot = malloc(u32len);
+    bool bSame = (esp_partition_read(partition, 0, pu8Slot, u32len) == ESP_OK) && (memcmp(pu8Slot, pu8Image, u32len) == 0);
+    free(pu8Slot);
+    return bSame;
+}
+
+static bool slot_holds(const uint8_t *pu8Image, uint32_t u32len)
+{
+    return partition_holds(esp_ota_get_next_update_partition(NULL), pu8Image, u32len);
+}
+
+static bool booted_update(void)
+{
+    return esp_ota_get_boot_partition() == esp_ota_get_next_update_partition(NULL);
+}
+
+static void bench_paths(const uint8_t *pu8Image, uint32_t u32len, uint32_t u32packed, uint32_t u32rate_kBps)
+{
+    static const char *cPaths[] = {"/fw.bin", "/fw.bota"};
+    static const char *cNames[] = {"plain", "compressed"};
+    ota_report_t reports[2][2];
+    char cWhat[96];
+
+    printf("\nDownload and write, image %lu bytes, container %lu bytes (%.1f%%)\n", (unsigned long)u32len,
+           (unsigned long)u32packed, 100.0 * u32packed / u32len);
+    for (int p = 0; p < 2; p++)
+    {
+        for (int r = 0; r < 2; r++)
+        {
+            set_faults((r == 0) ? 0 : u32rate_kBps * 1000, 0, false);
+            run_ota(cPaths[p]);
+            reports[p][r] = result.report;
+            snprintf(cWhat, sizeof(cWhat), "%s image at %s boots and matches", cNames[p], (r == 0) ? "loopback" : "throttled");
+            check((strcmp(result.cStatus, "Succeed") == 0) && booted_update() && slot_holds(pu8Image, u32len) &&
+                  (result.report.u32image_bytes == u32len), cWhat);
+        }
+    }
+    check(reports[0][0].u32download_bytes == u32len, "plain download is the image");
+    check(reports[1][0].u32download_bytes == u32packed, "compressed download is the container");
+    check(strcmp(cExpected_host, "127.0.0.1") == 0, "server certificate must name the URL host");
+
+    printf("  %-11s %12s %14s %14s\n", "path", "download B", "loopback ms", "throttled ms");
+    for (int p = 0; p < 2; p++)
+    {
+        printf("  %-11s %12lu %14lu %14lu\n", cNames[p], (unsigned long)reports[p][0].u32download_bytes,
+               (unsigned long)reports[p][0].u32elapsed_ms, (unsigned long)reports[p][1].u32elapsed_ms);
+    }
+    printf("  throttled to %lu kB/s, the compressed path takes %.1f%% of the plain time\n",
+           (unsigned long)u32rate_kBps, 100.0 * reports[1][1].u32elapsed_ms / (reports[0][1].u32elapsed_ms + 1));
+}
+
+static void bench_faults(const uint8_t *pu8Packed, uint32_t u32packed)
+{
+    uint8_t *pu8Bad = malloc(u32packed);
+
+    printf("\nBroken containers\n");
+    set_faults(0, 0, false);
+    memcpy(pu8Bad, pu8Packed, u32packed);
+    pu8Bad[offsetof(ota_pack_header_t, u8sha256)] ^= 0x01;
+    httpd_add_file("/bad_sha.bota", pu8Bad, u32packed);
+    run_ota("/bad_sha.bota");
+    check((strcmp(result.cStatus, "Failed") == 0) && !booted_update(), "wrong SHA-256 in the header does not boot");
+
+    httpd_add_file("/short.bota", pu8Packed, u32packed / 2);
+    run_ota("/short.bota");
+    check((strcmp(result.cStatus, "Failed") == 0) && !booted_update(), "truncated container does not boot");
+
+    uint8_t *pu8Flip = malloc(u32packed);
+    memcpy(pu8Flip, pu8Packed, u32packed);
+    pu8Flip[u32packed / 2] ^= 0x40;
+    httpd_add_file("/flip.bota", pu8Flip, u32packed);
+    run_ota("/flip.bota");
+    check((strcmp(result.cStatus, "Failed") == 0) && !booted_update(), "corrupted chunk does not boot");
+
+    run_ota("/missing.bin");
+    check((strcmp(result.cStatus, "Failed") == 0) && (result.report.u32download_bytes == 0), "404 is refused");
+    check(!ota_pending(), "nothing left pending");
+}
+
+/* What resuming cost: requests, bytes over the file size and NVS writes */
+static void resume_report(const char *cWhat, uint32_t u32file, uint32_t u32wakes, uint32_t u32slack)
+{
+    httpd_stats_t stats;
+    char cCheck[128];
+
+    httpd_get_stats(&stats);
+    printf("  %-30s %3lu wakes %3lu requests %8lu bytes over %3lu NVS writes %2lu progress\n", cWhat,
+           (unsigned long)u32wakes, (unsigned long)stats.u32requests,
+           (unsigned long)(stats.u32body_bytes - u32file), (unsigned long)u32nvs_saves, (unsigned long)u32progress_msgs);
+    snprintf(cCheck, sizeof(cCheck), "%s: boots and matches", cWhat);
+    check((strcmp(result.cStatus, "Succeed") == 0) && booted_update() && !ota_pending(), cCheck);
+    snprintf(cCheck, sizeof(cCheck), "%s: at most %lu bytes downloaded again per request", cWhat, (unsigned long)u32slack);
+    check(stats.u32body_bytes <= u32file + stats.u32requests * u32slack, cCheck);
+    snprintf(cCheck, sizeof(cCheck), "%s: NVS and progress writes bounded", cWhat);
+    check((u32nvs_saves <= result.report.u32image_bytes / OTA_NVS_EVERY + stats.u32requests + 1) &&
+          (u32progress_msgs <= 100 / OTA_PROGRESS_STEP), cCheck);
+}
+
+static void resume_start(void)
+{
+    httpd_clear_stats();
+    host_ota_reset();
+    u32nvs_saves = 0;
+    u32progress_msgs = 0;
+}
+
+static void bench_resume(const uint8_t *pu8Image, uint32_t u32len, uint32_t u32packed, uint32_t u32rate_kBps)
+{
+    static const char *cPaths[] = {"/fw.bin", "/fw.bota"};
+    static const char *cNames[] = {"plain, cut every 150 KB", "compressed, cut every 150 KB"};
+    uint32_t u32sizes[] = {u32len, u32packed};
+    uint32_t u32slack[] = {OTA_SECTOR_SIZE, BENCH_CHUNK};
+
+    printf("\nResumed downloads\n");
+    host_restart_hook = bench_restart;
+    for (int p = 0; p < 2; p++)
+    {
+        resume_start();
+        set_faults(0, BENCH_CUT, false);
+        run_ota(cPaths[p]);
+        check((result.cStatus[0] == '\0') && ota_pending(), "start_ota() leaves a cut update pending");
+        uint32_t u32wakes = wake_until_done(OTA_WAKE_BUDGET_MS);
+        check(slot_holds(pu8Image, u32len), "slot holds the image");
+        resume_report(cNames[p], u32sizes[p], u32wakes, u32slack[p]);
+    }
+
+    /* Every wake stops at its budget, the next one picks up */
+    resume_start();
+    set_faults(u32rate_kBps * 1000, BENCH_CUT, false);
+    run_ota("/fw.bin");
+    set_faults(u32rate_kBps * 1000, 0, false);
+    uint32_t u32wakes = wake_until_done(BENCH_WAKE_MS);
+    resume_report("plain, 1 s wakes, throttled", u32len, u32wakes, OTA_SECTOR_SIZE);
+    check(u32wakes >= (u32len - 3 * BENCH_CUT) / (u32rate_kBps * BENCH_WAKE_MS), "one budget per wake");
+
+    /* RTC memory is lost, the NVS checkpoint is behind the slot. Throttled, or the server is a socket
+     * buffer ahead of what the device received when the power goes */
+    resume_start();
+    set_faults(u32rate_kBps * 5000, 0, false);
+    u32power_at = BENCH_POWER_LOSS;
+    host_flash_write_hook = power_loss_hook;
+    run_ota("/fw.bota");
+    host_flash_write_hook = NULL;
+    check((result.cStatus[0] == '\0') && ota_pending(), "power loss leaves the update pending from NVS");
+    set_faults(0, 0, false);
+    u32wakes = wake_until_done(OTA_WAKE_BUDGET_MS);
+    resume_report("compressed, power loss", u32packed, u32wakes, OTA_NVS_EVERY + BENCH_CHUNK);
+
+    /* The server ignores Range and sends everything again */
+    resume_start();
+    set_faults(0, BENCH_CUT, false);
+    run_ota("/fw.bin");
+    set_faults(0, 0, true);
+    u32wakes = wake_until_done(OTA_WAKE_BUDGET_MS);
+    resume_report("plain, no range support", u32len, u32wakes, u32len);
+    host_restart_hook = NULL;
+}
+
+/* Queued by a manifest, downloaded by the next wakes */
+static void bench_schedule(const uint8_t *pu8Image, uint32_t u32len)
+{
+    httpd_stats_t stats;
+    uint8_t u8sha256[32];
+    char cUrl[96];
+
+    printf("\nScheduled by a manifest\n");
+    host_restart_hook = bench_restart;
+    mbedtls_sha256(pu8Image, u32len, u8sha256, 0);
+    snprintf(cUrl, sizeof(cUrl), "http://127.0.0.1:%u/fw.bota", u16port);
+    resume_start();
+    set_faults(0, 0, false);
+    ota_schedule(cUrl, u8sha256, u32len);
+    httpd_get_stats(&stats);
+    check(ota_pending() && (stats.u32requests == 0), "queued without a download");
+    uint32_t u32wakes = wake_until_done(OTA_WAKE_BUDGET_MS);
+    check((u32wakes == 1) && (strcmp(result.cStatus, "Succeed") == 0) && booted_update() &&
+          slot_holds(pu8Image, u32len), "next wake downloads and boots it");
+
+    u8sha256[0] ^= 0x01;
+    snprintf(cUrl, sizeof(cUrl), "http://127.0.0.1:%u/fw.bin", u16port);
+    resume_start();
+    ota_schedule(cUrl, u8sha256, u32len);
+    wake_until_done(OTA_WAKE_BUDGET_MS);
+    check((strcmp(result.cStatus, "Failed") == 0) && !booted_update() && !ota_pending(),
+          "image other than the announced one does not boot");
+    host_restart_hook = NULL;
+}
+
+static void bench_delta(const uint8_t *pu8Image, uint32_t u32len, const uint8_t *pu8Base, uint32_t u32base,
+                        uint32_t u32delta, uint32_t u32packed, uint32_t u32rate_kBps)
+{
+    ota_report_t reports[2];
+    char cWhat[96];
+
+    printf("\nDelta from the previous release (%u bytes moved, %u changed), %lu bytes, %.2f%% of the image, "
+           "%.2f%% of the container\n", BENCH_MOVE, BENCH_CHANGED, (unsigned long)u32delta,
+           100.0 * u32delta / u32len, 100.0 * u32delta / u32packed);
+    install_base(pu8Base, u32base);
+    for (int r = 0; r < 2; r++)
+    {
+        set_faults((r == 0) ? 0 : u32rate_kBps * 1000, 0, false);
+        run_ota("/fw.delta");
+        reports[r] = result.report;
+        snprintf(cWhat, sizeof(cWhat), "delta at %s boots and matches", (r == 0) ? "loopback" : "throttled");
+        check((strcmp(result.cStatus, "Succeed") == 0) && booted_update() && slot_holds(pu8Image, u32len) &&
+              (result.report.u32download_bytes == u32delta), cWhat);
+    }
+    printf("  %-11s %12s %14s %14s\n", "path", "download B", "loopback ms", "throttled ms");
+    printf("  %-11s %12lu %14lu %14lu\n", "delta", (unsigned long)reports[0].u32download_bytes,
+           (unsigned long)reports[0].u32elapsed_ms, (unsigned long)reports[1].u32elapsed_ms);
+
+    host_restart_hook = bench_restart;
+    resume_start();
+    set_faults(0, u32delta / 3, false);
+    run_ota("/fw.delta");
+    uint32_t u32wakes = wake_until_done(OTA_WAKE_BUDGET_MS);
+    check(slot_holds(pu8Image, u32len), "slot holds the image");
+    resume_report("delta, cut in three", u32delta, u32wakes, u32delta / 2);
+    host_restart_hook = NULL;
+
+    /* Running something else than the base */
+    set_faults(0, 0, false);
+    install_base(pu8Image, u32len);
+    run_ota("/fw.delta");
+    check((strcmp(result.cStatus, "Failed") == 0) && !booted_update() && (result.report.u32image_bytes == 0),
+          "delta for another base writes nothing");
+    check(!ota_pending(), "nothing left pending");
+    install_base(pu8Base, u32base);
+}
+
+/* The second update goes back to ota_0, and never into the partition running */
+static void bench_slots(const uint8_t *pu8Image, uint32_t u32len, const uint8_t *pu8Base, uint32_t u32base)
+{
+    const esp_partition_t *ota_0 = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+    const esp_partition_t *ota_1 = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, NULL);
+
+    printf("\nOTA slots\n");
+    set_faults(0, 0, false);
+    run_ota("/fw.bin");
+    check((strcmp(result.cStatus, "Succeed") == 0) && (esp_ota_get_boot_partition() == ota_1),
+          "update from ota_0 boots ota_1");
+
+    /* Running the update, the previous release is the base of a delta and stays where it is */
+    host_ota_boot();
+    install_base(pu8Base, u32base);
+    run_ota("/fw.delta");
+    check((strcmp(result.cStatus, "Succeed") == 0) && (esp_ota_get_boot_partition() == ota_0) &&
+          partition_holds(ota_0, pu8Image, u32len) && partition_holds(ota_1, pu8Base, u32base),
+          "delta from ota_1 boots ota_0, ota_1 untouched");
+    host_ota_boot();
+
+    /* A table with ota_0 only: the next update partition is the running one */
+    install_base(pu8Base, u32base);
+    host_ota_slots = 1;
+    run_ota("/fw.bin");
+    check((strcmp(result.cStatus, "Failed") == 0) && (result.report.u32download_bytes == 0) &&
+          partition_holds(ota_0, pu8Base, u32base) && !ota_pending(), "single OTA slot never written while running");
+    host_ota_slots = 2;
+
+    /* A device still on the factory + ota_0 table, updated once so running ota_0: the factory slot takes the next */
+    host_partition_legacy = true;
+    const esp_partition_t *factory = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_FACTORY, NULL);
+    run_ota("/fw.bin");
+    bool bFactory = (strcmp(result.cStatus, "Succeed") == 0) && (esp_ota_get_boot_partition() == factory) &&
+                    partition_holds(factory, pu8Image, u32len) && partition_holds(ota_0, pu8Base, u32base);
+    host_ota_boot();
+    run_ota("/fw.bin");
+    check(bFactory && (strcmp(result.cStatus, "Succeed") == 0) && (esp_ota_get_boot_partition() == ota_0) &&
+          partition_holds(ota_0, pu8Image, u32len), "factory + ota_0 table: updates alternate between the two");
+    host_ota_boot();
+    host_partition_legacy = false;
+}
+
+static int64_t cpu_time_us(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage); // The HTTP server is another thread
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/*
+ * Receive buffer and erase unit against a flash as slow as the real one, at loopback speed. The device does
+ * not receive while it erases beyond its 5744 byte TCP window, so on a link the transfer time adds to the
+ * flash time rather than hiding it: the last column adds it at the throttled rate.
+ */
+static void bench_tuning(uint32_t u32rate_kBps)
+{
+    static const ota_tuning_t tunings[] = {
+        {.u16rx_buf = 1024, .u32erase_unit = OTA_SECTOR_SIZE},  // Before ota_set_tuning()
+        {.u16rx_buf = 4096, .u32erase_unit = OTA_SECTOR_SIZE},
+        {.u16rx_buf = 4096, .u32erase_unit = OTA_ERASE_BLOCK},
+        {.u16rx_buf = 16384, .u32erase_unit = OTA_ERASE_BLOCK},
+        {.u16rx_buf = 4096, .u32erase_unit = OTA_ERASE_IMAGE},
+    };
+    static const host_flash_timing_t timing = {
+        .u32sector_erase_us = TUNE_SECTOR_ERASE_US,
+        .u32block_erase_us = TUNE_BLOCK_ERASE_US,
+        .u32page_program_us = TUNE_PAGE_PROGRAM_US,
+    };
+    uint32_t u32len = TUNE_IMAGE_KB * 1024;
+    uint8_t *pu8Image = make_image(u32len);
+    uint32_t u32flash_ms[sizeof(tunings) / sizeof(tunings[0])];
+    ota_tuning_t saved;
+    char cWhat[96];
+
+    printf("\nThroughput, image %lu bytes, flash erase %u/%u ms per sector/block, %u us per page\n",
+           (unsigned long)u32len, TUNE_SECTOR_ERASE_US / 1000, TUNE_BLOCK_ERASE_US / 1000, TUNE_PAGE_PROGRAM_US);
+    httpd_add_file("/tune.bin", pu8Image, u32len);
+    ota_get_tuning(&saved);
+    host_flash_timing = timing;
+    set_faults(0, 0, false);
+    printf("  %-7s %-6s %8s %6s %8s %9s %7s %14s\n", "rx buf", "erase", "kB/s", "CPU %", "net ms", "flash ms",
+           "erases", "at link ms");
+    for (size_t i = 0; i < sizeof(tunings) / sizeof(tunings[0]); i++)
+    {
+        host_flash_stats_t before;
+        host_flash_stats_t after;
+        const char *cUnit = (tunings[i].u32erase_unit == OTA_ERASE_IMAGE) ? "image" :
+                            (tunings[i].u32erase_unit == OTA_ERASE_BLOCK) ? "block" : "sector";
+
+        ota_set_tuning(&tunings[i]);
+        host_flash_get_stats(&before);
+        int64_t i64cpu_us = cpu_time_us();
+        int64_t i64start_us = esp_timer_get_time();
+        run_ota("/tune.bin");
+        int64_t i64wall_us = esp_timer_get_time() - i64start_us;
+        i64cpu_us = cpu_time_us() - i64cpu_us;
+        host_flash_get_stats(&after);
+
+        const ota_report_t *report = &result.report;
+        u32flash_ms[i] = report->u32flash_ms;
+        printf("  %-7u %-6s %8.1f %6.1f %8lu %9lu %7lu %14lu\n", tunings[i].u16rx_buf, cUnit,
+               u32len / 1.024 / (report->u32elapsed_ms + 1), 100.0 * i64cpu_us / i64wall_us,
+               (unsigned long)report->u32net_ms, (unsigned long)report->u32flash_ms,
+               (unsigned long)(after.u32erase_calls - before.u32erase_calls),
+               (unsigned long)(report->u32elapsed_ms - report->u32net_ms + u32len / u32rate_kBps));
+        snprintf(cWhat, sizeof(cWhat), "%u byte buffer, %s erase: boots and matches, no sector erased twice",
+                 tunings[i].u16rx_buf, cUnit);
+        check((strcmp(result.cStatus, "Succeed") == 0) && booted_update() && slot_holds(pu8Image, u32len) &&
+              (after.u32erases - before.u32erases == (u32len + OTA_SECTOR_SIZE - 1) / OTA_SECTOR_SIZE) &&
+              (report->u32net_ms + report->u32flash_ms <= report->u32elapsed_ms), cWhat);
+    }
+    check((u32flash_ms[2] < u32flash_ms[1] / 2) && (u32flash_ms[4] < u32flash_ms[1] / 2),
+          "block and image erases take less than half the flash time of sector erases");
+
+    /* Every resumed request erases the rest of the image again */
+    host_restart_hook = bench_restart;
+    resume_start();
+    set_faults(0, u32len / 3, false);
+    run_ota("/tune.bin");
+    set_faults(0, 0, false);
+    wake_until_done(OTA_WAKE_BUDGET_MS);
+    check((strcmp(result.cStatus, "Succeed") == 0) && slot_holds(pu8Image, u32len), "image erase resumes");
+    host_restart_hook = NULL;
+
+    ota_tuning_t bad = {.u16rx_buf = OTA_RX_BUF_MIN - 1, .u32erase_unit = OTA_ERASE_BLOCK};
+    bool bRefused = (ota_set_tuning(&bad) == ESP_ERR_INVALID_ARG);
+    bad.u16rx_buf = OTA_RX_BUF;
+    bad.u32erase_unit = OTA_SECTOR_SIZE + 1;
+    check(bRefused && (ota_set_tuning(&bad) == ESP_ERR_INVALID_ARG), "tuning out of range is refused");
+
+    memset(&host_flash_timing, 0, sizeof(host_flash_timing));
+    ota_set_tuning(&saved);
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    uint32_t u32len = BENCH_IMAGE_KB * 1024;
+    uint32_t u32rate_kBps = BENCH_RATE_KBPS;
+    const char *cImage = NULL;
+    const char *cPacked = NULL;
+    const char *cDelta = NULL;
+    bool bWrite = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:b:f:p:d:wv")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                u32len = (uint32_t)atoi(optarg) * 1024;
+                break;
+            case 'b':
+                u32rate_kBps = (uint32_t)atoi(optarg);
+                break;
+            case 'f':
+                cImage = optarg;
+                break;
+            case 'p':
+                cPacked = optarg;
+                break;
+            case 'd':
+                cDelta = optarg;
+                break;
+            case 'w':
+                bWrite = true;
+                break;
+            case 'v':
+                host_log_level = ESP_LOG_INFO;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s size_kb] [-b rate_kBps] [-f image] [-p container] [-d delta] [-w] [-v]\n",
+                        argv[0]);
+                return 2;
+        }
+    }
+    if ((u32len < HOST_IMAGE_MIN) || (u32rate_kBps == 0))
+    {
+        fprintf(stderr, "Size and rate must be positive\n");
+        return 2;
+    }
+
+    uint8_t *pu8Image;
+    if (cImage != NULL)
+    {
+        uint8_t u8sha256[32];
+        pu8Image = read_file(cImage, 32, &u32len);
+        if (pu8Image == NULL)
+        {
+            fprintf(stderr, "Cannot read %s\n", cImage);
+            return 2;
+        }
+        mbedtls_sha256(pu8Image, u32len - 32, u8sha256, 0);
+        if ((u32len < HOST_IMAGE_MIN) || (memcmp(u8sha256, &pu8Image[u32len - 32], 32) != 0))
+        {
+            u32len += 32;
+            seal_image(pu8Image, u32len);
+        }
+    }
+    else
+    {
+        pu8Image = make_image(u32len);
+    }
+
+    uint32_t u32packed;
+    uint8_t *pu8Packed = (cPacked != NULL) ? read_file(cPacked, 0, &u32packed) :
+                         pack_image(pu8Image, u32len, BENCH_CHUNK, &u32packed);
+    if (pu8Packed == NULL)
+    {
+        fprintf(stderr, "Cannot read %s\n", cPacked);
+        return 2;
+    }
+    uint32_t u32base;
+    uint32_t u32delta;
+    uint8_t *pu8Base = make_base(pu8Image, u32len, &u32base);
+    uint8_t *pu8Delta = (cDelta != NULL) ? read_file(cDelta, 0, &u32delta) :
+                        make_delta(pu8Base, u32base, pu8Image, u32len, BENCH_CHUNK, &u32delta);
+    if (pu8Delta == NULL)
+    {
+        fprintf(stderr, "Cannot read %s\n", cDelta);
+        return 2;
+    }
+    if (bWrite)
+    {
+        write_file("fw.bin", pu8Image, u32len);
+        write_file("fw.bota", pu8Packed, u32packed);
+        write_file("base.bin", pu8Base, u32base);
+        write_file("fw.delta", pu8Delta, u32delta);
+    }
+
+    u16port = httpd_start();
+    if (u16port == 0)
+    {
+        fprintf(stderr, "HTTP server did not start\n");
+        return 1;
+    }
+    printf("ota_bench: HTTP server on 127.0.0.1:%u\n", u16port);
+    httpd_add_file("/fw.bin", pu8Image, u32len);
+    httpd_add_file("/fw.bota", pu8Packed, u32packed);
+    httpd_add_file("/fw.delta", pu8Delta, u32delta);
+
+    bench_paths(pu8Image, u32len, u32packed, u32rate_kBps);
+    bench_faults(pu8Packed, u32packed);
+    bench_resume(pu8Image, u32len, u32packed, u32rate_kBps);
+    bench_schedule(pu8Image, u32len);
+    bench_delta(pu8Image, u32len, pu8Base, u32base, u32delta, u32packed, u32rate_kBps);
+    bench_slots(pu8Image, u32len, pu8Base, u32base);
+    bench_tuning(u32rate_kBps);
+
+    printf("\n%lu/%lu checks passed\n", (unsigned long)(u32checks - u32failed), (unsigned long)u32checks);
+    return (u32failed == 0) ? 0 : 1;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
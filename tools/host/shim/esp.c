@@ -0,0 +1,305 @@
+/*****************************************************************************
+ *
+ * @file 	esp.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	ESP-IDF stand-ins for the host build: timer, error names, restart,
+ *          station MAC, CRC32, RTC memory and a RAM image of partitions.csv
+ *          with NOR semantics
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_app_desc.h"
+#include "esp_system.h"
+#include "esp_wifi.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+
+#include "bee_outbox.h"
+#include "bee_history.h"
+#include "host_shim.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define HOST_FLASH_SIZE     0x400000    /* Indexed by flash address, as partitions.csv lays it out */
+#define HOST_APP_SIZE       0x180000
+#define HOST_OUTBOX_SIZE    0x20000
+#define HOST_HISTORY_SIZE   0x40000
+#define HOST_SECTOR_SIZE    4096
+#define HOST_BLOCK_SIZE     0x10000
+#define HOST_PAGE_SIZE      256
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+/* RTC_DATA_ATTR variables, the linker brackets the section */
+extern uint8_t __start_rtc_data[] __attribute__((weak));
+extern uint8_t __stop_rtc_data[] __attribute__((weak));
+
+esp_log_level_t host_log_level = ESP_LOG_WARN;
+void (*host_restart_hook)(void) = NULL;
+void (*host_flash_write_hook)(const esp_partition_t *partition, size_t offset, size_t size) = NULL;
+const char *host_flash_fail_label = NULL;
+bool host_partition_legacy = false;
+host_flash_timing_t host_flash_timing;
+
+static uint8_t u8flash[HOST_FLASH_SIZE];
+static bool bFlash_ready = false;
+static host_flash_stats_t flash_stats;
+static uint8_t *pu8rtc_boot = NULL;         /* RTC memory as the image sets it */
+static const esp_partition_t partitions[] = {
+    {
+        .type = ESP_PARTITION_TYPE_APP,
+        .subtype = ESP_PARTITION_SUBTYPE_APP_OTA_0,
+        .address = 0x10000,
+        .size = HOST_APP_SIZE,
+        .erase_size = HOST_SECTOR_SIZE,
+        .label = "ota_0",
+    },
+    {
+        .type = ESP_PARTITION_TYPE_APP,
+        .subtype = ESP_PARTITION_SUBTYPE_APP_OTA_1,
+        .address = 0x10000 + HOST_APP_SIZE,
+        .size = HOST_APP_SIZE,
+        .erase_size = HOST_SECTOR_SIZE,
+        .label = "ota_1",
+    },
+    {
+        .type = ESP_PARTITION_TYPE_APP,
+        .subtype = ESP_PARTITION_SUBTYPE_APP_FACTORY,
+        .address = 0x10000 + HOST_APP_SIZE,    /* Where ota_1 is, the two tables never coexist */
+        .size = HOST_APP_SIZE,
+        .erase_size = HOST_SECTOR_SIZE,
+        .label = "factory",
+    },
+    {
+        .type = ESP_PARTITION_TYPE_DATA,
+        .subtype = OUTBOX_PARTITION_SUBTYPE,
+        .address = 0x310000,
+        .size = HOST_OUTBOX_SIZE,
+        .erase_size = HOST_SECTOR_SIZE,
+        .label = OUTBOX_PARTITION_LABEL,
+    },
+    {
+        .type = ESP_PARTITION_TYPE_DATA,
+        .subtype = HISTORY_PARTITION_SUBTYPE,
+        .address = 0x310000 + HOST_OUTBOX_SIZE,
+        .size = HOST_HISTORY_SIZE,
+        .erase_size = HOST_SECTOR_SIZE,
+        .label = HISTORY_PARTITION_LABEL,
+    },
+};
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+__attribute__((constructor)) static void rtc_snapshot(void)
+{
+    size_t size = __stop_rtc_data - __start_rtc_data;
+    pu8rtc_boot = malloc(size + 1);
+    memcpy(pu8rtc_boot, __start_rtc_data, size);
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+const esp_app_desc_t *esp_app_get_description(void)
+{
+    static const esp_app_desc_t desc = {.version = HOST_APP_VERSION, .project_name = "SHT3x_Powersave"};
+    return &desc;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+        case ESP_OK:                    return "ESP_OK";
+        case ESP_FAIL:                  return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE:  return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC:       return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION:   return "ESP_ERR_INVALID_VERSION";
+        default:                        return "UNKNOWN ERROR";
+    }
+}
+
+void esp_restart(void)
+{
+    if (host_restart_hook != NULL)
+    {
+        host_restart_hook();
+    }
+    fprintf(stderr, "esp_restart()\n");
+    exit(0);
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return 0;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    static const uint8_t u8mac[6] = {0x24, 0x0A, 0xC4, 0x12, 0x34, 0x56};
+    memcpy(mac, u8mac, sizeof(u8mac));
+    return ESP_OK;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *buf++;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+void host_partition_reset(void)
+{
+    memset(u8flash, 0xFF, sizeof(u8flash));
+    bFlash_ready = true;
+}
+
+void host_rtc_power_loss(void)
+{
+    memcpy(__start_rtc_data, pu8rtc_boot, __stop_rtc_data - __start_rtc_data);
+}
+
+void host_flash_get_stats(host_flash_stats_t *stats)
+{
+    *stats = flash_stats;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    for (size_t i = 0; i < sizeof(partitions) / sizeof(partitions[0]); i++)
+    {
+        bool bOld_only = (partitions[i].subtype == ESP_PARTITION_SUBTYPE_APP_FACTORY) &&
+                         (partitions[i].type == ESP_PARTITION_TYPE_APP);
+        bool bNew_only = (partitions[i].type == ESP_PARTITION_TYPE_DATA) ||
+                         (partitions[i].subtype == ESP_PARTITION_SUBTYPE_APP_OTA_1);
+        if ((host_partition_legacy ? bNew_only : bOld_only))
+        {
+            continue;
+        }
+        if ((type == partitions[i].type) && (subtype == partitions[i].subtype) &&
+            ((label == NULL) || (strcmp(label, partitions[i].label) == 0)))
+        {
+            if (!bFlash_ready)
+            {
+                host_partition_reset();
+            }
+            return &partitions[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if ((src_offset > partition->size) || (size > partition->size - src_offset))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, &u8flash[partition->address + src_offset], size);
+    return ESP_OK;
+}
+
+/* NOR flash: programming can only clear bits */
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    if ((dst_offset > partition->size) || (size > partition->size - dst_offset))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if ((host_flash_fail_label != NULL) && (strcmp(partition->label, host_flash_fail_label) == 0))
+    {
+        return ESP_FAIL;
+    }
+    const uint8_t *pu8src = src;
+    uint8_t *pu8dst = &u8flash[partition->address + dst_offset];
+    for (size_t i = 0; i < size; i++)
+    {
+        pu8dst[i] &= pu8src[i];
+    }
+    flash_stats.u32writes++;
+    if (host_flash_timing.u32page_program_us > 0)
+    {
+        uint32_t u32pages = (dst_offset + size + HOST_PAGE_SIZE - 1) / HOST_PAGE_SIZE - dst_offset / HOST_PAGE_SIZE;
+        usleep(u32pages * host_flash_timing.u32page_program_us);
+    }
+    if (host_flash_write_hook != NULL)
+    {
+        host_flash_write_hook(partition, dst_offset, size);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    if ((offset % HOST_SECTOR_SIZE) || (size % HOST_SECTOR_SIZE))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((offset > partition->size) || (size > partition->size - offset))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memset(&u8flash[partition->address + offset], 0xFF, size);
+    flash_stats.u32erases += size / HOST_SECTOR_SIZE;
+    flash_stats.u32erase_calls++;
+
+    /* Blocks where the flash address allows, sectors around them */
+    uint32_t u32addr = partition->address + offset;
+    uint32_t u32end = u32addr + size;
+    uint64_t u64busy_us = 0;
+    while (u32addr < u32end)
+    {
+        bool bBlock = (u32addr % HOST_BLOCK_SIZE == 0) && (u32end - u32addr >= HOST_BLOCK_SIZE);
+        u64busy_us += bBlock ? host_flash_timing.u32block_erase_us : host_flash_timing.u32sector_erase_us;
+        u32addr += bBlock ? HOST_BLOCK_SIZE : HOST_SECTOR_SIZE;
+    }
+    if (u64busy_us > 0)
+    {
+        usleep((useconds_t)u64busy_us);
+    }
+    return ESP_OK;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,318 @@
+/*****************************************************************************
+ *
+ * @file 	freertos.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	FreeRTOS tasks, queues, mutexes and event groups on pthreads,
+ *          enough for bee_mqtt and bee_cmd to run on a Linux host
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+struct host_event_group
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    EventBits_t     bits;
+};
+
+struct host_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    UBaseType_t     length;
+    UBaseType_t     item_size;
+    UBaseType_t     head;
+    UBaseType_t     count;
+    uint8_t         *pu8items;
+};
+
+typedef struct
+{
+    TaskFunction_t fn;
+    void           *arg;
+} task_start_t;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* Absolute CLOCK_MONOTONIC time ticks from now */
+static struct timespec deadline_of(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t u64ns = (uint64_t)ts.tv_nsec + (uint64_t)ticks * (1000000000ULL / configTICK_RATE_HZ);
+    ts.tv_sec += u64ns / 1000000000ULL;
+    ts.tv_nsec = u64ns % 1000000000ULL;
+    return ts;
+}
+
+/* Wait on cond, false once the deadline passed, portMAX_DELAY waits forever */
+static bool cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *deadline)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) == 0;
+}
+
+static void *task_entry(void *arg)
+{
+    task_start_t start = *(task_start_t *)arg;
+    free(arg);
+    start.fn(start.arg);
+    return NULL;
+}
+
+/****************************************************************************/
+/***        Tasks                                                         ***/
+/****************************************************************************/
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth,
+                       void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask)
+{
+    pthread_t thread;
+    task_start_t *start = malloc(sizeof(task_start_t));
+    if (start == NULL)
+    {
+        return pdFAIL;
+    }
+    start->fn = pxTaskCode;
+    start->arg = pvParameters;
+    if (pthread_create(&thread, NULL, task_entry, start) != 0)
+    {
+        free(start);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    if (pxCreatedTask != NULL)
+    {
+        *pxCreatedTask = NULL;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t xTask)
+{
+    if (xTask == NULL)
+    {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    struct timespec ts = deadline_of(xTicksToDelay);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+    {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)((uint64_t)ts.tv_sec * configTICK_RATE_HZ + (uint64_t)ts.tv_nsec / (1000000000ULL / configTICK_RATE_HZ));
+}
+
+/****************************************************************************/
+/***        Queues                                                        ***/
+/****************************************************************************/
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    QueueHandle_t queue = calloc(1, sizeof(struct host_queue));
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    queue->pu8items = calloc(uxQueueLength, uxItemSize);
+    if (queue->pu8items == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    queue->length = uxQueueLength;
+    queue->item_size = uxItemSize;
+    pthread_mutex_init(&queue->lock, NULL);
+    cond_init(&queue->cond);
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    struct timespec deadline = deadline_of(xTicksToWait);
+    BaseType_t result = pdTRUE;
+
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == xQueue->length)
+    {
+        if ((xTicksToWait == 0) || !cond_wait(&xQueue->cond, &xQueue->lock, xTicksToWait, &deadline))
+        {
+            result = pdFALSE;
+            break;
+        }
+    }
+    if (result == pdTRUE)
+    {
+        UBaseType_t tail = (xQueue->head + xQueue->count) % xQueue->length;
+        memcpy(&xQueue->pu8items[tail * xQueue->item_size], pvItemToQueue, xQueue->item_size);
+        xQueue->count++;
+        pthread_cond_broadcast(&xQueue->cond);
+    }
+    pthread_mutex_unlock(&xQueue->lock);
+    return result;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    struct timespec deadline = deadline_of(xTicksToWait);
+    BaseType_t result = pdTRUE;
+
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == 0)
+    {
+        if ((xTicksToWait == 0) || !cond_wait(&xQueue->cond, &xQueue->lock, xTicksToWait, &deadline))
+        {
+            result = pdFALSE;
+            break;
+        }
+    }
+    if (result == pdTRUE)
+    {
+        memcpy(pvBuffer, &xQueue->pu8items[xQueue->head * xQueue->item_size], xQueue->item_size);
+        xQueue->head = (xQueue->head + 1) % xQueue->length;
+        xQueue->count--;
+        pthread_cond_broadcast(&xQueue->cond);
+    }
+    pthread_mutex_unlock(&xQueue->lock);
+    return result;
+}
+
+/****************************************************************************/
+/***        Mutexes                                                       ***/
+/****************************************************************************/
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *pxMutexBuffer)
+{
+    pthread_mutex_init(&pxMutexBuffer->mutex, NULL);
+    return pxMutexBuffer;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime)
+{
+    if (xBlockTime == portMAX_DELAY)
+    {
+        return (pthread_mutex_lock(&xSemaphore->mutex) == 0) ? pdTRUE : pdFALSE;
+    }
+    struct timespec deadline = deadline_of(xBlockTime);
+    return (pthread_mutex_clocklock(&xSemaphore->mutex, CLOCK_MONOTONIC, &deadline) == 0) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore)
+{
+    return (pthread_mutex_unlock(&xSemaphore->mutex) == 0) ? pdTRUE : pdFALSE;
+}
+
+/****************************************************************************/
+/***        Event Groups                                                  ***/
+/****************************************************************************/
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    EventGroupHandle_t group = calloc(1, sizeof(struct host_event_group));
+    if (group != NULL)
+    {
+        pthread_mutex_init(&group->lock, NULL);
+        cond_init(&group->cond);
+    }
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, EventBits_t uxBitsToSet)
+{
+    pthread_mutex_lock(&xEventGroup->lock);
+    xEventGroup->bits |= uxBitsToSet;
+    EventBits_t bits = xEventGroup->bits;
+    pthread_cond_broadcast(&xEventGroup->cond);
+    pthread_mutex_unlock(&xEventGroup->lock);
+    return bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, EventBits_t uxBitsToClear)
+{
+    pthread_mutex_lock(&xEventGroup->lock);
+    EventBits_t bits = xEventGroup->bits; /* Value before clearing, like FreeRTOS */
+    xEventGroup->bits &= ~uxBitsToClear;
+    pthread_mutex_unlock(&xEventGroup->lock);
+    return bits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t xEventGroup)
+{
+    pthread_mutex_lock(&xEventGroup->lock);
+    EventBits_t bits = xEventGroup->bits;
+    pthread_mutex_unlock(&xEventGroup->lock);
+    return bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup, EventBits_t uxBitsToWaitFor,
+                                BaseType_t xClearOnExit, BaseType_t xWaitForAllBits, TickType_t xTicksToWait)
+{
+    struct timespec deadline = deadline_of(xTicksToWait);
+
+    pthread_mutex_lock(&xEventGroup->lock);
+    for (;;)
+    {
+        EventBits_t match = xEventGroup->bits & uxBitsToWaitFor;
+        bool bDone = xWaitForAllBits ? (match == uxBitsToWaitFor) : (match != 0);
+        if (bDone)
+        {
+            break;
+        }
+        if ((xTicksToWait == 0) || !cond_wait(&xEventGroup->cond, &xEventGroup->lock, xTicksToWait, &deadline))
+        {
+            break;
+        }
+    }
+    EventBits_t bits = xEventGroup->bits;
+    bool bSatisfied = xWaitForAllBits ? ((bits & uxBitsToWaitFor) == uxBitsToWaitFor) : ((bits & uxBitsToWaitFor) != 0);
+    if (xClearOnExit && bSatisfied)
+    {
+        xEventGroup->bits &= ~uxBitsToWaitFor;
+    }
+    pthread_mutex_unlock(&xEventGroup->lock);
+    return bits;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
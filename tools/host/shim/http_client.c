@@ -0,0 +1,335 @@
+/*****************************************************************************
+ *
+ * @file 	http_client.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	minimal esp_http_client stand-in for the host build: one GET per
+ *          open over a blocking loopback socket, Content-Length bodies only
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "esp_log.h"
+#include "esp_http_client.h"
+
+#include "host_shim.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define CLIENT_BUFFER_SIZE  512     /* esp_http_client DEFAULT_HTTP_BUF_SIZE */
+#define CLIENT_TIMEOUT_MS   5000
+#define CLIENT_HEADERS_MAX  512     /* Extra request headers */
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+struct esp_http_client
+{
+    esp_http_client_config_t config;
+    char     cHost[64];
+    uint16_t u16port;
+    char     cPath[256];
+    char     cHeaders[CLIENT_HEADERS_MAX];
+    int      fd;
+    int      status;
+    int64_t  i64content_length;     /* -1 until the headers are in */
+    int64_t  i64received;           /* Body bytes handed out */
+    uint8_t  *pu8Buf;               /* Response head, then the body bytes read along with it */
+    size_t   buf_len;
+    size_t   buf_pos;
+};
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static esp_http_client_handle_t open_client = NULL; /* Connected, for host_http_power_loss() */
+
+static const char *TAG = "HOST_HTTP";
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void dispatch(esp_http_client_handle_t client, esp_http_client_event_id_t id, char *cKey, char *cValue)
+{
+    if (client->config.event_handler != NULL)
+    {
+        esp_http_client_event_t evt = {
+            .event_id = id,
+            .client = client,
+            .user_data = client->config.user_data,
+            .header_key = cKey,
+            .header_value = cValue,
+        };
+        client->config.event_handler(&evt);
+    }
+}
+
+static bool parse_url(esp_http_client_handle_t client, const char *cUrl)
+{
+    unsigned int port = 80;
+    int path_at = 0;
+
+    if ((strncmp(cUrl, "http://", 7) != 0) && (strncmp(cUrl, "https://", 8) != 0))
+    {
+        return false;
+    }
+    cUrl = strstr(cUrl, "://") + 3;
+    if ((sscanf(cUrl, "%63[^:/]:%u%n", client->cHost, &port, &path_at) < 2) &&
+        (sscanf(cUrl, "%63[^:/]%n", client->cHost, &path_at) < 1))
+    {
+        return false;
+    }
+    snprintf(client->cPath, sizeof(client->cPath), "%s", (cUrl[path_at] == '/') ? &cUrl[path_at] : "/");
+    client->u16port = (uint16_t)port;
+    return true;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    esp_http_client_handle_t client = calloc(1, sizeof(*client));
+    if (client == NULL)
+    {
+        return NULL;
+    }
+    client->config = *config;
+    if (client->config.buffer_size <= 0)
+    {
+        client->config.buffer_size = CLIENT_BUFFER_SIZE;
+    }
+    if (client->config.timeout_ms <= 0)
+    {
+        client->config.timeout_ms = CLIENT_TIMEOUT_MS;
+    }
+    client->fd = -1;
+    client->pu8Buf = malloc(client->config.buffer_size);
+    if ((client->pu8Buf == NULL) || !parse_url(client, config->url))
+    {
+        ESP_LOGE(TAG, "Bad URL %s", config->url);
+        free(client->pu8Buf);
+        free(client);
+        return NULL;
+    }
+    return client;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+    size_t used = strlen(client->cHeaders);
+    int n = snprintf(&client->cHeaders[used], sizeof(client->cHeaders) - used, "%s: %s\r\n", key, value);
+    if ((n < 0) || ((size_t)n >= sizeof(client->cHeaders) - used))
+    {
+        client->cHeaders[used] = '\0';
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(client->u16port)};
+    struct timeval tv = {.tv_sec = client->config.timeout_ms / 1000, .tv_usec = (client->config.timeout_ms % 1000) * 1000};
+
+    client->status = 0;
+    client->i64content_length = -1;
+    client->i64received = 0;
+    client->buf_len = 0;
+    client->buf_pos = 0;
+    if (inet_pton(AF_INET, (strcmp(client->cHost, "localhost") == 0) ? "127.0.0.1" : client->cHost, &addr.sin_addr) != 1)
+    {
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    client->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if ((client->fd < 0) || (connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0))
+    {
+        esp_http_client_close(client);
+        dispatch(client, HTTP_EVENT_ERROR, NULL, NULL);
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    setsockopt(client->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    open_client = client;
+    dispatch(client, HTTP_EVENT_ON_CONNECTED, NULL, NULL);
+
+    char cRequest[CLIENT_HEADERS_MAX + 512];
+    int n = snprintf(cRequest, sizeof(cRequest),
+                     "GET %s HTTP/1.1\r\nHost: %s:%u\r\nUser-Agent: ESP32 HTTP Client/1.0\r\n%sConnection: %s\r\n\r\n",
+                     client->cPath, client->cHost, client->u16port, client->cHeaders,
+                     client->config.keep_alive_enable ? "keep-alive" : "close");
+    if (send(client->fd, cRequest, n, MSG_NOSIGNAL) != n)
+    {
+        esp_http_client_close(client);
+        return ESP_ERR_HTTP_WRITE_DATA;
+    }
+    dispatch(client, HTTP_EVENT_HEADER_SENT, NULL, NULL);
+    return ESP_OK;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    char *pcEnd = NULL;
+
+    /* The whole head has to fit in the receive buffer, as with esp_http_client */
+    while (pcEnd == NULL)
+    {
+        if (client->buf_len == (size_t)client->config.buffer_size - 1)
+        {
+            ESP_LOGE(TAG, "Response head over %d bytes", client->config.buffer_size);
+            return ESP_FAIL;
+        }
+        ssize_t n = recv(client->fd, &client->pu8Buf[client->buf_len], client->config.buffer_size - 1 - client->buf_len, 0);
+        if (n <= 0)
+        {
+            return ESP_FAIL;
+        }
+        client->buf_len += n;
+        client->pu8Buf[client->buf_len] = '\0';
+        pcEnd = strstr((char *)client->pu8Buf, "\r\n\r\n");
+    }
+
+    *pcEnd = '\0';
+    client->buf_pos = (uint8_t *)pcEnd + 4 - client->pu8Buf;
+    char *pcSave = NULL;
+    char *pcLine = strtok_r((char *)client->pu8Buf, "\r\n", &pcSave);
+    if ((pcLine == NULL) || (sscanf(pcLine, "HTTP/1.%*d %d", &client->status) != 1))
+    {
+        return ESP_FAIL;
+    }
+    while ((pcLine = strtok_r(NULL, "\r\n", &pcSave)) != NULL)
+    {
+        char *pcValue = strchr(pcLine, ':');
+        if (pcValue == NULL)
+        {
+            continue;
+        }
+        *pcValue++ = '\0';
+        pcValue += strspn(pcValue, " ");
+        if (strcasecmp(pcLine, "Content-Length") == 0)
+        {
+            client->i64content_length = strtoll(pcValue, NULL, 10);
+        }
+        dispatch(client, HTTP_EVENT_ON_HEADER, pcLine, pcValue);
+    }
+    return client->i64content_length;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return client->status;
+}
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client)
+{
+    return client->i64content_length;
+}
+
+/* Fills the buffer unless the body ends first, like esp_http_client_read() */
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len)
+{
+    int ridx = 0;
+
+    while (ridx < len)
+    {
+        int64_t i64left = client->i64content_length - client->i64received;
+        if ((client->i64content_length >= 0) && (i64left <= 0))
+        {
+            break;
+        }
+        int need = len - ridx;
+        if ((client->i64content_length >= 0) && (need > i64left))
+        {
+            need = (int)i64left;
+        }
+
+        ssize_t n;
+        if (client->buf_pos < client->buf_len)
+        {
+            n = client->buf_len - client->buf_pos;
+            n = (n < need) ? n : need;
+            memcpy(&buffer[ridx], &client->pu8Buf[client->buf_pos], n);
+            client->buf_pos += n;
+        }
+        else
+        {
+            n = recv(client->fd, &buffer[ridx], need, 0);
+        }
+        if (n <= 0)
+        {
+            if ((n < 0) && (ridx == 0))
+            {
+                dispatch(client, HTTP_EVENT_ERROR, NULL, NULL);
+                return ESP_FAIL;
+            }
+            break;
+        }
+        ridx += n;
+        client->i64received += n;
+    }
+    if ((ridx == 0) && esp_http_client_is_complete_data_received(client))
+    {
+        dispatch(client, HTTP_EVENT_ON_FINISH, NULL, NULL);
+    }
+    return ridx;
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client)
+{
+    return (client->i64content_length >= 0) && (client->i64received == client->i64content_length);
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    if (client->fd >= 0)
+    {
+        close(client->fd);
+        client->fd = -1;
+        dispatch(client, HTTP_EVENT_DISCONNECTED, NULL, NULL);
+    }
+    if (open_client == client)
+    {
+        open_client = NULL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    if (client == NULL)
+    {
+        return ESP_FAIL;
+    }
+    esp_http_client_close(client);
+    free(client->pu8Buf);
+    free(client);
+    return ESP_OK;
+}
+
+void host_http_power_loss(void)
+{
+    if (open_client != NULL)
+    {
+        close(open_client->fd); /* The client itself is lost with the RAM */
+        open_client = NULL;
+    }
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
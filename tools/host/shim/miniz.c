@@ -0,0 +1,94 @@
+/*****************************************************************************
+ *
+ * @file 	miniz.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	tinfl_decompress() stand-in for the host build, the ROM inflater
+ *          calling convention over zlib
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "rom/miniz.h"
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static tinfl_status finish(tinfl_decompressor *r, tinfl_status status)
+{
+    inflateEnd(&r->strm);
+    r->bInit = 0;
+    r->bDone = 1;
+    return status;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size,
+                              uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size,
+                              const uint32_t decomp_flags)
+{
+    size_t in_size = *pIn_buf_size;
+    size_t out_size = *pOut_buf_size;
+
+    *pIn_buf_size = 0;
+    *pOut_buf_size = 0;
+    if (r->bDone)
+    {
+        return TINFL_STATUS_DONE;
+    }
+    if ((pOut_buf_next < pOut_buf_start) || (out_size == 0))
+    {
+        return TINFL_STATUS_BAD_PARAM;
+    }
+    if (!r->bInit)
+    {
+        memset(&r->strm, 0, sizeof(r->strm));
+        int ret = (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? inflateInit(&r->strm) : inflateInit2(&r->strm, -15);
+        if (ret != Z_OK)
+        {
+            return TINFL_STATUS_FAILED;
+        }
+        r->bInit = 1;
+    }
+
+    r->strm.next_in = (Bytef *)pIn_buf_next;
+    r->strm.avail_in = (uInt)in_size;
+    r->strm.next_out = pOut_buf_next;
+    r->strm.avail_out = (uInt)out_size;
+    int ret = inflate(&r->strm, Z_NO_FLUSH);
+    *pIn_buf_size = in_size - r->strm.avail_in;
+    *pOut_buf_size = out_size - r->strm.avail_out;
+
+    switch (ret)
+    {
+        case Z_STREAM_END:
+            return finish(r, TINFL_STATUS_DONE);
+        case Z_OK:
+        case Z_BUF_ERROR:
+            if (r->strm.avail_out == 0)
+            {
+                return TINFL_STATUS_HAS_MORE_OUTPUT;
+            }
+            if (!(decomp_flags & TINFL_FLAG_HAS_MORE_INPUT))
+            {
+                return finish(r, TINFL_STATUS_FAILED);
+            }
+            return TINFL_STATUS_NEEDS_MORE_INPUT;
+        case Z_DATA_ERROR:
+            return finish(r, ((r->strm.msg != NULL) && (strcmp(r->strm.msg, "incorrect data check") == 0)) ?
+                             TINFL_STATUS_ADLER32_MISMATCH : TINFL_STATUS_FAILED);
+        default:
+            return finish(r, TINFL_STATUS_FAILED);
+    }
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
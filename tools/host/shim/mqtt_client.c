@@ -0,0 +1,604 @@
+/*****************************************************************************
+ *
+ * @file 	mqtt_client.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	minimal esp-mqtt stand-in for the host build: one thread per
+ *          client reads the socket and raises the same events, publishers
+ *          write from their own thread like esp_mqtt_client_publish()
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mqtt_client.h"
+#include "mqtt5_client.h"
+
+#include "mqtt_wire.h"
+#include "host_shim.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define CLIENT_ID           "ESP32_123456"  /* esp-mqtt default: ESP32_ and the last 3 bytes of the MAC */
+#define CLIENT_KEEPALIVE_S  120
+#define CLIENT_BUFFER_SIZE  1024            /* Incoming messages are handed over in fragments of this size */
+#define CLIENT_POLL_MS      50
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+struct esp_mqtt_client
+{
+    esp_mqtt_client_config_t config;
+    uint8_t             u8level;            /* WIRE_LEVEL_311 or WIRE_LEVEL_5 */
+    uint32_t            u32session_expiry;
+    esp_event_handler_t handler;
+    void                *handler_arg;
+
+    pthread_mutex_t     lock;               /* Socket writes and the state below */
+    pthread_t           thread;
+    bool                bThread;
+    volatile bool       bRunning;           /* Cleared by esp_mqtt_client_disconnect(), no redial after that */
+    int                 fd;
+    bool                bConnected;
+    uint16_t            u16next_id;
+    uint16_t            u16alias_max;       /* Topic Alias Maximum of the broker */
+    bool                bPub_property;
+    esp_mqtt5_publish_property_config_t pub_property;
+    host_mqtt_stats_t   stats;
+};
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+host_mqtt_options_t host_mqtt_options = {
+    .u16port = 1883,
+    .u32connack_timeout_ms = 1000,
+    .u32reconnect_ms = 200,
+};
+
+static esp_mqtt_client_handle_t last_client = NULL;
+
+static const char *TAG = "HOST_MQTT";
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_t *event)
+{
+    event->client = client;
+    if (client->handler != NULL)
+    {
+        client->handler(client->handler_arg, "MQTT_EVENTS", event->event_id, event);
+    }
+}
+
+static void dispatch_id(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t id, int msg_id)
+{
+    esp_mqtt_event_t event = {.event_id = id, .msg_id = msg_id};
+    dispatch(client, &event);
+}
+
+/* Write a packet under the lock, counting it */
+static int send_locked(esp_mqtt_client_handle_t client, uint8_t u8header, const wire_buf_t *body)
+{
+    uint8_t u8packet[WIRE_PACKET_MAX];
+    size_t len = wire_frame(u8packet, sizeof(u8packet), u8header, body);
+    if ((len == 0) || (client->fd < 0) || (wire_write(client->fd, u8packet, len) != 0))
+    {
+        return -1;
+    }
+    client->stats.u32bytes_out += len;
+    return 0;
+}
+
+static uint16_t next_id_locked(esp_mqtt_client_handle_t client)
+{
+    if (++client->u16next_id == 0)
+    {
+        client->u16next_id = 1;
+    }
+    return client->u16next_id;
+}
+
+static int dial(void)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(host_mqtt_options.u16port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_connect_locked(esp_mqtt_client_handle_t client)
+{
+    uint8_t u8body[256];
+    wire_buf_t b = {.pu8 = u8body, .size = sizeof(u8body)};
+    const esp_mqtt_client_config_t *cfg = &client->config;
+    uint8_t u8flags = cfg->session.disable_clean_session ? 0 : 0x02;
+
+    if (cfg->credentials.username != NULL)
+    {
+        u8flags |= 0x80;
+    }
+    if (cfg->credentials.authentication.password != NULL)
+    {
+        u8flags |= 0x40;
+    }
+    if (cfg->session.last_will.topic != NULL)
+    {
+        u8flags |= 0x04 | ((cfg->session.last_will.qos & 0x03) << 3) | (cfg->session.last_will.retain ? 0x20 : 0);
+    }
+    wire_str(&b, "MQTT");
+    wire_u8(&b, client->u8level);
+    wire_u8(&b, u8flags);
+    wire_u16(&b, CLIENT_KEEPALIVE_S);
+    if (client->u8level == WIRE_LEVEL_5)
+    {
+        uint8_t u8props[16];
+        wire_buf_t p = {.pu8 = u8props, .size = sizeof(u8props)};
+        if (client->u32session_expiry != 0)
+        {
+            wire_u8(&p, WIRE_PROP_SESSION_EXPIRY);
+            wire_u32(&p, client->u32session_expiry);
+        }
+        wire_varint(&b, (uint32_t)p.len);
+        wire_bytes(&b, u8props, p.len);
+    }
+    wire_str(&b, (cfg->credentials.client_id != NULL) ? cfg->credentials.client_id : CLIENT_ID);
+    if (cfg->session.last_will.topic != NULL)
+    {
+        int len = (cfg->session.last_will.msg_len > 0) ? cfg->session.last_will.msg_len : (int)strlen(cfg->session.last_will.msg);
+        if (client->u8level == WIRE_LEVEL_5)
+        {
+            wire_varint(&b, 0); /* Will properties */
+        }
+        wire_str(&b, cfg->session.last_will.topic);
+        wire_u16(&b, (uint16_t)len);
+        wire_bytes(&b, cfg->session.last_will.msg, (size_t)len);
+    }
+    if (cfg->credentials.username != NULL)
+    {
+        wire_str(&b, cfg->credentials.username);
+    }
+    if (cfg->credentials.authentication.password != NULL)
+    {
+        wire_str(&b, cfg->credentials.authentication.password);
+    }
+    client->stats.u32connects++;
+    return send_locked(client, WIRE_CONNECT << 4, &b);
+}
+
+/* CONNACK accepted: session present flag in *pbSession, topic alias maximum taken from the properties */
+static bool parse_connack(esp_mqtt_client_handle_t client, const uint8_t *pu8body, uint32_t u32len, bool *pbSession)
+{
+    wire_rd_t r = {.pu8 = pu8body, .left = u32len};
+    *pbSession = (wire_rd_u8(&r) & 0x01) != 0;
+    uint8_t u8rc = wire_rd_u8(&r);
+    client->u16alias_max = 0;
+    if (client->u8level == WIRE_LEVEL_5)
+    {
+        wire_rd_t props;
+        wire_prop_t prop;
+        wire_rd_props(&r, &props);
+        while (wire_prop_next(&props, &prop))
+        {
+            if (prop.u8id == WIRE_PROP_ALIAS_MAX)
+            {
+                client->u16alias_max = (uint16_t)prop.u32value;
+            }
+        }
+    }
+    return !r.bBad && (u8rc == 0);
+}
+
+/* Incoming PUBLISH: MQTT_EVENT_DATA in buffer sized fragments, then the PUBACK for QoS1 */
+static void handle_publish(esp_mqtt_client_handle_t client, uint8_t u8header, uint8_t *pu8body, uint32_t u32len)
+{
+    wire_rd_t r = {.pu8 = pu8body, .left = u32len};
+    uint8_t u8qos = (u8header >> 1) & 0x03;
+    uint16_t u16topic_len;
+    const uint8_t *pu8topic = wire_rd_str(&r, &u16topic_len);
+    uint16_t u16msg_id = (u8qos > 0) ? wire_rd_u16(&r) : 0;
+    if (client->u8level == WIRE_LEVEL_5)
+    {
+        wire_rd_t props;
+        wire_rd_props(&r, &props);
+    }
+    if (r.bBad)
+    {
+        return;
+    }
+
+    char cTopic[128];
+    size_t topic_len = (u16topic_len < sizeof(cTopic)) ? u16topic_len : sizeof(cTopic) - 1;
+    memcpy(cTopic, pu8topic, topic_len);
+    cTopic[topic_len] = '\0';
+
+    int total = (int)r.left;
+    int offset = 0;
+    do
+    {
+        int chunk = (total - offset > CLIENT_BUFFER_SIZE) ? CLIENT_BUFFER_SIZE : total - offset;
+        esp_mqtt_event_t event = {
+            .event_id = MQTT_EVENT_DATA,
+            .data = (char *)&r.pu8[offset],
+            .data_len = chunk,
+            .total_data_len = total,
+            .current_data_offset = offset,
+            .topic = (offset == 0) ? cTopic : NULL,
+            .topic_len = (offset == 0) ? (int)topic_len : 0,
+            .msg_id = u16msg_id,
+            .qos = u8qos,
+        };
+        dispatch(client, &event);
+        offset += chunk;
+    } while (offset < total);
+
+    if (u8qos > 0)
+    {
+        uint8_t u8body[2];
+        wire_buf_t b = {.pu8 = u8body, .size = sizeof(u8body)};
+        wire_u16(&b, u16msg_id);
+        pthread_mutex_lock(&client->lock);
+        send_locked(client, WIRE_PUBACK << 4, &b);
+        pthread_mutex_unlock(&client->lock);
+    }
+}
+
+/* Read packets until the socket closes */
+static void serve(esp_mqtt_client_handle_t client, int fd)
+{
+    static uint8_t u8body[WIRE_PACKET_MAX];
+
+    for (;;)
+    {
+        uint8_t u8header;
+        uint32_t u32len, u32hdr_len;
+        int r = wire_read_header(fd, &u8header, &u32len, &u32hdr_len, CLIENT_POLL_MS);
+        if (r == 0)
+        {
+            continue;
+        }
+        if ((r < 0) || (u32len > sizeof(u8body)) || (wire_read_exact(fd, u8body, u32len) != 0))
+        {
+            return;
+        }
+
+        switch (u8header >> 4)
+        {
+            case WIRE_PUBACK:
+                if (u32len >= 2)
+                {
+                    dispatch_id(client, MQTT_EVENT_PUBLISHED, (u8body[0] << 8) | u8body[1]);
+                }
+                break;
+
+            case WIRE_SUBACK:
+                if (u32len >= 2)
+                {
+                    dispatch_id(client, MQTT_EVENT_SUBSCRIBED, (u8body[0] << 8) | u8body[1]);
+                }
+                break;
+
+            case WIRE_PUBLISH:
+                handle_publish(client, u8header, u8body, u32len);
+                break;
+
+            case WIRE_DISCONNECT:
+                return;
+
+            default:
+                break;
+        }
+    }
+}
+
+static void *client_thread(void *arg)
+{
+    esp_mqtt_client_handle_t client = arg;
+
+    while (client->bRunning)
+    {
+        int fd = dial();
+        if (fd < 0)
+        {
+            ESP_LOGW(TAG, "Broker not reachable on port %u", host_mqtt_options.u16port);
+            dispatch_id(client, MQTT_EVENT_ERROR, 0);
+        }
+        else
+        {
+            pthread_mutex_lock(&client->lock);
+            client->fd = fd;
+            bool bSent = client->bRunning && (send_connect_locked(client) == 0);
+            pthread_mutex_unlock(&client->lock);
+
+            uint8_t u8header, u8body[64];
+            uint32_t u32len, u32hdr_len;
+            bool bSession = false;
+            bool bAccepted = bSent &&
+                             (wire_read_header(fd, &u8header, &u32len, &u32hdr_len, host_mqtt_options.u32connack_timeout_ms) == 1) &&
+                             ((u8header >> 4) == WIRE_CONNACK) && (u32len <= sizeof(u8body)) &&
+                             (wire_read_exact(fd, u8body, u32len) == 0) &&
+                             parse_connack(client, u8body, u32len, &bSession);
+            if (bAccepted)
+            {
+                pthread_mutex_lock(&client->lock);
+                client->bConnected = true;
+                client->stats.u32connacks++;
+                client->stats.i64connack_us = esp_timer_get_time();
+                pthread_mutex_unlock(&client->lock);
+
+                esp_mqtt_event_t event = {.event_id = MQTT_EVENT_CONNECTED, .session_present = bSession};
+                dispatch(client, &event);
+                serve(client, fd);
+            }
+            else
+            {
+                ESP_LOGW(TAG, "No CONNACK in %lu ms", (unsigned long)host_mqtt_options.u32connack_timeout_ms);
+                dispatch_id(client, MQTT_EVENT_ERROR, 0);
+            }
+
+            pthread_mutex_lock(&client->lock);
+            client->bConnected = false;
+            client->fd = -1;
+            close(fd);
+            pthread_mutex_unlock(&client->lock);
+            dispatch_id(client, MQTT_EVENT_DISCONNECTED, 0);
+        }
+
+        /* Wait before dialing again, esp_mqtt_client_disconnect() ends the wait */
+        int64_t i64redial_us = esp_timer_get_time() + (int64_t)host_mqtt_options.u32reconnect_ms * 1000;
+        while (client->bRunning && (esp_timer_get_time() < i64redial_us))
+        {
+            usleep(5000);
+        }
+    }
+    return NULL;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    esp_mqtt_client_handle_t client = calloc(1, sizeof(struct esp_mqtt_client));
+    if (client == NULL)
+    {
+        return NULL;
+    }
+    client->config = *config;
+    client->u8level = (config->session.protocol_ver == MQTT_PROTOCOL_V_5) ? WIRE_LEVEL_5 : WIRE_LEVEL_311;
+    client->fd = -1;
+    pthread_mutex_init(&client->lock, NULL);
+    last_client = client;
+    return client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if (client->bThread)
+    {
+        return ESP_FAIL;
+    }
+    client->bRunning = true;
+    if (pthread_create(&client->thread, NULL, client_thread, client) != 0)
+    {
+        client->bRunning = false;
+        return ESP_FAIL;
+    }
+    client->bThread = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    esp_mqtt_client_disconnect(client);
+    if (client->bThread)
+    {
+        pthread_join(client->thread, NULL);
+        client->bThread = false;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client)
+{
+    esp_mqtt_client_stop(client);
+    return esp_mqtt_client_start(client);
+}
+
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client)
+{
+    pthread_mutex_lock(&client->lock);
+    client->bRunning = false;
+    if (client->fd >= 0)
+    {
+        if (client->bConnected)
+        {
+            wire_buf_t b = {0};
+            send_locked(client, WIRE_DISCONNECT << 4, &b);
+        }
+        shutdown(client->fd, SHUT_RDWR); /* The client thread raises MQTT_EVENT_DISCONNECTED */
+    }
+    pthread_mutex_unlock(&client->lock);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain)
+{
+    uint8_t u8body[WIRE_PACKET_MAX];
+    wire_buf_t b = {.pu8 = u8body, .size = sizeof(u8body)};
+    int msg_id = 0;
+
+    if (len <= 0)
+    {
+        len = (data != NULL) ? (int)strlen(data) : 0;
+    }
+
+    pthread_mutex_lock(&client->lock);
+    esp_mqtt5_publish_property_config_t property = client->pub_property;
+    bool bProperty = client->bPub_property;
+    client->bPub_property = false; /* One publish only, like esp-mqtt */
+
+    if (!client->bConnected)
+    {
+        pthread_mutex_unlock(&client->lock);
+        ESP_LOGI(TAG, "Publishing skipped: client is not connected");
+        return -1;
+    }
+    if (bProperty && (property.topic_alias > client->u16alias_max))
+    {
+        pthread_mutex_unlock(&client->lock);
+        ESP_LOGW(TAG, "Topic alias %u above the broker maximum %u", property.topic_alias, client->u16alias_max);
+        return -1;
+    }
+
+    wire_str(&b, topic);
+    if (qos > 0)
+    {
+        msg_id = next_id_locked(client);
+        wire_u16(&b, (uint16_t)msg_id);
+    }
+    if (client->u8level == WIRE_LEVEL_5)
+    {
+        uint8_t u8props[128];
+        wire_buf_t p = {.pu8 = u8props, .size = sizeof(u8props)};
+        if (bProperty && property.payload_format_indicator)
+        {
+            wire_u8(&p, WIRE_PROP_PAYLOAD_FORMAT);
+            wire_u8(&p, 1);
+        }
+        if (bProperty && (property.content_type != NULL))
+        {
+            wire_u8(&p, WIRE_PROP_CONTENT_TYPE);
+            wire_str(&p, property.content_type);
+        }
+        if (bProperty && (property.topic_alias != 0))
+        {
+            wire_u8(&p, WIRE_PROP_TOPIC_ALIAS);
+            wire_u16(&p, property.topic_alias);
+        }
+        wire_varint(&b, (uint32_t)p.len);
+        wire_bytes(&b, u8props, p.len);
+    }
+    wire_bytes(&b, data, (size_t)len);
+
+    uint8_t u8header = (WIRE_PUBLISH << 4) | ((qos & 0x03) << 1) | (retain ? 1 : 0);
+    if (send_locked(client, u8header, &b) != 0)
+    {
+        msg_id = -1;
+    }
+    else
+    {
+        client->stats.u32publishes++;
+    }
+    pthread_mutex_unlock(&client->lock);
+    return msg_id;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    uint8_t u8body[256];
+    wire_buf_t b = {.pu8 = u8body, .size = sizeof(u8body)};
+
+    pthread_mutex_lock(&client->lock);
+    if (!client->bConnected)
+    {
+        pthread_mutex_unlock(&client->lock);
+        return -1;
+    }
+    int msg_id = next_id_locked(client);
+    wire_u16(&b, (uint16_t)msg_id);
+    if (client->u8level == WIRE_LEVEL_5)
+    {
+        wire_varint(&b, 0);
+    }
+    wire_str(&b, topic);
+    wire_u8(&b, (uint8_t)qos);
+    if (send_locked(client, (WIRE_SUBSCRIBE << 4) | 0x02, &b) != 0)
+    {
+        msg_id = -1;
+    }
+    pthread_mutex_unlock(&client->lock);
+    return msg_id;
+}
+
+esp_err_t esp_mqtt5_client_set_publish_property(esp_mqtt_client_handle_t client,
+                                                const esp_mqtt5_publish_property_config_t *property)
+{
+    pthread_mutex_lock(&client->lock);
+    client->pub_property = *property;
+    client->bPub_property = true;
+    pthread_mutex_unlock(&client->lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt5_client_set_connect_property(esp_mqtt_client_handle_t client,
+                                                const esp_mqtt5_connection_property_config_t *connect_property)
+{
+    client->u32session_expiry = connect_property->session_expiry_interval;
+    return ESP_OK;
+}
+
+void host_mqtt_restart(void)
+{
+    if (last_client != NULL)
+    {
+        esp_mqtt_client_reconnect(last_client);
+    }
+}
+
+void host_mqtt_get_stats(host_mqtt_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (last_client != NULL)
+    {
+        pthread_mutex_lock(&last_client->lock);
+        *stats = last_client->stats;
+        pthread_mutex_unlock(&last_client->lock);
+    }
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
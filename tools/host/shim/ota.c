@@ -0,0 +1,208 @@
+/*****************************************************************************
+ *
+ * @file 	ota.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	esp_ota_ops stand-in for the host build: one handle at a time
+ *          on the RAM app partitions, images checked as esp_ota_ops.h describes
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "mbedtls/sha256.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define OTA_HANDLE      1
+#define OTA_SECTOR      4096
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static const esp_partition_t *open_partition = NULL;
+static bool bSequential = false;
+static uint32_t u32written = 0;
+static uint32_t u32erased = 0;              /* Bytes erased from the start of the partition */
+static const esp_partition_t *boot = NULL;  /* NULL: the running one */
+static const esp_partition_t *running = NULL; /* NULL: ota_0, where a serial flash puts the app */
+
+uint8_t host_ota_slots = 2;
+
+static const char *TAG = "HOST_OTA";
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/* esp_image_verify() of a test image */
+static esp_err_t verify(const esp_partition_t *partition)
+{
+    uint8_t u8head[5];
+    if (esp_partition_read(partition, 0, u8head, sizeof(u8head)) != ESP_OK)
+    {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    uint32_t u32len = u8head[1] | (u8head[2] << 8) | (u8head[3] << 16) | ((uint32_t)u8head[4] << 24);
+    if ((u8head[0] != HOST_IMAGE_MAGIC) || (u32len < HOST_IMAGE_MIN) || (u32len > partition->size))
+    {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    uint8_t *pu8Image = malloc(u32len);
+    uint8_t u8sha256[32];
+    esp_err_t err = (pu8Image != NULL) ? esp_partition_read(partition, 0, pu8Image, u32len) : ESP_ERR_NO_MEM;
+    if (err == ESP_OK)
+    {
+        mbedtls_sha256(pu8Image, u32len - 32, u8sha256, 0);
+        err = (memcmp(u8sha256, &pu8Image[u32len - 32], 32) == 0) ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    free(pu8Image);
+    return err;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return (running != NULL) ? running :
+           esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+}
+
+/* The OTA slot after the one given, round to the first: with a single slot that is the running one */
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from_partition)
+{
+    const esp_partition_t *from = (start_from_partition != NULL) ? start_from_partition : esp_ota_get_running_partition();
+    int slot = from->subtype - ESP_PARTITION_SUBTYPE_APP_OTA_0;
+    slot = ((slot >= 0) && (slot + 1 < host_ota_slots)) ? slot + 1 : 0;
+    const esp_partition_t *next = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0 + slot, NULL);
+    return (next != NULL) ? next : esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    if ((partition == NULL) || (partition == esp_ota_get_running_partition()))
+    {
+        return (partition == NULL) ? ESP_ERR_INVALID_ARG : ESP_ERR_OTA_PARTITION_CONFLICT;
+    }
+    if (open_partition != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    bSequential = (image_size == OTA_WITH_SEQUENTIAL_WRITES);
+    u32erased = 0;
+    if (!bSequential)
+    {
+        uint32_t u32size = (image_size == OTA_SIZE_UNKNOWN) ? partition->size :
+                           (uint32_t)(image_size + OTA_SECTOR - 1) & ~(OTA_SECTOR - 1);
+        esp_err_t err = esp_partition_erase_range(partition, 0, u32size);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        u32erased = u32size;
+    }
+    open_partition = partition;
+    u32written = 0;
+    *out_handle = OTA_HANDLE;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    if ((handle != OTA_HANDLE) || (open_partition == NULL))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((u32written == 0) && (size > 0) && (((const uint8_t *)data)[0] != HOST_IMAGE_MAGIC))
+    {
+        ESP_LOGE(TAG, "OTA image has invalid magic byte");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    if (size > open_partition->size - u32written)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    while (bSequential && (u32erased < u32written + size))
+    {
+        esp_err_t err = esp_partition_erase_range(open_partition, u32erased, OTA_SECTOR);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        u32erased += OTA_SECTOR;
+    }
+    esp_err_t err = esp_partition_write(open_partition, u32written, data, size);
+    if (err == ESP_OK)
+    {
+        u32written += size;
+    }
+    return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    if ((handle != OTA_HANDLE) || (open_partition == NULL))
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    const esp_partition_t *partition = open_partition;
+    open_partition = NULL;
+    return (u32written == 0) ? ESP_ERR_INVALID_SIZE : verify(partition);
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    if ((handle != OTA_HANDLE) || (open_partition == NULL))
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    open_partition = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    if ((partition == NULL) || (partition->type != ESP_PARTITION_TYPE_APP))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = verify(partition);
+    if (err == ESP_OK)
+    {
+        boot = partition;
+    }
+    return err;
+}
+
+const esp_partition_t *esp_ota_get_boot_partition(void)
+{
+    return (boot != NULL) ? boot : esp_ota_get_running_partition();
+}
+
+void host_ota_reset(void)
+{
+    open_partition = NULL;
+    boot = NULL;
+}
+
+void host_ota_boot(void)
+{
+    running = esp_ota_get_boot_partition();
+    boot = NULL;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
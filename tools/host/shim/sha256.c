@@ -0,0 +1,162 @@
+/*****************************************************************************
+ *
+ * @file 	sha256.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	mbedtls_sha256 stand-in for the host build (FIPS 180-4)
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "mbedtls/sha256.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define ROR(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void transform(mbedtls_sha256_context *ctx, const uint8_t *pu8Block)
+{
+    uint32_t w[64];
+    uint32_t s[8];
+
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = ((uint32_t)pu8Block[4 * i] << 24) | ((uint32_t)pu8Block[4 * i + 1] << 16) |
+               ((uint32_t)pu8Block[4 * i + 2] << 8) | pu8Block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(s, ctx->state, sizeof(s));
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t t1 = s[7] + (ROR(s[4], 6) ^ ROR(s[4], 11) ^ ROR(s[4], 25)) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + K[i] + w[i];
+        uint32_t t2 = (ROR(s[0], 2) ^ ROR(s[0], 13) ^ ROR(s[0], 22)) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(&s[1], &s[0], 7 * sizeof(s[0]));
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        ctx->state[i] += s[i];
+    }
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224)
+{
+    static const uint32_t H[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    if (is224)
+    {
+        return -1;
+    }
+    memcpy(ctx->state, H, sizeof(H));
+    ctx->total = 0;
+    return 0;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    size_t used = ctx->total % 64;
+
+    ctx->total += ilen;
+    if (used > 0)
+    {
+        size_t take = (ilen < 64 - used) ? ilen : 64 - used;
+        memcpy(&ctx->buffer[used], input, take);
+        input += take;
+        ilen -= take;
+        if (used + take < 64)
+        {
+            return 0;
+        }
+        transform(ctx, ctx->buffer);
+    }
+    for (; ilen >= 64; input += 64, ilen -= 64)
+    {
+        transform(ctx, input);
+    }
+    memcpy(ctx->buffer, input, ilen);
+    return 0;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32])
+{
+    uint8_t u8pad[72] = {0x80};
+    uint64_t bits = ctx->total * 8;
+    size_t pad = (ctx->total % 64 < 56) ? 56 - ctx->total % 64 : 120 - ctx->total % 64;
+
+    for (int i = 0; i < 8; i++)
+    {
+        u8pad[pad + i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    mbedtls_sha256_update(ctx, u8pad, pad + 8);
+    for (int i = 0; i < 8; i++)
+    {
+        output[4 * i] = (uint8_t)(ctx->state[i] >> 24);
+        output[4 * i + 1] = (uint8_t)(ctx->state[i] >> 16);
+        output[4 * i + 2] = (uint8_t)(ctx->state[i] >> 8);
+        output[4 * i + 3] = (uint8_t)ctx->state[i];
+    }
+    return 0;
+}
+
+int mbedtls_sha256(const unsigned char *input, size_t ilen, unsigned char output[32], int is224)
+{
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    int ret = mbedtls_sha256_starts(&ctx, is224);
+    if (ret == 0)
+    {
+        mbedtls_sha256_update(&ctx, input, ilen);
+        mbedtls_sha256_finish(&ctx, output);
+    }
+    mbedtls_sha256_free(&ctx);
+    return ret;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,192 @@
+/*****************************************************************************
+ *
+ * @file 	stubs.c
+ * @author 	agent
+ * @date 	19 October 2026
+ * @brief	stand-ins for the components the host build leaves out:
+ *          Wi-Fi diagnostics, sensor settings, sleep interval, config NVS blob,
+ *          OTA and TLS
+ *
+ ***************************************************************************/
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "esp_log.h"
+
+#include "bee_wifi.h"
+#include "bee_sht3x.h"
+#include "bee_deep_sleep.h"
+#include "bee_nvs.h"
+#include "bee_ota.h"
+#include "bee_tls.h"
+#include "host_shim.h"
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+bool bButton_task = false;
+
+static uint16_t u16interval_s = 0;
+static uint8_t u8publish_every = DEEP_SLEEP_PUBLISH_EVERY;
+static uint8_t u8config[128];               /* NVS blob */
+static size_t config_len = 0;
+static uint32_t u32config_saves = 0;
+static char cOta_url[OTA_URL_MAX];         /* Scheduled, nothing downloads it */
+static bool bOta_scheduled = false;
+static uint8_t u8running_sha256[32];        /* Of the image the host runs */
+
+static const char *TAG = "HOST";
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+void wifi_get_diag(wifi_diag_t *diag)
+{
+    memset(diag, 0, sizeof(*diag));
+}
+
+void wifi_get_link(wifi_link_t *link)
+{
+    memset(link, 0, sizeof(*link));
+    link->i8tx_power = WIFI_TX_POWER_MAX;
+    link->i8rssi_avg = -60;
+}
+
+void wifi_diag_reported(void)
+{
+}
+
+void wifi_link_report_publish(bool bOk)
+{
+}
+
+void wifi_link_reported(void)
+{
+}
+
+esp_err_t sht3x_set_calibration(float fTemp_offset, float fHumi_offset)
+{
+    return ESP_OK;
+}
+
+esp_err_t sht3x_enable_heater()
+{
+    return ESP_OK;
+}
+
+esp_err_t sht3x_disable_heater()
+{
+    return ESP_OK;
+}
+
+esp_err_t deep_sleep_set_interval(uint16_t u16seconds)
+{
+    if ((u16seconds < DEEP_SLEEP_INTERVAL_MIN) || (u16seconds > DEEP_SLEEP_INTERVAL_MAX))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    u16interval_s = u16seconds;
+    return ESP_OK;
+}
+
+uint16_t deep_sleep_get_interval(void)
+{
+    return (u16interval_s != 0) ? u16interval_s : 30;
+}
+
+uint16_t host_get_interval(void)
+{
+    return u16interval_s;
+}
+
+esp_err_t deep_sleep_set_publish_every(uint8_t u8wakes)
+{
+    if (u8wakes > DEEP_SLEEP_PUBLISH_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    u8publish_every = u8wakes;
+    return ESP_OK;
+}
+
+uint8_t deep_sleep_get_publish_every(void)
+{
+    return u8publish_every;
+}
+
+bool load_config_from_nvs(void *pData, size_t len)
+{
+    if ((config_len == 0) || (config_len != len))
+    {
+        return false;
+    }
+    memcpy(pData, u8config, len);
+    return true;
+}
+
+void save_config_to_nvs(const void *pData, size_t len)
+{
+    if (len <= sizeof(u8config))
+    {
+        memcpy(u8config, pData, len);
+        config_len = len;
+    }
+    u32config_saves++;
+}
+
+uint32_t host_get_config_saves(void)
+{
+    return u32config_saves;
+}
+
+void start_ota(char *cUrl)
+{
+    ESP_LOGW(TAG, "start_ota(%s) is not available on the host", cUrl);
+}
+
+esp_err_t ota_schedule(const char *cUrl, const uint8_t *pu8Sha256, uint32_t u32size)
+{
+    snprintf(cOta_url, sizeof(cOta_url), "%s", cUrl);
+    bOta_scheduled = true;
+    return ESP_OK;
+}
+
+bool ota_pending(void)
+{
+    return cOta_url[0] != '\0';
+}
+
+bool ota_image_running(const uint8_t *pu8Sha256, uint32_t u32size)
+{
+    return memcmp(pu8Sha256, u8running_sha256, sizeof(u8running_sha256)) == 0;
+}
+
+void host_set_running_image(const uint8_t *pu8Sha256)
+{
+    memcpy(u8running_sha256, pu8Sha256, sizeof(u8running_sha256));
+}
+
+const char *host_take_ota_schedule(void)
+{
+    bool bScheduled = bOta_scheduled;
+    bOta_scheduled = false;
+    return bScheduled ? cOta_url : NULL;
+}
+
+void host_ota_drop(void)
+{
+    cOta_url[0] = '\0';
+}
+
+esp_transport_handle_t tls_transport_init(void)
+{
+    return NULL;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,231 @@
+#!/usr/bin/env python3
+"""Packer for the compressed OTA images of the SHT3x node.
+
+Wraps an app image into the OTA_PACK_MAGIC container bee_ota inflates while it
+downloads (see bee_ota.h): a header with the image size and SHA-256, then
+independent zlib chunks. Serve the result instead of the .bin, the device tells
+the two apart by their first bytes.
+
+A delta container holds the records that make the new image out of the one the
+device runs, for a release that changed a few KB the download is about a
+hundredth of the image. It is refused by any device running something else.
+
+    ota_pack.py compress build/SHT3x.bin SHT3x.bota
+    ota_pack.py delta SHT3x-1.0.bin build/SHT3x.bin SHT3x-1.0.delta
+    ota_pack.py info SHT3x.bota
+    ota_pack.py info --base SHT3x-1.0.bin SHT3x-1.0.delta
+
+Only the Python standard library is used.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC = b"BOTA"
+VERSION = 1
+KIND_FULL = 0
+KIND_DELTA = 1
+HEADER = struct.Struct("<4sBBHII32s")
+DELTA_HEADER = struct.Struct("<I32s")  # ota_delta_header_t
+OP = struct.Struct("<III")  # ota_patch_op_t
+MATCH = 16  # DELTA_MATCH of ota_bench.c, shortest exact match a copy starts from
+SLACK = 32  # Mismatches over matches a copy extends through
+CHUNK = 0x8000
+CHUNK_MAX = 0x10000  # OTA_PACK_CHUNK_MAX
+SECTOR = 0x1000  # OTA_SECTOR_SIZE, a resumed download starts a chunk on a blank sector
+APP_MAGIC = 0xE9
+
+
+def compress(image, chunk=CHUNK, level=9):
+    """Return the container of an image."""
+    out = [HEADER.pack(MAGIC, VERSION, KIND_FULL, 0, len(image), chunk, hashlib.sha256(image).digest())]
+    for off in range(0, len(image), chunk):
+        data = zlib.compress(image[off:off + chunk], level)
+        out.append(struct.pack("<I", len(data)))
+        out.append(data)
+    return b"".join(out)
+
+
+def _literal(out, data):
+    if data:
+        out.append(OP.pack(0, 0, len(data)))
+        out.append(data)
+
+
+def _extend(base, image, src, pos, end):
+    """Length of the copy from base[src] at image[pos]: the longest prefix with most matches over mismatches."""
+    score = best = best_len = n = 0
+    limit = min(end - pos, len(base) - src)
+    while n < limit and score > best - SLACK:
+        score += 1 if base[src + n] == image[pos + n] else -1
+        n += 1
+        if score > best:
+            best, best_len = score, n
+    return best_len
+
+
+def delta(base, image, chunk=CHUNK, level=9):
+    """Return the delta container that makes image out of base, see ota_patch_op_t in bee_ota.h."""
+    index = {}
+    for j in range(len(base) - MATCH + 1):
+        index.setdefault(base[j:j + MATCH], j)
+    out = [HEADER.pack(MAGIC, VERSION, KIND_DELTA, 0, len(image), chunk, hashlib.sha256(image).digest()),
+           DELTA_HEADER.pack(len(base), hashlib.sha256(base).digest())]
+    shift = 0  # Base offset minus image offset of the last copy
+    for start in range(0, len(image), chunk):
+        end = min(start + chunk, len(image))
+        records = []
+        pos = literal = start
+        while pos < end:
+            src = -1
+            if pos + MATCH <= end:
+                key = image[pos:pos + MATCH]
+                same = pos + shift
+                if key in index:
+                    src = index[key]
+                elif 0 <= same <= len(base) - MATCH and base[same:same + MATCH] == key:
+                    src = same
+            if src < 0:
+                pos += 1
+                continue
+            length = _extend(base, image, src, pos, end)
+            _literal(records, image[literal:pos])
+            records.append(OP.pack(length, src, 0))
+            records.append(bytes((image[pos + n] - base[src + n]) & 0xFF for n in range(length)))
+            shift = src - pos
+            pos = literal = pos + length
+        _literal(records, image[literal:end])
+        data = zlib.compress(b"".join(records), level)
+        out.append(struct.pack("<I", len(data)))
+        out.append(data)
+    return b"".join(out)
+
+
+def _apply(records, base, image):
+    """Append what the records of one chunk make to image."""
+    pos = 0
+    while pos < len(records):
+        copy, src, literal = OP.unpack_from(records, pos)
+        pos += OP.size
+        if src + copy > len(base) or pos + copy + literal > len(records):
+            raise ValueError("record at %d out of bounds" % len(image))
+        image += bytes((base[src + n] + records[pos + n]) & 0xFF for n in range(copy))
+        pos += copy
+        image += records[pos:pos + literal]
+        pos += literal
+
+
+def unpack(container, base=None):
+    """Return (header fields, image) of a container, checking it the way the device does.
+
+    A delta needs its base for the image, without one the image returned is None."""
+    magic, version, kind, _, size, chunk, digest = HEADER.unpack_from(container)
+    if magic != MAGIC or version != VERSION or kind not in (KIND_FULL, KIND_DELTA) or chunk == 0 or chunk % SECTOR:
+        raise ValueError("not a version %d container" % VERSION)
+    fields = {"kind": "delta" if kind == KIND_DELTA else "full", "image_size": size, "chunk_size": chunk,
+              "sha256": digest.hex()}
+    pos = HEADER.size
+    if kind == KIND_DELTA:
+        base_size, base_digest = DELTA_HEADER.unpack_from(container, pos)
+        pos += DELTA_HEADER.size
+        fields.update(base_size=base_size, base_sha256=base_digest.hex())
+        if base is not None and (len(base) != base_size or hashlib.sha256(base).digest() != base_digest):
+            raise ValueError("made for another base")
+    image = bytearray()
+    chunks = 0
+    while pos < len(container):
+        (length,) = struct.unpack_from("<I", container, pos)
+        pos += 4
+        raw = zlib.decompress(container[pos:pos + length])
+        pos += length
+        chunks += 1
+        done = len(image)
+        if kind == KIND_FULL:
+            image += raw
+        elif base is not None:
+            _apply(raw, base, image)
+        else:
+            continue
+        if len(image) - done != min(chunk, size - done):
+            raise ValueError("chunk at %d makes %d bytes" % (done, len(image) - done))
+    if chunks != (size + chunk - 1) // chunk:
+        raise ValueError("%d chunks for %d bytes" % (chunks, size))
+    if kind == KIND_DELTA and base is None:
+        return fields, None
+    if hashlib.sha256(image).digest() != digest:
+        raise ValueError("SHA-256 mismatch")
+    return fields, bytes(image)
+
+
+def read_app(path):
+    with open(path, "rb") as f:
+        image = f.read()
+    if not image or image[0] != APP_MAGIC:
+        raise ValueError("%s: not an app image" % path)
+    return image
+
+
+def check_chunk(chunk):
+    if not 0 < chunk <= CHUNK_MAX or chunk % SECTOR:
+        raise ValueError("chunk must be a multiple of 0x%x up to 0x%x" % (SECTOR, CHUNK_MAX))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+    p = sub.add_parser("compress", help="pack an app image")
+    p.add_argument("image")
+    p.add_argument("output")
+    p.add_argument("--chunk", type=lambda s: int(s, 0), default=CHUNK,
+                   help="image bytes per zlib stream, a multiple of 0x%x up to 0x%x (default 0x%x)"
+                        % (SECTOR, CHUNK_MAX, CHUNK))
+    p = sub.add_parser("delta", help="make a delta from the image the devices run")
+    p.add_argument("base")
+    p.add_argument("image")
+    p.add_argument("output")
+    p.add_argument("--chunk", type=lambda s: int(s, 0), default=CHUNK,
+                   help="image bytes per zlib stream (default 0x%x)" % CHUNK)
+    p = sub.add_parser("info", help="check a container and print its header")
+    p.add_argument("container")
+    p.add_argument("--base", help="image a delta applies to, to check what it makes")
+    args = parser.parse_args()
+
+    if args.command in ("compress", "delta"):
+        try:
+            image = read_app(args.image)
+            check_chunk(args.chunk)
+            if args.command == "delta":
+                base = read_app(args.base)
+                container = delta(base, image, args.chunk)
+                if unpack(container, base)[1] != image:
+                    raise ValueError("delta does not make the image")
+            else:
+                container = compress(image, args.chunk)
+        except ValueError as e:
+            print(e, file=sys.stderr)
+            return 1
+        with open(args.output, "wb") as f:
+            f.write(container)
+        print("%s: %d -> %d bytes (%.1f%%)" % (args.output, len(image), len(container),
+                                               100.0 * len(container) / len(image)))
+        return 0
+
+    with open(args.container, "rb") as f:
+        container = f.read()
+    try:
+        base = read_app(args.base) if args.base else None
+        fields, _ = unpack(container, base)
+    except (ValueError, struct.error, zlib.error) as e:
+        print("%s: %s" % (args.container, e), file=sys.stderr)
+        return 1
+    fields["container_size"] = len(container)
+    for key, value in fields.items():
+        print("%s: %s" % (key, value))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())